@@ -9,9 +9,16 @@
 #ifndef VIRTUAL_JUICE_ARCHIVE_INCLUDE_H_
 #define VIRTUAL_JUICE_ARCHIVE_INCLUDE_H_
 
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <vector>
+
+#include "apis/compiler.h"
+
+#if defined(OS_WIN)
 #include <Windows.h>
+#endif // OS_WIN
 
 #include "apis/juice.h"
 #include "apis/basictypes.h"
@@ -23,9 +30,49 @@ namespace juice {
 
 typedef enum class __Level {
     FAST    = 0,
-    NORMAL  = 1
+    NORMAL  = 1,
+    STORE   = 2,
+    MAXIMUM = 3,
+    ULTRA   = 4,
 } Level;
 
+typedef enum class __Method {
+    DEFAULT     = 0,
+    COPY        = 1,
+    LZMA        = 2,
+    LZMA2       = 3,
+    PPMD        = 4,
+    BZIP2       = 5,
+    DEFLATE     = 6,
+    DEFLATE64   = 7,
+} Method;
+
+// What Compress() asks of the handler, through ISetProperties. The zero
+// values leave the handler defaults alone.
+struct CompressOptions {
+    Level level = Level::NORMAL;
+    // DEFAULT is LZMA2 for 7z and Deflate for zip. Only 7z and zip take one.
+    Method method = Method::DEFAULT;
+    // The dictionary of LZMA and LZMA2, the model size of PPMd, the block
+    // size of BZip2. Deflate and Copy have none.
+    uint32 dictionary_size = 0;
+    // 7z only. The bytes of one solid block, 1 writes every file on its own.
+    uint64 solid_block_size = 0;
+    uint threads = 0;
+    // 7-Zip has no property for it: the dictionary, then the threads, of an
+    // LZMA or LZMA2 coder (7z and xz) are lowered until its estimate fits.
+    uint64 memory_limit = 0;
+    // 7z only. Puts the Dedup coder before the method: chunks seen earlier
+    // within this many bytes of the solid block are stored as copies. The
+    // decoder keeps a window of this size, up to 2 GB. 0 leaves it out.
+    uint32 dedup_window = 0;
+    // LZMA and LZMA2 of 7z, and xz. The encoder also takes matches up to
+    // this many bytes back, found in a sparse table instead of the match
+    // finder of the dictionary. It keeps the bytes, the decoder needs them as
+    // its dictionary. Up to 1.5 GB, 0 leaves it out.
+    uint32 long_distance_window = 0;
+};
+
 typedef enum class __Format : std::size_t {
     SEVENZ  = 0,
     ZIP     = 1,
@@ -37,9 +84,80 @@ typedef enum class __Format : std::size_t {
     CAB     = 7,
     LZMA    = 8,
     LZMA86  = 9,
+    XZ      = 10,
     LAST,
 } Format;
 
+// An item of the streamed Compress(), which comes from memory or from a
+// producer instead of a file.
+struct CompressItem {
+    // Fills |buffer| with up to |size| bytes and returns how many it did, zero
+    // at the end and a negative number on an error.
+    using Reader = std::function<int64(void* buffer, size_t size)>;
+
+    std::wstring name;
+    bool directory = false;
+    FILETIME last_modified = {};
+    // The bytes of the item, which stay the caller's until Compress() returns.
+    const void* data = nullptr;
+    // The size of |data|, or of what |reader| produces. Tar writes it before
+    // the data and needs it exact, 7z stores no data for a zero size. It is a
+    // hint otherwise.
+    uint64 size = 0;
+    // Used when |data| is null. Zip seeks back in its input to store what
+    // does not compress, it only takes |data|.
+    Reader reader;
+};
+
+// Takes the archive of the streamed Compress() in order: a socket, a pipe.
+// Returns false to stop the compression.
+using CompressSink = std::function<bool(const void* data, size_t size)>;
+
+// Takes the items extracted by ArchiveReader, in pieces and in the order of
+// the archive. Returns false to stop the extraction.
+using ExtractSink = std::function<bool(uint32 index, const void* data, size_t size)>;
+
+// The items of an archive by column, filled by Archive::List(). Only the
+// columns asked for are filled, the others are left empty.
+struct ArchiveListing {
+    enum Column : uint32 {
+        PATH          = 1 << 0,
+        SIZE          = 1 << 1,
+        PACKED_SIZE   = 1 << 2,
+        LAST_MODIFIED = 1 << 3,
+        ATTRIBUTES    = 1 << 4,
+        CRC           = 1 << 5,
+        DIRECTORY     = 1 << 6,
+        ALL           = (1 << 7) - 1,
+    };
+
+    uint32 count = 0;
+    uint32 columns = 0;
+    // The paths back to back, the one of item i is [path_offsets[i],
+    // path_offsets[i + 1]).
+    std::wstring paths;
+    std::vector<size_t> path_offsets;
+    std::vector<uint64> sizes;
+    std::vector<uint64> packed_sizes;
+    std::vector<FILETIME> last_modified;
+    std::vector<uint32> attributes;
+    // Zero where |has_crc| is not set.
+    std::vector<uint32> crcs;
+    // Bitmaps, item i is bit i % 64 of word i / 64.
+    std::vector<uint64> has_crc;
+    std::vector<uint64> directories;
+
+    std::wstring GetPath(uint32 index) const {
+        return paths.substr(path_offsets[index], path_offsets[index + 1] - path_offsets[index]);
+    }
+    bool HasCrc(uint32 index) const { return TestBit(has_crc, index); }
+    bool IsDirectory(uint32 index) const { return TestBit(directories, index); }
+
+    static bool TestBit(const std::vector<uint64>& bits, uint32 index) {
+        return (bits[index / 64] >> (index % 64)) & 1;
+    }
+};
+
 class Progress {
 public:
   virtual ~Progress() {}
@@ -61,16 +179,130 @@ public:
         return SUCCEEDED(result);
     }
 
+    // Reads the archives through a memory mapping of the file instead of a
+    // file stream. Off by default.
+    void SetMappedInput(bool mapped) { mapped_input_ = mapped; }
+    bool mapped_input() const { return mapped_input_; }
+
+    // Writes the extracted files on a background I/O pool, the decoder only
+    // waits once |memory_budget| bytes are queued. Zero writes them in line,
+    // which is the default.
+    void SetWriteBehind(size_t memory_budget) { write_behind_ = memory_budget; }
+    size_t write_behind() const { return write_behind_; }
+
+    // Keeps the item table of the archives in a sidecar file next to them
+    // (".jidx"), Open() and ArchiveReader use it while the archive is
+    // unchanged instead of parsing its headers. Off by default.
+    void SetIndexCache(bool enabled) { index_cache_ = enabled; }
+    bool index_cache() const { return index_cache_; }
+
+    // Keeps the access points of the gzip archives, one every |spacing| bytes
+    // of output with the 32 KiB window before it, in a sidecar file next to
+    // them (".jgzi"). The first Extract() on threads or ArchiveReader::Read()
+    // records it. After that the threads decode the spans between the points
+    // and Read() starts at the point before the offset. Zero, the default,
+    // keeps none.
+    void SetGzipIndex(uint64 spacing) { gzip_index_ = spacing; }
+    uint64 gzip_index() const { return gzip_index_; }
+
+    // Used by the following Compress() calls.
+    void SetCompressOptions(const CompressOptions& options) { compress_options_ = options; }
+    const CompressOptions& compress_options() const { return compress_options_; }
+
+    // Calls |callback| with the path and the size of every item. The handler
+    // reports the path of the archive itself first, with a size of -1.
     using OpenCallback = std::function<void(const std::wstring& path, const ULONGLONG& bytes)>;
     bool Open(const std::wstring& path, const juice::Format& format, const OpenCallback& callback);
 
+    // Lists the |columns| (ArchiveListing::Column) of every item at once.
+    // Nothing is called back, and the paths share one string.
+    bool List(const std::wstring& path, const juice::Format& format, uint32 columns, ArchiveListing* listing);
+
     bool Extract(const std::wstring& path, const juice::Format& format, const std::wstring& root, Progress* callback);
 
+    // Extracts the independent units of the archive (zip entries, 7z folders)
+    // on |threads| workers, each one over its own IInArchive and file stream.
+    // Zero picks the number of hardware threads. |callback| is serialized.
+    // A gzip archive is decoded by its handler on the threads: the members of
+    // a multi-member or BGZF file, or the spans of the SetGzipIndex() index.
+    bool Extract(const std::wstring& path, const juice::Format& format, const std::wstring& root, Progress* callback, uint threads);
+
     bool Compress(const std::wstring& path, const juice::Format& format, const std::vector<x::PlatformFileInfo>& file_list, Progress* callback);
 
+    // Compresses everything below the directory |root|, which is scanned on
+    // |threads| threads (zero for the number of hardware threads). The items
+    // are named relative to |root|.
+    bool Compress(const std::wstring& path, const juice::Format& format, const std::wstring& root, Progress* callback, uint threads);
+
+    // Compresses |items| into |sink| without a file on either side. Gzip,
+    // bzip2, xz and tar are written straight through. 7z and zip go back to
+    // patch their headers, they are built in memory and handed to |sink| at
+    // the end.
+    bool Compress(const std::vector<CompressItem>& items, const juice::Format& format, const CompressSink& sink, Progress* callback);
+
+    // Compresses |items| into |buffer|, which is replaced.
+    bool Compress(const std::vector<CompressItem>& items, const juice::Format& format, std::vector<uint8_t>* buffer, Progress* callback);
+
 protected:
     x::Function<uint, const GUID*, const GUID*, void**> CreateObject;
+    bool mapped_input_ = false;
+    size_t write_behind_ = 0;
+    bool index_cache_ = false;
+    uint64 gzip_index_ = 0;
+    CompressOptions compress_options_;
+
+};
+
+// Keeps an archive open for random access. The paths of the items are
+// indexed once, when it is opened, a lookup after that is one hash probe and
+// the extraction only decodes the items asked for (and, in a solid 7z, what
+// precedes them in their block). With the index cache of the Archive the
+// handler is only opened for the first extraction.
+//
+// Example:
+//   juice::ArchiveReader reader(&archive);
+//   std::vector<uint8_t> data;
+//   uint32 index;
+//   if (reader.Open(path, juice::Format::ZIP) && reader.Find(L"docs/a.txt", &index)) {
+//     reader.Extract(index, &data);
+//   }
+class JUICE_API ArchiveReader {
+public:
+    // |archive| provides the handlers and outlives the reader.
+    explicit ArchiveReader(Archive* archive);
+    ~ArchiveReader();
+
+    bool Open(const std::wstring& path, const juice::Format& format);
+    void Close();
+    bool is_open() const;
+
+    uint32 GetNumberOfItems() const;
+    // Either separator matches, names are compared as stored otherwise.
+    bool Find(const std::wstring& name, uint32* index) const;
+    std::wstring GetName(uint32 index) const;
+    uint64 GetSize(uint32 index) const;
+    bool IsDirectory(uint32 index) const;
+
+    bool Extract(uint32 index, std::vector<uint8_t>* buffer);
+    // |buffers| gets one entry for each of |indices|, in the same order.
+    bool Extract(const std::vector<uint32>& indices, std::vector<std::vector<uint8_t>>* buffers);
+    bool Extract(const std::vector<uint32>& indices, const ExtractSink& sink);
+
+    // Reads up to |size| bytes of the item from |offset| and tells how many in
+    // |read|, fewer only at the end of the item. Gzip starts at the access
+    // point before |offset|, from the SetGzipIndex() sidecar or an index of
+    // 1 MiB spans recorded by the first call. The other formats decode the
+    // item up to the range.
+    bool Read(uint32 index, uint64 offset, void* data, size_t size, size_t* read);
+
+private:
+    struct State;
 
+    Archive* archive_ = nullptr;
+    std::unique_ptr<State> state_;
+    // The handlers are not reentrant.
+    mutable std::mutex lock_;
+    DISALLOW_COPY_AND_ASSIGN(ArchiveReader);
 };
 
 }
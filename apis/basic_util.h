@@ -9,18 +9,62 @@
 #ifndef JUICE_BASIC_UTIL_INCLUDE_H_
 #define JUICE_BASIC_UTIL_INCLUDE_H_
 
+#include <cstring>
 #include <memory>
 #include <stack>
+#include <string>
+
+#include "apis/compiler.h"
+
+#if defined(OS_WIN)
 #include <Windows.h>
 #include <Shlwapi.h>
+#else
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <windows.h>
+#endif // OS_WIN
 
 #include "apis/juice.h"
 #include "apis/basictypes.h"
 #include "apis/scoped_object.h"
 
+#if defined(OS_POSIX)
+typedef void* HMODULE;
+
+typedef struct tagSTATSTG {
+    ULARGE_INTEGER cbSize;
+    FILETIME mtime;
+    FILETIME ctime;
+    FILETIME atime;
+} STATSTG;
+
+#define STATFLAG_NONAME 1
+
+// The subset of the |IStream| used by juice, so the streams of 7-zip can be
+// built on top of a file on every platform.
+struct IStream : public IUnknown {
+    STDMETHOD(Read)(void* data, ULONG size, ULONG* processed) PURE;
+    STDMETHOD(Write)(const void* data, ULONG size, ULONG* processed) PURE;
+    STDMETHOD(Seek)(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* position) PURE;
+    STDMETHOD(SetSize)(ULARGE_INTEGER size) PURE;
+    STDMETHOD(Stat)(STATSTG* stat, DWORD flag) PURE;
+};
+#endif // OS_POSIX
+
 namespace x {
 
+#if defined(OS_WIN)
 const wchar_t kSeparators[] = L"\\/";
+#else
+const wchar_t kSeparators[] = L"/";
+#endif // OS_WIN
 const size_t kSeparatorsLength = arraysize(kSeparators);
 const wchar_t kCurrentDirectory[] = L".";
 const wchar_t kParentDirectory[] = L"..";
@@ -31,13 +75,18 @@ const wchar_t kSearchAll = L'*';
 struct JUICE_API PlatformFileInfo {
     PlatformFileInfo() {}
     virtual ~PlatformFileInfo() {}
+    // The virtual destructor would otherwise turn every move into a copy.
+    PlatformFileInfo(const PlatformFileInfo&) = default;
+    PlatformFileInfo(PlatformFileInfo&&) = default;
+    PlatformFileInfo& operator=(const PlatformFileInfo&) = default;
+    PlatformFileInfo& operator=(PlatformFileInfo&&) = default;
 
     ULONGLONG size = 0;
     DWORD attributes = 0;
     bool directory = false;
-    FILETIME creation_time;
-    FILETIME last_modified;
-    FILETIME last_accessed;
+    FILETIME creation_time = {};
+    FILETIME last_modified = {};
+    FILETIME last_accessed = {};
     std::wstring filename;
     std::wstring path;
 };
@@ -52,6 +101,7 @@ static bool IsSeparator(wchar_t character) {
 }
 
 static std::wstring::size_type FindDriveLetter(const std::wstring& path) {
+#if defined(OS_WIN)
     // This is dependent on an ASCII-based character set, but that's a
     // reasonable assumption.  iswalpha can be too inclusive here.
     if (path.length() >= 2 && path[1] == L':' &&
@@ -59,6 +109,7 @@ static std::wstring::size_type FindDriveLetter(const std::wstring& path) {
         (path[0] >= L'a' && path[0] <= L'z'))) {
         return 1;
     }
+#endif // OS_WIN
     return std::wstring::npos;
 }
 
@@ -76,7 +127,8 @@ static std::wstring StripTrailingSeparators(std::wstring path) {
     return path;
 }
 
-bool IsPathAbsolute(const std::wstring path) {
+inline bool IsPathAbsolute(const std::wstring path) {
+#if defined(OS_WIN)
     std::wstring::size_type letter = FindDriveLetter(path);
     if (letter != std::wstring::npos) {
         // Look for a separator right after the drive specification.
@@ -84,6 +136,10 @@ bool IsPathAbsolute(const std::wstring path) {
     }
     // Look for a pair of leading separators.
     return path.length() > 1 && IsSeparator(path[0]) && IsSeparator(path[1]);
+#else
+    // Look for a separator in the first position.
+    return path.length() > 0 && IsSeparator(path[0]);
+#endif // OS_WIN
 }
 
 static std::wstring GetParent(std::wstring path) {
@@ -130,7 +186,7 @@ static std::wstring GetFileName(std::wstring path) {
     return path;
 }
 
-static std::wstring Append(std::wstring path, const std::wstring& component) WARN_UNUSED_RESULT {
+WARN_UNUSED_RESULT static std::wstring Append(std::wstring path, const std::wstring& component) {
     const std::wstring* appended = &component;
     std::wstring without_nuls;
     auto nul_pos = component.find(kStringTerminator);
@@ -157,15 +213,16 @@ static std::wstring Append(std::wstring path, const std::wstring& component) WAR
     return path.append(*appended);
 }
 
+#if defined(OS_WIN)
 
-bool DirectoryExists(const std::wstring& path) {
+inline bool DirectoryExists(const std::wstring& path) {
     DWORD fileattr = GetFileAttributes(path.c_str());
     if (fileattr != INVALID_FILE_ATTRIBUTES)
         return (fileattr & FILE_ATTRIBUTE_DIRECTORY) != 0;
     return false;
 }
 
-bool CreatePathTree(const std::wstring& path) {
+inline bool CreatePathTree(const std::wstring& path) {
     auto result = CreateDirectoryEx(nullptr, path.c_str(), nullptr);
     if (result == ERROR_SUCCESS) return true;
     DWORD fileattr = ::GetFileAttributes(path.c_str());
@@ -190,7 +247,16 @@ bool CreatePathTree(const std::wstring& path) {
     return true;
 }
 
-bool GetFileInfo(const std::wstring& path, PlatformFileInfo* results) {
+// Replaces |to| with |from| in one step, both are on the same volume.
+inline bool Rename(const std::wstring& from, const std::wstring& to) {
+    return ::MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+inline bool Remove(const std::wstring& path) {
+    return ::DeleteFileW(path.c_str()) != 0;
+}
+
+inline bool GetFileInfo(const std::wstring& path, PlatformFileInfo* results) {
     WIN32_FILE_ATTRIBUTE_DATA attr;
     if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &attr)) {
         return false;
@@ -209,13 +275,13 @@ bool GetFileInfo(const std::wstring& path, PlatformFileInfo* results) {
     return true;
 }
 
-int64 GetFileSize(const std::wstring& path) {
+inline int64 GetFileSize(const std::wstring& path) {
     PlatformFileInfo info;
     if (!GetFileInfo(path, &info)) return -1;
     return info.size;
 }
 
-int64_t GetFileSize(const WIN32_FILE_ATTRIBUTE_DATA &find_data) {
+inline int64_t GetFileSize(const WIN32_FILE_ATTRIBUTE_DATA &find_data) {
     ULARGE_INTEGER size;
     size.HighPart = find_data.nFileSizeHigh;
     size.LowPart = find_data.nFileSizeLow;
@@ -225,7 +291,7 @@ int64_t GetFileSize(const WIN32_FILE_ATTRIBUTE_DATA &find_data) {
     return static_cast<int64_t>(size.QuadPart);
 }
 
-int64_t GetFileSize(const WIN32_FIND_DATA& find_data) {
+inline int64_t GetFileSize(const WIN32_FIND_DATA& find_data) {
   ULARGE_INTEGER size;
   size.HighPart = find_data.nFileSizeHigh;
   size.LowPart = find_data.nFileSizeLow;
@@ -254,7 +320,7 @@ struct ScopedSearchHANDLECloseTraits {
 using ScopedHANDLE = ScopedGeneric<HANDLE, internal::ScopedHANDLECloseTraits>;
 using ScopedSearchHANDLE = ScopedGeneric<HANDLE, internal::ScopedSearchHANDLECloseTraits>;
 
-bool IsSymbolicLink(const std::wstring& path) {
+inline bool IsSymbolicLink(const std::wstring& path) {
     WIN32_FIND_DATA find_data;
     ScopedSearchHANDLE handle(::FindFirstFileEx(path.c_str(), FindExInfoBasic, &find_data, FindExSearchNameMatch, nullptr, 0));
     if (!handle.is_valid()) return false;
@@ -262,7 +328,7 @@ bool IsSymbolicLink(const std::wstring& path) {
         find_data.dwReserved0 == IO_REPARSE_TAG_SYMLINK;
 }
 
-bool IsRegularFile(const std::wstring& path) {
+inline bool IsRegularFile(const std::wstring& path) {
     auto fileattr = ::GetFileAttributes(path.c_str());
     if (fileattr == INVALID_FILE_ATTRIBUTES) return false;
     if ((fileattr & FILE_ATTRIBUTE_DIRECTORY) != 0 ||
@@ -272,22 +338,218 @@ bool IsRegularFile(const std::wstring& path) {
     return true;
 }
 
-bool IsDirectory(const DWORD& attributes, bool allow_symlinks) {
+inline bool IsDirectory(const DWORD& attributes, bool allow_symlinks) {
     if (attributes == INVALID_FILE_ATTRIBUTES) return false;
     if (!allow_symlinks && (attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0) return false;
     return (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
 }
 
-bool IsDirectory(const std::wstring& path, bool allow_symlinks) {
+inline bool IsDirectory(const std::wstring& path, bool allow_symlinks) {
     return IsDirectory(::GetFileAttributes(path.c_str()), allow_symlinks);
 }
 
+#endif // OS_WIN
+
+#if defined(OS_POSIX)
+
+#if !defined(INVALID_FILE_ATTRIBUTES)
+#define INVALID_FILE_ATTRIBUTES ((DWORD)-1)
+#endif
+
+// Seconds between 1601-01-01 (the FILETIME epoch) and 1970-01-01.
+const ULONGLONG kFileTimeToUnixEpochSeconds = GG_ULONGLONG(11644473600);
+const ULONGLONG kFileTimeTicksPerSecond = GG_ULONGLONG(10000000);
+
+// Paths are kept as std::wstring everywhere, the file system wants UTF-8.
+static std::string SysWideToNativeMB(const std::wstring& wide) {
+    std::string native;
+    native.reserve(wide.length());
+    for (auto character : wide) {
+        uint32 code = static_cast<uint32>(character);
+        if (code < 0x80) {
+            native.push_back(static_cast<char>(code));
+        } else if (code < 0x800) {
+            native.push_back(static_cast<char>(0xC0 | (code >> 6)));
+            native.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else if (code < 0x10000) {
+            native.push_back(static_cast<char>(0xE0 | (code >> 12)));
+            native.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            native.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else {
+            native.push_back(static_cast<char>(0xF0 | ((code >> 18) & 0x07)));
+            native.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+            native.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            native.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+    }
+    return native;
+}
+
+static std::wstring SysNativeMBToWide(const std::string& native) {
+    std::wstring wide;
+    wide.reserve(native.length());
+    for (size_t i = 0; i < native.length();) {
+        uint8 lead = static_cast<uint8>(native[i]);
+        size_t trailing = lead < 0x80 ? 0 : lead < 0xE0 ? 1 : lead < 0xF0 ? 2 : 3;
+        uint32 code = trailing == 0 ? lead : lead & (0x3F >> trailing);
+        if (lead >= 0x80 && lead < 0xC0) trailing = 0;   // Stray continuation byte.
+        if (i + trailing >= native.length() && trailing != 0) trailing = native.length() - i - 1;
+        for (size_t j = 1; j <= trailing; ++j) {
+            code = (code << 6) | (static_cast<uint8>(native[i + j]) & 0x3F);
+        }
+        wide.push_back(static_cast<wchar_t>(code));
+        i += trailing + 1;
+    }
+    return wide;
+}
+
+static FILETIME TimeToFileTime(const struct timespec& time) {
+    ULONGLONG ticks = (static_cast<ULONGLONG>(time.tv_sec) + kFileTimeToUnixEpochSeconds) * kFileTimeTicksPerSecond +
+        static_cast<ULONGLONG>(time.tv_nsec) / 100;
+    FILETIME result;
+    result.dwLowDateTime = static_cast<DWORD>(ticks);
+    result.dwHighDateTime = static_cast<DWORD>(ticks >> 32);
+    return result;
+}
+
+static struct timespec FileTimeToTime(const FILETIME& filetime) {
+    ULONGLONG ticks = (static_cast<ULONGLONG>(filetime.dwHighDateTime) << 32) | filetime.dwLowDateTime;
+    struct timespec result;
+    result.tv_sec = static_cast<time_t>(ticks / kFileTimeTicksPerSecond) - static_cast<time_t>(kFileTimeToUnixEpochSeconds);
+    result.tv_nsec = static_cast<long>(ticks % kFileTimeTicksPerSecond) * 100;
+    return result;
+}
+
+// Encodes the |stat| mode like p7zip does, so the attributes round-trip
+// through the archive handlers.
+static DWORD GetFileAttributes(const struct stat& info) {
+    DWORD attributes = S_ISDIR(info.st_mode) ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_ARCHIVE;
+    if (!(info.st_mode & S_IWUSR)) attributes |= FILE_ATTRIBUTE_READONLY;
+    if (S_ISLNK(info.st_mode)) attributes |= FILE_ATTRIBUTE_REPARSE_POINT;
+    attributes |= FILE_ATTRIBUTE_UNIX_EXTENSION + ((info.st_mode & 0xFFFF) << 16);
+    return attributes;
+}
+
+static void FillPlatformFileInfo(const struct stat& info, PlatformFileInfo* results) {
+    results->size = S_ISDIR(info.st_mode) ? 0 : static_cast<ULONGLONG>(info.st_size);
+    results->attributes = GetFileAttributes(info);
+    results->directory = S_ISDIR(info.st_mode);
+#if defined(OS_MACOSX)
+    results->last_modified = TimeToFileTime(info.st_mtimespec);
+    results->last_accessed = TimeToFileTime(info.st_atimespec);
+    results->creation_time = TimeToFileTime(info.st_ctimespec);
+#else
+    results->last_modified = TimeToFileTime(info.st_mtim);
+    results->last_accessed = TimeToFileTime(info.st_atim);
+    results->creation_time = TimeToFileTime(info.st_ctim);
+#endif // OS_MACOSX
+}
+
+inline bool DirectoryExists(const std::wstring& path) {
+    struct stat info;
+    if (::stat(SysWideToNativeMB(path).c_str(), &info) != 0) return false;
+    return S_ISDIR(info.st_mode);
+}
+
+inline bool CreatePathTree(const std::wstring& path) {
+    if (DirectoryExists(path)) return true;
+
+    auto parent_path = GetParent(path);
+    if (path == parent_path) return false;
+    if (!CreatePathTree(parent_path)) return false;
+
+    if (::mkdir(SysWideToNativeMB(path).c_str(), 0777) != 0) {
+        if (errno == EEXIST && DirectoryExists(path)) {
+            return true;
+        }
+        return false;
+    }
+    return true;
+}
+
+// Replaces |to| with |from| in one step, both are on the same file system.
+inline bool Rename(const std::wstring& from, const std::wstring& to) {
+    return ::rename(SysWideToNativeMB(from).c_str(), SysWideToNativeMB(to).c_str()) == 0;
+}
+
+inline bool Remove(const std::wstring& path) {
+    return ::unlink(SysWideToNativeMB(path).c_str()) == 0;
+}
+
+inline bool GetFileInfo(const std::wstring& path, PlatformFileInfo* results) {
+    struct stat info;
+    if (::stat(SysWideToNativeMB(path).c_str(), &info) != 0) {
+        return false;
+    }
+    FillPlatformFileInfo(info, results);
+    return true;
+}
+
+inline int64 GetFileSize(const std::wstring& path) {
+    PlatformFileInfo info;
+    if (!GetFileInfo(path, &info)) return -1;
+    return info.size;
+}
+
+inline int64_t GetFileSize(const struct stat& info) {
+    if (S_ISDIR(info.st_mode)) return 0;
+    return static_cast<int64_t>(info.st_size);
+}
+
+namespace internal {
+
+struct ScopedFDCloseTraits {
+    static int InvalidValue() { return -1; }
+    static void Free(int fd) { ::close(fd); }
+};
+
+struct ScopedDIRCloseTraits {
+    static DIR* InvalidValue() { return nullptr; }
+    static void Free(DIR* dir) { ::closedir(dir); }
+};
+
+} // namespace internal
+
+using ScopedFD = ScopedGeneric<int, internal::ScopedFDCloseTraits>;
+using ScopedDIR = ScopedGeneric<DIR*, internal::ScopedDIRCloseTraits>;
+
+inline bool IsSymbolicLink(const std::wstring& path) {
+    struct stat info;
+    if (::lstat(SysWideToNativeMB(path).c_str(), &info) != 0) return false;
+    return S_ISLNK(info.st_mode);
+}
+
+inline bool IsRegularFile(const std::wstring& path) {
+    struct stat info;
+    if (::lstat(SysWideToNativeMB(path).c_str(), &info) != 0) return false;
+    return S_ISREG(info.st_mode);
+}
+
+inline bool IsDirectory(const DWORD& attributes, bool allow_symlinks) {
+    if (attributes == INVALID_FILE_ATTRIBUTES) return false;
+    if (!allow_symlinks && (attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0) return false;
+    return (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+}
+
+inline bool IsDirectory(const std::wstring& path, bool allow_symlinks) {
+    struct stat info;
+    auto native = SysWideToNativeMB(path);
+    if (::lstat(native.c_str(), &info) != 0) return false;
+    if (S_ISLNK(info.st_mode)) {
+        if (!allow_symlinks || ::stat(native.c_str(), &info) != 0) return false;
+    }
+    return S_ISDIR(info.st_mode);
+}
+
+#endif // OS_POSIX
+
 // A class for enumerating the files in a provided path. The order of the
 // results is not guaranteed. This is blocking. Do not use on critical threads.
 // Example:
 //   base::FileEnumerator enum(my_dir, false, base::FileEnumerator::FILES, L"*.txt");
 //   for (auto name = enum.Next(); !name.empty(); name = enum.Next())
 //     ...
+#if defined(OS_WIN)
 class JUICE_API FileEnumerator {
 public:
     // Note: copy & assign supported.
@@ -375,6 +637,8 @@ public:
         results.last_modified = data.find_data().ftLastWriteTime;
         results.last_accessed = data.find_data().ftLastAccessTime;
         results.creation_time = data.find_data().ftCreationTime;
+        results.filename = data.GetName();
+        results.path = Append(root_path_, results.filename);
         return results;
     }
 
@@ -399,13 +663,155 @@ private:
     DISALLOW_COPY_AND_ASSIGN(FileEnumerator);
 };
 
-bool IsDirectoryEmpty(const std::wstring& path) {
+#else
+
+// The POSIX enumerator keeps the directory open as a file descriptor and
+// resolves every entry relative to it with |fstatat|, so a single path walk
+// is done per directory instead of per file.
+class JUICE_API FileEnumerator {
+public:
+    // Note: copy & assign supported.
+    class JUICE_API FileInfo {
+    public:
+        explicit FileInfo() { std::memset(&stat_, 0, sizeof(stat_)); }
+        virtual ~FileInfo() {}
+        std::wstring GetName() const { return filename_; } // The name of the file. This will not include any path information.
+        int64_t GetSize() const { return GetFileSize(stat_); }
+        FILETIME GetLastModifiedTime() const {
+            PlatformFileInfo info;
+            FillPlatformFileInfo(stat_, &info);
+            return info.last_modified;
+        }
+        bool IsDirectory() const { return S_ISDIR(stat_.st_mode); }
+        const struct stat& find_data() const { return stat_; }
+    private:
+        friend class FileEnumerator;
+        std::wstring filename_;
+        struct stat stat_;
+    };
+
+    enum FileType {
+        FILES = 1 << 0,
+        DIRECTORIES = 1 << 1,
+        INCLUDE_DOT_DOT = 1 << 2,
+    };
+
+    explicit FileEnumerator(const std::wstring& root_path, bool recursive, int file_type)
+        : FileEnumerator(root_path, recursive, file_type, L"") {}
+
+    explicit FileEnumerator(const std::wstring& root_path, bool recursive, int file_type, const std::wstring& pattern)
+        : recursive_(recursive), file_type_(file_type), pattern_(pattern.empty() ? std::wstring(1, kSearchAll) : pattern) {
+        assert(!(recursive && (INCLUDE_DOT_DOT & file_type_)));
+        pending_paths_.push(root_path);
+    }
+    virtual ~FileEnumerator() {}
+
+    std::wstring Next() {
+        while (has_find_data_ || !pending_paths_.empty()) {
+            if (!has_find_data_) {
+                // The last directory is done, prepare a new one.
+                root_path_ = pending_paths_.top();
+                pending_paths_.pop();
+
+                // The |DIR| owns the descriptor once |fdopendir| succeeded.
+                int fd = ::open(SysWideToNativeMB(root_path_).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (fd >= 0) {
+                    find_handle_.reset(::fdopendir(fd));
+                    if (!find_handle_.is_valid()) ::close(fd);
+                }
+                has_find_data_ = true;
+            }
+
+            struct dirent* entry = find_handle_.is_valid() ? ::readdir(find_handle_.get()) : nullptr;
+            if (entry == nullptr) {
+                find_handle_.reset();
+                has_find_data_ = false;
+                pattern_ = kSearchAll;
+                continue;
+            }
+
+            auto name = SysNativeMBToWide(entry->d_name);
+            if (ShouldSkip(name) || !MatchPattern(name))
+                continue;
+
+            if (::fstatat(::dirfd(find_handle_.get()), entry->d_name, &find_data_.stat_, AT_SYMLINK_NOFOLLOW) != 0)
+                continue;
+            find_data_.filename_ = name;
+
+            auto cur_file = Append(root_path_, name);
+            if (S_ISDIR(find_data_.stat_.st_mode)) {
+                if (recursive_) {
+                    pending_paths_.push(cur_file);
+                }
+                if (file_type_ & FileEnumerator::DIRECTORIES) return cur_file;
+            } else if (file_type_ & FileEnumerator::FILES) {
+                return cur_file;
+            }
+        }
+        return L"";
+    }
+
+    FileInfo GetInfo() const {
+        if (!has_find_data_) return FileInfo();
+        return find_data_;
+    }
+
+    PlatformFileInfo GetPlatformFileInfo() const {
+        PlatformFileInfo results;
+        if (!has_find_data_) return results;
+        FillPlatformFileInfo(find_data_.find_data(), &results);
+        results.filename = find_data_.GetName();
+        results.path = Append(root_path_, results.filename);
+        return results;
+    }
+
+private:
+    // Returns true if the given path should be skipped in enumeration.
+    bool ShouldSkip(const std::wstring& path) {
+        auto basename = GetFileName(path);
+        return basename == L"." || (basename == L".." && !(INCLUDE_DOT_DOT & file_type_));
+    }
+
+    // Only the leading or trailing |kSearchAll| patterns of FindFirstFile are
+    // supported, i.e. "*", "*.txt" and "name*".
+    bool MatchPattern(const std::wstring& name) const {
+        if (pattern_.length() == 1 && pattern_[0] == kSearchAll) return true;
+        if (!pattern_.empty() && pattern_.front() == kSearchAll) {
+            auto suffix = pattern_.substr(1);
+            return name.length() >= suffix.length() &&
+                name.compare(name.length() - suffix.length(), suffix.length(), suffix) == 0;
+        }
+        if (!pattern_.empty() && pattern_.back() == kSearchAll) {
+            return name.compare(0, pattern_.length() - 1, pattern_, 0, pattern_.length() - 1) == 0;
+        }
+        return name == pattern_;
+    }
+
+    // True when find_data_ is valid.
+    bool has_find_data_ = false;
+    bool recursive_ = false;
+    int file_type_ = 0;
+
+    ScopedDIR find_handle_;
+    FileInfo find_data_;
+
+    std::wstring root_path_;
+    std::wstring pattern_;  // Empty when we want to find everything.
+    std::stack<std::wstring> pending_paths_;
+    DISALLOW_COPY_AND_ASSIGN(FileEnumerator);
+};
+
+#endif // OS_WIN
+
+inline bool IsDirectoryEmpty(const std::wstring& path) {
     FileEnumerator files(path, false, FileEnumerator::FILES | FileEnumerator::DIRECTORIES);
     if (files.Next().empty()) return true;
     return false;
 }
 
-ScopedComObject<IStream> Open(const std::wstring& path, bool read) {
+#if defined(OS_WIN)
+
+inline ScopedComObject<IStream> Open(const std::wstring& path, bool read) {
     ScopedComObject<IStream> file_stream;
     auto mode = read ? STGM_READ : (STGM_CREATE | STGM_WRITE);
     auto result = ::SHCreateStreamOnFileEx(path.c_str(), mode, FILE_ATTRIBUTE_NORMAL, read ? FALSE : TRUE, nullptr, file_stream.Receive());
@@ -431,7 +837,7 @@ namespace internal {
 typedef HMODULE(WINAPI* LoadLibraryFunction)(const wchar_t* file_name);
 
 // LoadLibrary() opens the file off disk.
-HMODULE LoadNativeLibraryHelper(const std::wstring& library_path, LoadLibraryFunction load_library_api) {
+inline HMODULE LoadNativeLibraryHelper(const std::wstring& library_path, LoadLibraryFunction load_library_api) {
     // Switch the current directory to the library directory as the library
     // may have dependencies on DLLs in this directory.
     bool restore_directory = false;
@@ -452,11 +858,11 @@ HMODULE LoadNativeLibraryHelper(const std::wstring& library_path, LoadLibraryFun
 
 } // namespace internal
 
-JUICE_API HMODULE LoadLibrary(const std::wstring& path, std::string* error) {
+JUICE_API inline HMODULE LoadLibrary(const std::wstring& path, std::string* error) {
     return internal::LoadNativeLibraryHelper(path, ::LoadLibraryW);
 }
 
-JUICE_API HMODULE LoadLibraryDynamically(const std::wstring& path) {
+JUICE_API inline HMODULE LoadLibraryDynamically(const std::wstring& path) {
     typedef HMODULE(WINAPI* LoadLibraryFunction)(const wchar_t* file_name);
 
     LoadLibraryFunction load_library = reinterpret_cast<LoadLibraryFunction>(
@@ -465,17 +871,17 @@ JUICE_API HMODULE LoadLibraryDynamically(const std::wstring& path) {
     return internal::LoadNativeLibraryHelper(path, load_library);
 }
 
-JUICE_API void UnloadNativeLibrary(HMODULE library) {
+JUICE_API inline void UnloadNativeLibrary(HMODULE library) {
     if (library == nullptr) return;
     ::FreeLibrary(library);
 }
 
-JUICE_API void* GetFunctionPointerFromNativeLibrary(HMODULE library, const char* name) {
+JUICE_API inline void* GetFunctionPointerFromNativeLibrary(HMODULE library, const char* name) {
     if (name == nullptr) return nullptr;
     return ::GetProcAddress(library, name);
 }
 
-JUICE_API void* GetFunctionPointerFromNativeLibrary(const std::wstring& library_name, const char* name) {
+JUICE_API inline void* GetFunctionPointerFromNativeLibrary(const std::wstring& library_name, const char* name) {
     if (name == nullptr) return nullptr;
     HMODULE wellknown_handler = ::GetModuleHandle(library_name.c_str());
     if (nullptr == wellknown_handler) return nullptr;
@@ -484,12 +890,226 @@ JUICE_API void* GetFunctionPointerFromNativeLibrary(const std::wstring& library_
 
 // Returns the result whether |library_name| had been loaded.
 // It will be true if |library_name| is empty.
-JUICE_API bool WellKnownLibrary(const std::wstring& library_name) {
+JUICE_API inline bool WellKnownLibrary(const std::wstring& library_name) {
     if (library_name.empty()) return false;
     HMODULE wellknown_handler = ::GetModuleHandle(library_name.c_str());
     return nullptr != wellknown_handler;
 }
 
+#else
+
+class FileStream
+    : public IStream
+    , public RefCounted<FileStream> {
+public:
+    explicit FileStream(int fd) : fd_(fd) {}
+    virtual ~FileStream() {}
+
+    STDMETHOD(QueryInterface)(REFIID iid, void** obj) {
+        if (Query<IUnknown>(this, iid, obj)) return S_OK;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHOD_(ULONG, AddRef)() {
+        return static_cast<ULONG>(RefCounted::AddRef());
+    }
+
+    STDMETHOD_(ULONG, Release)() {
+        return static_cast<ULONG>(RefCounted::Release());
+    }
+
+    STDMETHOD(Read)(void* data, ULONG size, ULONG* processed) {
+        ssize_t result;
+        do {
+            result = ::read(fd_.get(), data, size);
+        } while (result < 0 && errno == EINTR);
+        if (processed != nullptr) *processed = result < 0 ? 0 : static_cast<ULONG>(result);
+        return result < 0 ? HRESULT_FROM_ERRNO(errno) : S_OK;
+    }
+
+    STDMETHOD(Write)(const void* data, ULONG size, ULONG* processed) {
+        ULONG written = 0;
+        while (written < size) {
+            auto result = ::write(fd_.get(), static_cast<const uint8*>(data) + written, size - written);
+            if (result < 0 && errno == EINTR) continue;
+            if (result <= 0) break;
+            written += static_cast<ULONG>(result);
+        }
+        if (processed != nullptr) *processed = written;
+        return written == size ? S_OK : HRESULT_FROM_ERRNO(errno);
+    }
+
+    STDMETHOD(Seek)(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* position) {
+        // STREAM_SEEK_SET, STREAM_SEEK_CUR and STREAM_SEEK_END are SEEK_SET, SEEK_CUR and SEEK_END.
+        auto result = ::lseek(fd_.get(), static_cast<off_t>(move.QuadPart), static_cast<int>(origin));
+        if (result < 0) return HRESULT_FROM_ERRNO(errno);
+        if (position != nullptr) position->QuadPart = static_cast<ULONGLONG>(result);
+        return S_OK;
+    }
+
+    STDMETHOD(SetSize)(ULARGE_INTEGER size) {
+        if (::ftruncate(fd_.get(), static_cast<off_t>(size.QuadPart)) != 0) return HRESULT_FROM_ERRNO(errno);
+        return S_OK;
+    }
+
+    STDMETHOD(Stat)(STATSTG* stat, DWORD flag) {
+        struct stat info;
+        if (::fstat(fd_.get(), &info) != 0) return HRESULT_FROM_ERRNO(errno);
+        PlatformFileInfo file;
+        FillPlatformFileInfo(info, &file);
+        stat->cbSize.QuadPart = file.size;
+        stat->mtime = file.last_modified;
+        stat->ctime = file.creation_time;
+        stat->atime = file.last_accessed;
+        return S_OK;
+    }
+
+    int fd() const { return fd_.get(); }
+
+private:
+    static HRESULT HRESULT_FROM_ERRNO(int error) {
+        return static_cast<HRESULT>((error & 0x0000FFFF) | (7 << 16) | 0x80000000);
+    }
+
+    ScopedFD fd_;
+    DISALLOW_COPY_AND_ASSIGN(FileStream);
+};
+
+inline ScopedComObject<IStream> Open(const std::wstring& path, bool read) {
+    ScopedComObject<IStream> file_stream;
+    auto mode = read ? O_RDONLY : (O_CREAT | O_TRUNC | O_WRONLY);
+    int fd = ::open(SysWideToNativeMB(path).c_str(), mode | O_CLOEXEC, 0666);
+    if (fd < 0) return file_stream;
+    file_stream = new FileStream(fd);
+    return file_stream;
+}
+
+static bool GetCurrentDirectory(std::wstring* dir) {
+    char system_buffer[MAX_PATH] = { 0 };
+    if (::getcwd(system_buffer, MAX_PATH) == nullptr) return false;
+    *dir = StripTrailingSeparators(SysNativeMBToWide(system_buffer));
+    return true;
+}
+
+static bool SetCurrentDirectory(const std::wstring& directory) {
+    return ::chdir(SysWideToNativeMB(directory).c_str()) == 0;
+}
+
+JUICE_API inline HMODULE LoadLibrary(const std::wstring& path, std::string* error) {
+    // The libraries are shared between the threads of the extractor, so
+    // resolve everything up front instead of on the first call.
+    HMODULE module = ::dlopen(SysWideToNativeMB(path).c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (module == nullptr && error != nullptr) *error = ::dlerror();
+    return module;
+}
+
+JUICE_API inline HMODULE LoadLibraryDynamically(const std::wstring& path) {
+    return LoadLibrary(path, nullptr);
+}
+
+JUICE_API inline void UnloadNativeLibrary(HMODULE library) {
+    if (library == nullptr) return;
+    ::dlclose(library);
+}
+
+JUICE_API inline void* GetFunctionPointerFromNativeLibrary(HMODULE library, const char* name) {
+    if (name == nullptr) return nullptr;
+    return ::dlsym(library, name);
+}
+
+JUICE_API inline void* GetFunctionPointerFromNativeLibrary(const std::wstring& library_name, const char* name) {
+    if (name == nullptr) return nullptr;
+    HMODULE wellknown_handler = ::dlopen(SysWideToNativeMB(library_name).c_str(), RTLD_LAZY | RTLD_NOLOAD);
+    if (nullptr == wellknown_handler) return nullptr;
+    // Drop the reference taken by RTLD_NOLOAD, the library stays loaded by its owner.
+    auto function = GetFunctionPointerFromNativeLibrary(wellknown_handler, name);
+    ::dlclose(wellknown_handler);
+    return function;
+}
+
+// Returns the result whether |library_name| had been loaded.
+// It will be true if |library_name| is empty.
+JUICE_API inline bool WellKnownLibrary(const std::wstring& library_name) {
+    if (library_name.empty()) return false;
+    HMODULE wellknown_handler = ::dlopen(SysWideToNativeMB(library_name).c_str(), RTLD_LAZY | RTLD_NOLOAD);
+    if (nullptr == wellknown_handler) return false;
+    ::dlclose(wellknown_handler);
+    return true;
+}
+
+#endif // OS_WIN
+
+// A read-only view of a whole file. The handlers read the archive headers in
+// many small pieces; a mapping serves those out of the page cache without a
+// system call per read.
+class JUICE_API MemoryMappedFile {
+public:
+    MemoryMappedFile() {}
+    ~MemoryMappedFile() { CloseHandles(); }
+
+    bool Initialize(const std::wstring& path) {
+        if (IsValid()) return false;
+#if defined(OS_WIN)
+        HANDLE handle = ::CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) return false;
+        ScopedHANDLE file(handle);
+        LARGE_INTEGER size;
+        if (!::GetFileSizeEx(file.get(), &size)) return false;
+        valid_ = true;
+        if (size.QuadPart == 0) return true;
+
+        mapping_.reset(::CreateFileMapping(file.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+        if (!mapping_.is_valid()) return Fail();
+        data_ = static_cast<uint8_t*>(::MapViewOfFile(mapping_.get(), FILE_MAP_READ, 0, 0, 0));
+        if (data_ == nullptr) return Fail();
+        length_ = static_cast<size_t>(size.QuadPart);
+#else
+        ScopedFD fd(::open(SysWideToNativeMB(path).c_str(), O_RDONLY | O_CLOEXEC));
+        if (!fd.is_valid()) return false;
+        struct stat info;
+        if (::fstat(fd.get(), &info) != 0 || !S_ISREG(info.st_mode)) return false;
+        valid_ = true;
+        if (info.st_size == 0) return true;
+
+        void* data = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd.get(), 0);
+        if (data == MAP_FAILED) return Fail();
+        data_ = static_cast<uint8_t*>(data);
+        length_ = static_cast<size_t>(info.st_size);
+#endif // OS_WIN
+        return true;
+    }
+
+    const uint8_t* data() const { return data_; }
+    size_t length() const { return length_; }
+    bool IsValid() const { return valid_; }
+
+private:
+    bool Fail() {
+        CloseHandles();
+        return false;
+    }
+
+    void CloseHandles() {
+#if defined(OS_WIN)
+        if (data_ != nullptr) ::UnmapViewOfFile(data_);
+        mapping_.reset();
+#else
+        if (data_ != nullptr) ::munmap(data_, length_);
+#endif // OS_WIN
+        data_ = nullptr;
+        length_ = 0;
+        valid_ = false;
+    }
+
+#if defined(OS_WIN)
+    ScopedHANDLE mapping_;
+#endif // OS_WIN
+    uint8_t* data_ = nullptr;
+    size_t length_ = 0;
+    bool valid_ = false;
+    DISALLOW_COPY_AND_ASSIGN(MemoryMappedFile);
+};
 
 
 } // namespace x
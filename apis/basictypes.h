@@ -19,13 +19,19 @@
 #include <string.h>
 #include <wchar.h>
 
-#include <WinUser.h>
-
 #include "apis/compiler.h"
 
+#if defined(OS_WIN)
+#include <WinUser.h>
+#endif // OS_WIN
+
 #define JUICE_BASE WM_USER + 0x07C4 
 
+#if defined(COMPILER_MSVC)
 #define X_ABSL_COMDAT __declspec(selectany)
+#else
+#define X_ABSL_COMDAT __attribute__((weak))
+#endif // COMPILER_MSVC
 
 // Helper macro which assist user to print enum value with the Literally.
 // which use the enum value macro.
@@ -89,7 +95,28 @@ struct ToUnsigned<short> {
 };
 
 #ifdef OS_POSIX
-#error "without format_macros defined."
+
+#if !defined(__STDC_FORMAT_MACROS)
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+#define WidePRId64 PRId64
+#define WidePRIu64 PRIu64
+#define WidePRIx64 PRIx64
+
+#if !defined(PRIuS)
+#define PRIuS "zu"
+#endif
+
+#if !defined(PRDWROD)
+#define PRDWROD "u"
+#endif
+
+#if !defined(PRHRESULT)
+#define PRHRESULT "08X"
+#endif
+
 #else // OS_WIN
 
 #if !defined(PRId64)
@@ -14,8 +14,20 @@
 #if defined(_WIN32)
 #define OS_WIN 1
 #define TOOLKIT_VIEWS 1
+#elif defined(__APPLE__)
+#define OS_MACOSX 1
+#elif defined(__linux__)
+#define OS_LINUX 1
+#elif defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#define OS_BSD 1
 #else
 #error Please add support for your platform
+#endif
+
+// For access to standard POSIXish features, use OS_POSIX instead of a
+// more specific macro.
+#if defined(OS_MACOSX) || defined(OS_LINUX) || defined(OS_BSD)
+#define OS_POSIX 1
 #endif
 
 
@@ -186,7 +198,6 @@
 // Disable: 4251 4275
 #if defined(COMPILER_MSVC)
 #pragma warning(disable:4251 4275)
-#elif
 #endif
 
 #endif  // !#define (VIRTUAL_JUICE_COMPILER_INCLUDE_H_ )
\ No newline at end of file
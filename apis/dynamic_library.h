@@ -10,7 +10,12 @@
 #define VIRTUALLIB_JUICE_DYNAMIC_LIBRARY_INCLUDE_H_
 
 #include <memory>
+
+#include "apis/compiler.h"
+
+#if defined(OS_WIN)
 #include <Windows.h>
+#endif // OS_WIN
 
 #include "apis/juice.h"
 #include "apis/basic_util.h"
@@ -42,7 +47,7 @@ public:
     template<typename R, typename... P>
     typename FunctorTraits<R, P...>::Type GetFunctionPointer(const std::string& InterfaceName) const {
         if (!is_valid() && InterfaceName.empty()) return nullptr;
-        using Type = FunctorTraits<R, P...>::Type;
+        using Type = typename FunctorTraits<R, P...>::Type;
         return reinterpret_cast<Type>(DynamicLibrary::GetFunctionPointer(InterfaceName.c_str()));
     }
 
@@ -60,6 +65,11 @@ public:
         return result;
     }
 
+    static std::wstring GetLibraryName(const std::shared_ptr<DynamicLibrary>& library) {
+        if (!library) return L"";
+        return library->library_name();
+    }
+
 private:
     std::wstring library_name_;
     HMODULE library_ = nullptr;
@@ -69,21 +79,21 @@ private:
 template<typename R, typename... P>
 typename FunctorTraits<R, P...>::Type GetFunctionPointer(const HMODULE& library, const std::string& InterfaceName) {
     if (!library || InterfaceName.empty()) return nullptr;
-    using Type = FunctorTraits<R, P...>::Type;
+    using Type = typename FunctorTraits<R, P...>::Type;
     return reinterpret_cast<Type>(GetFunctionPointerFromNativeLibrary(library, InterfaceName.c_str()));
 }
 
 template<typename R, typename... P>
 typename FunctorTraits<R, P...>::Type GetFunctionPointer(const DynamicLibrary* library, const std::string& InterfaceName) {
     if (!library) return nullptr;
-    return library->GetFunctionPointer<R, P...>(InterfaceName.c_str());
+    return library->template GetFunctionPointer<R, P...>(InterfaceName.c_str());
 }
 
 template<typename R, typename... P>
 typename FunctorTraits<R, P...>::Type GetFunctionPointer(const std::weak_ptr<DynamicLibrary>& library, const std::string& InterfaceName) {
     auto known_library = library.lock();
     if (!known_library) return nullptr;
-    return known_library->GetFunctionPointer<R, P...>(InterfaceName.c_str());
+    return known_library->template GetFunctionPointer<R, P...>(InterfaceName.c_str());
 }
 
 } // namespace x
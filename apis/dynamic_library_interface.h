@@ -10,6 +10,7 @@
 #define VIRTUALLIB_JUICE_DYNAMIC_LIBRARY_INTERFACE_INCLUDE_H_
 
 #include <mutex>
+#include <thread>
 
 #include "apis/dynamic_library.h"
 
@@ -47,7 +48,7 @@ public:
     using Destructor = std::function<void(NativeInterface**)>;
 
     explicit NativeTraits(NativeInterface* inter, const Destructor& destructor)
-        : inteface_(inter)
+        : interface_(inter)
         , destructor_(destructor) {}
 
     explicit NativeTraits(const std::weak_ptr<DynamicLibrary>& library, const std::string& CreateInterface, const std::string& DestroyInterface)
@@ -95,17 +96,17 @@ using DoublePointerTraits = NativeTraits<NativeInterface, DoublePointer<NativeIn
 
 class ThreadFlag {
 public:
-    ThreadFlag() : valid_thread_id_(::GetCurrentThreadId()) {}
+    ThreadFlag() : valid_thread_id_(std::this_thread::get_id()) {}
     virtual ~ThreadFlag() {}
 
     bool CalledOnValidThread() const {
         std::lock_guard<std::mutex> guard(lock_);
-        return valid_thread_id_ == ::GetCurrentThreadId();
+        return valid_thread_id_ == std::this_thread::get_id();
     }
 
 private:
     mutable std::mutex lock_;
-    mutable DWORD valid_thread_id_ = 0;
+    mutable std::thread::id valid_thread_id_;
 };
 
 } // namespace subtle
@@ -197,7 +198,7 @@ public:
 
     void reset() { interface_ = nullptr; weak_interface_ = nullptr; library_name_ = L""; }
 
-    void swap(Interface& r) { interface_.swap(r.interface_); weak_interface_.swap(r.weak_interface_); std::swap(libarary_name_, r.library_name_); }
+    void swap(Interface& r) { interface_.swap(r.interface_); weak_interface_.swap(r.weak_interface_); std::swap(library_name_, r.library_name_); }
 
     void SetLibraryName(const std::wstring& name) { library_name_ = name; }
 
@@ -247,7 +248,7 @@ public:
 
     void reset() { library_ = nullptr; function_ = nullptr; name_ = ""; }
 
-    void swap(Function& r) { library_.swap(r.library_); weak_library_.swap(r.weak_library_); std::swap(name_, r.name_); std::swap(function_, r.function_); }
+    void swap(Function& r) { library_.swap(r.library_); std::swap(name_, r.name_); std::swap(function_, r.function_); }
 
 protected:
     typename FunctorTraits<R, P...>::Type get() const {
@@ -66,7 +66,7 @@ auto enumerate_cast(Enumeration const value)-> typename std::underlying_type<Enu
 }
 
 template<typename Enumeration, typename Type>
-auto enumerate_cast(Type const value) -> typename Enumeration {
+auto enumerate_cast(Type const value) -> Enumeration {
     return static_cast<Enumeration>(value);
 }
 
@@ -78,7 +78,7 @@ auto enumerate_cast(Enumeration const value)-> int {
 }
 
 template<typename Enumeration>
-auto enumerate_cast(int const value) -> typename Enumeration {
+auto enumerate_cast(int const value) -> Enumeration {
     return static_cast<Enumeration>(value);
 }
 
@@ -0,0 +1,223 @@
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 The Authors of ANT(http:://ant.sh) . All Rights Reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef JUICE_FILE_SCANNER_INCLUDE_H_
+#define JUICE_FILE_SCANNER_INCLUDE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "apis/compiler.h"
+#include "apis/basictypes.h"
+#include "apis/basic_util.h"
+
+namespace x {
+
+// Walks a directory tree on several threads. Every thread owns a queue of
+// directories: it takes the newest one of its own, and steals the oldest one
+// of another thread once its queue runs dry, which is the largest subtree
+// that is left there. The results are handed to the callback in batches while
+// the walk goes on, with the size, the times and the attributes filled in.
+//
+// Example:
+//   x::ParallelFileScanner scanner(8);
+//   scanner.Scan(root, x::FileEnumerator::FILES, [](std::vector<x::PlatformFileInfo>& files) {
+//     ...
+//   });
+class JUICE_API ParallelFileScanner {
+public:
+    // Called with one batch at a time, never concurrently. It may move the
+    // entries out of |files|.
+    using Callback = std::function<void(std::vector<PlatformFileInfo>& files)>;
+
+    static const size_t kBatchSize = 1024;
+
+    explicit ParallelFileScanner(uint threads = 0)
+        : threads_(threads != 0 ? threads : (std::max)(1u, std::thread::hardware_concurrency())) {}
+
+    // Scans everything below |root|, |file_type| takes FileEnumerator::FILES
+    // and FileEnumerator::DIRECTORIES. Symbolic links are reported, not
+    // followed. Returns false if |root| is not a directory.
+    bool Scan(const std::wstring& root, int file_type, const Callback& callback) const {
+        if (!IsDirectory(root, false)) return false;
+
+        Walk walk(threads_, file_type, callback);
+        walk.pending = 1;
+        walk.queues[0].directories.push_back(StripTrailingSeparators(root));
+
+        std::vector<std::thread> threads;
+        for (uint i = 1; i < threads_; i++) {
+            threads.emplace_back(&ParallelFileScanner::Run, std::ref(walk), i);
+        }
+        Run(walk, 0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return true;
+    }
+
+    std::vector<PlatformFileInfo> Scan(const std::wstring& root, int file_type) const {
+        std::vector<PlatformFileInfo> results;
+        Scan(root, file_type, [&results](std::vector<PlatformFileInfo>& files) {
+            std::move(files.begin(), files.end(), std::back_inserter(results));
+        });
+        return results;
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<std::wstring> directories;
+    };
+
+    struct Walk {
+        Walk(uint threads, int type, const Callback& results)
+            : queues(threads), file_type(type), callback(results) {}
+
+        std::vector<Queue> queues;
+        // The directories queued or being read. The walk is over at zero.
+        std::atomic<size_t> pending{ 0 };
+        std::mutex idle_lock;
+        std::condition_variable idle;
+        std::mutex callback_lock;
+        int file_type = 0;
+        const Callback& callback;
+    };
+
+    static bool Take(Walk& walk, uint self, std::wstring* directory) {
+        {
+            Queue& queue = walk.queues[self];
+            std::lock_guard<std::mutex> lock(queue.lock);
+            if (!queue.directories.empty()) {
+                *directory = std::move(queue.directories.back());
+                queue.directories.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < walk.queues.size(); i++) {
+            Queue& victim = walk.queues[(self + i) % walk.queues.size()];
+            std::lock_guard<std::mutex> lock(victim.lock);
+            if (!victim.directories.empty()) {
+                *directory = std::move(victim.directories.front());
+                victim.directories.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void Deliver(Walk& walk, std::vector<PlatformFileInfo>& batch) {
+        if (batch.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(walk.callback_lock);
+            walk.callback(batch);
+        }
+        batch.clear();
+    }
+
+    static void Run(Walk& walk, uint self) {
+        std::vector<PlatformFileInfo> batch;
+        std::vector<std::wstring> subdirectories;
+        std::wstring directory;
+        while (walk.pending != 0) {
+            if (!Take(walk, self, &directory)) {
+                // Everything left is being read by the other threads, wait
+                // for them to queue more or to finish.
+                std::unique_lock<std::mutex> lock(walk.idle_lock);
+                walk.idle.wait_for(lock, std::chrono::milliseconds(1));
+                continue;
+            }
+
+            subdirectories.clear();
+            ReadDirectory(directory, walk.file_type, &batch, &subdirectories);
+            if (!subdirectories.empty()) {
+                walk.pending += subdirectories.size();
+                Queue& queue = walk.queues[self];
+                {
+                    std::lock_guard<std::mutex> lock(queue.lock);
+                    for (auto& subdirectory : subdirectories) {
+                        queue.directories.push_back(std::move(subdirectory));
+                    }
+                }
+                walk.idle.notify_all();
+            }
+            if (batch.size() >= kBatchSize) Deliver(walk, batch);
+            if (--walk.pending == 0) walk.idle.notify_all();
+        }
+        Deliver(walk, batch);
+    }
+
+#if defined(OS_WIN)
+    static void ReadDirectory(const std::wstring& directory, int file_type,
+        std::vector<PlatformFileInfo>* results, std::vector<std::wstring>* subdirectories) {
+        WIN32_FIND_DATA find_data;
+        auto pattern = Append(directory, std::wstring(1, kSearchAll));
+        ScopedSearchHANDLE find_handle(::FindFirstFileEx(pattern.c_str(), FindExInfoBasic, &find_data,
+            FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH));
+        if (find_handle.get() == INVALID_HANDLE_VALUE) return;
+        do {
+            std::wstring name = find_data.cFileName;
+            if (name == kCurrentDirectory || name == kParentDirectory) continue;
+
+            PlatformFileInfo info;
+            info.size = GetFileSize(find_data);
+            info.attributes = find_data.dwFileAttributes;
+            // Junctions and directory links are reported, not followed.
+            info.directory = IsDirectory(find_data.dwFileAttributes, false);
+            info.creation_time = find_data.ftCreationTime;
+            info.last_modified = find_data.ftLastWriteTime;
+            info.last_accessed = find_data.ftLastAccessTime;
+            info.filename = name;
+            info.path = Append(directory, name);
+            if (info.directory) subdirectories->push_back(info.path);
+            if (file_type & (info.directory ? FileEnumerator::DIRECTORIES : FileEnumerator::FILES)) {
+                results->push_back(std::move(info));
+            }
+        } while (::FindNextFile(find_handle.get(), &find_data));
+    }
+#else
+    static void ReadDirectory(const std::wstring& directory, int file_type,
+        std::vector<PlatformFileInfo>* results, std::vector<std::wstring>* subdirectories) {
+        // The |DIR| owns the descriptor once |fdopendir| succeeded.
+        int fd = ::open(SysWideToNativeMB(directory).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) return;
+        ScopedDIR dir(::fdopendir(fd));
+        if (!dir.is_valid()) {
+            ::close(fd);
+            return;
+        }
+        struct stat info;
+        while (struct dirent* entry = ::readdir(dir.get())) {
+            if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0) continue;
+            if (::fstatat(fd, entry->d_name, &info, AT_SYMLINK_NOFOLLOW) != 0) continue;
+
+            PlatformFileInfo result;
+            FillPlatformFileInfo(info, &result);
+            result.filename = SysNativeMBToWide(entry->d_name);
+            result.path = Append(directory, result.filename);
+            if (result.directory) subdirectories->push_back(result.path);
+            if (file_type & (result.directory ? FileEnumerator::DIRECTORIES : FileEnumerator::FILES)) {
+                results->push_back(std::move(result));
+            }
+        }
+    }
+#endif // OS_WIN
+
+    uint threads_ = 1;
+};
+
+} // namespace x
+
+#endif  // !JUICE_FILE_SCANNER_INCLUDE_H_
@@ -11,16 +11,41 @@
 #define JUICE_SCOPED_OBJECT_INCLUDE_H_
 
 #include <algorithm>
+#include <cstring>
 
 #include <stdlib.h>
-#include <unknwn.h>
 #include <assert.h>
+
+#include "apis/compiler.h"
+
+#if defined(OS_WIN)
+#include <unknwn.h>
 #include <Windows.h>
 #include <OleAuto.h>
+#else
+// The COM subset (IUnknown, PROPVARIANT, BSTR) is provided by the p7zip tree,
+// which also supplies the 7z.so that we talk to.
+#include "Common/MyWindows.h"
+#endif // OS_WIN
 
 #include "apis/juice.h"
 #include "apis/basictypes.h"
 
+#if defined(OS_POSIX)
+#if !defined(SUCCEEDED)
+#define SUCCEEDED(Status) ((HRESULT)(Status) >= 0)
+#endif
+
+static inline HRESULT PropVariantInit(PROPVARIANT* var) {
+    memset(var, 0, sizeof(PROPVARIANT));
+    return S_OK;
+}
+
+static inline HRESULT PropVariantClear(PROPVARIANT* var) {
+    return ::VariantClear(var);
+}
+#endif // OS_POSIX
+
 static const int32 kExChangedStep = 1;
 
 template<typename T>
@@ -28,38 +53,62 @@ class JUICE_API RefCounted {
 public:
     RefCounted() {}
 
+    // Both return the new reference count, as IUnknown does.
     auto AddRef() const {
-        auto atom = InterlockedExchangeAdd(
-            reinterpret_cast<volatile LONG*>(&ref_count_),
-            static_cast<LONG>(kExChangedStep));
-        return atom;
+        auto count = ExchangeAdd(kExChangedStep) + kExChangedStep;
+        return count;
     }
 
     auto Release() const {
         auto step = -kExChangedStep;
-        auto atom = InterlockedExchangeAdd(
-            reinterpret_cast<volatile LONG*>(&ref_count_),
-            static_cast<LONG>(step));
-        if (0 == atom) {
+        auto count = ExchangeAdd(step) + step;
+        if (0 == count) {
             DeleteInternal(static_cast<const T*>(this));
         }
-        return atom;
+        return count;
     }
 
-    bool HasOneRef() const { return 1 = *(&ref_count_); }
+    bool HasOneRef() const { return 1 == *(&ref_count_); }
 
 protected:
     virtual ~RefCounted() {}
     
 private:
+    // Returns the value of |ref_count_| before the |step| was added.
+    int32 ExchangeAdd(int32 step) const {
+#if defined(OS_WIN)
+        return InterlockedExchangeAdd(
+            reinterpret_cast<volatile LONG*>(&ref_count_),
+            static_cast<LONG>(step));
+#else
+        return __sync_fetch_and_add(&ref_count_, step);
+#endif // OS_WIN
+    }
+
     static void DeleteInternal(const T* x) { delete x; }
     mutable int32 ref_count_ = 0;
     DISALLOW_COPY_AND_ASSIGN(RefCounted);
 };
 
+#if defined(COMPILER_MSVC)
+#define X_UUIDOF(Interface) __uuidof(Interface)
+#else
+// There is no __uuidof outside of MSVC, so only the interfaces which have a
+// well known IID can be queried without passing the IID explicitly.
+template<class Interface>
+struct InterfaceIdentifier;
+
+template<>
+struct InterfaceIdentifier<IUnknown> {
+    static const IID& Get() { return IID_IUnknown; }
+};
+
+#define X_UUIDOF(Interface) InterfaceIdentifier<Interface>::Get()
+#endif // COMPILER_MSVC
+
 template<class Interface, class Containter>
 bool Query(Containter* containter, REFIID iid, void** obj) {
-    if (iid == __uuidof(Interface)) {
+    if (iid == X_UUIDOF(Interface)) {
         *obj = reinterpret_cast<Interface*>(containter);
         containter->AddRef();
         return true;
@@ -70,7 +119,7 @@ bool Query(Containter* containter, REFIID iid, void** obj) {
 template<class Interface, class Containter>
 bool Query(Containter* containter, const IID& id, REFIID iid, void** obj) {
     if (iid == id) {
-        *obj = reinterpret_cast<Interface*>(containter);
+        *obj = static_cast<Interface*>(containter);
         containter->AddRef();
         return true;
     }
@@ -122,7 +171,7 @@ public:
 
     template<class U>
     ScopedComObject& operator=(const ScopedComObject<U>& p) {
-        ScopedComObject(other).swap(*this);
+        ScopedComObject(p.get()).swap(*this);
         return *this;
     }
 
@@ -189,13 +238,15 @@ public:
         return object->QueryInterface(Receive());
     }
 
+#if defined(OS_WIN)
     HRESULT CreateInstance(const CLSID& clsid, IUnknown* outer = NULL,
         DWORD context = CLSCTX_ALL) {
         assert(!ptr_);
-        HRESULT hr = ::CoCreateInstance(clsid, outer, context, *id,
+        HRESULT hr = ::CoCreateInstance(clsid, outer, context, __uuidof(Interface),
             reinterpret_cast<void**>(&ptr_));
         return hr;
     }
+#endif // OS_WIN
 
     bool IsSameObject(IUnknown* other) {
         if (!other && !ptr_)
@@ -205,10 +256,10 @@ public:
             return false;
 
         ScopedComObject<IUnknown> my_identity;
-        QueryInterface(my_identity.Receive());
+        QueryInterface(IID_IUnknown, my_identity.ReceiveVoid());
 
         ScopedComObject<IUnknown> other_identity;
-        other->QueryInterface(other_identity.Receive());
+        other->QueryInterface(IID_IUnknown, other_identity.ReceiveVoid());
 
         return static_cast<IUnknown*>(my_identity) ==
             static_cast<IUnknown*>(other_identity);
@@ -376,6 +427,7 @@ class JUICE_API ScopedVariant {
         var_.lVal = value;
     }
 
+#if defined(OS_WIN)
     // Creates a new double-precision type variant.  |vt| must be either VT_R8
     // or VT_DATE.
     explicit ScopedVariant(double value, VARTYPE vt = VT_R8) {
@@ -401,6 +453,7 @@ class JUICE_API ScopedVariant {
         var_.vt = VT_EMPTY;
         Set(safearray);
     }
+#endif // OS_WIN
 
     // Copies the variant.
     explicit ScopedVariant(const VARIANT& var) {
@@ -438,6 +491,7 @@ class JUICE_API ScopedVariant {
             var->wReserved1 = 0;
         }
         std::memcpy(var, &var_, sizeof(PROPVARIANT));
+        var_.vt = VT_EMPTY;
         return S_OK;
     }
 
@@ -450,11 +504,16 @@ class JUICE_API ScopedVariant {
 
     // Returns a copy of the variant.
     VARIANT Copy() const {
+#if defined(OS_WIN)
       VARIANT ret = {{{VT_EMPTY}}};
-      ::VariantCopy(&ret, &var_);
+#else
+      VARIANT ret = {VT_EMPTY};
+#endif // OS_WIN
+      ::VariantCopy(&ret, const_cast<VARIANT*>(&var_));
       return ret;  
     }
 
+#if defined(OS_WIN)
     // The return value is 0 if the variants are equal, 1 if this object is
     // greater than |var|, -1 if it is smaller.
     int Compare(const VARIANT& var, bool ignore_case = false) const {
@@ -475,6 +534,7 @@ class JUICE_API ScopedVariant {
       }
       return ret;
     }
+#endif // OS_WIN
 
     // Retrieves the pointer address.
     // Used to receive a VARIANT as an out argument (and take ownership).
@@ -525,13 +585,22 @@ class JUICE_API ScopedVariant {
     void Set(int64_t i64) {
       assert(!IsLeakableVarType(var_.vt));
       var_.vt = VT_I8;
+#if defined(OS_WIN)
       var_.llVal = i64;
+#else
+      var_.hVal.QuadPart = i64;
+#endif // OS_WIN
     }
     void Set(uint64_t ui64) {
       assert(!IsLeakableVarType(var_.vt));
       var_.vt = VT_UI8;
+#if defined(OS_WIN)
       var_.ullVal = ui64;
+#else
+      var_.uhVal.QuadPart = ui64;
+#endif // OS_WIN
     }
+#if defined(OS_WIN)
     void Set(float r32) {
       assert(!IsLeakableVarType(var_.vt));
       var_.vt = VT_R4;
@@ -542,6 +611,7 @@ class JUICE_API ScopedVariant {
       var_.vt = VT_R8;
       var_.dblVal = r64;
     }
+#endif // OS_WIN
     void Set(bool b) {
       assert(!IsLeakableVarType(var_.vt));
       var_.vt = VT_BOOL;
@@ -553,11 +623,12 @@ class JUICE_API ScopedVariant {
     // free the current value and assume ownership.
     void Set(const VARIANT& var) {
       assert(!IsLeakableVarType(var_.vt));
-      if (FAILED(::VariantCopy(&var_, &var))) {
+      if (FAILED(::VariantCopy(&var_, const_cast<VARIANT*>(&var)))) {
         var_.vt = VT_EMPTY;
       }
     }
 
+#if defined(OS_WIN)
     // COM object setters
     void Set(IDispatch* disp) {
       assert(!IsLeakableVarType(var_.vt));
@@ -592,6 +663,7 @@ class JUICE_API ScopedVariant {
       var_.vt = VT_DATE;
       var_.date = date;
     }
+#endif // OS_WIN
 
     // Allows const access to the contained variant without DCHECKs etc.
     // This support is necessary for the V_XYZ (e.g. V_BSTR) set of macros to
@@ -626,6 +698,7 @@ class JUICE_API ScopedVariant {
     // Used as a debug check to see if we're leaking anything.
     static bool IsLeakableVarType(VARTYPE vt) {
       bool leakable = false;
+#if defined(OS_WIN)
       switch (vt & VT_TYPEMASK) {
         case VT_BSTR:
         case VT_DISPATCH:
@@ -657,6 +730,18 @@ class JUICE_API ScopedVariant {
       if (!leakable && (vt & VT_ARRAY) != 0) {
         leakable = true;
       }
+#else
+      switch (vt) {
+        case VT_BSTR:
+        case VT_DISPATCH:
+        case VT_VARIANT:
+        case VT_UNKNOWN:
+        case VT_VOID:
+        case VT_FILETIME:
+          leakable = true;
+          break;
+      }
+#endif // OS_WIN
 
       return leakable;
     }
@@ -672,7 +757,11 @@ private:
     DISALLOW_COPY_AND_ASSIGN(ScopedVariant);
 };
 
+#if defined(OS_WIN)
 X_ABSL_COMDAT const VARIANT ScopedVariant::kEmptyVariant = {{{VT_EMPTY}}};
+#else
+X_ABSL_COMDAT const VARIANT ScopedVariant::kEmptyVariant = {VT_EMPTY};
+#endif // OS_WIN
 
 
 
@@ -483,7 +483,11 @@ OutStringType DoReplaceStringPlaceholders(const FormatStringType& format_string,
 namespace x {
 
 static inline char* strdup(const char* str) {
+#if defined(OS_WIN)
     return _strdup(str);
+#else
+    return ::strdup(str);
+#endif // OS_WIN
 }
 
 // C standard-library functions like "strncasecmp" and "snprintf" that aren't
@@ -495,14 +499,22 @@ static inline char* strdup(const char* str) {
 // the current locale; returns 0 if they are equal, 1 if s1 > s2, and -1 if
 // s2 > s1 according to a lexicographic comparison.
 static int strcasecmp(const char* s1, const char* s2) {
+#if defined(OS_WIN)
     return _stricmp(s1, s2);
+#else
+    return ::strcasecmp(s1, s2);
+#endif // OS_WIN
 }
 
 // Compares up to count characters of s1 and s2 without regard to case using
 // the current locale; returns 0 if they are equal, 1 if s1 > s2, and -1 if
 // s2 > s1 according to a lexicographic comparison.
 static int strncasecmp(const char* s1, const char* s2, size_t count) {
+#if defined(OS_WIN)
     return _strnicmp(s1, s2, count);
+#else
+    return ::strncasecmp(s1, s2, count);
+#endif // OS_WIN
 }
 
 // Same as strncmp but for char16 strings.
@@ -513,33 +525,41 @@ static int strncmp16(const char16* s1, const char16* s2, size_t count) {
 // Wrapper for vsnprintf that always null-terminates and always returns the
 // number of characters that would be in an untruncated formatted
 // string, even when truncation occurs.
-static inline int vsnprintf(char* buffer, size_t size, const char* format, va_list arguments) PRINTF_FORMAT(3, 0) {
+PRINTF_FORMAT(3, 0) static inline int vsnprintf(char* buffer, size_t size, const char* format, va_list arguments) {
+#if defined(OS_WIN)
     int length = _vsprintf_p(buffer, size, format, arguments);
     if (length < 0) {
         if (size > 0) buffer[0] = 0;
         return _vscprintf_p(format, arguments);
     }
     return length;
+#else
+    return ::vsnprintf(buffer, size, format, arguments);
+#endif // OS_WIN
 }
 
 // vswprintf always null-terminates, but when truncation occurs, it will either
 // return -1 or the number of characters that would be in an untruncated
 // formatted string.  The actual return value depends on the underlying
 // C library's vswprintf implementation.
-static int vswprintf(wchar_t* buffer, size_t size, const wchar_t* format, va_list arguments) WPRINTF_FORMAT(3, 0) {
+WPRINTF_FORMAT(3, 0) static int vswprintf(wchar_t* buffer, size_t size, const wchar_t* format, va_list arguments) {
+#if defined(OS_WIN)
     int length = _vswprintf_p(buffer, size, format, arguments);
     if (length < 0) {
         if (size > 0) buffer[0] = 0;
         return _vscwprintf_p(format, arguments);
     }
     return length;
+#else
+    return ::vswprintf(buffer, size, format, arguments);
+#endif // OS_WIN
 }
 
 // Some of these implementations need to be inlined.
 
 // We separate the declaration from the implementation of this inline
 // function just so the PRINTF_FORMAT works.
-static int snprintf(char* buffer, size_t size, const char* format, ...) PRINTF_FORMAT(3, 4) {
+PRINTF_FORMAT(3, 4) static int snprintf(char* buffer, size_t size, const char* format, ...) {
     va_list arguments;
     va_start(arguments, format);
     int result = vsnprintf(buffer, size, format, arguments);
@@ -549,7 +569,7 @@ static int snprintf(char* buffer, size_t size, const char* format, ...) PRINTF_F
 
 // We separate the declaration from the implementation of this inline
 // function just so the WPRINTF_FORMAT works.
-static int swprintf(wchar_t* buffer, size_t size, const wchar_t* format, ...) WPRINTF_FORMAT(3, 4) {
+WPRINTF_FORMAT(3, 4) static int swprintf(wchar_t* buffer, size_t size, const wchar_t* format, ...) {
     va_list arguments;
     va_start(arguments, format);
     int result = vswprintf(buffer, size, format, arguments);
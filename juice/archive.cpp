@@ -9,13 +9,26 @@
 #include "apis/archive.h"
 #include "apis/enumerate.h"
 #include "apis/basic_util.h"
+#include "apis/file_scanner.h"
 
+#include <algorithm>
 #include <array>
+#include <iterator>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include "guids.h"
 
+// The GUIDs of the handler interfaces are selectany on Windows. Elsewhere they
+// are plain extern "C" symbols, which are only defined once in guids.cpp.
+#if defined(OS_WIN)
 #include <InitGuid.h>
+#endif // OS_WIN
 #include "7zip/Archive/IArchive.h"
 
+#include "index_cache.h"
 #include "streaming.h"
 
 #if defined(COMPILER_MSVC)
@@ -35,7 +48,7 @@
 namespace juice {
 
 const GUID *FormatGUID(const juice::Format& format) {
-    static const std::array<const GUID*, 11> guid = {
+    static const std::array<const GUID*, 12> guid = {
         &CLSID_CFormat7z,
         &CLSID_CFormatZip,
         &CLSID_CFormatGZip,
@@ -46,6 +59,7 @@ const GUID *FormatGUID(const juice::Format& format) {
         &CLSID_CFormatCab,
         &CLSID_CFormatLzma,
         &CLSID_CFormatLzma86,
+        &CLSID_CFormatXz,
         &CLSID_CFormat7z,
     };
     size_t formats = enumerate_cast(format);
@@ -55,8 +69,8 @@ const GUID *FormatGUID(const juice::Format& format) {
 }
 
 const std::wstring FormatExtension(const juice::Format& format) {
-    static const std::array<const wchar_t*, 11> extension = {
-        L".7z", L".zip", L".gz", L".bz", L".rar", L".tar", L".iso", L".cab", L".lzma", L".lzma86",
+    static const std::array<const wchar_t*, 12> extension = {
+        L".7z", L".zip", L".gz", L".bz", L".rar", L".tar", L".iso", L".cab", L".lzma", L".lzma86", L".xz",
         L".zip",
     };
     size_t formats = enumerate_cast(format);
@@ -77,6 +91,196 @@ static ScopedComObject<IOutArchive> LoadEditor(Archive* archive, const juice::Fo
     return obj;
 }
 
+// The ISetProperties names of 7-Zip's command line, with the values they take.
+class CompressProperties {
+public:
+    CompressProperties() {}
+    ~CompressProperties() {
+        for (auto& value : values_) {
+            ::PropVariantClear(&value);
+        }
+    }
+
+    void Add(const wchar_t* name, uint32 number) {
+        PROPVARIANT value;
+        ::PropVariantInit(&value);
+        value.vt = VT_UI4;
+        value.ulVal = number;
+        names_.push_back(name);
+        values_.push_back(value);
+    }
+
+    void Add(const wchar_t* name, const std::wstring& text) {
+        PROPVARIANT value;
+        ::PropVariantInit(&value);
+        value.vt = VT_BSTR;
+        value.bstrVal = ::SysAllocString(text.c_str());
+        names_.push_back(name);
+        values_.push_back(value);
+    }
+
+    HRESULT Apply(IUnknown* handler) {
+        if (names_.empty()) return S_OK;
+        ScopedComObject<ISetProperties> properties;
+        auto result = handler->QueryInterface(IID_ISetProperties, properties.ReceiveVoid());
+        if (FAILED(result)) return result;
+        std::vector<const wchar_t*> names;
+        for (auto& name : names_) {
+            names.push_back(name.c_str());
+        }
+        return properties->SetProperties(names.data(), values_.data(), static_cast<UInt32>(values_.size()));
+    }
+
+private:
+    std::vector<std::wstring> names_;
+    std::vector<PROPVARIANT> values_;
+    DISALLOW_COPY_AND_ASSIGN(CompressProperties);
+};
+
+// The LZMA encoder of 7-Zip keeps about 11.5 bytes per dictionary byte with
+// the bt4 match finder. LZMA2 runs a coder for every two threads and reads
+// a block of four dictionaries ahead for each of them.
+static uint64 LzmaMemoryUsage(uint64 dictionary, uint threads, bool lzma2) {
+    const uint64 kCoderOverhead = 6 << 20;
+    uint64 coder = dictionary * 23 / 2 + kCoderOverhead;
+    if (!lzma2 || threads <= 2) return coder;
+    return (coder + dictionary * 4) * ((threads + 1) / 2);
+}
+
+// The long distance matching of the LZMA encoder keeps the window in the
+// buffer of the match finder and reads half of it ahead. LzmaEnc_AllocLdm()
+// sizes its table for the power of two at or above the window, 256 KiB to
+// 1 GB: an 8 byte entry for every 128 bytes of it, after 2 KiB of hash tables.
+static uint64 LdmMemoryUsage(uint64 window) {
+    uint64 span = 1 << 18;
+    while (span < window && span < (1 << 30)) {
+        span <<= 1;
+    }
+    return window * 3 / 2 + span / 128 * 8 + 256 * 8;
+}
+
+// Lowers the dictionary, then the threads, until an LZMA coder fits in
+// |options.memory_limit|.
+static void FitMemoryLimit(uint level, bool lzma2, CompressOptions* options) {
+    const uint32 kMinDictionary = 1 << 16;
+    uint64 dictionary = options->dictionary_size;
+    if (dictionary == 0) {
+        // LzmaEncProps_Normalize() picks these.
+        dictionary = level <= 5 ? (uint64(1) << (level * 2 + 14)) : (level == 6 ? (1 << 25) : (1 << 26));
+    }
+    uint threads = options->threads != 0 ? options->threads : (std::max)(1u, std::thread::hardware_concurrency());
+
+    auto fits = [&]() { return LzmaMemoryUsage(dictionary, threads, lzma2) <= options->memory_limit; };
+    if (fits()) return;
+    while (!fits() && dictionary > kMinDictionary) {
+        dictionary >>= 1;
+    }
+    while (!fits() && threads > 1) {
+        threads--;
+    }
+    options->dictionary_size = static_cast<uint32>(dictionary);
+    options->threads = threads;
+}
+
+// Hands |options| to the handler of |format|. Fails on an option the format
+// has no use for.
+static HRESULT ApplyCompressOptions(IOutArchive* archive, const juice::Format& format, CompressOptions options) {
+    static const std::array<uint, 5> levels = { 1, 5, 0, 7, 9 };
+    static const std::array<const wchar_t*, 8> methods = {
+        L"", L"Copy", L"LZMA", L"LZMA2", L"PPMd", L"BZip2", L"Deflate", L"Deflate64",
+    };
+    size_t level_index = enumerate_cast(options.level);
+    auto level = levels[(std::min)(level_index, levels.size() - 1)];
+    auto method = options.method;
+    if (method == Method::DEFAULT) {
+        if (format == Format::SEVENZ || format == Format::XZ) method = Method::LZMA2;
+        if (format == Format::ZIP || format == Format::GZIP) method = Method::DEFLATE;
+        if (format == Format::BZIP2) method = Method::BZIP2;
+    } else if (format != Format::SEVENZ && format != Format::ZIP) {
+        return E_INVALIDARG;
+    }
+
+    bool dedup = options.dedup_window != 0;
+    if (dedup && format != Format::SEVENZ) {
+        return E_INVALIDARG;
+    }
+
+    bool lzma = method == Method::LZMA || method == Method::LZMA2;
+    // Deflate, Deflate64 and Copy have no dictionary to set, and tar has no
+    // coder at all.
+    bool has_dictionary = lzma || method == Method::PPMD || method == Method::BZIP2;
+    if (options.dictionary_size != 0 && !has_dictionary) {
+        return E_INVALIDARG;
+    }
+
+    bool ldm = options.long_distance_window != 0;
+    if (ldm && !lzma) {
+        return E_INVALIDARG;
+    }
+
+    if (options.memory_limit != 0 && lzma) {
+        // The Dedup encoder holds its window besides the LZMA coder.
+        if (dedup) {
+            if (options.memory_limit <= options.dedup_window) return E_INVALIDARG;
+            options.memory_limit -= options.dedup_window;
+        }
+        if (ldm) {
+            uint64 usage = LdmMemoryUsage(options.long_distance_window);
+            if (options.memory_limit <= usage) return E_INVALIDARG;
+            options.memory_limit -= usage;
+        }
+        FitMemoryLimit(level, method == Method::LZMA2, &options);
+    }
+
+    CompressProperties properties;
+    properties.Add(L"x", level);
+    // A number would be taken as a power of two, the text is in bytes.
+    auto to_bytes = [](uint64 size) { return std::to_wstring(size) + L"b"; };
+    // With Dedup the method is the second coder of the 7z chain, and its
+    // properties take the index.
+    std::wstring prefix;
+    if (dedup) {
+        properties.Add(L"0", std::wstring(L"Dedup"));
+        properties.Add(L"0d", to_bytes(options.dedup_window));
+        prefix = L"1";
+    }
+    if (options.method != Method::DEFAULT || dedup) {
+        size_t method_index = enumerate_cast(method);
+        auto name = methods[(std::min)(method_index, methods.size() - 1)];
+        properties.Add(format == Format::SEVENZ ? (dedup ? L"1" : L"0") : L"m", std::wstring(name));
+    }
+    if (options.dictionary_size != 0) {
+        auto bytes = to_bytes(options.dictionary_size);
+        if (method == Method::PPMD) {
+            properties.Add((prefix + L"mem").c_str(), bytes);
+        } else {
+            properties.Add((prefix + L"d").c_str(), bytes);
+        }
+    }
+    if (ldm) {
+        properties.Add((prefix + L"ldm").c_str(), to_bytes(options.long_distance_window));
+    }
+    if (options.solid_block_size != 0 && format == Format::SEVENZ) {
+        properties.Add(L"s", std::to_wstring(options.solid_block_size) + L"b");
+    }
+    if (options.threads != 0) {
+        properties.Add(L"mt", options.threads);
+    }
+    return properties.Apply(archive);
+}
+
+// Opens |path| for the handlers, through a memory mapping when |mapped|.
+static ScopedComObject<IInStream> OpenInStream(const std::wstring& path, bool mapped) {
+    if (mapped) {
+        std::unique_ptr<x::MemoryMappedFile> file(new x::MemoryMappedFile);
+        if (!file->Initialize(path)) return nullptr;
+        return ScopedComObject<IInStream>(new juice::MappedFileStreamming(std::move(file)));
+    }
+    auto file = x::Open(path, true);
+    if (!file) return nullptr;
+    return ScopedComObject<IInStream>(new juice::ReadFileStreamming(file));
+}
+
 Archive::Archive(const std::wstring& path) : Archive(std::make_shared<x::DynamicLibrary>(path)) {
 }
 
@@ -86,65 +290,342 @@ Archive::Archive(const std::shared_ptr<x::DynamicLibrary>& library) : CreateObje
 
 Archive::~Archive() {}
 
-bool Archive::Open(const std::wstring& path, const juice::Format& format, const OpenCallback& callback) {
-    if (path.empty()) return false;
-    auto file = x::Open(path, true);
-    if (!file) return false;
-    auto archive = LoadReader(this, format);
-    if (!archive) return false;
+static ScopedComObject<IInArchive> OpenReader(Archive* archive, const std::wstring& path, const juice::Format& format) {
+    auto streamming = OpenInStream(path, archive->mapped_input());
+    if (!streamming) return nullptr;
+    auto reader = LoadReader(archive, format);
+    if (!reader) return nullptr;
 
-    ScopedComObject<juice::ReadFileStreamming> streamming(new juice::ReadFileStreamming(file));
     ScopedComObject<juice::ArchiveOpenning> openning(new juice::ArchiveOpenning);
-    auto result = archive->Open(streamming, 0, openning);
-    if (FAILED(result)) return false;
-    {
-        ScopedPropVariant prop;
-        archive->GetArchiveProperty(kpidPath, prop.Receive());
-        if (prop.get().vt == VT_BSTR) {
-            callback(prop.get().bstrVal, -1);
+    auto result = reader->Open(streamming, 0, openning);
+    if (FAILED(result)) return nullptr;
+    return reader;
+}
+
+static uint64 GetNumber(const PROPVARIANT& value) {
+    switch (value.vt) {
+    case VT_UI8: return value.uhVal.QuadPart;
+    case VT_UI4: return value.ulVal;
+    case VT_UI2: return value.uiVal;
+    case VT_UI1: return value.bVal;
+    default: return 0;
+    }
+}
+
+static void SetBit(std::vector<uint64>* bits, uint32 index) {
+    (*bits)[index / 64] |= uint64(1) << (index % 64);
+}
+
+static void ResetListing(uint32 count, uint32 columns, ArchiveListing* listing) {
+    size_t words = (static_cast<size_t>(count) + 63) / 64;
+    listing->count = count;
+    listing->columns = columns;
+    listing->paths.clear();
+    listing->path_offsets.assign((columns & ArchiveListing::PATH) ? count + size_t(1) : 0, 0);
+    listing->sizes.assign((columns & ArchiveListing::SIZE) ? count : 0, 0);
+    listing->packed_sizes.assign((columns & ArchiveListing::PACKED_SIZE) ? count : 0, 0);
+    listing->last_modified.assign((columns & ArchiveListing::LAST_MODIFIED) ? count : 0, FILETIME());
+    listing->attributes.assign((columns & ArchiveListing::ATTRIBUTES) ? count : 0, 0);
+    listing->crcs.assign((columns & ArchiveListing::CRC) ? count : 0, 0);
+    listing->has_crc.assign((columns & ArchiveListing::CRC) ? words : 0, 0);
+    listing->directories.assign((columns & ArchiveListing::DIRECTORY) ? words : 0, 0);
+}
+
+// Asks the handler for the columns wanted only, through one PROPVARIANT. The
+// paths are copied out of their BSTR into the shared string.
+static bool ListItems(IInArchive* archive, uint32 columns, ArchiveListing* listing) {
+    UInt32 count = 0;
+    if (FAILED(archive->GetNumberOfItems(&count))) return false;
+    ResetListing(count, columns, listing);
+
+    ScopedPropVariant prop;
+    auto get = [archive, &prop](UInt32 index, PROPID id) -> const PROPVARIANT& {
+        prop.Reset();
+        archive->GetProperty(index, id, prop.Receive());
+        return prop.get();
+    };
+    for (UInt32 i = 0; i < count; i++) {
+        if (columns & ArchiveListing::PATH) {
+            listing->path_offsets[i] = listing->paths.size();
+            auto& value = get(i, kpidPath);
+            if (value.vt == VT_BSTR) listing->paths.append(value.bstrVal, ::SysStringLen(value.bstrVal));
+        }
+        if (columns & ArchiveListing::SIZE) listing->sizes[i] = GetNumber(get(i, kpidSize));
+        if (columns & ArchiveListing::PACKED_SIZE) listing->packed_sizes[i] = GetNumber(get(i, kpidPackSize));
+        if (columns & ArchiveListing::LAST_MODIFIED) {
+            auto& value = get(i, kpidMTime);
+            if (value.vt == VT_FILETIME) listing->last_modified[i] = value.filetime;
+        }
+        if (columns & ArchiveListing::ATTRIBUTES) {
+            listing->attributes[i] = static_cast<uint32>(GetNumber(get(i, kpidAttrib)));
+        }
+        if (columns & ArchiveListing::CRC) {
+            auto& value = get(i, kpidCRC);
+            if (value.vt == VT_UI4) {
+                listing->crcs[i] = value.ulVal;
+                SetBit(&listing->has_crc, i);
+            }
+        }
+        if (columns & ArchiveListing::DIRECTORY) {
+            auto& value = get(i, kpidIsDir);
+            if (value.vt == VT_BOOL && value.boolVal != VARIANT_FALSE) SetBit(&listing->directories, i);
         }
     }
+    if (columns & ArchiveListing::PATH) listing->path_offsets[count] = listing->paths.size();
+    return true;
+}
 
-    UInt32 num = 0;
-    archive->GetNumberOfItems(&num);
-    for (UInt32 i = 0; i < num; i++) {
-        ScopedPropVariant prop;
-        archive->GetProperty(i, kpidSize, prop.Receive());
-        int size = prop.get().intVal;
-        if (prop.get().vt == VT_BSTR) {
-            callback(prop.get().bstrVal, size);
+// The same from the records of the sidecar, without the handler.
+static void ListItems(const ArchiveIndex& index, uint32 columns, ArchiveListing* listing) {
+    uint32 count = index.size();
+    ResetListing(count, columns, listing);
+    for (uint32 i = 0; i < count; i++) {
+        const ArchiveIndex::Record& record = index.record(i);
+        if (columns & ArchiveListing::PATH) {
+            listing->path_offsets[i] = listing->paths.size();
+            index.AppendName(i, &listing->paths);
+        }
+        if (columns & ArchiveListing::SIZE) listing->sizes[i] = record.size;
+        if (columns & ArchiveListing::PACKED_SIZE) listing->packed_sizes[i] = record.packed_size;
+        if (columns & ArchiveListing::LAST_MODIFIED) listing->last_modified[i] = record.last_modified;
+        if (columns & ArchiveListing::ATTRIBUTES) listing->attributes[i] = record.attributes;
+        if ((columns & ArchiveListing::CRC) && (record.flags & ArchiveIndex::kHasCrc)) {
+            listing->crcs[i] = record.crc;
+            SetBit(&listing->has_crc, i);
+        }
+        if ((columns & ArchiveListing::DIRECTORY) && (record.flags & ArchiveIndex::kDirectory)) {
+            SetBit(&listing->directories, i);
         }
     }
-    archive->Close();
+    if (columns & ArchiveListing::PATH) listing->path_offsets[count] = listing->paths.size();
+}
+
+// Lists |path| from its sidecar when the index cache is on, from the handler
+// otherwise. |archive_path| takes the path the handler reports for the
+// archive itself, the sidecar has none.
+static bool ListArchive(Archive* archive, const std::wstring& path, const juice::Format& format, uint32 columns,
+    ArchiveListing* listing, std::wstring* archive_path) {
+    ScopedComObject<IInArchive> reader;
+    if (archive->index_cache()) {
+        ArchiveIndex index;
+        if (!index.Load(path)) {
+            reader = OpenReader(archive, path, format);
+            if (!reader) return false;
+            // Without a sidecar, in a read-only directory, it is listed below.
+            index.Build(reader, path);
+        }
+        if (index.is_loaded()) {
+            if (reader) reader->Close();
+            ListItems(index, columns, listing);
+            return true;
+        }
+    }
+
+    if (!reader) reader = OpenReader(archive, path, format);
+    if (!reader) return false;
+    if (archive_path != nullptr) {
+        ScopedPropVariant prop;
+        reader->GetArchiveProperty(kpidPath, prop.Receive());
+        if (prop.get().vt == VT_BSTR) *archive_path = prop.get().bstrVal;
+    }
+    bool listed = ListItems(reader, columns, listing);
+    reader->Close();
+    return listed;
+}
+
+bool Archive::Open(const std::wstring& path, const juice::Format& format, const OpenCallback& callback) {
+    if (path.empty()) return false;
+    ArchiveListing listing;
+    std::wstring archive_path;
+    if (!ListArchive(this, path, format, ArchiveListing::PATH | ArchiveListing::SIZE, &listing, &archive_path)) {
+        return false;
+    }
+    if (!archive_path.empty()) callback(archive_path, static_cast<ULONGLONG>(-1));
+
+    std::wstring name;
+    for (uint32 i = 0; i < listing.count; i++) {
+        name.assign(listing.paths, listing.path_offsets[i], listing.path_offsets[i + 1] - listing.path_offsets[i]);
+        callback(name, listing.sizes[i]);
+    }
     return true;
 }
 
+bool Archive::List(const std::wstring& path, const juice::Format& format, uint32 columns, ArchiveListing* listing) {
+    if (path.empty() || listing == nullptr) return false;
+    return ListArchive(this, path, format, columns, listing, nullptr);
+}
+
 bool Archive::Extract(const std::wstring& path, const juice::Format& format, const std::wstring& root, Progress* callback) {
     if (path.empty()) return false;
 
-    auto file = x::Open(path, true);
-    if (!file) return false;
+    auto streamming = OpenInStream(path, mapped_input_);
+    if (!streamming) return false;
 
     auto archive = LoadReader(this, format);
     if (!archive) return false;
 
-    ScopedComObject<juice::ReadFileStreamming> streamming(new juice::ReadFileStreamming(file));
     ScopedComObject<juice::ArchiveOpenning> openning(new juice::ArchiveOpenning);
     auto result = archive->Open(streamming, 0, openning);
     if (FAILED(result)) return false;
 
-    ScopedComObject<ArchiveExtractting> extractting(new ArchiveExtractting(archive, root, callback));
+    std::unique_ptr<WriteBehind> writer;
+    if (write_behind_ != 0) writer.reset(new WriteBehind(write_behind_));
+
+    ScopedComObject<ArchiveExtractting> extractting(new ArchiveExtractting(archive, root, callback, writer.get()));
     result = archive->Extract(nullptr, -1, FALSE, extractting);
+    if (writer && !writer->Flush()) return false;
     if (FAILED(result)) return false;
 
     archive->Close();
     return true;
 }
 
+namespace {
+
+// Serializes the progress notifications of the extraction workers.
+class LockedProgress : public Progress {
+public:
+    explicit LockedProgress(Progress* callback) : callback_(callback) {}
+
+    void StartProgress(const std::wstring &path, const ULONGLONG &bytes) override {
+        if (callback_ == nullptr) return;
+        std::lock_guard<std::mutex> lock(lock_);
+        callback_->StartProgress(path, bytes);
+    }
+
+    void Progressed(const std::wstring &path, const ULONGLONG &bytes) override {
+        if (callback_ == nullptr) return;
+        std::lock_guard<std::mutex> lock(lock_);
+        callback_->Progressed(path, bytes);
+    }
+
+private:
+    std::mutex lock_;
+    Progress* callback_ = nullptr;
+};
+
+} // namespace
+
+// Groups the items into units that decode independently of each other: the
+// items of one 7z folder (kpidBlock) stay together, any other item is a unit
+// of its own.
+static std::vector<std::vector<UInt32>> GetExtractUnits(IInArchive* archive) {
+    std::vector<std::vector<UInt32>> units;
+    std::unordered_map<UInt32, size_t> blocks;
+    UInt32 num = 0;
+    archive->GetNumberOfItems(&num);
+    for (UInt32 i = 0; i < num; i++) {
+        ScopedPropVariant prop;
+        archive->GetProperty(i, kpidBlock, prop.Receive());
+        if (prop.get().vt != VT_UI4) {
+            units.push_back({ i });
+            continue;
+        }
+        auto block = blocks.emplace(prop.get().ulVal, units.size());
+        if (block.second) units.emplace_back();
+        units[block.first->second].push_back(i);
+    }
+    return units;
+}
+
+// A gzip archive is one item, its handler decodes it on |threads| threads
+// ("mt"). With the index of SetGzipIndex() those take the spans between the
+// access points, the first extraction records it.
+static bool ExtractGzip(Archive* archive, const std::wstring& path, const std::wstring& root, Progress* callback, uint threads) {
+    auto reader = OpenReader(archive, path, juice::Format::GZIP);
+    if (!reader) return false;
+    CompressProperties properties;
+    properties.Add(L"mt", threads);
+    if (FAILED(properties.Apply(reader))) return false;
+
+    ScopedComObject<IArchiveStreamIndex> index;
+    bool record = false;
+    if (archive->gzip_index() != 0 &&
+        SUCCEEDED(reader.get()->QueryInterface(IID_IArchiveStreamIndex, index.ReceiveVoid())) &&
+        !LoadStreamIndex(reader, path)) {
+        index->SetIndexSpacing(archive->gzip_index());
+        record = true;
+    }
+
+    std::unique_ptr<WriteBehind> writer;
+    if (archive->write_behind() != 0) writer.reset(new WriteBehind(archive->write_behind()));
+    ScopedComObject<ArchiveExtractting> extractting(new ArchiveExtractting(reader, root, callback, writer.get()));
+    auto result = reader->Extract(nullptr, -1, FALSE, extractting);
+    if (writer && !writer->Flush()) return false;
+    if (FAILED(result)) return false;
+    // The handler has no index when the archive did not decode.
+    if (record) SaveStreamIndex(reader, path);
+
+    reader->Close();
+    return true;
+}
+
+bool Archive::Extract(const std::wstring& path, const juice::Format& format, const std::wstring& root, Progress* callback, uint threads) {
+    if (path.empty()) return false;
+    if (threads == 0) threads = (std::max)(1u, std::thread::hardware_concurrency());
+    if (format == juice::Format::GZIP && threads > 1) return ExtractGzip(this, path, root, callback, threads);
+
+    std::vector<std::vector<UInt32>> units;
+    {
+        auto archive = OpenReader(this, path, format);
+        if (!archive) return false;
+        units = GetExtractUnits(archive);
+        archive->Close();
+    }
+    if (units.empty()) return true;
+
+    threads = static_cast<uint>((std::min)(static_cast<size_t>(threads), units.size()));
+    if (threads == 1) return Extract(path, format, root, callback);
+
+    // The workers take a few units at a time, so that many small zip entries
+    // do not cost an IInArchive::Extract call each while the tail still balances.
+    const size_t batch = (std::max)(size_t(1), units.size() / (threads * 8));
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    LockedProgress progress(callback);
+    std::unique_ptr<WriteBehind> writer;
+    if (write_behind_ != 0) writer.reset(new WriteBehind(write_behind_));
+
+    auto worker = [&]() {
+        auto archive = OpenReader(this, path, format);
+        if (!archive) {
+            failed = true;
+            return;
+        }
+        ScopedComObject<ArchiveExtractting> extractting(new ArchiveExtractting(archive, root, &progress, writer.get()));
+        std::vector<UInt32> indices;
+        while (!failed) {
+            size_t first = next.fetch_add(batch);
+            if (first >= units.size()) break;
+            size_t last = (std::min)(first + batch, units.size());
+
+            indices.clear();
+            for (size_t i = first; i < last; i++) {
+                indices.insert(indices.end(), units[i].begin(), units[i].end());
+            }
+            std::sort(indices.begin(), indices.end());
+            auto result = archive->Extract(indices.data(), static_cast<UInt32>(indices.size()), FALSE, extractting);
+            if (FAILED(result)) failed = true;
+        }
+        archive->Close();
+    };
+
+    std::vector<std::thread> workers;
+    for (uint i = 0; i < threads; i++) {
+        workers.emplace_back(worker);
+    }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    if (writer && !writer->Flush()) return false;
+    return !failed;
+}
+
 bool Archive::Compress(const std::wstring& path, const juice::Format& format, const std::vector<x::PlatformFileInfo>& file_list, Progress* callback) {
     if (path.empty() || file_list.empty()) return false;
     auto archive = LoadEditor(this, format);
     if (!archive) return false;
+    if (FAILED(ApplyCompressOptions(archive, format, compress_options_))) return false;
 
     auto file = x::Open(path, false);
     if (!file) return false;
@@ -157,6 +638,300 @@ bool Archive::Compress(const std::wstring& path, const juice::Format& format, co
     return true;
 }
 
+bool Archive::Compress(const std::wstring& path, const juice::Format& format, const std::wstring& root, Progress* callback, uint threads) {
+    if (path.empty() || root.empty()) return false;
+    auto archive = LoadEditor(this, format);
+    if (!archive) return false;
+    if (FAILED(ApplyCompressOptions(archive, format, compress_options_))) return false;
+
+    // IOutArchive::UpdateItems wants the number of items up front, and the
+    // handlers go through all of them before the first byte is compressed.
+    std::vector<x::PlatformFileInfo> file_list;
+    x::ParallelFileScanner scanner(threads);
+    auto scanned = scanner.Scan(root, x::FileEnumerator::FILES | x::FileEnumerator::DIRECTORIES,
+        [&file_list](std::vector<x::PlatformFileInfo>& files) {
+        std::move(files.begin(), files.end(), std::back_inserter(file_list));
+    });
+    if (!scanned || file_list.empty()) return false;
+    auto items = static_cast<UInt32>(file_list.size());
+
+    auto file = x::Open(path, false);
+    if (!file) return false;
+
+    ScopedComObject<juice::WriteFileStreamming> streamming(new juice::WriteFileStreamming(file));
+    ScopedComObject<ArchiveCompressing> compressing(new ArchiveCompressing(std::move(file_list), path, callback, root));
+
+    auto result = archive->UpdateItems(streamming, items, compressing);
+    if (FAILED(result)) return false;
+    return true;
+}
+
+bool Archive::Compress(const std::vector<CompressItem>& items, const juice::Format& format, const CompressSink& sink, Progress* callback) {
+    if (items.empty() || !sink) return false;
+    // IOutArchive of 7z and zip wants an IOutStream, and seeks back to the
+    // start header once everything is written.
+    if (format == Format::SEVENZ || format == Format::ZIP) {
+        std::vector<uint8_t> buffer;
+        if (!Compress(items, format, &buffer, callback)) return false;
+        return sink(buffer.data(), buffer.size());
+    }
+
+    auto archive = LoadEditor(this, format);
+    if (!archive) return false;
+    if (FAILED(ApplyCompressOptions(archive, format, compress_options_))) return false;
+
+    ScopedComObject<SinkStreamming> streamming(new SinkStreamming(sink));
+    ScopedComObject<ItemCompressing> compressing(new ItemCompressing(items, callback));
+
+    auto result = archive->UpdateItems(streamming, static_cast<UInt32>(items.size()), compressing);
+    if (FAILED(result)) return false;
+    return true;
+}
+
+bool Archive::Compress(const std::vector<CompressItem>& items, const juice::Format& format, std::vector<uint8_t>* buffer, Progress* callback) {
+    if (items.empty() || buffer == nullptr) return false;
+    auto archive = LoadEditor(this, format);
+    if (!archive) return false;
+    if (FAILED(ApplyCompressOptions(archive, format, compress_options_))) return false;
+
+    buffer->clear();
+    ScopedComObject<MemoryOutStreamming> streamming(new MemoryOutStreamming(buffer));
+    ScopedComObject<ItemCompressing> compressing(new ItemCompressing(items, callback));
+
+    auto result = archive->UpdateItems(streamming, static_cast<UInt32>(items.size()), compressing);
+    if (FAILED(result)) return false;
+    return true;
+}
+
+struct ArchiveReader::State {
+    // Opened for the first extraction when |index| is loaded.
+    ScopedComObject<IInArchive> archive;
+    ArchiveIndex index;
+    std::wstring path;
+    juice::Format format;
+    UInt32 count = 0;
+    std::unordered_map<std::wstring, uint32> items;
+    // Gzip only, set by the first Read() once the handler has its index.
+    ScopedComObject<IArchiveStreamIndex> stream_index;
+};
+
+// The spans of the index Read() records when the Archive keeps none.
+static const uint64 kReadIndexSpacing = 1 << 20;
+
+// Both separators index the same, the handlers store the native one.
+static std::wstring GetReaderKey(std::wstring name) {
+    std::replace(name.begin(), name.end(), L'\\', L'/');
+    return name;
+}
+
+ArchiveReader::ArchiveReader(Archive* archive) : archive_(archive) {}
+
+ArchiveReader::~ArchiveReader() {
+    Close();
+}
+
+bool ArchiveReader::Open(const std::wstring& path, const juice::Format& format) {
+    Close();
+    std::lock_guard<std::mutex> lock(lock_);
+    std::unique_ptr<State> state(new State);
+    state->path = path;
+    state->format = format;
+    if (archive_->index_cache() && !state->index.Load(path)) {
+        state->archive = OpenReader(archive_, path, format);
+        if (!state->archive) return false;
+        state->index.Build(state->archive, path);
+    }
+
+    // The sidecar has its own table of the names. Otherwise a later item of
+    // the same name replaces the earlier one, as it would on extraction.
+    if (state->index.is_loaded()) {
+        state->count = state->index.size();
+    } else {
+        if (!state->archive) state->archive = OpenReader(archive_, path, format);
+        if (!state->archive) return false;
+        state->archive->GetNumberOfItems(&state->count);
+        state->items.reserve(state->count);
+        for (UInt32 i = 0; i < state->count; i++) {
+            ScopedPropVariant prop;
+            state->archive->GetProperty(i, kpidPath, prop.Receive());
+            if (prop.get().vt != VT_BSTR) continue;
+            state->items[GetReaderKey(prop.get().bstrVal)] = i;
+        }
+    }
+    state_ = std::move(state);
+    return true;
+}
+
+void ArchiveReader::Close() {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!state_) return;
+    if (state_->archive) state_->archive->Close();
+    state_.reset();
+}
+
+bool ArchiveReader::is_open() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return !!state_;
+}
+
+uint32 ArchiveReader::GetNumberOfItems() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return state_ ? state_->count : 0;
+}
+
+bool ArchiveReader::Find(const std::wstring& name, uint32* index) const {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!state_) return false;
+    if (state_->index.is_loaded()) return state_->index.Find(name, index);
+    auto it = state_->items.find(GetReaderKey(name));
+    if (it == state_->items.end()) return false;
+    if (index != nullptr) *index = it->second;
+    return true;
+}
+
+std::wstring ArchiveReader::GetName(uint32 index) const {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!state_ || index >= state_->count) return L"";
+    if (state_->index.is_loaded()) return state_->index.GetName(index);
+    ScopedPropVariant prop;
+    state_->archive->GetProperty(index, kpidPath, prop.Receive());
+    return prop.get().vt == VT_BSTR ? prop.get().bstrVal : L"";
+}
+
+uint64 ArchiveReader::GetSize(uint32 index) const {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!state_ || index >= state_->count) return 0;
+    if (state_->index.is_loaded()) return state_->index.record(index).size;
+    ScopedPropVariant prop;
+    state_->archive->GetProperty(index, kpidSize, prop.Receive());
+    return GetNumber(prop.get());
+}
+
+bool ArchiveReader::IsDirectory(uint32 index) const {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!state_ || index >= state_->count) return false;
+    if (state_->index.is_loaded()) return state_->index.IsDirectory(index);
+    ScopedPropVariant prop;
+    state_->archive->GetProperty(index, kpidIsDir, prop.Receive());
+    return prop.get().vt == VT_BOOL && prop.get().boolVal != VARIANT_FALSE;
+}
+
+bool ArchiveReader::Extract(uint32 index, std::vector<uint8_t>* buffer) {
+    if (buffer == nullptr) return false;
+    buffer->clear();
+    buffer->reserve(static_cast<size_t>(GetSize(index)));
+    return Extract(std::vector<uint32>(1, index), [buffer](uint32, const void* data, size_t size) {
+        auto bytes = static_cast<const uint8_t*>(data);
+        buffer->insert(buffer->end(), bytes, bytes + size);
+        return true;
+    });
+}
+
+bool ArchiveReader::Extract(const std::vector<uint32>& indices, std::vector<std::vector<uint8_t>>* buffers) {
+    if (buffers == nullptr) return false;
+    buffers->assign(indices.size(), std::vector<uint8_t>());
+    std::unordered_map<uint32, size_t> positions;
+    for (size_t i = 0; i < indices.size(); i++) {
+        positions.emplace(indices[i], i);
+    }
+    auto extracted = Extract(indices, [buffers, &positions](uint32 index, const void* data, size_t size) {
+        auto& buffer = (*buffers)[positions[index]];
+        auto bytes = static_cast<const uint8_t*>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+        return true;
+    });
+    if (!extracted) return false;
+    // An index asked for twice is only decoded once.
+    for (size_t i = 0; i < indices.size(); i++) {
+        auto first = positions[indices[i]];
+        if (first != i) (*buffers)[i] = (*buffers)[first];
+    }
+    return true;
+}
+
+bool ArchiveReader::Extract(const std::vector<uint32>& indices, const ExtractSink& sink) {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!state_ || !sink) return false;
+    if (indices.empty()) return true;
+
+    // The handlers want the indices sorted, each one once, and do not check
+    // the range.
+    std::vector<UInt32> items(indices.begin(), indices.end());
+    std::sort(items.begin(), items.end());
+    items.erase(std::unique(items.begin(), items.end()), items.end());
+    if (items.back() >= state_->count) return false;
+    if (!state_->archive) {
+        state_->archive = OpenReader(archive_, state_->path, state_->format);
+        if (!state_->archive) return false;
+    }
+
+    ScopedComObject<ItemExtractting> extractting(new ItemExtractting(sink));
+    auto result = state_->archive->Extract(items.data(), static_cast<UInt32>(items.size()), FALSE, extractting);
+    if (FAILED(result)) return false;
+    return !extractting->failed();
+}
+
+bool ArchiveReader::Read(uint32 index, uint64 offset, void* data, size_t size, size_t* read) {
+    if (read != nullptr) *read = 0;
+    if (data == nullptr && size != 0) return false;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (!state_ || index >= state_->count) return false;
+        if (state_->format == juice::Format::GZIP) {
+            if (!state_->archive) {
+                state_->archive = OpenReader(archive_, state_->path, state_->format);
+                if (!state_->archive) return false;
+            }
+            if (!state_->stream_index) {
+                ScopedComObject<IArchiveStreamIndex> stream_index;
+                auto result = state_->archive.get()->QueryInterface(IID_IArchiveStreamIndex, stream_index.ReceiveVoid());
+                if (FAILED(result)) return false;
+                // A test pass over the archive records the index.
+                const bool persist = archive_->gzip_index() != 0;
+                if (!persist || !LoadStreamIndex(state_->archive, state_->path)) {
+                    stream_index->SetIndexSpacing(persist ? archive_->gzip_index() : kReadIndexSpacing);
+                    ExtractSink sink = [](uint32, const void*, size_t) { return true; };
+                    ScopedComObject<ItemExtractting> extractting(new ItemExtractting(sink));
+                    result = state_->archive->Extract(nullptr, static_cast<UInt32>(-1), TRUE, extractting);
+                    if (FAILED(result) || extractting->failed()) return false;
+                    if (persist) SaveStreamIndex(state_->archive, state_->path);
+                }
+                state_->stream_index = stream_index;
+            }
+
+            size_t done = 0;
+            while (done < size) {
+                auto chunk = static_cast<UInt32>((std::min)(size - done, size_t(1) << 30));
+                UInt32 processed = 0;
+                if (state_->stream_index->ReadAt(offset + done, static_cast<uint8_t*>(data) + done, chunk, &processed) != S_OK) {
+                    return false;
+                }
+                done += processed;
+                if (processed < chunk) break;
+            }
+            if (read != nullptr) *read = done;
+            return true;
+        }
+    }
+
+    // The item is decoded from its start, the sink stops it once the range is
+    // copied.
+    size_t done = 0;
+    uint64 position = 0;
+    auto extracted = Extract(std::vector<uint32>(1, index), [&](uint32, const void* chunk, size_t length) {
+        if (position + length > offset && done < size) {
+            auto skip = static_cast<size_t>(offset > position ? offset - position : 0);
+            auto count = (std::min)(length - skip, size - done);
+            std::memcpy(static_cast<uint8_t*>(data) + done, static_cast<const uint8_t*>(chunk) + skip, count);
+            done += count;
+        }
+        position += length;
+        return done < size;
+    });
+    if (read != nullptr) *read = done;
+    return extracted || done == size;
+}
+
 
 
 
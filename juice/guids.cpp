@@ -1,4 +1,9 @@
 #include "stdafx.h"
+#if defined(_WIN32)
 #include <atlbase.h>
 #include <InitGuid.h>
+#else
+// Also defines IID_IUnknown, there is no uuid library to link outside of Windows.
+#include "Common/MyInitGuid.h"
+#endif // _WIN32
 #include "guids.h"
\ No newline at end of file
@@ -31,6 +31,10 @@ DEFINE_GUID(IID_IOutStream, 0x23170F69, 0x40C1, 0x278A, 0x00, 0x00, 0x00, 0x03,
 // {23170F69-40C1-278A-0000-000300060000}
 DEFINE_GUID(IID_IStreamGetSize, 0x23170F69, 0x40C1, 0x278A, 0x00, 0x00, 0x00, 0x03, 0x00, 0x06, 0x00, 0x00);
 
+// juice: IStreamGetBuffer, outside of the ids used by 7-Zip.
+// {23170F69-40C1-278A-0000-000300800000}
+DEFINE_GUID(IID_IStreamGetBuffer, 0x23170F69, 0x40C1, 0x278A, 0x00, 0x00, 0x00, 0x03, 0x00, 0x80, 0x00, 0x00);
+
 // ICoder.h
 // {23170F69-40C1-278A-0000-000400040000}
 DEFINE_GUID(IID_ICompressProgressInfo, 0x23170F69, 0x40C1, 0x278A, 0x00, 0x00, 0x00, 0x04, 0x00, 0x04, 0x00, 0x00);
@@ -48,6 +52,9 @@ DEFINE_GUID(IID_ICryptoGetTextPassword2, 0x23170F69, 0x40C1, 0x278A, 0x00, 0x00,
 // {23170F69-40C1-278A-0000-000600030000}
 DEFINE_GUID(IID_ISetProperties, 0x23170F69, 0x40C1, 0x278A, 0x00, 0x00, 0x00, 0x06, 0x00, 0x03, 0x00, 0x00);
 
+// {23170F69-40C1-278A-0000-000600090000}
+DEFINE_GUID(IID_IArchiveStreamIndex, 0x23170F69, 0x40C1, 0x278A, 0x00, 0x00, 0x00, 0x06, 0x00, 0x09, 0x00, 0x00);
+
 // {23170F69-40C1-278A-0000-000600100000}
 DEFINE_GUID(IID_IArchiveOpenCallback, 0x23170F69, 0x40C1, 0x278A, 0x00, 0x00, 0x00, 0x06, 0x00, 0x10, 0x00, 0x00);
 
@@ -89,6 +96,9 @@ DEFINE_GUID(CLSID_CFormatLzma, 0x23170F69, 0x40C1, 0x278A, 0x10, 0x00, 0x00, 0x0
 // {23170F69-40C1-278A-1000-0001100B0000}
 DEFINE_GUID(CLSID_CFormatLzma86, 0x23170F69, 0x40C1, 0x278A, 0x10, 0x00, 0x00, 0x01, 0x10, 0x0B, 0x00, 0x00);
 
+// {23170F69-40C1-278A-1000-0001100C0000}
+DEFINE_GUID(CLSID_CFormatXz, 0x23170F69, 0x40C1, 0x278A, 0x10, 0x00, 0x00, 0x01, 0x10, 0x0C, 0x00, 0x00);
+
 // {23170F69-40C1-278A-1000-000110E70000}
 DEFINE_GUID(CLSID_CFormatIso, 0x23170F69, 0x40C1, 0x278A, 0x10, 0x00, 0x00, 0x01, 0x10, 0xE7, 0x00, 0x00);
 
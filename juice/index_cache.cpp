@@ -0,0 +1,403 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 The Authors of ANT(http://ant.sh). All Rights Reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+////////////////////////////////////////////////////////////////////////////////
+#include "stdafx.h"
+#include "index_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <codecvt>
+#include <cstring>
+#include <locale>
+#include <stdexcept>
+#include <vector>
+
+#include "apis/scoped_object.h"
+#include "guids.h"
+#include "7zip/Archive/IArchive.h"
+#include "streaming.h"
+
+namespace juice {
+
+namespace {
+
+const char kMagic[8] = { 'J', 'U', 'I', 'C', 'E', 'I', 'D', 'X' };
+const uint32 kVersion = 2;
+// The sidecar of the gzip access points has the same header, the blob of the
+// handler follows it.
+const char kStreamIndexMagic[8] = { 'J', 'U', 'I', 'C', 'E', 'G', 'Z', 'I' };
+const uint32 kStreamIndexVersion = 1;
+// The bytes hashed at either end of the archive.
+const size_t kHashedBytes = 64 << 10;
+
+struct SidecarHeader {
+    char magic[8];
+    uint32 version;
+    uint32 count;
+    uint64 archive_size;
+    uint64 archive_time;
+    uint64 header_hash;
+    // The UTF-8 path of the archive follows the header, padded to 8 bytes.
+    uint32 path_length;
+    uint32 names_size;
+    // A power of two, at least twice the items.
+    uint32 slot_count;
+    uint32 reserved;
+};
+
+static_assert(sizeof(SidecarHeader) == 56, "the sidecar header is 56 bytes");
+static_assert(sizeof(ArchiveIndex::Record) == 56, "a sidecar record is 56 bytes");
+
+size_t Align(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+#if defined(OS_WIN)
+using Utf8Converter = std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>;
+#else
+using Utf8Converter = std::wstring_convert<std::codecvt_utf8<wchar_t>>;
+#endif // OS_WIN
+
+// Most names are ASCII, those skip the converter. Fails on a name that has
+// no UTF-8 form, an unpaired surrogate.
+bool ToUtf8(const std::wstring& text, std::string* utf8) {
+    if (std::all_of(text.begin(), text.end(), [](wchar_t c) { return c < 0x80; })) {
+        utf8->assign(text.begin(), text.end());
+        return true;
+    }
+    try {
+        Utf8Converter converter;
+        *utf8 = converter.to_bytes(text);
+    } catch (const std::range_error&) {
+        return false;
+    }
+    return true;
+}
+
+// A name that is not UTF-8 comes back empty instead of throwing.
+std::wstring FromUtf8(const char* text, size_t length) {
+    if (std::all_of(text, text + length, [](char c) { return static_cast<unsigned char>(c) < 0x80; })) {
+        return std::wstring(text, text + length);
+    }
+    Utf8Converter converter{std::string(), std::wstring()};
+    return converter.from_bytes(text, text + length);
+}
+
+const uint64 kHashSeed = 0xCBF29CE484222325ULL;
+
+// FNV-1a.
+uint64 Hash(uint64 hash, const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// The names are hashed and compared with '\\' read as '/'.
+char Normalize(char c) {
+    return c == '\\' ? '/' : c;
+}
+
+uint64 HashName(const char* name, size_t length) {
+    uint64 hash = kHashSeed;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ static_cast<uint8_t>(Normalize(name[i]))) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+bool EqualNames(const char* name, size_t length, const char* other, size_t other_length) {
+    if (length != other_length) return false;
+    for (size_t i = 0; i < length; i++) {
+        if (Normalize(name[i]) != Normalize(other[i])) return false;
+    }
+    return true;
+}
+
+uint64 ToUInt64(const FILETIME& time) {
+    return (static_cast<uint64>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+}
+
+// Fills the fields of |header| that tie it to the archive at |path|.
+bool GetArchiveKey(const std::wstring& path, SidecarHeader* header) {
+    x::PlatformFileInfo info;
+    if (!x::GetFileInfo(path, &info)) return false;
+    x::MemoryMappedFile file;
+    if (!file.Initialize(path)) return false;
+
+    uint64 hash = kHashSeed;
+    size_t length = file.length();
+    size_t head = (std::min)(length, kHashedBytes);
+    hash = Hash(hash, file.data(), head);
+    size_t tail = (std::min)(length - head, kHashedBytes);
+    hash = Hash(hash, file.data() + length - tail, tail);
+
+    header->archive_size = static_cast<uint64>(info.size);
+    header->archive_time = ToUInt64(info.last_modified);
+    header->header_hash = hash;
+    return true;
+}
+
+uint64 GetNumber(IInArchive* archive, UInt32 index, PROPID id) {
+    ScopedPropVariant prop;
+    archive->GetProperty(index, id, prop.Receive());
+    switch (prop.get().vt) {
+    case VT_UI8: return prop.get().uhVal.QuadPart;
+    case VT_UI4: return prop.get().ulVal;
+    case VT_UI2: return prop.get().uiVal;
+    case VT_UI1: return prop.get().bVal;
+    default: return 0;
+    }
+}
+
+template<typename Type>
+void Append(std::vector<uint8_t>* buffer, const Type& value) {
+    auto bytes = reinterpret_cast<const uint8_t*>(&value);
+    buffer->insert(buffer->end(), bytes, bytes + sizeof(Type));
+}
+
+// Writes |buffer| to a file of its own next to |path| and renames it over
+// |path|. A reader that has the old sidecar mapped keeps the old file, it is
+// never truncated under the mapping.
+bool WriteSidecar(const std::wstring& path, const std::vector<uint8_t>& buffer) {
+    static std::atomic<uint32> next_file(0);
+#if defined(OS_WIN)
+    auto process = static_cast<uint32>(::GetCurrentProcessId());
+#else
+    auto process = static_cast<uint32>(::getpid());
+#endif // OS_WIN
+    auto temp_path = path + L"." + std::to_wstring(process) + L"." + std::to_wstring(next_file++) + L".tmp";
+
+    bool written = false;
+    {
+        auto file = x::Open(temp_path, false);
+        if (!file) return false;
+        ULONG size = 0;
+        written = SUCCEEDED(file->Write(buffer.data(), static_cast<ULONG>(buffer.size()), &size)) &&
+            size == buffer.size();
+    }
+    if (written && x::Rename(temp_path, path)) return true;
+    x::Remove(temp_path);
+    return false;
+}
+
+} // namespace
+
+std::wstring ArchiveIndex::GetSidecarPath(const std::wstring& path) {
+    return path + L".jidx";
+}
+
+bool ArchiveIndex::Load(const std::wstring& path) {
+    if (is_loaded()) return false;
+    SidecarHeader key = {};
+    if (!GetArchiveKey(path, &key)) return false;
+    std::unique_ptr<x::MemoryMappedFile> file(new x::MemoryMappedFile);
+    if (!file->Initialize(GetSidecarPath(path))) return false;
+
+    SidecarHeader header;
+    if (file->length() < sizeof(header)) return false;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion) return false;
+    if (header.archive_size != key.archive_size || header.archive_time != key.archive_time ||
+        header.header_hash != key.header_hash) {
+        return false;
+    }
+
+    if (header.slot_count == 0 || (header.slot_count & (header.slot_count - 1)) != 0) return false;
+    uint64 records = sizeof(header) + Align(header.path_length);
+    uint64 slots = records + static_cast<uint64>(header.count) * sizeof(Record);
+    uint64 names = slots + static_cast<uint64>(header.slot_count) * sizeof(uint32);
+    if (file->length() != names + header.names_size) return false;
+    std::string utf8_path;
+    if (!ToUtf8(path, &utf8_path)) return false;
+    auto stored_path = reinterpret_cast<const char*>(file->data() + sizeof(header));
+    if (std::string(stored_path, header.path_length) != utf8_path) return false;
+
+    // The lookups trust the table, so a sidecar that matches the key but is
+    // corrupt inside is turned down here: every name lies in the names and
+    // every slot holds an item.
+    auto stored_records = reinterpret_cast<const Record*>(file->data() + records);
+    for (uint32 i = 0; i < header.count; i++) {
+        const Record& record = stored_records[i];
+        if (static_cast<uint64>(record.name_offset) + record.name_length > header.names_size) return false;
+    }
+    auto stored_slots = reinterpret_cast<const uint32*>(file->data() + slots);
+    for (uint32 i = 0; i < header.slot_count; i++) {
+        if (stored_slots[i] > header.count) return false;
+    }
+
+    file_ = std::move(file);
+    records_ = stored_records;
+    slots_ = stored_slots;
+    names_ = reinterpret_cast<const char*>(file_->data() + names);
+    count_ = header.count;
+    slot_count_ = header.slot_count;
+    return true;
+}
+
+bool ArchiveIndex::Build(IInArchive* archive, const std::wstring& path) {
+    if (is_loaded()) return false;
+    SidecarHeader header = {};
+    if (!GetArchiveKey(path, &header)) return false;
+
+    UInt32 count = 0;
+    if (FAILED(archive->GetNumberOfItems(&count))) return false;
+    std::vector<Record> records(count);
+    std::string names;
+    std::string name;
+    for (UInt32 i = 0; i < count; i++) {
+        Record& record = records[i];
+        std::memset(&record, 0, sizeof(record));
+        ScopedPropVariant prop;
+        archive->GetProperty(i, kpidPath, prop.Receive());
+        if (prop.get().vt == VT_BSTR) {
+            // Without a sidecar the archive is listed from its headers.
+            if (!ToUtf8(prop.get().bstrVal, &name)) return false;
+            record.name_offset = static_cast<uint32>(names.size());
+            record.name_length = static_cast<uint32>(name.size());
+            names += name;
+        }
+        prop.Reset();
+        archive->GetProperty(i, kpidIsDir, prop.Receive());
+        if (prop.get().vt == VT_BOOL && prop.get().boolVal != VARIANT_FALSE) record.flags |= kDirectory;
+        prop.Reset();
+        archive->GetProperty(i, kpidMTime, prop.Receive());
+        if (prop.get().vt == VT_FILETIME) record.last_modified = prop.get().filetime;
+        prop.Reset();
+        archive->GetProperty(i, kpidBlock, prop.Receive());
+        record.block = prop.get().vt == VT_UI4 ? prop.get().ulVal : kNoBlock;
+        prop.Reset();
+        archive->GetProperty(i, kpidCRC, prop.Receive());
+        if (prop.get().vt == VT_UI4) {
+            record.crc = prop.get().ulVal;
+            record.flags |= kHasCrc;
+        }
+
+        record.size = GetNumber(archive, i, kpidSize);
+        record.packed_size = GetNumber(archive, i, kpidPackSize);
+        record.offset = GetNumber(archive, i, kpidOffset);
+        record.attributes = static_cast<uint32>(GetNumber(archive, i, kpidAttrib));
+    }
+    if (names.size() > kuint32max) return false;
+
+    uint32 slot_count = 16;
+    while (slot_count < count * 2) slot_count <<= 1;
+    std::vector<uint32> slots(slot_count, 0);
+    for (UInt32 i = 0; i < count; i++) {
+        const char* name = names.data() + records[i].name_offset;
+        size_t length = records[i].name_length;
+        size_t slot = HashName(name, length) & (slot_count - 1);
+        while (slots[slot] != 0) {
+            const Record& other = records[slots[slot] - 1];
+            if (EqualNames(name, length, names.data() + other.name_offset, other.name_length)) break;
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = i + 1;
+    }
+
+    std::string stored_path;
+    if (!ToUtf8(path, &stored_path)) return false;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.count = count;
+    header.path_length = static_cast<uint32>(stored_path.size());
+    header.names_size = static_cast<uint32>(names.size());
+    header.slot_count = slot_count;
+
+    std::vector<uint8_t> buffer;
+    buffer.reserve(sizeof(header) + Align(stored_path.size()) + records.size() * sizeof(Record) +
+        slots.size() * sizeof(uint32) + names.size());
+    Append(&buffer, header);
+    buffer.insert(buffer.end(), stored_path.begin(), stored_path.end());
+    buffer.resize(sizeof(header) + Align(stored_path.size()));
+    auto bytes = reinterpret_cast<const uint8_t*>(records.data());
+    buffer.insert(buffer.end(), bytes, bytes + records.size() * sizeof(Record));
+    bytes = reinterpret_cast<const uint8_t*>(slots.data());
+    buffer.insert(buffer.end(), bytes, bytes + slots.size() * sizeof(uint32));
+    buffer.insert(buffer.end(), names.begin(), names.end());
+
+    if (!WriteSidecar(GetSidecarPath(path), buffer)) return false;
+    return Load(path);
+}
+
+bool ArchiveIndex::Find(const std::wstring& name, uint32* index) const {
+    if (!is_loaded()) return false;
+    std::string key;
+    if (!ToUtf8(name, &key)) return false;
+    size_t slot = HashName(key.data(), key.size()) & (slot_count_ - 1);
+    // The table is never full, a free slot ends the probe.
+    for (uint32 probes = 0; probes < slot_count_ && slots_[slot] != 0; probes++) {
+        uint32 item = slots_[slot] - 1;
+        const Record& record = records_[item];
+        if (EqualNames(key.data(), key.size(), names_ + record.name_offset, record.name_length)) {
+            if (index != nullptr) *index = item;
+            return true;
+        }
+        slot = (slot + 1) & (slot_count_ - 1);
+    }
+    return false;
+}
+
+bool LoadStreamIndex(IInArchive* archive, const std::wstring& path) {
+    ScopedComObject<IArchiveStreamIndex> index;
+    if (FAILED(archive->QueryInterface(IID_IArchiveStreamIndex, index.ReceiveVoid()))) return false;
+    SidecarHeader key = {};
+    if (!GetArchiveKey(path, &key)) return false;
+    x::MemoryMappedFile file;
+    if (!file.Initialize(path + L".jgzi")) return false;
+
+    SidecarHeader header;
+    if (file.length() < sizeof(header)) return false;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, kStreamIndexMagic, sizeof(kStreamIndexMagic)) != 0 ||
+        header.version != kStreamIndexVersion) {
+        return false;
+    }
+    if (header.archive_size != key.archive_size || header.archive_time != key.archive_time ||
+        header.header_hash != key.header_hash) {
+        return false;
+    }
+
+    // The handler checks the blob against the archive too.
+    ScopedComObject<ISequentialInStream> stream(new BufferStreamming(file.data() + sizeof(header), file.length() - sizeof(header)));
+    return index->LoadIndex(stream) == S_OK;
+}
+
+bool SaveStreamIndex(IInArchive* archive, const std::wstring& path) {
+    ScopedComObject<IArchiveStreamIndex> index;
+    if (FAILED(archive->QueryInterface(IID_IArchiveStreamIndex, index.ReceiveVoid()))) return false;
+    SidecarHeader header = {};
+    if (!GetArchiveKey(path, &header)) return false;
+    std::memcpy(header.magic, kStreamIndexMagic, sizeof(kStreamIndexMagic));
+    header.version = kStreamIndexVersion;
+
+    std::vector<uint8_t> buffer;
+    ScopedComObject<ISequentialOutStream> stream(new MemoryOutStreamming(&buffer));
+    if (index->SaveIndex(stream) != S_OK) return false;
+    buffer.insert(buffer.begin(), reinterpret_cast<const uint8_t*>(&header),
+        reinterpret_cast<const uint8_t*>(&header) + sizeof(header));
+
+    return WriteSidecar(path + L".jgzi", buffer);
+}
+
+std::wstring ArchiveIndex::GetName(uint32 index) const {
+    const Record& item = records_[index];
+    return FromUtf8(names_ + item.name_offset, item.name_length);
+}
+
+void ArchiveIndex::AppendName(uint32 index, std::wstring* text) const {
+    const Record& item = records_[index];
+    const char* name = names_ + item.name_offset;
+    const char* end = name + item.name_length;
+    if (std::all_of(name, end, [](char c) { return static_cast<unsigned char>(c) < 0x80; })) {
+        text->append(name, end);
+    } else {
+        text->append(FromUtf8(name, item.name_length));
+    }
+}
+
+} // namespace juice
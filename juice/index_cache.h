@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 The Authors of ANT(http:://ant.sh) . All Rights Reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef JUICE_INDEX_CACHE_INCLUDE_H_
+#define JUICE_INDEX_CACHE_INCLUDE_H_
+
+#include <memory>
+#include <string>
+
+#include "apis/compiler.h"
+#include "apis/basictypes.h"
+#include "apis/basic_util.h"
+
+struct IInArchive;
+
+namespace juice {
+
+// The item table of an archive, kept in a sidecar file next to it
+// (|path| + ".jidx") so that listing an unchanged archive again does not
+// parse its headers. The sidecar is mapped and read in place: a header, a
+// fixed size record for every item, an open addressing table of the names
+// and the UTF-8 names behind them. Find() probes the table in the mapping,
+// nothing is built when it is loaded.
+//
+// It belongs to the archive as it was when it was written: the path, the size,
+// the modification time and a hash of the first and the last 64 KiB, where
+// the 7z start header and the zip end of central directory live, have to
+// match, Load() fails otherwise.
+class ArchiveIndex {
+public:
+    struct Record {
+        uint64 size;
+        uint64 packed_size;
+        uint64 offset;
+        FILETIME last_modified;
+        uint32 attributes;
+        // The 7z folder of the item, kNoBlock for the other formats.
+        uint32 block;
+        uint32 name_offset;
+        uint32 name_length;
+        uint32 flags;
+        // Valid with kHasCrc.
+        uint32 crc;
+    };
+
+    static const uint32 kNoBlock = 0xFFFFFFFF;
+    static const uint32 kDirectory = 1;
+    static const uint32 kHasCrc = 2;
+
+    ArchiveIndex() {}
+
+    static std::wstring GetSidecarPath(const std::wstring& path);
+
+    bool Load(const std::wstring& path);
+    // Writes the sidecar of |path| from the items of the opened |archive|,
+    // and loads it.
+    bool Build(IInArchive* archive, const std::wstring& path);
+
+    bool is_loaded() const { return records_ != nullptr; }
+    uint32 size() const { return count_; }
+    const Record& record(uint32 index) const { return records_[index]; }
+    std::wstring GetName(uint32 index) const;
+    // Appends the name to |text|, without a string of its own.
+    void AppendName(uint32 index, std::wstring* text) const;
+    // Either separator matches. A later item of the same name hides the
+    // earlier one.
+    bool Find(const std::wstring& name, uint32* index) const;
+    bool IsDirectory(uint32 index) const { return (records_[index].flags & kDirectory) != 0; }
+
+private:
+    std::unique_ptr<x::MemoryMappedFile> file_;
+    const Record* records_ = nullptr;
+    // Holds the index + 1 of an item, zero for a free slot.
+    const uint32* slots_ = nullptr;
+    const char* names_ = nullptr;
+    uint32 count_ = 0;
+    uint32 slot_count_ = 0;
+    DISALLOW_COPY_AND_ASSIGN(ArchiveIndex);
+};
+
+// The access points of a gzip archive (IArchiveStreamIndex of the handler),
+// kept in a sidecar file next to it (|path| + ".jgzi") under the same key as
+// the item table: the size, the modification time and the hash of both ends.
+// Load fails when the archive changed or the handler has no such index.
+bool LoadStreamIndex(IInArchive* archive, const std::wstring& path);
+// Writes the index the last Extract() of |archive| recorded.
+bool SaveStreamIndex(IInArchive* archive, const std::wstring& path);
+
+} // namespace juice
+
+#endif  // !JUICE_INDEX_CACHE_INCLUDE_H_
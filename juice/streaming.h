@@ -9,6 +9,8 @@
 #ifndef JUICE_ARCHIVE_STREAMING_INCLUDE_H_
 #define JUICE_ARCHIVE_STREAMING_INCLUDE_H_
 
+#include <algorithm>
+#include <memory>
 #include <vector>
 
 #include "7zip/Archive/IArchive.h"
@@ -20,6 +22,8 @@
 #include "apis/scoped_object.h"
 #include "apis/basic_util.h"
 
+#include "write_behind.h"
+
 namespace juice {
 
 class ReadFileStreamming
@@ -78,6 +82,76 @@ private:
     ScopedComObject<IStream> streaming_;
 };
 
+// An IInStream over a MemoryMappedFile. Read() is a memcpy out of the page
+// cache and Seek() only moves the position.
+class MappedFileStreamming
+    : public IInStream
+    , public IStreamGetSize
+    , public IStreamGetBuffer
+    , public RefCounted<MappedFileStreamming> {
+public:
+    explicit MappedFileStreamming(std::unique_ptr<x::MemoryMappedFile> file)
+        : file_(std::move(file)) {}
+    virtual ~MappedFileStreamming() {}
+
+    STDMETHOD(QueryInterface)(REFIID iid, void** obj) {
+        if (Query<IUnknown>(this, iid, obj)) return S_OK;
+        if (Query<ISequentialInStream>(this, IID_ISequentialInStream, iid, obj)) return S_OK;
+        if (Query<IInStream>(this, IID_IInStream, iid, obj)) return S_OK;
+        if (Query<IStreamGetSize>(this, IID_IStreamGetSize, iid, obj)) return S_OK;
+        if (Query<IStreamGetBuffer>(this, IID_IStreamGetBuffer, iid, obj)) return S_OK;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHOD_(ULONG, AddRef)() {
+        return static_cast<ULONG>(RefCounted::AddRef());
+    }
+
+    STDMETHOD_(ULONG, Release)() {
+        return static_cast<ULONG>(RefCounted::Release());
+    }
+
+    STDMETHOD(Read)(void* data, UInt32 size, UInt32* processedSize) {
+        UInt64 length = file_->length();
+        UInt32 sized = 0;
+        if (position_ < length) {
+            sized = static_cast<UInt32>((std::min)(static_cast<UInt64>(size), length - position_));
+            std::memcpy(data, file_->data() + position_, sized);
+            position_ += sized;
+        }
+        if (processedSize != nullptr) *processedSize = sized;
+        return S_OK;
+    }
+
+    STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64* newPosition) {
+        switch (seekOrigin) {
+        case STREAM_SEEK_SET: break;
+        case STREAM_SEEK_CUR: offset += position_; break;
+        case STREAM_SEEK_END: offset += file_->length(); break;
+        default: return STG_E_INVALIDFUNCTION;
+        }
+        if (offset < 0) return HRESULT_WIN32_ERROR_NEGATIVE_SEEK;
+        position_ = static_cast<UInt64>(offset);
+        if (newPosition != nullptr) *newPosition = position_;
+        return S_OK;
+    }
+
+    STDMETHOD(GetSize)(UInt64* size) {
+        *size = file_->length();
+        return S_OK;
+    }
+
+    STDMETHOD(GetBuffer)(const Byte** data, UInt64* size) {
+        *data = file_->data();
+        *size = file_->length();
+        return S_OK;
+    }
+
+private:
+    std::unique_ptr<x::MemoryMappedFile> file_;
+    UInt64 position_ = 0;
+};
+
 class WriteFileStreamming
     : public IOutStream
     , public RefCounted<WriteFileStreamming> {
@@ -129,6 +203,63 @@ private:
     ScopedComObject<IStream> streaming_;
 };
 
+// An ISequentialOutStream that gathers the decoded bytes into large buffers
+// for WriteBehind. The file is closed, and stamped with |last_modified|, once
+// the decoder releases the stream.
+class WriteBehindStreamming
+    : public ISequentialOutStream
+    , public RefCounted<WriteBehindStreamming> {
+public:
+    static const size_t kBufferSize = 1 << 20;
+
+    WriteBehindStreamming(WriteBehind* writer, const std::wstring& path, uint64_t size, const FILETIME* last_modified)
+        : writer_(writer), file_(writer->Create(path)) {
+        if (last_modified != nullptr) {
+            stamp_ = true;
+            last_modified_ = *last_modified;
+        }
+        buffer_.reserve(static_cast<size_t>((std::min)(size, static_cast<uint64_t>(kBufferSize))));
+    }
+
+    virtual ~WriteBehindStreamming() {
+        writer_->Write(file_, std::move(buffer_));
+        writer_->Close(file_, stamp_ ? &last_modified_ : nullptr);
+    }
+
+    STDMETHOD(QueryInterface)(REFIID iid, void** obj) {
+        if (Query<IUnknown>(this, iid, obj)) return S_OK;
+        if (Query<ISequentialOutStream>(this, IID_ISequentialOutStream, iid, obj)) return S_OK;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHOD_(ULONG, AddRef)() {
+        return static_cast<ULONG>(RefCounted::AddRef());
+    }
+
+    STDMETHOD_(ULONG, Release)() {
+        return static_cast<ULONG>(RefCounted::Release());
+    }
+
+    STDMETHOD(Write)(const void* data, UInt32 size, UInt32* processedSize) {
+        auto bytes = static_cast<const uint8_t*>(data);
+        buffer_.insert(buffer_.end(), bytes, bytes + size);
+        if (buffer_.size() >= kBufferSize) {
+            writer_->Write(file_, std::move(buffer_));
+            buffer_ = std::vector<uint8_t>();
+            buffer_.reserve(kBufferSize);
+        }
+        if (processedSize != nullptr) *processedSize = size;
+        return S_OK;
+    }
+
+private:
+    WriteBehind* writer_ = nullptr;
+    std::shared_ptr<WriteBehind::File> file_;
+    std::vector<uint8_t> buffer_;
+    FILETIME last_modified_;
+    bool stamp_ = false;
+};
+
 class ArchiveOpenning
     : public IArchiveOpenCallback
     , public ICryptoGetTextPassword
@@ -162,8 +293,10 @@ class ArchiveExtractting
     , public ICryptoGetTextPassword
     , public RefCounted<ArchiveExtractting> {
 public:
-    ArchiveExtractting(const ScopedComObject<IInArchive>& archive, const std::wstring& root, juice::Progress* callback)
-        : archive_(archive), callback_(callback), root_(root){}
+    // With a |writer| the files are written behind the decoder.
+    ArchiveExtractting(const ScopedComObject<IInArchive>& archive, const std::wstring& root, juice::Progress* callback,
+        WriteBehind* writer = nullptr)
+        : archive_(archive), callback_(callback), root_(root), writer_(writer) {}
     virtual ~ArchiveExtractting() {}
 
     STDMETHOD(QueryInterface)(REFIID iid, void** obj) override {
@@ -216,7 +349,7 @@ public:
             if (prop.get().vt == VT_EMPTY) {
                 file_.directory = false;
             } else if (prop.get().vt == VT_BOOL) {
-                file_.filename = prop.get().boolVal != VARIANT_FALSE;
+                file_.directory = prop.get().boolVal != VARIANT_FALSE;
             }
         }
         prop.Reset();
@@ -258,7 +391,19 @@ public:
         }
 
         auto directory = x::GetParent(file_.path);
-        x::CreatePathTree(directory);
+        if (directory != directory_) {
+            x::CreatePathTree(directory);
+            directory_ = directory;
+        }
+
+        if (writer_ != nullptr) {
+            const FILETIME& time = file_.last_modified;
+            bool stamp = time.dwHighDateTime != 0 || time.dwLowDateTime != 0;
+            ScopedComObject<WriteBehindStreamming> streamming(
+                new WriteBehindStreamming(writer_, file_.path, file_.size, stamp ? &time : nullptr));
+            *outStream = streamming.Detach();
+            return S_OK;
+        }
 
         auto file = x::Open(file_.path, false);
         if (!file) {
@@ -289,8 +434,12 @@ public:
 private:
     x::PlatformFileInfo file_;
     std::wstring root_;
+    // The last directory created, the items of one directory mostly follow
+    // each other.
+    std::wstring directory_;
     ScopedComObject<IInArchive> archive_;
     juice::Progress* callback_ = nullptr;
+    WriteBehind* writer_ = nullptr;
 };
 
 class ArchiveCompressing
@@ -299,8 +448,11 @@ class ArchiveCompressing
     , public ICompressProgressInfo
     , public RefCounted<ArchiveCompressing> {
 public:
-    ArchiveCompressing(const std::vector<x::PlatformFileInfo>& files, const std::wstring& path, juice::Progress* callback)
-        : callback_(callback), path_(path), file_list_(files) {}
+    // With a |root| the items are named relative to it, otherwise by their
+    // |path| as given.
+    ArchiveCompressing(std::vector<x::PlatformFileInfo> files, const std::wstring& path, juice::Progress* callback,
+        const std::wstring& root = L"")
+        : callback_(callback), path_(path), file_list_(std::move(files)), root_(root) {}
     virtual ~ArchiveCompressing() {}
 
     STDMETHOD(QueryInterface)(REFIID iid, void** obj) override {
@@ -346,15 +498,23 @@ public:
         if (index > file_list_.size()) return E_INVALIDARG;
         const x::PlatformFileInfo& info = file_list_.at(index);
         switch (propID) {
-        case kpidPath:		var.Set(info.path.c_str()); break;
+        case kpidPath:		var.Set(GetItemName(info).c_str()); break;
         case kpidIsDir:		var.Set(info.directory); break;
-        case kpidSize:		var.Set(info.size); break;
-        //case kpidAttrib:	var.Set(info.attributes); break;
+        case kpidSize:		var.Set(static_cast<uint64_t>(info.size)); break;
+        case kpidAttrib:
+            if (info.attributes != 0) var.Set(static_cast<uint32_t>(info.attributes));
+            break;
         //case kpidCTime:		var.Set(info.creation_time); break;
         //case kpidATime:		var.Set(info.last_accessed); break;
-        //case kpidMTime:		var.Set(info.last_modified); break;
+        case kpidMTime:
+            // A VARIANT has no FILETIME member, the PROPVARIANT gets it.
+            if (info.last_modified.dwHighDateTime == 0 && info.last_modified.dwLowDateTime == 0) break;
+            var.Release(value);
+            value->vt = VT_FILETIME;
+            value->filetime = info.last_modified;
+            return S_OK;
         default:
-            return E_INVALIDARG;
+            // Unknown properties are reported as VT_EMPTY, the handlers fail otherwise.
             break;
         }
         var.Release(value);
@@ -384,11 +544,399 @@ public:
     STDMETHOD(SetRatioInfo)(const UInt64* inSize, const UInt64* outSize) { return S_OK; }
 
 private:
+    std::wstring GetItemName(const x::PlatformFileInfo& info) const {
+        const std::wstring& path = info.path;
+        if (root_.empty() || path.length() <= root_.length() || path.compare(0, root_.length(), root_) != 0) {
+            return path;
+        }
+        auto name = path.substr(root_.length());
+        if (!x::IsSeparator(name.front()) && !x::IsSeparator(root_.back())) return path;
+        while (!name.empty() && x::IsSeparator(name.front())) name.erase(0, 1);
+        return name;
+    }
+
     std::vector<x::PlatformFileInfo> file_list_;
+    std::wstring root_;
     std::wstring path_;
     juice::Progress* callback_ = nullptr;
 };
 
+// An IInStream over the bytes of a CompressItem.
+class BufferStreamming
+    : public IInStream
+    , public IStreamGetSize
+    , public RefCounted<BufferStreamming> {
+public:
+    BufferStreamming(const void* data, size_t size)
+        : data_(static_cast<const Byte*>(data)), size_(size) {}
+    virtual ~BufferStreamming() {}
+
+    STDMETHOD(QueryInterface)(REFIID iid, void** obj) {
+        if (Query<IUnknown>(this, iid, obj)) return S_OK;
+        if (Query<ISequentialInStream>(this, IID_ISequentialInStream, iid, obj)) return S_OK;
+        if (Query<IInStream>(this, IID_IInStream, iid, obj)) return S_OK;
+        if (Query<IStreamGetSize>(this, IID_IStreamGetSize, iid, obj)) return S_OK;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHOD_(ULONG, AddRef)() {
+        return static_cast<ULONG>(RefCounted::AddRef());
+    }
+
+    STDMETHOD_(ULONG, Release)() {
+        return static_cast<ULONG>(RefCounted::Release());
+    }
+
+    STDMETHOD(Read)(void* data, UInt32 size, UInt32* processedSize) {
+        UInt32 sized = 0;
+        if (position_ < size_) {
+            sized = static_cast<UInt32>((std::min)(static_cast<UInt64>(size), size_ - position_));
+            std::memcpy(data, data_ + position_, sized);
+            position_ += sized;
+        }
+        if (processedSize != nullptr) *processedSize = sized;
+        return S_OK;
+    }
+
+    STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64* newPosition) {
+        switch (seekOrigin) {
+        case STREAM_SEEK_SET: break;
+        case STREAM_SEEK_CUR: offset += position_; break;
+        case STREAM_SEEK_END: offset += size_; break;
+        default: return STG_E_INVALIDFUNCTION;
+        }
+        if (offset < 0) return HRESULT_WIN32_ERROR_NEGATIVE_SEEK;
+        position_ = static_cast<UInt64>(offset);
+        if (newPosition != nullptr) *newPosition = position_;
+        return S_OK;
+    }
+
+    STDMETHOD(GetSize)(UInt64* size) {
+        *size = size_;
+        return S_OK;
+    }
+
+private:
+    const Byte* data_ = nullptr;
+    UInt64 size_ = 0;
+    UInt64 position_ = 0;
+};
+
+// An ISequentialInStream over the reader of a CompressItem.
+class ReaderStreamming
+    : public ISequentialInStream
+    , public RefCounted<ReaderStreamming> {
+public:
+    explicit ReaderStreamming(const CompressItem::Reader& reader)
+        : reader_(reader) {}
+    virtual ~ReaderStreamming() {}
+
+    STDMETHOD(QueryInterface)(REFIID iid, void** obj) {
+        if (Query<IUnknown>(this, iid, obj)) return S_OK;
+        if (Query<ISequentialInStream>(this, IID_ISequentialInStream, iid, obj)) return S_OK;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHOD_(ULONG, AddRef)() {
+        return static_cast<ULONG>(RefCounted::AddRef());
+    }
+
+    STDMETHOD_(ULONG, Release)() {
+        return static_cast<ULONG>(RefCounted::Release());
+    }
+
+    STDMETHOD(Read)(void* data, UInt32 size, UInt32* processedSize) {
+        if (processedSize != nullptr) *processedSize = 0;
+        if (size == 0) return S_OK;
+        auto sized = reader_(data, size);
+        if (sized < 0) return E_FAIL;
+        if (processedSize != nullptr) *processedSize = static_cast<UInt32>((std::min)(sized, int64(size)));
+        return S_OK;
+    }
+
+private:
+    const CompressItem::Reader& reader_;
+};
+
+// An ISequentialOutStream that hands everything to a CompressSink.
+class SinkStreamming
+    : public ISequentialOutStream
+    , public RefCounted<SinkStreamming> {
+public:
+    explicit SinkStreamming(const CompressSink& sink)
+        : sink_(sink) {}
+    virtual ~SinkStreamming() {}
+
+    STDMETHOD(QueryInterface)(REFIID iid, void** obj) {
+        if (Query<IUnknown>(this, iid, obj)) return S_OK;
+        if (Query<ISequentialOutStream>(this, IID_ISequentialOutStream, iid, obj)) return S_OK;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHOD_(ULONG, AddRef)() {
+        return static_cast<ULONG>(RefCounted::AddRef());
+    }
+
+    STDMETHOD_(ULONG, Release)() {
+        return static_cast<ULONG>(RefCounted::Release());
+    }
+
+    STDMETHOD(Write)(const void* data, UInt32 size, UInt32* processedSize) {
+        if (processedSize != nullptr) *processedSize = 0;
+        if (size != 0 && !sink_(data, size)) return E_ABORT;
+        if (processedSize != nullptr) *processedSize = size;
+        return S_OK;
+    }
+
+private:
+    const CompressSink& sink_;
+};
+
+// An IOutStream that writes into a vector, for the handlers that seek back.
+class MemoryOutStreamming
+    : public IOutStream
+    , public RefCounted<MemoryOutStreamming> {
+public:
+    explicit MemoryOutStreamming(std::vector<uint8_t>* buffer)
+        : buffer_(buffer) {}
+    virtual ~MemoryOutStreamming() {}
+
+    STDMETHOD(QueryInterface)(REFIID iid, void** obj) {
+        if (Query<IUnknown>(this, iid, obj)) return S_OK;
+        if (Query<ISequentialOutStream>(this, IID_ISequentialOutStream, iid, obj)) return S_OK;
+        if (Query<IOutStream>(this, IID_IOutStream, iid, obj)) return S_OK;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHOD_(ULONG, AddRef)() {
+        return static_cast<ULONG>(RefCounted::AddRef());
+    }
+
+    STDMETHOD_(ULONG, Release)() {
+        return static_cast<ULONG>(RefCounted::Release());
+    }
+
+    STDMETHOD(Write)(const void* data, UInt32 size, UInt32* processedSize) {
+        if (position_ + size > buffer_->size()) buffer_->resize(static_cast<size_t>(position_ + size));
+        if (size != 0) std::memcpy(buffer_->data() + position_, data, size);
+        position_ += size;
+        if (processedSize != nullptr) *processedSize = size;
+        return S_OK;
+    }
+
+    STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64* newPosition) {
+        switch (seekOrigin) {
+        case STREAM_SEEK_SET: break;
+        case STREAM_SEEK_CUR: offset += position_; break;
+        case STREAM_SEEK_END: offset += buffer_->size(); break;
+        default: return STG_E_INVALIDFUNCTION;
+        }
+        if (offset < 0) return HRESULT_WIN32_ERROR_NEGATIVE_SEEK;
+        position_ = static_cast<UInt64>(offset);
+        if (newPosition != nullptr) *newPosition = position_;
+        return S_OK;
+    }
+
+    STDMETHOD(SetSize)(UInt64 newSize) {
+        buffer_->resize(static_cast<size_t>(newSize));
+        return S_OK;
+    }
+
+private:
+    std::vector<uint8_t>* buffer_ = nullptr;
+    UInt64 position_ = 0;
+};
+
+// The IArchiveUpdateCallback of the streamed Compress(), over CompressItems.
+class ItemCompressing
+    : public IArchiveUpdateCallback
+    , public ICryptoGetTextPassword2
+    , public ICompressProgressInfo
+    , public RefCounted<ItemCompressing> {
+public:
+    ItemCompressing(const std::vector<CompressItem>& items, juice::Progress* callback)
+        : items_(items), callback_(callback) {}
+    virtual ~ItemCompressing() {}
+
+    STDMETHOD(QueryInterface)(REFIID iid, void** obj) override {
+        if (Query<IUnknown>(this, iid, obj)) return S_OK;
+        if (Query<IArchiveUpdateCallback>(this, IID_IArchiveUpdateCallback, iid, obj)) return S_OK;
+        if (Query<ICryptoGetTextPassword2>(this, IID_ICryptoGetTextPassword2, iid, obj)) return S_OK;
+        if (Query<ICompressProgressInfo>(this, IID_ICompressProgressInfo, iid, obj)) return S_OK;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHOD_(ULONG, AddRef)() {
+        return static_cast<ULONG>(RefCounted::AddRef());
+    }
+
+    STDMETHOD_(ULONG, Release)() {
+        return static_cast<ULONG>(RefCounted::Release());
+    }
+
+    STDMETHOD(SetTotal)(UInt64 size) {
+        if (callback_ != nullptr) callback_->StartProgress(L"", size);
+        return S_OK;
+    }
+
+    STDMETHOD(SetCompleted)(const UInt64* completeValue) {
+        if (callback_ != nullptr) callback_->Progressed(L"", *completeValue);
+        return S_OK;
+    }
+
+    STDMETHOD(GetUpdateItemInfo)(UInt32 index, Int32* newData, Int32* newProperties, UInt32* indexInArchive) {
+        if (newData != nullptr) *newData = 1;
+        if (newProperties != nullptr) *newProperties = 1;
+        if (indexInArchive != nullptr) *indexInArchive = (std::numeric_limits<UInt32>::max)();
+        return S_OK;
+    }
+
+    STDMETHOD(GetProperty)(UInt32 index, PROPID propID, PROPVARIANT* value) {
+        ScopedVariant var;
+        if (propID == kpidIsAnti) {
+            var.Set(false);
+            var.Release(value);
+            return S_OK;
+        }
+        if (index >= items_.size()) return E_INVALIDARG;
+        const CompressItem& item = items_[index];
+        switch (propID) {
+        case kpidPath:		var.Set(item.name.c_str()); break;
+        case kpidIsDir:		var.Set(item.directory); break;
+        case kpidSize:		var.Set(static_cast<uint64_t>(item.size)); break;
+        case kpidMTime:
+            if (item.last_modified.dwHighDateTime == 0 && item.last_modified.dwLowDateTime == 0) break;
+            var.Release(value);
+            value->vt = VT_FILETIME;
+            value->filetime = item.last_modified;
+            return S_OK;
+        default:
+            break;
+        }
+        var.Release(value);
+        return S_OK;
+    }
+
+    STDMETHOD(GetStream)(UInt32 index, ISequentialInStream** inStream) {
+        if (index >= items_.size()) return E_INVALIDARG;
+        const CompressItem& item = items_[index];
+        if (item.directory) return S_OK;
+        if (item.data == nullptr && item.reader) {
+            ScopedComObject<ReaderStreamming> streamming(new ReaderStreamming(item.reader));
+            *inStream = streamming.Detach();
+            return S_OK;
+        }
+        auto size = item.data != nullptr ? static_cast<size_t>(item.size) : 0;
+        ScopedComObject<BufferStreamming> streamming(new BufferStreamming(item.data, size));
+        *inStream = streamming.Detach();
+        return S_OK;
+    }
+
+    STDMETHOD(SetOperationResult)(Int32 operationResult) { return S_OK; }
+
+    STDMETHOD(CryptoGetTextPassword2)(Int32* passwordIsDefined, BSTR* password) {
+        *passwordIsDefined = 0;
+        *password = ::SysAllocString(L"");
+        return S_OK;
+    }
+
+    STDMETHOD(SetRatioInfo)(const UInt64* inSize, const UInt64* outSize) { return S_OK; }
+
+private:
+    const std::vector<CompressItem>& items_;
+    juice::Progress* callback_ = nullptr;
+};
+
+// An ISequentialOutStream that hands one extracted item to an ExtractSink.
+class ItemOutStreamming
+    : public ISequentialOutStream
+    , public RefCounted<ItemOutStreamming> {
+public:
+    ItemOutStreamming(UInt32 index, const ExtractSink& sink)
+        : index_(index), sink_(sink) {}
+    virtual ~ItemOutStreamming() {}
+
+    STDMETHOD(QueryInterface)(REFIID iid, void** obj) {
+        if (Query<IUnknown>(this, iid, obj)) return S_OK;
+        if (Query<ISequentialOutStream>(this, IID_ISequentialOutStream, iid, obj)) return S_OK;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHOD_(ULONG, AddRef)() {
+        return static_cast<ULONG>(RefCounted::AddRef());
+    }
+
+    STDMETHOD_(ULONG, Release)() {
+        return static_cast<ULONG>(RefCounted::Release());
+    }
+
+    STDMETHOD(Write)(const void* data, UInt32 size, UInt32* processedSize) {
+        if (processedSize != nullptr) *processedSize = 0;
+        if (size != 0 && !sink_(index_, data, size)) return E_ABORT;
+        if (processedSize != nullptr) *processedSize = size;
+        return S_OK;
+    }
+
+private:
+    UInt32 index_ = 0;
+    const ExtractSink& sink_;
+};
+
+// The IArchiveExtractCallback of ArchiveReader, which extracts into an
+// ExtractSink instead of files. |failed()| tells about the items that did
+// not decode, the handlers only report those through SetOperationResult().
+class ItemExtractting
+    : public IArchiveExtractCallback
+    , public ICryptoGetTextPassword
+    , public RefCounted<ItemExtractting> {
+public:
+    explicit ItemExtractting(const ExtractSink& sink)
+        : sink_(sink) {}
+    virtual ~ItemExtractting() {}
+
+    STDMETHOD(QueryInterface)(REFIID iid, void** obj) override {
+        if (Query<IUnknown>(this, iid, obj)) return S_OK;
+        if (Query<IArchiveExtractCallback>(this, IID_IArchiveExtractCallback, iid, obj)) return S_OK;
+        if (Query<ICryptoGetTextPassword>(this, IID_ICryptoGetTextPassword, iid, obj)) return S_OK;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHOD_(ULONG, AddRef)() {
+        return static_cast<ULONG>(RefCounted::AddRef());
+    }
+
+    STDMETHOD_(ULONG, Release)() {
+        return static_cast<ULONG>(RefCounted::Release());
+    }
+
+    STDMETHOD(SetTotal)(UInt64 size) { return S_OK; }
+    STDMETHOD(SetCompleted)(const UInt64* completeValue) { return S_OK; }
+
+    STDMETHOD(GetStream)(UInt32 index, ISequentialOutStream** outStream, Int32 askExtractMode) {
+        *outStream = nullptr;
+        if (askExtractMode != NArchive::NExtract::NAskMode::kExtract) return S_OK;
+        ScopedComObject<ItemOutStreamming> streamming(new ItemOutStreamming(index, sink_));
+        *outStream = streamming.Detach();
+        return S_OK;
+    }
+
+    STDMETHOD(PrepareOperation)(Int32 askExtractMode) { return S_OK; }
+
+    STDMETHOD(SetOperationResult)(Int32 resultEOperationResult) {
+        if (resultEOperationResult != NArchive::NExtract::NOperationResult::kOK) failed_ = true;
+        return S_OK;
+    }
+
+    // ICryptoGetTextPassword
+    STDMETHOD(CryptoGetTextPassword)(BSTR* password) { return E_ABORT; }
+
+    bool failed() const { return failed_; }
+
+private:
+    const ExtractSink& sink_;
+    bool failed_ = false;
+};
+
 } // namespace juice 
 
 #endif  // !JUICE_ARCHIVE_STREAMING_INCLUDE_H_
\ No newline at end of file
@@ -0,0 +1,496 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 The Authors of ANT(http://ant.sh). All Rights Reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+////////////////////////////////////////////////////////////////////////////////
+#include "stdafx.h"
+#include "write_behind.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#if defined(OS_LINUX)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif // OS_LINUX
+
+namespace juice {
+
+struct WriteBehind::Request {
+    enum Type { kOpen, kWrite, kClose };
+
+    Type type = kOpen;
+    std::vector<uint8_t> data;
+    uint64_t offset = 0;
+    size_t written = 0;
+    bool stamp = false;
+    FILETIME last_modified = {};
+};
+
+struct WriteBehind::File {
+#if defined(OS_WIN)
+    std::wstring path;
+    HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+    std::string path;
+    int fd = -1;
+#endif // OS_WIN
+    uint64_t size = 0;
+    bool scheduled = false;
+    bool failed = false;
+    std::deque<Request> requests;
+    // The request the ring is working on, it owns the buffer in flight.
+    Request current;
+};
+
+namespace {
+
+bool IsOpen(const WriteBehind::File* file) {
+#if defined(OS_WIN)
+    return file->handle != INVALID_HANDLE_VALUE;
+#else
+    return file->fd >= 0;
+#endif // OS_WIN
+}
+
+// Runs |request| on |file| with blocking system calls.
+bool Execute(WriteBehind::File* file, WriteBehind::Request* request) {
+#if defined(OS_WIN)
+    switch (request->type) {
+    case WriteBehind::Request::kOpen:
+        file->handle = ::CreateFile(file->path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+        return IsOpen(file);
+    case WriteBehind::Request::kWrite:
+        while (request->written < request->data.size()) {
+            OVERLAPPED overlapped = {};
+            uint64_t offset = request->offset + request->written;
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD size = static_cast<DWORD>((std::min)(request->data.size() - request->written, size_t(1) << 30));
+            DWORD written = 0;
+            if (!::WriteFile(file->handle, request->data.data() + request->written, size, &written, &overlapped)) {
+                return false;
+            }
+            request->written += written;
+        }
+        return true;
+    case WriteBehind::Request::kClose: {
+        bool stamped = !request->stamp || ::SetFileTime(file->handle, nullptr, nullptr, &request->last_modified);
+        bool closed = ::CloseHandle(file->handle) != FALSE;
+        file->handle = INVALID_HANDLE_VALUE;
+        return stamped && closed;
+    }
+    }
+#else
+    switch (request->type) {
+    case WriteBehind::Request::kOpen:
+        file->fd = ::open(file->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        return IsOpen(file);
+    case WriteBehind::Request::kWrite:
+        while (request->written < request->data.size()) {
+            ssize_t written = ::pwrite(file->fd, request->data.data() + request->written,
+                request->data.size() - request->written, request->offset + request->written);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+            request->written += static_cast<size_t>(written);
+        }
+        return true;
+    case WriteBehind::Request::kClose: {
+        bool stamped = true;
+        if (request->stamp) {
+            struct timespec times[2];
+            times[0].tv_sec = 0;
+            times[0].tv_nsec = UTIME_OMIT;
+            times[1] = x::FileTimeToTime(request->last_modified);
+            stamped = ::futimens(file->fd, times) == 0;
+        }
+        bool closed = ::close(file->fd) == 0;
+        file->fd = -1;
+        return stamped && closed;
+    }
+    }
+#endif // OS_WIN
+    return false;
+}
+
+} // namespace
+
+WriteBehind::WriteBehind(size_t memory_budget, uint threads)
+    : memory_budget_((std::max)(memory_budget, size_t(1))) {
+#if defined(OS_LINUX)
+    if (StartRing()) return;
+#endif // OS_LINUX
+    // The threads mostly wait on the file system, a few more than the cores
+    // keep it busy.
+    if (threads == 0) threads = (std::min)(8u, (std::max)(2u, std::thread::hardware_concurrency()));
+    for (uint i = 0; i < threads; i++) {
+        workers_.emplace_back(&WriteBehind::RunThread, this);
+    }
+}
+
+WriteBehind::~WriteBehind() {
+    Flush();
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        stopping_ = true;
+    }
+    work_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+std::shared_ptr<WriteBehind::File> WriteBehind::Create(const std::wstring& path) {
+    auto file = std::make_shared<File>();
+#if defined(OS_WIN)
+    file->path = path;
+#else
+    file->path = x::SysWideToNativeMB(path);
+#endif // OS_WIN
+    Request request;
+    request.type = Request::kOpen;
+    Enqueue(file, std::move(request));
+    return file;
+}
+
+void WriteBehind::Write(const std::shared_ptr<File>& file, std::vector<uint8_t> data) {
+    if (data.empty()) return;
+    Request request;
+    request.type = Request::kWrite;
+    request.offset = file->size;
+    file->size += data.size();
+    request.data = std::move(data);
+    Enqueue(file, std::move(request));
+}
+
+void WriteBehind::Close(const std::shared_ptr<File>& file, const FILETIME* last_modified) {
+    Request request;
+    request.type = Request::kClose;
+    if (last_modified != nullptr) {
+        request.stamp = true;
+        request.last_modified = *last_modified;
+    }
+    Enqueue(file, std::move(request));
+}
+
+bool WriteBehind::Flush() {
+    std::unique_lock<std::mutex> lock(lock_);
+    idle_.wait(lock, [this]() { return pending_ == 0; });
+    bool succeeded = !failed_;
+    failed_ = false;
+    return succeeded;
+}
+
+void WriteBehind::Enqueue(const std::shared_ptr<File>& file, Request&& request) {
+    std::unique_lock<std::mutex> lock(lock_);
+    size_t bytes = request.data.size();
+    // A buffer larger than the whole budget still goes through, alone.
+    space_.wait(lock, [&]() { return queued_bytes_ == 0 || queued_bytes_ + bytes <= memory_budget_; });
+    queued_bytes_ += bytes;
+    pending_++;
+    file->requests.push_back(std::move(request));
+    if (!file->scheduled) {
+        file->scheduled = true;
+        ready_.push_back(file);
+        work_.notify_one();
+    }
+}
+
+std::shared_ptr<WriteBehind::File> WriteBehind::NextFile(bool wait) {
+    std::unique_lock<std::mutex> lock(lock_);
+    if (wait) work_.wait(lock, [this]() { return stopping_ || !ready_.empty(); });
+    if (ready_.empty()) return nullptr;
+    auto file = std::move(ready_.front());
+    ready_.pop_front();
+    return file;
+}
+
+bool WriteBehind::NextRequest(File* file, Request* request) {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (file->requests.empty()) {
+        file->scheduled = false;
+        return false;
+    }
+    *request = std::move(file->requests.front());
+    file->requests.pop_front();
+    return true;
+}
+
+void WriteBehind::Complete(File* file, const Request& request, bool succeeded) {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!succeeded) {
+        file->failed = true;
+        failed_ = true;
+    }
+    if (!request.data.empty()) {
+        queued_bytes_ -= request.data.size();
+        space_.notify_all();
+    }
+    if (--pending_ == 0) idle_.notify_all();
+}
+
+void WriteBehind::Drain(File* file) {
+    Request request;
+    while (NextRequest(file, &request)) {
+        // Once a file failed only its close still runs.
+        bool succeeded = false;
+        if (!file->failed || (request.type == Request::kClose && IsOpen(file))) {
+            succeeded = Execute(file, &request);
+        }
+        Complete(file, request, succeeded && !file->failed);
+    }
+}
+
+void WriteBehind::RunThread() {
+    while (auto file = NextFile(true)) {
+        Drain(file.get());
+    }
+}
+
+#if defined(OS_LINUX)
+
+// A minimal io_uring, set up with the raw system calls so that juice does not
+// need liburing. Only the ring thread touches it.
+class WriteBehind::Ring {
+public:
+    static const unsigned kEntries = 64;
+
+    Ring() {}
+    ~Ring() {
+        if (sqes_ != nullptr) ::munmap(sqes_, sqes_size_);
+        if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) ::munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_ != nullptr) ::munmap(sq_ring_, sq_ring_size_);
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    bool Initialize() {
+        struct io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, kEntries, &params));
+        if (fd_ < 0) return false;
+        if (!Supported()) return false;
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) sq_ring_size_ = cq_ring_size_ = (std::max)(sq_ring_size_, cq_ring_size_);
+
+        sq_ring_ = Map(sq_ring_size_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == nullptr) return false;
+        cq_ring_ = single ? sq_ring_ : Map(cq_ring_size_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == nullptr) return false;
+        sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes_ = static_cast<struct io_uring_sqe*>(Map(sqes_size_, IORING_OFF_SQES));
+        if (sqes_ == nullptr) return false;
+
+        auto sq = static_cast<uint8_t*>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        auto cq = static_cast<uint8_t*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+        tail_ = *sq_tail_;
+        return true;
+    }
+
+    // The caller keeps at most kEntries requests in flight, so there is
+    // always room.
+    struct io_uring_sqe* NextSqe(void* user_data) {
+        unsigned index = tail_ & sq_mask_;
+        struct io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->user_data = reinterpret_cast<uint64_t>(user_data);
+        sq_array_[index] = index;
+        tail_++;
+        return sqe;
+    }
+
+    // Submits the new entries and waits for |wait| completions.
+    bool Submit(unsigned wait) {
+        unsigned submit = tail_ - __atomic_load_n(sq_tail_, __ATOMIC_RELAXED);
+        __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+        for (;;) {
+            long result = ::syscall(__NR_io_uring_enter, fd_, submit, wait,
+                wait != 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (result >= 0) return true;
+            if (errno != EINTR) return false;
+            submit = 0;
+        }
+    }
+
+    template<typename Function>
+    void Reap(Function&& function) {
+        unsigned head = __atomic_load_n(cq_head_, __ATOMIC_RELAXED);
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const struct io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            function(reinterpret_cast<void*>(cqe.user_data), cqe.res);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    void* Map(size_t size, off_t offset) {
+        void* address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+        return address == MAP_FAILED ? nullptr : address;
+    }
+
+    // Open, write and close only became io_uring operations in Linux 5.6.
+    bool Supported() {
+        const unsigned kOps = 64;
+        std::vector<uint8_t> buffer(sizeof(struct io_uring_probe) + kOps * sizeof(struct io_uring_probe_op));
+        auto probe = reinterpret_cast<struct io_uring_probe*>(buffer.data());
+        if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, kOps) < 0) return false;
+        for (unsigned op : { IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_CLOSE }) {
+            if (op > probe->last_op || (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) return false;
+        }
+        return true;
+    }
+
+    int fd_ = -1;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    struct io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    struct io_uring_cqe* cqes_ = nullptr;
+    unsigned tail_ = 0;
+};
+
+bool WriteBehind::StartRing() {
+    std::unique_ptr<Ring> ring(new Ring);
+    if (!ring->Initialize()) return false;
+    ring_ = std::move(ring);
+    workers_.emplace_back(&WriteBehind::RunRing, this);
+    return true;
+}
+
+// Keeps up to Ring::kEntries files in flight, each with one operation queued
+// in the ring. A completion moves its file on to the next request.
+void WriteBehind::RunRing() {
+    std::unordered_map<File*, std::shared_ptr<File>> inflight;
+
+    // Queues the next request of |file|, or drops it when there is none.
+    auto advance = [&](const std::shared_ptr<File>& file) {
+        Request& request = file->current;
+        while (NextRequest(file.get(), &request)) {
+            if (file->failed && !(request.type == Request::kClose && IsOpen(file.get()))) {
+                Complete(file.get(), request, false);
+                continue;
+            }
+            struct io_uring_sqe* sqe = ring_->NextSqe(file.get());
+            switch (request.type) {
+            case Request::kOpen:
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = reinterpret_cast<uint64_t>(file->path.c_str());
+                sqe->len = 0666;
+                sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+                break;
+            case Request::kWrite:
+                sqe->opcode = IORING_OP_WRITE;
+                sqe->fd = file->fd;
+                sqe->addr = reinterpret_cast<uint64_t>(request.data.data());
+                sqe->len = static_cast<uint32_t>((std::min)(request.data.size(), size_t(1) << 30));
+                sqe->off = request.offset;
+                break;
+            case Request::kClose:
+                // There is no io_uring operation for the times.
+                if (request.stamp) {
+                    struct timespec times[2];
+                    times[0].tv_sec = 0;
+                    times[0].tv_nsec = UTIME_OMIT;
+                    times[1] = x::FileTimeToTime(request.last_modified);
+                    if (::futimens(file->fd, times) != 0) file->failed = true;
+                }
+                sqe->opcode = IORING_OP_CLOSE;
+                sqe->fd = file->fd;
+                break;
+            }
+            inflight[file.get()] = file;
+            return;
+        }
+        inflight.erase(file.get());
+    };
+
+    for (;;) {
+        while (inflight.size() < Ring::kEntries) {
+            auto file = NextFile(inflight.empty());
+            if (!file) break;
+            advance(file);
+        }
+        if (inflight.empty()) {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (stopping_ && ready_.empty()) return;
+            continue;
+        }
+
+        if (!ring_->Submit(1)) {
+            // The ring is gone, finish what is in flight the blocking way.
+            for (auto& entry : inflight) {
+                Complete(entry.first, entry.first->current, false);
+                Drain(entry.first);
+            }
+            ring_.reset();
+            RunThread();
+            return;
+        }
+
+        std::vector<std::pair<File*, int>> completions;
+        ring_->Reap([&](void* user_data, int result) {
+            completions.emplace_back(static_cast<File*>(user_data), result);
+        });
+        for (const auto& completion : completions) {
+            auto file = inflight[completion.first];
+            Request& request = file->current;
+            int result = completion.second;
+            bool succeeded = result >= 0;
+            switch (request.type) {
+            case Request::kOpen:
+                if (succeeded) file->fd = result;
+                break;
+            case Request::kWrite:
+                if (result > 0) {
+                    request.written += static_cast<size_t>(result);
+                    if (request.written < request.data.size()) {
+                        // A short write, queue the rest of the buffer.
+                        struct io_uring_sqe* sqe = ring_->NextSqe(file.get());
+                        sqe->opcode = IORING_OP_WRITE;
+                        sqe->fd = file->fd;
+                        sqe->addr = reinterpret_cast<uint64_t>(request.data.data() + request.written);
+                        sqe->len = static_cast<uint32_t>((std::min)(request.data.size() - request.written, size_t(1) << 30));
+                        sqe->off = request.offset + request.written;
+                        continue;
+                    }
+                } else {
+                    succeeded = false;
+                }
+                break;
+            case Request::kClose:
+                file->fd = -1;
+                break;
+            }
+            Complete(file.get(), request, succeeded && !file->failed);
+            advance(file);
+        }
+    }
+}
+
+#endif // OS_LINUX
+
+} // namespace juice
@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 The Authors of ANT(http:://ant.sh) . All Rights Reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef JUICE_WRITE_BEHIND_INCLUDE_H_
+#define JUICE_WRITE_BEHIND_INCLUDE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "apis/compiler.h"
+#include "apis/basictypes.h"
+#include "apis/basic_util.h"
+
+namespace juice {
+
+// Finishes the output files of an extraction behind the decoder. The decoder
+// hands over filled buffers and goes on decoding; creating, writing, stamping
+// and closing the files runs on a background I/O pool: one io_uring on Linux,
+// a few threads doing plain system calls otherwise. The buffers handed over
+// are bounded by |memory_budget|, Write() only blocks once it is used up.
+//
+// The requests of one file run in order, different files run concurrently.
+class WriteBehind {
+public:
+    struct File;
+    struct Request;
+
+    static const size_t kDefaultMemoryBudget = 64 << 20;
+
+    explicit WriteBehind(size_t memory_budget = kDefaultMemoryBudget, uint threads = 0);
+    ~WriteBehind();
+
+    std::shared_ptr<File> Create(const std::wstring& path);
+    void Write(const std::shared_ptr<File>& file, std::vector<uint8_t> data);
+    // |last_modified| may be null to keep the time of the close.
+    void Close(const std::shared_ptr<File>& file, const FILETIME* last_modified);
+
+    // Waits until every queued request is done. Returns false if one of the
+    // files could not be written since the last Flush().
+    bool Flush();
+
+private:
+    class Ring;
+
+    void Enqueue(const std::shared_ptr<File>& file, Request&& request);
+    std::shared_ptr<File> NextFile(bool wait);
+    bool NextRequest(File* file, Request* request);
+    void Complete(File* file, const Request& request, bool succeeded);
+
+    // Runs the requests of |file| that are queued, on the calling thread.
+    void Drain(File* file);
+    void RunThread();
+#if defined(OS_LINUX)
+    bool StartRing();
+    void RunRing();
+#endif // OS_LINUX
+
+    std::mutex lock_;
+    std::condition_variable work_;
+    std::condition_variable space_;
+    std::condition_variable idle_;
+    std::deque<std::shared_ptr<File>> ready_;
+    size_t memory_budget_ = 0;
+    size_t queued_bytes_ = 0;
+    size_t pending_ = 0;
+    bool failed_ = false;
+    bool stopping_ = false;
+
+    std::unique_ptr<Ring> ring_;
+    std::vector<std::thread> workers_;
+    DISALLOW_COPY_AND_ASSIGN(WriteBehind);
+};
+
+} // namespace juice
+
+#endif  // !JUICE_WRITE_BEHIND_INCLUDE_H_
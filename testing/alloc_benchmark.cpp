@@ -0,0 +1,213 @@
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 The Authors of ANT(http:://ant.sh) . All Rights Reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+// Compares the blocks of BigAlloc(), that Alloc.c backs with huge pages on
+// Linux, with the blocks of malloc() that g_Alloc gives. The "probe" rows
+// chase a random cycle through a block of 64 MB to 1 GB, one cache line at a
+// time, as the match finder reads its hash and son arrays. The "lzma" rows
+// encode the corpus with a 64 MB dictionary, with the big buffers of the
+// encoder from each allocator; both must give the same stream. The "huge"
+// column is the part of the blocks that the kernel backed with huge pages,
+// from AnonHugePages of /proc/self/smaps. The files given are the corpus;
+// without them it is made of text and log lines.
+//
+// Usage:
+//   alloc_benchmark [iterations] [file...]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Alloc.h"
+#include "LzmaEnc.h"
+
+#include "benchmark_data.h"
+
+namespace {
+
+using benchmark::Input;
+using benchmark::MakeLog;
+using benchmark::MakeText;
+using benchmark::ReadFile;
+
+const size_t kLineSize = 64;
+const UInt32 kDictionary = 64 << 20;
+
+// The bytes of the mapping that holds |address|, that are in huge pages now.
+size_t GetHugeBytes(const void* address) {
+    FILE* file = std::fopen("/proc/self/smaps", "r");
+    if (file == nullptr) return 0;
+    uintptr_t target = reinterpret_cast<uintptr_t>(address);
+    bool inside = false;
+    size_t huge = 0;
+    char line[512];
+    while (std::fgets(line, sizeof(line), file) != nullptr) {
+        unsigned long long start = 0, end = 0, kb = 0;
+        if (std::sscanf(line, "%llx-%llx ", &start, &end) == 2) {
+            inside = start <= target && target < end;
+        } else if (inside && std::sscanf(line, "AnonHugePages: %llu kB", &kb) == 1) {
+            huge = static_cast<size_t>(kb) << 10;
+            break;
+        }
+    }
+    std::fclose(file);
+    return huge;
+}
+
+// Forwards to |base| and sums the huge pages of each block before it is freed.
+struct CountingAlloc {
+    ISzAlloc vt;
+    ISzAlloc* base;
+    size_t allocated;
+    size_t huge;
+};
+
+void* CountingAllocate(void* p, size_t size) {
+    CountingAlloc* alloc = static_cast<CountingAlloc*>(p);
+    void* address = alloc->base->Alloc(alloc->base, size);
+    if (address != nullptr && size >= (1 << 20)) alloc->allocated += size;
+    return address;
+}
+
+void CountingFree(void* p, void* address) {
+    CountingAlloc* alloc = static_cast<CountingAlloc*>(p);
+    if (address != nullptr) alloc->huge += GetHugeBytes(address);
+    alloc->base->Free(alloc->base, address);
+}
+
+struct Result {
+    double value;
+    size_t allocated;
+    size_t huge;
+};
+
+// Nanoseconds per access of a random cycle through |size| bytes from |alloc|.
+Result Probe(ISzAlloc* alloc, size_t size, int iterations) {
+    Result result = { -1, size, 0 };
+    size_t lines = size / kLineSize;
+    Byte* block = static_cast<Byte*>(alloc->Alloc(alloc, size));
+    if (block == nullptr) return result;
+
+    // Sattolo's shuffle gives a single cycle through all lines.
+    std::vector<uint32_t> order(lines);
+    for (size_t i = 0; i < lines; ++i) order[i] = static_cast<uint32_t>(i);
+    std::mt19937 random(1);
+    for (size_t i = lines - 1; i > 0; --i) std::swap(order[i], order[random() % i]);
+    for (size_t i = 0; i < lines; ++i) {
+        *reinterpret_cast<uint32_t*>(block + order[i] * kLineSize) = order[(i + 1) % lines];
+    }
+    std::vector<uint32_t>().swap(order);
+
+    size_t steps = std::max<size_t>(lines, 1 << 24);
+    uint32_t line = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        for (size_t step = 0; step < steps; ++step) line = *reinterpret_cast<uint32_t*>(block + line * kLineSize);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.value = line < lines ? seconds * 1e9 / (static_cast<double>(steps) * iterations) : -1;
+    result.huge = GetHugeBytes(block);
+    alloc->Free(alloc, block);
+    return result;
+}
+
+// MB/s of the encoder with the big buffers from |big|, or -1 if the stream differs from |encoded|.
+Result Encode(ISzAlloc* big, const Input& input, std::vector<Byte>* encoded, int iterations) {
+    CountingAlloc counting = { { CountingAllocate, CountingFree }, big, 0, 0 };
+    Result result = { -1, 0, 0 };
+    CLzmaEncProps props;
+    LzmaEncProps_Init(&props);
+    props.level = 5;
+    props.dictSize = kDictionary;
+    size_t capacity = input.data.size() + input.data.size() / 3 + (1 << 12);
+    std::vector<Byte> output;
+    Byte props_encoded[LZMA_PROPS_SIZE];
+
+    double seconds = 0;
+    for (int i = 0; i < iterations; ++i) {
+        output.resize(capacity);
+        SizeT output_size = output.size();
+        SizeT props_size = LZMA_PROPS_SIZE;
+        auto start = std::chrono::steady_clock::now();
+        SRes res = LzmaEncode(output.data(), &output_size, input.data.data(), input.data.size(), &props,
+            props_encoded, &props_size, 0, nullptr, &g_Alloc, &counting.vt);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (res != SZ_OK) return result;
+        output.resize(output_size);
+        if (encoded->empty()) *encoded = output;
+        if (output != *encoded) return result;
+    }
+    result.value = static_cast<double>(input.data.size()) * iterations / seconds / 1e6;
+    result.allocated = counting.allocated / iterations;
+    result.huge = counting.huge / iterations;
+    return result;
+}
+
+void Report(const std::string& name, const char* alloc, const char* unit, const Result& result, double baseline) {
+    if (result.value < 0) {
+        std::printf("%-24s %-8s failed\n", name.c_str(), alloc);
+        return;
+    }
+    std::printf("%-24s %-8s %10.2f %-5s  huge %5zu of %5zu MB", name.c_str(), alloc, result.value, unit,
+        result.huge >> 20, result.allocated >> 20);
+    if (baseline > 0) std::printf("  x%.2f", std::strcmp(unit, "ns") == 0 ? baseline / result.value : result.value / baseline);
+    std::printf("\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 1;
+
+    // The pool of huge pages is used if it is configured, as with "7z -slp".
+    SetLargePageSize();
+
+    std::vector<Input> inputs;
+    for (int i = 2; i < argc; ++i) {
+        Input input;
+        input.name = argv[i];
+        if (!ReadFile(argv[i], &input.data)) {
+            std::fprintf(stderr, "cannot read %s\n", argv[i]);
+            return 1;
+        }
+        if (!input.data.empty()) inputs.push_back(std::move(input));
+    }
+    if (inputs.empty()) {
+        inputs.resize(2);
+        inputs[0].name = "text";
+        inputs[0].data = MakeText(8 << 20, 1);
+        inputs[1].name = "log";
+        inputs[1].data = MakeLog(8 << 20, 2);
+    }
+
+    bool failed = false;
+    for (size_t size = 64 << 20; size <= (1 << 30); size <<= 2) {
+        std::string name = "probe " + std::to_string(size >> 20) + " MB";
+        Result plain = Probe(&g_Alloc, size, iterations);
+        Report(name, "malloc", "ns", plain, 0);
+        Result big = Probe(&g_BigAlloc, size, iterations);
+        Report(name, "BigAlloc", "ns", big, plain.value);
+        failed |= plain.value < 0 || big.value < 0;
+    }
+    for (const auto& input : inputs) {
+        std::string name = "lzma " + input.name;
+        std::vector<Byte> encoded;
+        Result plain = Encode(&g_Alloc, input, &encoded, iterations);
+        Report(name, "malloc", "MB/s", plain, 0);
+        Result big = Encode(&g_BigAlloc, input, &encoded, iterations);
+        Report(name, "BigAlloc", "MB/s", big, plain.value);
+        failed |= plain.value < 0 || big.value < 0;
+    }
+    return failed ? 1 : 0;
+}
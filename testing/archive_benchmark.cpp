@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 The Authors of ANT(http:://ant.sh) . All Rights Reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+// Measures the per-archive call overhead of juice::Archive against spawning
+// the 7za binary for the same job, which is what the workers did before.
+//
+// Usage:
+//   archive_benchmark <7z.so> <archive> <format> [7za] [iterations]
+//   format: 7z | zip | gzip | bzip2 | tar | lzma
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "apis/archive.h"
+#include "apis/basic_util.h"
+
+extern char** environ;
+
+namespace {
+
+class NullProgress : public juice::Progress {
+public:
+    void StartProgress(const std::wstring& path, const ULONGLONG& bytes) override {}
+    void Progressed(const std::wstring& path, const ULONGLONG& bytes) override {}
+};
+
+bool ParseFormat(const std::string& name, juice::Format* format) {
+    static const struct {
+        const char* name;
+        juice::Format format;
+    } kFormats[] = {
+        { "7z", juice::Format::SEVENZ },
+        { "zip", juice::Format::ZIP },
+        { "gzip", juice::Format::GZIP },
+        { "bzip2", juice::Format::BZIP2 },
+        { "tar", juice::Format::TAR },
+        { "lzma", juice::Format::LZMA },
+    };
+    for (const auto& known : kFormats) {
+        if (name == known.name) {
+            *format = known.format;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Spawns |argv| with its output discarded and waits for it, the same as the
+// workers used to shell out to 7za.
+bool RunProcess(const std::vector<std::string>& argv) {
+    std::vector<char*> args;
+    for (const auto& arg : argv) args.push_back(const_cast<char*>(arg.c_str()));
+    args.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    pid_t pid = 0;
+    int result = posix_spawn(&pid, args[0], &actions, nullptr, args.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (result != 0) return false;
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) != pid) return false;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Returns the average wall time of |function| in microseconds, or a negative
+// value if one of the calls failed.
+template<typename Function>
+double Measure(int iterations, Function&& function) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        if (!function()) return -1.0;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+}
+
+void Report(const char* name, double microseconds) {
+    if (microseconds < 0) {
+        std::printf("%-28s failed\n", name);
+        return;
+    }
+    std::printf("%-28s %12.1f us/archive\n", name, microseconds);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::fprintf(stderr, "usage: %s <7z.so> <archive> <format> [7za] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    juice::Format format;
+    if (!ParseFormat(argv[3], &format)) {
+        std::fprintf(stderr, "unknown format: %s\n", argv[3]);
+        return 1;
+    }
+
+    const std::wstring library = x::SysNativeMBToWide(argv[1]);
+    const std::wstring path = x::SysNativeMBToWide(argv[2]);
+    const std::string sevenza = argc > 4 ? argv[4] : "";
+    const int iterations = argc > 5 ? std::max(1, std::atoi(argv[5])) : 100;
+
+    char directory[] = "/tmp/juice_benchmark_XXXXXX";
+    if (::mkdtemp(directory) == nullptr) return 1;
+    const std::string root = directory;
+
+    juice::Archive archive(library);
+    NullProgress progress;
+
+    std::printf("%s, %d iterations\n", argv[2], iterations);
+
+    Report("juice Open (list)", Measure(iterations, [&]() {
+        size_t items = 0;
+        return archive.Open(path, format, [&](const std::wstring&, const ULONGLONG&) { ++items; });
+    }));
+    Report("juice Extract", Measure(iterations, [&]() {
+        return archive.Extract(path, format, x::SysNativeMBToWide(root), &progress);
+    }));
+    Report("juice Extract (parallel)", Measure(iterations, [&]() {
+        return archive.Extract(path, format, x::SysNativeMBToWide(root), &progress, 0);
+    }));
+    archive.SetWriteBehind(64 << 20);
+    Report("juice Extract (write-behind)", Measure(iterations, [&]() {
+        return archive.Extract(path, format, x::SysNativeMBToWide(root), &progress);
+    }));
+    archive.SetWriteBehind(0);
+
+    if (!sevenza.empty()) {
+        Report("7za l (subprocess)", Measure(iterations, [&]() {
+            return RunProcess({ sevenza, "l", argv[2] });
+        }));
+        Report("7za x (subprocess)", Measure(iterations, [&]() {
+            return RunProcess({ sevenza, "x", "-y", "-o" + root, argv[2] });
+        }));
+    }
+
+    RunProcess({ "/bin/rm", "-rf", root });
+    return 0;
+}
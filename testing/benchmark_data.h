@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 The Authors of ANT(http:://ant.sh) . All Rights Reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+// The corpus the benchmarks share: the files given on the command line, or
+// text, log lines and noise made from a seed, so that runs can be compared.
+
+#ifndef JUICE_TESTING_BENCHMARK_DATA_INCLUDE_H_
+#define JUICE_TESTING_BENCHMARK_DATA_INCLUDE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace benchmark {
+
+struct Input {
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+inline std::vector<uint8_t> MakeText(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<std::string> words;
+    for (int i = 0; i < 4000; ++i) {
+        std::string word;
+        int length = 2 + static_cast<int>(random() % 9);
+        for (int j = 0; j < length; ++j) word += static_cast<char>('a' + random() % 26);
+        words.push_back(word);
+    }
+    std::vector<uint8_t> text;
+    text.reserve(size);
+    while (text.size() < size) {
+        // Skewed to the front, as the words of a language are.
+        size_t a = random() % words.size();
+        size_t b = random() % words.size();
+        const std::string& word = words[a * b / words.size()];
+        text.insert(text.end(), word.begin(), word.end());
+        text.push_back(random() % 12 == 0 ? '\n' : ' ');
+    }
+    text.resize(size);
+    return text;
+}
+
+// The request lines of a web server, that differ in few fields.
+inline std::vector<uint8_t> MakeLog(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+    static const char* kPaths[] = { "/api/v1/items", "/api/v1/users", "/static/app.js", "/health" };
+    std::vector<uint8_t> log;
+    log.reserve(size + 256);
+    char line[256];
+    for (unsigned second = 0; log.size() < size; second += random() % 3) {
+        int length = std::snprintf(line, sizeof(line),
+            "2018-06-01 12:%02u:%02u INFO server.request handled GET %s status=200 bytes=%u\n",
+            (second / 60) % 60, second % 60, kPaths[random() % 4], 5120 + random() % 16);
+        log.insert(log.end(), line, line + length);
+    }
+    log.resize(size);
+    return log;
+}
+
+inline std::vector<uint8_t> MakeNoise(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<uint8_t> noise(size);
+    for (auto& byte : noise) byte = static_cast<uint8_t>(random());
+    return noise;
+}
+
+inline bool ReadFile(const char* path, std::vector<uint8_t>* data) {
+    FILE* file = std::fopen(path, "rb");
+    if (file == nullptr) return false;
+    uint8_t buffer[1 << 16];
+    size_t read = 0;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data->insert(data->end(), buffer, buffer + read);
+    }
+    std::fclose(file);
+    return true;
+}
+
+} // namespace benchmark
+
+#endif // !JUICE_TESTING_BENCHMARK_DATA_INCLUDE_H_
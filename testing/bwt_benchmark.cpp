@@ -0,0 +1,161 @@
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 The Authors of ANT(http:://ant.sh) . All Rights Reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+// Sorts the rotations of 900 KB blocks, as the BZip2 encoder does, with the
+// radix sort of BlockSort() and with the SA-IS of BlockSort_SaIs(). Both
+// results must give the same BWT column, and the row of the original
+// rotation must hold the block itself. The files given are the corpus;
+// without them it is made of repetitive data, where BlockSort() is slowest:
+// log lines, DNA with long repeats, a period that divides the block and a
+// run, and of text and noise to compare with.
+//
+// Usage:
+//   bwt_benchmark [iterations] [file...]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "BwtSort.h"
+
+#include "benchmark_data.h"
+
+namespace {
+
+using benchmark::Input;
+using benchmark::MakeLog;
+using benchmark::MakeNoise;
+using benchmark::MakeText;
+using benchmark::ReadFile;
+
+const UInt32 kBlockSize = 900000;
+
+// Pieces of a genome that mutates slowly, as the reads of one species.
+std::vector<Byte> MakeDna(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<Byte> genome(1 << 16);
+    for (auto& base : genome) base = "ACGT"[random() % 4];
+    std::vector<Byte> dna;
+    while (dna.size() < size) {
+        size_t length = 500 + random() % 4500;
+        size_t start = random() % (genome.size() - length);
+        dna.insert(dna.end(), genome.begin() + start, genome.begin() + start + length);
+        genome[random() % genome.size()] = "ACGT"[random() % 4];
+    }
+    dna.resize(size);
+    return dna;
+}
+
+// A block that is a power of one word.
+std::vector<Byte> MakePeriodic(size_t size, size_t period, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<Byte> data(size);
+    for (size_t i = 0; i < size; ++i) data[i] = i < period ? static_cast<Byte>('a' + random() % 4) : data[i - period];
+    return data;
+}
+
+typedef UInt32 (*SortFunc)(UInt32* indices, const Byte* data, UInt32 block_size);
+
+// The last column of the sorted rotations.
+void GetColumn(const UInt32* indices, const Byte* block, UInt32 size, std::vector<Byte>* column) {
+    column->resize(size);
+    for (UInt32 i = 0; i < size; ++i) (*column)[i] = block[indices[i] == 0 ? size - 1 : indices[i] - 1];
+}
+
+bool IsOriginal(const UInt32* indices, UInt32 orig_ptr, const Byte* block, UInt32 size) {
+    UInt32 start = indices[orig_ptr];
+    return std::memcmp(block + start, block, size - start) == 0 && std::memcmp(block, block + size - start, start) == 0;
+}
+
+// Returns MB/s, or a negative number if a block gives other column than |expected|.
+double Measure(SortFunc sort, const Input& input, const std::vector<std::vector<Byte>>& expected, int iterations) {
+    std::vector<UInt32> indices(BLOCK_SORT_BUF_SIZE(kBlockSize));
+    std::vector<Byte> column;
+    double seconds = 0;
+    for (int i = 0; i < iterations; ++i) {
+        for (size_t pos = 0, block = 0; pos < input.data.size(); pos += kBlockSize, ++block) {
+            const Byte* data = input.data.data() + pos;
+            UInt32 size = static_cast<UInt32>(std::min<size_t>(kBlockSize, input.data.size() - pos));
+            auto start = std::chrono::steady_clock::now();
+            UInt32 orig_ptr = sort(indices.data(), data, size);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            GetColumn(indices.data(), data, size, &column);
+            if (column != expected[block] || !IsOriginal(indices.data(), orig_ptr, data, size)) return -1;
+        }
+    }
+    return static_cast<double>(input.data.size()) * iterations / seconds / 1e6;
+}
+
+void Report(const std::string& name, const char* sorter, double speed, double baseline) {
+    if (speed < 0) {
+        std::printf("%-20s %-6s failed\n", name.c_str(), sorter);
+        return;
+    }
+    std::printf("%-20s %-6s %10.2f MB/s", name.c_str(), sorter, speed);
+    if (baseline > 0) std::printf("  x%.1f", speed / baseline);
+    std::printf("\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 3;
+
+    std::vector<Input> inputs;
+    for (int i = 2; i < argc; ++i) {
+        Input input;
+        input.name = argv[i];
+        if (!ReadFile(argv[i], &input.data)) {
+            std::fprintf(stderr, "cannot read %s\n", argv[i]);
+            return 1;
+        }
+        if (!input.data.empty()) inputs.push_back(std::move(input));
+    }
+    if (inputs.empty()) {
+        const size_t kSize = kBlockSize * 4;
+        inputs.resize(6);
+        inputs[0].name = "log";
+        inputs[0].data = MakeLog(kSize, 1);
+        inputs[1].name = "dna";
+        inputs[1].data = MakeDna(kSize, 2);
+        inputs[2].name = "periodic";
+        inputs[2].data = MakePeriodic(kSize, 3000, 3);
+        inputs[3].name = "run";
+        inputs[3].data.assign(kBlockSize, 'a');
+        inputs[4].name = "text";
+        inputs[4].data = MakeText(kSize, 4);
+        inputs[5].name = "noise";
+        inputs[5].data = MakeNoise(kBlockSize, 5);
+    }
+
+    bool failed = false;
+    for (const auto& input : inputs) {
+        // The columns of BlockSort(), that both sorters must give.
+        std::vector<std::vector<Byte>> expected;
+        std::vector<UInt32> indices(BLOCK_SORT_BUF_SIZE(kBlockSize));
+        for (size_t pos = 0; pos < input.data.size(); pos += kBlockSize) {
+            UInt32 size = static_cast<UInt32>(std::min<size_t>(kBlockSize, input.data.size() - pos));
+            BlockSort(indices.data(), input.data.data() + pos, size);
+            expected.emplace_back();
+            GetColumn(indices.data(), input.data.data() + pos, size, &expected.back());
+        }
+
+        double radix = Measure(BlockSort, input, expected, iterations);
+        Report(input.name, "radix", radix, 0);
+        double sais = Measure(BlockSort_SaIs, input, expected, iterations);
+        Report(input.name, "SA-IS", sais, radix);
+        failed |= radix < 0 || sais < 0;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 The Authors of ANT(http:://ant.sh) . All Rights Reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+// Compresses generated items, which repeat pieces of each other, into one 7z
+// solid block with and without the Dedup coder. Then extracts the block as a
+// whole and every item on its own through ArchiveReader, and checks the data.
+// The items before the last one of the block are a partial decoding, where
+// the coders stop at the end of the item instead of the end of the block.
+//
+// Usage:
+//   dedup_benchmark <7z.so> [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "apis/archive.h"
+#include "apis/basic_util.h"
+
+namespace {
+
+struct Item {
+    std::wstring name;
+    std::vector<uint8_t> data;
+};
+
+// Three items of 3 MB, 1 MB and 100 bytes, cut from a pool of random 64 KiB
+// pieces. The copies of Dedup cross the ends of the items.
+std::vector<Item> MakeItems() {
+    const size_t kPiece = 64 << 10;
+    std::mt19937 random(7);
+    std::vector<uint8_t> pool(kPiece * 16);
+    for (auto& byte : pool) byte = static_cast<uint8_t>(random());
+
+    auto make = [&](const wchar_t* name, size_t size) {
+        Item item;
+        item.name = name;
+        while (item.data.size() < size) {
+            size_t piece = random() % 16;
+            size_t take = (std::min)(kPiece, size - item.data.size());
+            item.data.insert(item.data.end(), pool.begin() + piece * kPiece, pool.begin() + piece * kPiece + take);
+        }
+        return item;
+    };
+    return { make(L"a.bin", 3 << 20), make(L"b.bin", 1 << 20), make(L"c.bin", 100) };
+}
+
+bool WriteFile(const std::string& path, const std::vector<uint8_t>& data) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+    bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    return std::fclose(file) == 0 && written;
+}
+
+// Returns the average wall time of |function| in milliseconds, or a negative
+// value if one of the calls failed.
+template<typename Function>
+double Measure(int iterations, Function&& function) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        if (!function()) return -1.0;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::milli>(elapsed).count() / iterations;
+}
+
+void Report(const char* name, double milliseconds) {
+    if (milliseconds < 0) {
+        std::printf("%-32s failed\n", name);
+        return;
+    }
+    std::printf("%-32s %12.1f ms\n", name, milliseconds);
+}
+
+// Compresses |items| with |options| to |path| and extracts them back.
+// Returns false if the data of an item differs.
+bool RoundTrip(juice::Archive* archive, const char* title, const juice::CompressOptions& options,
+               const std::vector<Item>& items, const std::string& path, int iterations) {
+    std::vector<juice::CompressItem> inputs(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        inputs[i].name = items[i].name;
+        inputs[i].data = items[i].data.data();
+        inputs[i].size = items[i].data.size();
+    }
+
+    archive->SetCompressOptions(options);
+    std::vector<uint8_t> buffer;
+    std::printf("%s\n", title);
+    Report("  Compress", Measure(iterations, [&]() {
+        return archive->Compress(inputs, juice::Format::SEVENZ, &buffer, nullptr);
+    }));
+    if (buffer.empty() || !WriteFile(path, buffer)) return false;
+    std::printf("  %-30s %12zu bytes\n", "archive", buffer.size());
+
+    juice::ArchiveReader reader(archive);
+    if (!reader.Open(x::SysNativeMBToWide(path), juice::Format::SEVENZ)) return false;
+    std::vector<uint32> indices;
+    for (const auto& item : items) {
+        uint32 index = 0;
+        if (!reader.Find(item.name, &index)) return false;
+        indices.push_back(index);
+    }
+
+    bool same = true;
+    std::vector<std::vector<uint8_t>> buffers;
+    Report("  Extract (block)", Measure(iterations, [&]() {
+        return reader.Extract(indices, &buffers);
+    }));
+    for (size_t i = 0; i < items.size() && same; ++i) {
+        same = i < buffers.size() && buffers[i] == items[i].data;
+    }
+
+    std::vector<uint8_t> data;
+    for (size_t i = 0; i < items.size(); ++i) {
+        std::string name = "  Extract (" + x::SysWideToNativeMB(items[i].name) + " alone)";
+        Report(name.c_str(), Measure(iterations, [&]() {
+            data.clear();
+            return reader.Extract(indices[i], &data);
+        }));
+        if (data != items[i].data) {
+            std::printf("  %s differs: %zu of %zu bytes\n", x::SysWideToNativeMB(items[i].name).c_str(),
+                data.size(), items[i].data.size());
+            same = false;
+        }
+    }
+    reader.Close();
+    return same;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <7z.so> [iterations]\n", argv[0]);
+        return 1;
+    }
+    const int iterations = argc > 2 ? std::max(1, std::atoi(argv[2])) : 3;
+
+    char directory[] = "/tmp/juice_dedup_XXXXXX";
+    if (::mkdtemp(directory) == nullptr) return 1;
+    const std::string path = std::string(directory) + "/items.7z";
+
+    juice::Archive archive(x::SysNativeMBToWide(argv[1]));
+    const auto items = MakeItems();
+
+    juice::CompressOptions options;
+    options.level = juice::Level::FAST;
+    bool same = RoundTrip(&archive, "LZMA2", options, items, path, iterations);
+    options.dedup_window = 64 << 20;
+    same = RoundTrip(&archive, "Dedup + LZMA2", options, items, path, iterations) && same;
+    std::printf("%s\n", same ? "data checked" : "DATA DIFFERS");
+
+    ::unlink(path.c_str());
+    ::rmdir(directory);
+    return same ? 0 : 1;
+}
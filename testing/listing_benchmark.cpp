@@ -0,0 +1,267 @@
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 The Authors of ANT(http:://ant.sh) . All Rights Reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+// Lists a zip with many small entries through the file stream and through the
+// memory mapped stream, with the callback of Open() and into the columns of
+// List(). The zip is generated (stored, empty entries, ZIP64 end of central
+// directory) so that only the header parsing is measured. Then lists a 7z of
+// the same entries through both streams, where the mapped stream hands the
+// header to the handler in place. Then lists the zip out of the sidecar index
+// cache, and looks single entries up through an open ArchiveReader.
+//
+// Usage:
+//   listing_benchmark <7z.so> [entries] [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "apis/archive.h"
+#include "apis/basic_util.h"
+
+namespace {
+
+void PutUInt16(std::vector<uint8_t>* buffer, uint16_t value) {
+    buffer->push_back(static_cast<uint8_t>(value));
+    buffer->push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void PutUInt32(std::vector<uint8_t>* buffer, uint32_t value) {
+    PutUInt16(buffer, static_cast<uint16_t>(value));
+    PutUInt16(buffer, static_cast<uint16_t>(value >> 16));
+}
+
+void PutUInt64(std::vector<uint8_t>* buffer, uint64_t value) {
+    PutUInt32(buffer, static_cast<uint32_t>(value));
+    PutUInt32(buffer, static_cast<uint32_t>(value >> 32));
+}
+
+void PutString(std::vector<uint8_t>* buffer, const std::string& value) {
+    buffer->insert(buffer->end(), value.begin(), value.end());
+}
+
+// Writes a zip of |entries| empty stored files to |path|.
+bool WriteZip(const std::string& path, uint32_t entries) {
+    std::vector<uint8_t> local;
+    std::vector<uint8_t> central;
+    char name[32];
+    for (uint32_t i = 0; i < entries; ++i) {
+        std::snprintf(name, sizeof(name), "d%03u/f%07u.txt", i % 1000, i);
+        const std::string filename = name;
+        const uint32_t offset = static_cast<uint32_t>(local.size());
+
+        PutUInt32(&local, 0x04034b50);
+        PutUInt16(&local, 20);      // version needed
+        PutUInt16(&local, 0);       // flags
+        PutUInt16(&local, 0);       // stored
+        PutUInt16(&local, 0);       // time
+        PutUInt16(&local, 0x4c21);  // date
+        PutUInt32(&local, 0);       // crc
+        PutUInt32(&local, 0);       // packed size
+        PutUInt32(&local, 0);       // size
+        PutUInt16(&local, static_cast<uint16_t>(filename.size()));
+        PutUInt16(&local, 0);
+        PutString(&local, filename);
+
+        PutUInt32(&central, 0x02014b50);
+        PutUInt16(&central, 0x031e);  // made by unix
+        PutUInt16(&central, 20);
+        PutUInt16(&central, 0);
+        PutUInt16(&central, 0);
+        PutUInt16(&central, 0);
+        PutUInt16(&central, 0x4c21);
+        PutUInt32(&central, 0);
+        PutUInt32(&central, 0);
+        PutUInt32(&central, 0);
+        PutUInt16(&central, static_cast<uint16_t>(filename.size()));
+        PutUInt16(&central, 0);       // extra
+        PutUInt16(&central, 0);       // comment
+        PutUInt16(&central, 0);       // disk
+        PutUInt16(&central, 0);       // internal attributes
+        PutUInt32(&central, 0100644u << 16);
+        PutUInt32(&central, offset);
+        PutString(&central, filename);
+    }
+
+    std::vector<uint8_t> end;
+    const uint64_t central_offset = local.size();
+    const uint64_t zip64_offset = central_offset + central.size();
+    PutUInt32(&end, 0x06064b50);
+    PutUInt64(&end, 44);
+    PutUInt16(&end, 45);
+    PutUInt16(&end, 45);
+    PutUInt32(&end, 0);
+    PutUInt32(&end, 0);
+    PutUInt64(&end, entries);
+    PutUInt64(&end, entries);
+    PutUInt64(&end, central.size());
+    PutUInt64(&end, central_offset);
+
+    PutUInt32(&end, 0x07064b50);
+    PutUInt32(&end, 0);
+    PutUInt64(&end, zip64_offset);
+    PutUInt32(&end, 1);
+
+    PutUInt32(&end, 0x06054b50);
+    PutUInt16(&end, 0);
+    PutUInt16(&end, 0);
+    PutUInt16(&end, 0xffff);
+    PutUInt16(&end, 0xffff);
+    PutUInt32(&end, 0xffffffff);
+    PutUInt32(&end, 0xffffffff);
+    PutUInt16(&end, 0);
+
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+    bool written = std::fwrite(local.data(), 1, local.size(), file) == local.size() &&
+        std::fwrite(central.data(), 1, central.size(), file) == central.size() &&
+        std::fwrite(end.data(), 1, end.size(), file) == end.size();
+    return std::fclose(file) == 0 && written;
+}
+
+// Writes a 7z of |entries| empty files, named as in the zip, to |path|.
+bool Write7z(juice::Archive* archive, const std::string& path, uint32_t entries) {
+    std::vector<juice::CompressItem> items(entries);
+    char name[32];
+    for (uint32_t i = 0; i < entries; ++i) {
+        std::snprintf(name, sizeof(name), "d%03u/f%07u.txt", i % 1000, i);
+        items[i].name = x::SysNativeMBToWide(name);
+    }
+    std::vector<uint8_t> buffer;
+    if (!archive->Compress(items, juice::Format::SEVENZ, &buffer, nullptr)) return false;
+
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+    bool written = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    return std::fclose(file) == 0 && written;
+}
+
+// Returns the average wall time of |function| in milliseconds, or a negative
+// value if one of the calls failed.
+template<typename Function>
+double Measure(int iterations, Function&& function) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        if (!function()) return -1.0;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::milli>(elapsed).count() / iterations;
+}
+
+void Report(const char* name, double milliseconds) {
+    if (milliseconds < 0) {
+        std::printf("%-28s failed\n", name);
+        return;
+    }
+    std::printf("%-28s %12.1f ms/listing\n", name, milliseconds);
+}
+
+void ReportLookup(const char* name, double milliseconds) {
+    if (milliseconds < 0) {
+        std::printf("%-28s failed\n", name);
+        return;
+    }
+    std::printf("%-28s %12.2f us/lookup\n", name, milliseconds * 1000);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <7z.so> [entries] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    const uint32_t entries = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 1000000;
+    const int iterations = argc > 3 ? std::max(1, std::atoi(argv[3])) : 5;
+
+    char directory[] = "/tmp/juice_listing_XXXXXX";
+    if (::mkdtemp(directory) == nullptr) return 1;
+    const std::string path = std::string(directory) + "/entries.zip";
+    if (!WriteZip(path, entries)) {
+        std::fprintf(stderr, "cannot write %s\n", path.c_str());
+        return 1;
+    }
+
+    juice::Archive archive(x::SysNativeMBToWide(argv[1]));
+    const std::wstring wide_path = x::SysNativeMBToWide(path);
+    auto list = [&]() {
+        uint32_t listed = 0;
+        bool opened = archive.Open(wide_path, juice::Format::ZIP, [&listed](const std::wstring&, const ULONGLONG&) {
+            listed++;
+        });
+        return opened && listed == entries;
+    };
+    juice::ArchiveListing listing;
+    auto columns = [&](uint32 wanted) {
+        return [&archive, &wide_path, &listing, entries, wanted]() {
+            return archive.List(wide_path, juice::Format::ZIP, wanted, &listing) && listing.count == entries;
+        };
+    };
+    const uint32 path_and_size = juice::ArchiveListing::PATH | juice::ArchiveListing::SIZE;
+
+    std::printf("%u entries, %d iterations\n", entries, iterations);
+    archive.SetMappedInput(false);
+    Report("juice Open (file stream)", Measure(iterations, list));
+    archive.SetMappedInput(true);
+    Report("juice Open (mapped)", Measure(iterations, list));
+    Report("juice List (path, size)", Measure(iterations, columns(path_and_size)));
+    Report("juice List (all)", Measure(iterations, columns(juice::ArchiveListing::ALL)));
+
+    const std::string path_7z = std::string(directory) + "/entries.7z";
+    if (!Write7z(&archive, path_7z, entries)) {
+        std::fprintf(stderr, "cannot write %s\n", path_7z.c_str());
+        return 1;
+    }
+    const std::wstring wide_path_7z = x::SysNativeMBToWide(path_7z);
+    auto list_7z = [&]() {
+        return archive.List(wide_path_7z, juice::Format::SEVENZ, path_and_size, &listing) && listing.count == entries;
+    };
+    archive.SetMappedInput(false);
+    Report("juice List 7z (file stream)", Measure(iterations, list_7z));
+    archive.SetMappedInput(true);
+    Report("juice List 7z (mapped)", Measure(iterations, list_7z));
+    ::unlink(path_7z.c_str());
+
+    juice::ArchiveReader reader(&archive);
+    Report("juice ArchiveReader Open", Measure(iterations, [&]() {
+        return reader.Open(wide_path, juice::Format::ZIP);
+    }));
+
+    // The first listing writes the sidecar.
+    archive.SetIndexCache(true);
+    Report("juice Open (index build)", Measure(1, list));
+    Report("juice Open (index cache)", Measure(iterations, list));
+    Report("juice List (cache, all)", Measure(iterations, columns(juice::ArchiveListing::ALL)));
+    Report("juice ArchiveReader (cache)", Measure(iterations, [&]() {
+        return reader.Open(wide_path, juice::Format::ZIP);
+    }));
+
+    const int lookups = 10000;
+    std::vector<std::wstring> names;
+    char name[32];
+    for (int i = 0; i < lookups; ++i) {
+        uint32_t entry = static_cast<uint32_t>((static_cast<uint64_t>(i) * 2654435761u) % entries);
+        std::snprintf(name, sizeof(name), "d%03u/f%07u.txt", entry % 1000, entry);
+        names.push_back(x::SysNativeMBToWide(name));
+    }
+    std::vector<uint8_t> data;
+    int next = 0;
+    ReportLookup("juice ArchiveReader Extract", Measure(lookups, [&]() {
+        uint32 index = 0;
+        return reader.Find(names[next++], &index) && reader.Extract(index, &data);
+    }));
+
+    reader.Close();
+    ::unlink(path.c_str());
+    ::unlink((path + ".jidx").c_str());
+    ::rmdir(directory);
+    return 0;
+}
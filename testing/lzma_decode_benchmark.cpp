@@ -0,0 +1,207 @@
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 The Authors of ANT(http:://ant.sh) . All Rights Reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+// Decodes LZMA streams with the C loop of LzmaDec.c and with the x64 loop of
+// Asm/x86/LzmaDecOpt.S, and checks that both give the input back. The files
+// given are the corpus, without them it is made of text, fixed size records
+// and noise. The "ring" rows decode through a 64 KiB dictionary in 4 KiB
+// steps, the way the handlers do, so that the matches wrap around it.
+//
+// Usage:
+//   lzma_decode_benchmark [iterations] [file...]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "LzmaDec.h"
+#include "LzmaEnc.h"
+
+#include "benchmark_data.h"
+
+namespace {
+
+using benchmark::MakeNoise;
+using benchmark::MakeText;
+using benchmark::ReadFile;
+
+void* Allocate(void*, size_t size) {
+    return std::malloc(size);
+}
+
+void Free(void*, void* address) {
+    std::free(address);
+}
+
+ISzAlloc g_alloc = { Allocate, Free };
+
+struct Input : benchmark::Input {
+    // The dictionary it is encoded with, zero for the default of level 5.
+    uint32_t dictionary = 0;
+    // Decoded through a dictionary of this size when it is not zero.
+    size_t ring_step = 0;
+
+    std::vector<uint8_t> encoded;
+    uint8_t props[LZMA_PROPS_SIZE];
+};
+
+std::vector<uint8_t> MakeRecords(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<uint8_t> records;
+    records.reserve(size + 32);
+    uint64_t time = 1500000000000ULL;
+    static const char* kKinds[] = { "open", "read", "write", "close", "stat", "seek" };
+    for (uint32_t id = 0; records.size() < size; ++id) {
+        uint8_t record[32] = {};
+        time += random() % 1000;
+        float value = static_cast<float>(random() % 10000) / 100.0f;
+        std::memcpy(record, &id, sizeof(id));
+        std::memcpy(record + 4, &time, sizeof(time));
+        std::memcpy(record + 12, &value, sizeof(value));
+        const char* kind = kKinds[random() % 6];
+        std::memcpy(record + 16, kind, std::strlen(kind));
+        records.insert(records.end(), record, record + sizeof(record));
+    }
+    records.resize(size);
+    return records;
+}
+
+bool Encode(Input* input) {
+    CLzmaEncProps props;
+    LzmaEncProps_Init(&props);
+    props.level = 5;
+    if (input->dictionary != 0) props.dictSize = input->dictionary;
+
+    input->encoded.resize(input->data.size() + input->data.size() / 3 + (1 << 12));
+    SizeT encoded_size = input->encoded.size();
+    SizeT props_size = LZMA_PROPS_SIZE;
+    SRes result = LzmaEncode(input->encoded.data(), &encoded_size, input->data.data(), input->data.size(), &props,
+        input->props, &props_size, 0, nullptr, &g_alloc, &g_alloc);
+    input->encoded.resize(encoded_size);
+    return result == SZ_OK;
+}
+
+// The whole stream into one buffer.
+bool Decode(const Input& input, std::vector<uint8_t>* output) {
+    output->resize(input.data.size());
+    SizeT output_size = output->size();
+    SizeT input_size = input.encoded.size();
+    ELzmaStatus status;
+    SRes result = LzmaDecode(output->data(), &output_size, input.encoded.data(), &input_size, input.props,
+        LZMA_PROPS_SIZE, LZMA_FINISH_END, &status, &g_alloc);
+    return result == SZ_OK && output_size == input.data.size();
+}
+
+// Through the dictionary of the decoder, |input.ring_step| bytes at a time.
+bool DecodeRing(const Input& input, std::vector<uint8_t>* output) {
+    CLzmaDec decoder;
+    LzmaDec_Construct(&decoder);
+    if (LzmaDec_Allocate(&decoder, input.props, LZMA_PROPS_SIZE, &g_alloc) != SZ_OK) return false;
+    LzmaDec_Init(&decoder);
+
+    output->clear();
+    size_t position = 0;
+    while (output->size() < input.data.size()) {
+        if (decoder.dicPos == decoder.dicBufSize) decoder.dicPos = 0;
+        SizeT start = decoder.dicPos;
+        SizeT limit = std::min(decoder.dicBufSize, start + input.ring_step);
+        limit = std::min<SizeT>(limit, start + (input.data.size() - output->size()));
+        SizeT input_size = input.encoded.size() - position;
+        ELzmaStatus status;
+        SRes result = LzmaDec_DecodeToDic(&decoder, limit, input.encoded.data() + position, &input_size,
+            LZMA_FINISH_ANY, &status);
+        position += input_size;
+        output->insert(output->end(), decoder.dic + start, decoder.dic + decoder.dicPos);
+        if (result != SZ_OK || (input_size == 0 && decoder.dicPos == start)) break;
+    }
+    LzmaDec_Free(&decoder, &g_alloc);
+    return output->size() == input.data.size();
+}
+
+// Returns MB/s of decoded data, or a negative number if the output differs.
+double Measure(const Input& input, int iterations) {
+    std::vector<uint8_t> output;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        bool decoded = input.ring_step != 0 ? DecodeRing(input, &output) : Decode(input, &output);
+        if (!decoded || output != input.data) return -1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(input.data.size()) * iterations / seconds / 1e6;
+}
+
+void Report(const std::string& name, const char* loop, double speed, double baseline) {
+    if (speed < 0) {
+        std::printf("%-20s %-4s failed\n", name.c_str(), loop);
+        return;
+    }
+    std::printf("%-20s %-4s %10.1f MB/s", name.c_str(), loop, speed);
+    if (baseline > 0) std::printf("  %+6.1f%%", (speed / baseline - 1) * 100);
+    std::printf("\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 5;
+
+    std::vector<Input> inputs;
+    for (int i = 2; i < argc; ++i) {
+        Input input;
+        input.name = argv[i];
+        if (!ReadFile(argv[i], &input.data)) {
+            std::fprintf(stderr, "cannot read %s\n", argv[i]);
+            return 1;
+        }
+        inputs.push_back(std::move(input));
+    }
+    if (inputs.empty()) {
+        const size_t kSize = 8 << 20;
+        inputs.resize(4);
+        inputs[0].name = "text";
+        inputs[0].data = MakeText(kSize, 1);
+        inputs[1].name = "records";
+        inputs[1].data = MakeRecords(kSize, 2);
+        inputs[2].name = "noise";
+        inputs[2].data = MakeNoise(kSize / 4, 3);
+        inputs[3].name = "text ring 64 KiB";
+        inputs[3].data = MakeText(kSize, 4);
+        inputs[3].dictionary = 1 << 16;
+        inputs[3].ring_step = 1 << 12;
+    }
+
+    for (auto& input : inputs) {
+        if (!Encode(&input)) {
+            std::fprintf(stderr, "cannot encode %s\n", input.name.c_str());
+            return 1;
+        }
+        std::printf("%-20s %10zu -> %10zu bytes\n", input.name.c_str(), input.data.size(), input.encoded.size());
+    }
+
+    bool failed = false;
+    for (const auto& input : inputs) {
+#if defined(_LZMA_DEC_OPT)
+        LzmaDec_UseOpt(False);
+#endif
+        double c = Measure(input, iterations);
+        Report(input.name, "C", c, 0);
+        failed |= c < 0;
+#if defined(_LZMA_DEC_OPT)
+        LzmaDec_UseOpt(True);
+        double opt = Measure(input, iterations);
+        Report(input.name, "asm", opt, c);
+        failed |= opt < 0;
+#endif
+    }
+    return failed ? 1 : 0;
+}
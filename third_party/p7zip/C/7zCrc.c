@@ -1,11 +1,15 @@
 /* 7zCrc.c -- CRC32 init
-2015-03-10 : Igor Pavlov : Public domain */
+2018-10-16 : Igor Pavlov : Public domain */
 
 #include "Precomp.h"
 
 #include "7zCrc.h"
 #include "CpuArch.h"
 
+#ifdef _7ZIP_CRC_CLMUL
+#include "CrcClmul.h"
+#endif
+
 #define kCrcPoly 0xEDB88320
 
 #ifdef MY_CPU_LE
@@ -28,10 +32,49 @@ typedef UInt32 (MY_FAST_CALL *CRC_FUNC)(UInt32 v, const void *data, size_t size,
 
 CRC_FUNC g_CrcUpdateT4;
 CRC_FUNC g_CrcUpdateT8;
+CRC_FUNC g_CrcUpdateClmul;
+CRC_FUNC g_CrcUpdateVClmul;
 CRC_FUNC g_CrcUpdate;
 
 UInt32 g_CrcTable[256 * CRC_NUM_TABLES];
 
+#if defined(_7ZIP_CRC_CLMUL) && defined(CRC_CLMUL_SUPPORTED)
+
+static CCrcClmulKeys g_CrcClmulKeys;
+static CRC_FUNC g_CrcUpdateTables;
+
+static UInt32 MY_FAST_CALL CrcUpdateClmul(UInt32 v, const void *data, size_t size, const UInt32 *table)
+{
+  if (size >= CRC_CLMUL_MIN_SIZE)
+  {
+    Byte state[16];
+    size_t folded = CrcClmul_Fold(v, (const Byte *)data, size, &g_CrcClmulKeys, state);
+    v = g_CrcUpdateTables(0, state, 16, table);
+    data = (const Byte *)data + folded;
+    size -= folded;
+  }
+  return g_CrcUpdateTables(v, data, size, table);
+}
+
+#ifdef CRC_VCLMUL_SUPPORTED
+
+static UInt32 MY_FAST_CALL CrcUpdateVClmul(UInt32 v, const void *data, size_t size, const UInt32 *table)
+{
+  if (size >= CRC_VCLMUL_MIN_SIZE)
+  {
+    Byte state[16];
+    size_t folded = CrcClmul_VFold(v, (const Byte *)data, size, &g_CrcClmulKeys, state);
+    v = g_CrcUpdateTables(0, state, 16, table);
+    data = (const Byte *)data + folded;
+    size -= folded;
+  }
+  return CrcUpdateClmul(v, data, size, table);
+}
+
+#endif
+
+#endif
+
 UInt32 MY_FAST_CALL CrcUpdate(UInt32 v, const void *data, size_t size)
 {
   return g_CrcUpdate(v, data, size, g_CrcTable);
@@ -90,6 +133,24 @@ void MY_FAST_CALL CrcGenerateTable()
       #endif
     #endif
 
+    #if defined(_7ZIP_CRC_CLMUL) && defined(CRC_CLMUL_SUPPORTED)
+    if (CPU_Is_Clmul_Supported())
+    {
+      CrcClmulKeys_Init(&g_CrcClmulKeys, kCrcPoly, 32);
+      /* the folded state and the tails still go through the tables */
+      g_CrcUpdateTables = g_CrcUpdate;
+      g_CrcUpdateClmul = CrcUpdateClmul;
+      g_CrcUpdate = CrcUpdateClmul;
+      #ifdef CRC_VCLMUL_SUPPORTED
+      if (CPU_Is_VClmul_Supported())
+      {
+        g_CrcUpdateVClmul = CrcUpdateVClmul;
+        g_CrcUpdate = CrcUpdateVClmul;
+      }
+      #endif
+    }
+    #endif
+
   #else
   {
     #ifndef MY_CPU_BE
@@ -1,11 +1,19 @@
 /* Aes.c -- AES encryption / decryption
-2016-05-21 : Igor Pavlov : Public domain */
+2018-10-16 : Igor Pavlov : Public domain */
 
 #include "Precomp.h"
 
 #include "Aes.h"
 #include "CpuArch.h"
 
+#ifdef _7ZIP_AES_OPT
+  #include "AesOpt.h"
+#endif
+
+#if defined(MY_CPU_X86_OR_AMD64) && (defined(_7ZIP_ASM) || defined(AES_HW_SUPPORTED))
+  #define AES_USE_INTEL
+#endif
+
 static UInt32 T[256 * 4];
 static const Byte Sbox[256] = {
   0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
@@ -33,9 +41,15 @@ void MY_FAST_CALL AesCbc_Encode_Intel(UInt32 *ivAes, Byte *data, size_t numBlock
 void MY_FAST_CALL AesCbc_Decode_Intel(UInt32 *ivAes, Byte *data, size_t numBlocks);
 void MY_FAST_CALL AesCtr_Code_Intel(UInt32 *ivAes, Byte *data, size_t numBlocks);
 
+static void MY_FAST_CALL AesCbc_Encode_Multi(UInt32 * const *ivAes, Byte * const *data, size_t numBlocks, unsigned num);
+
 AES_CODE_FUNC g_AesCbc_Encode;
 AES_CODE_FUNC g_AesCbc_Decode;
 AES_CODE_FUNC g_AesCtr_Code;
+AES_CODE_MULTI_FUNC g_AesCbc_Encode_Multi;
+
+/* the highest AES_ALGO_* that the CPU runs */
+static unsigned g_Aes_MaxAlgo = AES_ALGO_SW;
 
 static UInt32 D[256 * 4];
 static Byte InvS[256];
@@ -87,17 +101,75 @@ void AesGenTables(void)
   g_AesCbc_Encode = AesCbc_Encode;
   g_AesCbc_Decode = AesCbc_Decode;
   g_AesCtr_Code = AesCtr_Code;
+  g_AesCbc_Encode_Multi = AesCbc_Encode_Multi;
+  g_Aes_MaxAlgo = AES_ALGO_SW;
   
-  #ifdef MY_CPU_X86_OR_AMD64
-  #ifdef _7ZIP_ASM
+  #ifdef AES_USE_INTEL
   if (CPU_Is_Aes_Supported())
   {
     g_AesCbc_Encode = AesCbc_Encode_Intel;
     g_AesCbc_Decode = AesCbc_Decode_Intel;
     g_AesCtr_Code = AesCtr_Code_Intel;
+    g_Aes_MaxAlgo = AES_ALGO_HW;
+    #ifdef AES_HW_SUPPORTED
+    g_AesCbc_Encode_Multi = AesCbc_Encode_Multi_Intel;
+    #endif
+    #ifdef AES_VAES_SUPPORTED
+    if (CPU_Is_VAes_Supported())
+    {
+      g_AesCbc_Decode = AesCbc_Decode_VAes;
+      g_AesCtr_Code = AesCtr_Code_VAes;
+      g_Aes_MaxAlgo = AES_ALGO_VAES;
+      if (CPU_Is_VAes512_Supported())
+      {
+        g_AesCbc_Decode = AesCbc_Decode_VAes512;
+        g_AesCtr_Code = AesCtr_Code_VAes512;
+        g_Aes_MaxAlgo = AES_ALGO_VAES512;
+      }
+    }
+    #endif
   }
   #endif
-  #endif
+}
+
+Bool Aes_GetFunctions(unsigned algo, AES_CODE_FUNC *cbcEncode, AES_CODE_FUNC *cbcDecode, AES_CODE_FUNC *ctr)
+{
+  if (algo > g_Aes_MaxAlgo)
+    return False;
+  switch (algo)
+  {
+    case AES_ALGO_DEFAULT:
+      *cbcEncode = g_AesCbc_Encode;
+      *cbcDecode = g_AesCbc_Decode;
+      *ctr = g_AesCtr_Code;
+      return True;
+    case AES_ALGO_SW:
+      *cbcEncode = AesCbc_Encode;
+      *cbcDecode = AesCbc_Decode;
+      *ctr = AesCtr_Code;
+      return True;
+    #ifdef AES_USE_INTEL
+    case AES_ALGO_HW:
+      *cbcEncode = AesCbc_Encode_Intel;
+      *cbcDecode = AesCbc_Decode_Intel;
+      *ctr = AesCtr_Code_Intel;
+      return True;
+    #endif
+    #ifdef AES_VAES_SUPPORTED
+    /* CBC encoding has one block in flight, VAES can't help it */
+    case AES_ALGO_VAES:
+      *cbcEncode = AesCbc_Encode_Intel;
+      *cbcDecode = AesCbc_Decode_VAes;
+      *ctr = AesCtr_Code_VAes;
+      return True;
+    case AES_ALGO_VAES512:
+      *cbcEncode = AesCbc_Encode_Intel;
+      *cbcDecode = AesCbc_Decode_VAes512;
+      *ctr = AesCtr_Code_VAes512;
+      return True;
+    #endif
+  }
+  return False;
 }
 
 
@@ -295,3 +367,10 @@ void MY_FAST_CALL AesCtr_Code(UInt32 *p, Byte *data, size_t numBlocks)
       *data++ ^= buf[i];
   }
 }
+
+static void MY_FAST_CALL AesCbc_Encode_Multi(UInt32 * const *ivAes, Byte * const *data, size_t numBlocks, unsigned num)
+{
+  unsigned i;
+  for (i = 0; i < num; i++)
+    g_AesCbc_Encode(ivAes[i], data[i], numBlocks);
+}
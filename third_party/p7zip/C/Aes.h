@@ -1,5 +1,5 @@
 /* Aes.h -- AES encryption / decryption
-2013-01-18 : Igor Pavlov : Public domain */
+2018-10-16 : Igor Pavlov : Public domain */
 
 #ifndef __AES_H
 #define __AES_H
@@ -33,6 +33,29 @@ extern AES_CODE_FUNC g_AesCbc_Encode;
 extern AES_CODE_FUNC g_AesCbc_Decode;
 extern AES_CODE_FUNC g_AesCtr_Code;
 
+/*
+CBC encoding of (num) independent streams of (numBlocks) blocks each.
+ivAes[i] and data[i] are as for g_AesCbc_Encode. CBC encoding of one stream
+can't run its blocks in parallel, but the streams can run together.
+*/
+typedef void (MY_FAST_CALL *AES_CODE_MULTI_FUNC)(UInt32 * const *ivAes, Byte * const *data, size_t numBlocks, unsigned num);
+extern AES_CODE_MULTI_FUNC g_AesCbc_Encode_Multi;
+
+#define AES_ALGO_DEFAULT 0
+#define AES_ALGO_SW      1
+#define AES_ALGO_HW      2
+#define AES_ALGO_VAES    3
+#define AES_ALGO_VAES512 4
+
+/*
+Aes_GetFunctions() gives the CBC encoding, CBC decoding and CTR code of (algo).
+AES_ALGO_DEFAULT is the fastest code for the CPU, as in g_AesCbc_Encode, g_AesCbc_Decode and g_AesCtr_Code.
+return:
+  0 - the CPU or the build has no code for (algo)
+  1 - the functions were set
+*/
+Bool Aes_GetFunctions(unsigned algo, AES_CODE_FUNC *cbcEncode, AES_CODE_FUNC *cbcDecode, AES_CODE_FUNC *ctr);
+
 EXTERN_C_END
 
 #endif
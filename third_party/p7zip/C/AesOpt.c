@@ -0,0 +1,491 @@
+/* AesOpt.c -- AES with AES-NI and VAES
+2018-10-16 : Igor Pavlov : Public domain */
+
+#include "Precomp.h"
+
+#include "AesOpt.h"
+
+/*
+ivAes is the iv (or the counter) block, the block whose first word is
+numRounds / 2, and the round keys. The decoding keys are in the order of
+the encoding ones, so decoding starts from the last key.
+*/
+
+#ifdef AES_HW_SUPPORTED
+
+#include <wmmintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define ATTRIB_AES __attribute__((__target__("sse2,aes")))
+#else
+  #define ATTRIB_AES
+#endif
+
+#define NUM_ROUNDS2(p) (*(const UInt32 *)(const void *)((p) + 1))
+
+ATTRIB_AES
+void MY_FAST_CALL AesCbc_Encode_Intel(UInt32 *ivAes, Byte *data8, size_t numBlocks)
+{
+  __m128i *p = (__m128i *)(void *)ivAes;
+  __m128i *data = (__m128i *)(void *)data8;
+  __m128i m = *p;
+  for (; numBlocks != 0; numBlocks--, data++)
+  {
+    UInt32 numRounds2 = NUM_ROUNDS2(p) - 1;
+    const __m128i *w = p + 3;
+    m = _mm_xor_si128(m, *data);
+    m = _mm_xor_si128(m, p[2]);
+    do
+    {
+      m = _mm_aesenc_si128(m, w[0]);
+      m = _mm_aesenc_si128(m, w[1]);
+      w += 2;
+    }
+    while (--numRounds2 != 0);
+    m = _mm_aesenc_si128(m, w[0]);
+    m = _mm_aesenclast_si128(m, w[1]);
+    *data = m;
+  }
+  *p = m;
+}
+
+/* AES instructions have a latency of several cycles and a throughput of 1 or 2 per cycle */
+#define NUM_WAYS 8
+
+#define AES_OP_W(op, n) { \
+    const __m128i t = w[n]; \
+    m0 = op(m0, t); \
+    m1 = op(m1, t); \
+    m2 = op(m2, t); \
+    m3 = op(m3, t); \
+    m4 = op(m4, t); \
+    m5 = op(m5, t); \
+    m6 = op(m6, t); \
+    m7 = op(m7, t); \
+    }
+
+#define AES_DEC(n) AES_OP_W(_mm_aesdec_si128, n)
+#define AES_DEC_LAST(n) AES_OP_W(_mm_aesdeclast_si128, n)
+#define AES_ENC(n) AES_OP_W(_mm_aesenc_si128, n)
+#define AES_ENC_LAST(n) AES_OP_W(_mm_aesenclast_si128, n)
+
+#define CBC_XOR(i) { const __m128i t = _mm_xor_si128(m ## i, iv); iv = data[i]; data[i] = t; }
+#define CTR_START(i) ctr = _mm_add_epi64(ctr, one); m ## i = _mm_xor_si128(ctr, t);
+#define CTR_XOR(i) data[i] = _mm_xor_si128(data[i], m ## i);
+
+ATTRIB_AES
+void MY_FAST_CALL AesCbc_Decode_Intel(UInt32 *ivAes, Byte *data8, size_t numBlocks)
+{
+  __m128i *p = (__m128i *)(void *)ivAes;
+  __m128i *data = (__m128i *)(void *)data8;
+  __m128i iv = *p;
+  for (; numBlocks >= NUM_WAYS; numBlocks -= NUM_WAYS, data += NUM_WAYS)
+  {
+    UInt32 numRounds2 = NUM_ROUNDS2(p);
+    const __m128i *w = p + numRounds2 * 2;
+    __m128i m0, m1, m2, m3, m4, m5, m6, m7;
+    {
+      const __m128i t = w[2];
+      m0 = _mm_xor_si128(t, data[0]);
+      m1 = _mm_xor_si128(t, data[1]);
+      m2 = _mm_xor_si128(t, data[2]);
+      m3 = _mm_xor_si128(t, data[3]);
+      m4 = _mm_xor_si128(t, data[4]);
+      m5 = _mm_xor_si128(t, data[5]);
+      m6 = _mm_xor_si128(t, data[6]);
+      m7 = _mm_xor_si128(t, data[7]);
+    }
+    numRounds2--;
+    do
+    {
+      AES_DEC(1)
+      AES_DEC(0)
+      w -= 2;
+    }
+    while (--numRounds2 != 0);
+    AES_DEC(1)
+    AES_DEC_LAST(0)
+
+    CBC_XOR(0) CBC_XOR(1) CBC_XOR(2) CBC_XOR(3)
+    CBC_XOR(4) CBC_XOR(5) CBC_XOR(6) CBC_XOR(7)
+  }
+  for (; numBlocks != 0; numBlocks--, data++)
+  {
+    UInt32 numRounds2 = NUM_ROUNDS2(p);
+    const __m128i *w = p + numRounds2 * 2;
+    __m128i m = _mm_xor_si128(w[2], *data);
+    numRounds2--;
+    do
+    {
+      m = _mm_aesdec_si128(m, w[1]);
+      m = _mm_aesdec_si128(m, w[0]);
+      w -= 2;
+    }
+    while (--numRounds2 != 0);
+    m = _mm_aesdec_si128(m, w[1]);
+    m = _mm_aesdeclast_si128(m, w[0]);
+
+    m = _mm_xor_si128(m, iv);
+    iv = *data;
+    *data = m;
+  }
+  *p = iv;
+}
+
+ATTRIB_AES
+void MY_FAST_CALL AesCtr_Code_Intel(UInt32 *ivAes, Byte *data8, size_t numBlocks)
+{
+  __m128i *p = (__m128i *)(void *)ivAes;
+  __m128i *data = (__m128i *)(void *)data8;
+  __m128i ctr = *p;
+  /* the counter is the low 64 bits */
+  const __m128i one = _mm_cvtsi32_si128(1);
+  for (; numBlocks >= NUM_WAYS; numBlocks -= NUM_WAYS, data += NUM_WAYS)
+  {
+    UInt32 numRounds2 = NUM_ROUNDS2(p) - 1;
+    const __m128i *w = p;
+    __m128i m0, m1, m2, m3, m4, m5, m6, m7;
+    {
+      const __m128i t = w[2];
+      CTR_START(0) CTR_START(1) CTR_START(2) CTR_START(3)
+      CTR_START(4) CTR_START(5) CTR_START(6) CTR_START(7)
+    }
+    w += 3;
+    do
+    {
+      AES_ENC(0)
+      AES_ENC(1)
+      w += 2;
+    }
+    while (--numRounds2 != 0);
+    AES_ENC(0)
+    AES_ENC_LAST(1)
+
+    CTR_XOR(0) CTR_XOR(1) CTR_XOR(2) CTR_XOR(3)
+    CTR_XOR(4) CTR_XOR(5) CTR_XOR(6) CTR_XOR(7)
+  }
+  for (; numBlocks != 0; numBlocks--, data++)
+  {
+    UInt32 numRounds2 = NUM_ROUNDS2(p) - 1;
+    const __m128i *w = p;
+    __m128i m;
+    ctr = _mm_add_epi64(ctr, one);
+    m = _mm_xor_si128(ctr, p[2]);
+    w += 3;
+    do
+    {
+      m = _mm_aesenc_si128(m, w[0]);
+      m = _mm_aesenc_si128(m, w[1]);
+      w += 2;
+    }
+    while (--numRounds2 != 0);
+    m = _mm_aesenc_si128(m, w[0]);
+    m = _mm_aesenclast_si128(m, w[1]);
+    *data = _mm_xor_si128(*data, m);
+  }
+  *p = ctr;
+}
+
+/*
+CBC encoding of one stream is a chain of dependent blocks, so a single
+stream waits for the latency of every round. 4 streams go through the
+rounds together, each with its own keys.
+*/
+
+#define NUM_STREAMS 4
+
+#define ENC_4(op, r) \
+    m0 = op(m0, p0[r]); \
+    m1 = op(m1, p1[r]); \
+    m2 = op(m2, p2[r]); \
+    m3 = op(m3, p3[r]);
+
+#define CBC_START(k) m ## k = _mm_xor_si128(_mm_xor_si128(m ## k, d ## k[i]), p ## k[2]);
+#define CBC_STORE(k) d ## k[i] = m ## k;
+
+ATTRIB_AES
+static void AesCbc_Encode_4(UInt32 * const *ivAes, Byte * const *data, size_t numBlocks)
+{
+  __m128i *p0 = (__m128i *)(void *)ivAes[0];
+  __m128i *p1 = (__m128i *)(void *)ivAes[1];
+  __m128i *p2 = (__m128i *)(void *)ivAes[2];
+  __m128i *p3 = (__m128i *)(void *)ivAes[3];
+  __m128i *d0 = (__m128i *)(void *)data[0];
+  __m128i *d1 = (__m128i *)(void *)data[1];
+  __m128i *d2 = (__m128i *)(void *)data[2];
+  __m128i *d3 = (__m128i *)(void *)data[3];
+  __m128i m0 = *p0, m1 = *p1, m2 = *p2, m3 = *p3;
+  const UInt32 numRounds = NUM_ROUNDS2(p0) * 2;
+  size_t i;
+
+  for (i = 0; i < numBlocks; i++)
+  {
+    UInt32 r;
+    CBC_START(0) CBC_START(1) CBC_START(2) CBC_START(3)
+    for (r = 3; r < numRounds + 2; r++)
+    {
+      ENC_4(_mm_aesenc_si128, r)
+    }
+    ENC_4(_mm_aesenclast_si128, numRounds + 2)
+    CBC_STORE(0) CBC_STORE(1) CBC_STORE(2) CBC_STORE(3)
+  }
+  *p0 = m0;
+  *p1 = m1;
+  *p2 = m2;
+  *p3 = m3;
+}
+
+void MY_FAST_CALL AesCbc_Encode_Multi_Intel(UInt32 * const *ivAes, Byte * const *data, size_t numBlocks, unsigned num)
+{
+  for (; num != 0; ivAes++, data++, num--)
+  {
+    /* the streams of a group use keys of the same size */
+    if (num >= NUM_STREAMS)
+    {
+      const UInt32 numRounds2 = NUM_ROUNDS2((const __m128i *)(const void *)ivAes[0]);
+      if (numRounds2 == NUM_ROUNDS2((const __m128i *)(const void *)ivAes[1])
+          && numRounds2 == NUM_ROUNDS2((const __m128i *)(const void *)ivAes[2])
+          && numRounds2 == NUM_ROUNDS2((const __m128i *)(const void *)ivAes[3]))
+      {
+        AesCbc_Encode_4(ivAes, data, numBlocks);
+        ivAes += NUM_STREAMS - 1;
+        data += NUM_STREAMS - 1;
+        num -= NUM_STREAMS - 1;
+        continue;
+      }
+    }
+    AesCbc_Encode_Intel(ivAes[0], data[0], numBlocks);
+  }
+}
+
+#endif
+
+
+#ifdef AES_VAES_SUPPORTED
+
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define ATTRIB_VAES __attribute__((__target__("avx2,aes,vaes")))
+  #define ATTRIB_VAES512 __attribute__((__target__("avx512f,aes,vaes")))
+#else
+  #define ATTRIB_VAES
+  #define ATTRIB_VAES512
+#endif
+
+/*
+The VAES code keeps 16 blocks in flight: 8 registers of 2 blocks with AVX2
+and 4 registers of 4 blocks with AVX-512. The keys are broadcast to every
+block lane once per call, and the last blocks go to the AES-NI code.
+*/
+
+#define V_OP_8(op, k) \
+    v0 = op(v0, k); v1 = op(v1, k); v2 = op(v2, k); v3 = op(v3, k); \
+    v4 = op(v4, k); v5 = op(v5, k); v6 = op(v6, k); v7 = op(v7, k);
+
+#define V_OP_4(op, k) \
+    v0 = op(v0, k); v1 = op(v1, k); v2 = op(v2, k); v3 = op(v3, k);
+
+#define LOADU_256(p) _mm256_loadu_si256((const __m256i *)(const void *)(p))
+#define STOREU_256(p, v) _mm256_storeu_si256((__m256i *)(void *)(p), v)
+#define LOADU_512(p) _mm512_loadu_si512((const void *)(p))
+#define STOREU_512(p, v) _mm512_storeu_si512((void *)(p), v)
+
+/* the ciphertext for the register i + 1 is loaded before the register i is stored over it */
+#define CBC_XOR_256(i) \
+    { const __m256i next = LOADU_256(data + (i) * 32 + 16); \
+    STOREU_256(data + (i) * 32, _mm256_xor_si256(v ## i, prev)); \
+    prev = next; }
+
+ATTRIB_VAES
+void MY_FAST_CALL AesCbc_Decode_VAes(UInt32 *ivAes, Byte *data, size_t numBlocks)
+{
+  __m128i *p = (__m128i *)(void *)ivAes;
+  const UInt32 numRounds = NUM_ROUNDS2(p) * 2;
+  __m256i keys[15];
+  UInt32 r;
+
+  for (r = 0; r <= numRounds; r++)
+    keys[r] = _mm256_broadcastsi128_si256(p[2 + numRounds - r]);
+
+  for (; numBlocks >= 16; numBlocks -= 16, data += 16 * 16)
+  {
+    __m256i v0, v1, v2, v3, v4, v5, v6, v7, prev;
+    {
+      const __m256i k = keys[0];
+      v0 = _mm256_xor_si256(k, LOADU_256(data));
+      v1 = _mm256_xor_si256(k, LOADU_256(data + 32));
+      v2 = _mm256_xor_si256(k, LOADU_256(data + 64));
+      v3 = _mm256_xor_si256(k, LOADU_256(data + 96));
+      v4 = _mm256_xor_si256(k, LOADU_256(data + 128));
+      v5 = _mm256_xor_si256(k, LOADU_256(data + 160));
+      v6 = _mm256_xor_si256(k, LOADU_256(data + 192));
+      v7 = _mm256_xor_si256(k, LOADU_256(data + 224));
+    }
+    for (r = 1; r < numRounds; r++)
+    {
+      const __m256i k = keys[r];
+      V_OP_8(_mm256_aesdec_epi128, k)
+    }
+    {
+      const __m256i k = keys[numRounds];
+      V_OP_8(_mm256_aesdeclast_epi128, k)
+    }
+
+    prev = _mm256_inserti128_si256(_mm256_castsi128_si256(*p), *(const __m128i *)(const void *)data, 1);
+    *p = *(const __m128i *)(const void *)(data + 15 * 16);
+    CBC_XOR_256(0) CBC_XOR_256(1) CBC_XOR_256(2) CBC_XOR_256(3)
+    CBC_XOR_256(4) CBC_XOR_256(5) CBC_XOR_256(6)
+    STOREU_256(data + 7 * 32, _mm256_xor_si256(v7, prev));
+  }
+
+  if (numBlocks != 0)
+    AesCbc_Decode_Intel(ivAes, data, numBlocks);
+}
+
+ATTRIB_VAES
+void MY_FAST_CALL AesCtr_Code_VAes(UInt32 *ivAes, Byte *data, size_t numBlocks)
+{
+  __m128i *p = (__m128i *)(void *)ivAes;
+  const UInt32 numRounds = NUM_ROUNDS2(p) * 2;
+  __m256i keys[15];
+  __m256i ctr;
+  /* the counters are the low 64 bits of each block lane */
+  const __m256i two = _mm256_set_epi64x(0, 2, 0, 2);
+  UInt32 r;
+
+  for (r = 0; r <= numRounds; r++)
+    keys[r] = _mm256_broadcastsi128_si256(p[2 + r]);
+  ctr = _mm256_add_epi64(_mm256_broadcastsi128_si256(*p), _mm256_set_epi64x(0, 2, 0, 1));
+
+  for (; numBlocks >= 16; numBlocks -= 16, data += 16 * 16)
+  {
+    __m256i v0, v1, v2, v3, v4, v5, v6, v7;
+    {
+      const __m256i k = keys[0];
+      v0 = _mm256_xor_si256(ctr, k); ctr = _mm256_add_epi64(ctr, two);
+      v1 = _mm256_xor_si256(ctr, k); ctr = _mm256_add_epi64(ctr, two);
+      v2 = _mm256_xor_si256(ctr, k); ctr = _mm256_add_epi64(ctr, two);
+      v3 = _mm256_xor_si256(ctr, k); ctr = _mm256_add_epi64(ctr, two);
+      v4 = _mm256_xor_si256(ctr, k); ctr = _mm256_add_epi64(ctr, two);
+      v5 = _mm256_xor_si256(ctr, k); ctr = _mm256_add_epi64(ctr, two);
+      v6 = _mm256_xor_si256(ctr, k); ctr = _mm256_add_epi64(ctr, two);
+      v7 = _mm256_xor_si256(ctr, k); ctr = _mm256_add_epi64(ctr, two);
+    }
+    for (r = 1; r < numRounds; r++)
+    {
+      const __m256i k = keys[r];
+      V_OP_8(_mm256_aesenc_epi128, k)
+    }
+    {
+      const __m256i k = keys[numRounds];
+      V_OP_8(_mm256_aesenclast_epi128, k)
+    }
+    STOREU_256(data,       _mm256_xor_si256(v0, LOADU_256(data)));
+    STOREU_256(data + 32,  _mm256_xor_si256(v1, LOADU_256(data + 32)));
+    STOREU_256(data + 64,  _mm256_xor_si256(v2, LOADU_256(data + 64)));
+    STOREU_256(data + 96,  _mm256_xor_si256(v3, LOADU_256(data + 96)));
+    STOREU_256(data + 128, _mm256_xor_si256(v4, LOADU_256(data + 128)));
+    STOREU_256(data + 160, _mm256_xor_si256(v5, LOADU_256(data + 160)));
+    STOREU_256(data + 192, _mm256_xor_si256(v6, LOADU_256(data + 192)));
+    STOREU_256(data + 224, _mm256_xor_si256(v7, LOADU_256(data + 224)));
+  }
+
+  /* the low lane is the next counter, the one before it was used last */
+  *p = _mm_sub_epi64(_mm256_castsi256_si128(ctr), _mm_cvtsi32_si128(1));
+  if (numBlocks != 0)
+    AesCtr_Code_Intel(ivAes, data, numBlocks);
+}
+
+#define CBC_XOR_512(i) \
+    { const __m512i next = LOADU_512(data + (i) * 64 + 48); \
+    STOREU_512(data + (i) * 64, _mm512_xor_si512(v ## i, prev)); \
+    prev = next; }
+
+ATTRIB_VAES512
+void MY_FAST_CALL AesCbc_Decode_VAes512(UInt32 *ivAes, Byte *data, size_t numBlocks)
+{
+  __m128i *p = (__m128i *)(void *)ivAes;
+  const UInt32 numRounds = NUM_ROUNDS2(p) * 2;
+  __m512i keys[15];
+  UInt32 r;
+
+  for (r = 0; r <= numRounds; r++)
+    keys[r] = _mm512_broadcast_i32x4(p[2 + numRounds - r]);
+
+  for (; numBlocks >= 16; numBlocks -= 16, data += 16 * 16)
+  {
+    __m512i v0, v1, v2, v3, prev;
+    {
+      const __m512i k = keys[0];
+      v0 = _mm512_xor_si512(k, LOADU_512(data));
+      v1 = _mm512_xor_si512(k, LOADU_512(data + 64));
+      v2 = _mm512_xor_si512(k, LOADU_512(data + 128));
+      v3 = _mm512_xor_si512(k, LOADU_512(data + 192));
+    }
+    for (r = 1; r < numRounds; r++)
+    {
+      const __m512i k = keys[r];
+      V_OP_4(_mm512_aesdec_epi128, k)
+    }
+    {
+      const __m512i k = keys[numRounds];
+      V_OP_4(_mm512_aesdeclast_epi128, k)
+    }
+
+    /* the iv and the first 3 blocks, the masked out block before data is not read */
+    prev = _mm512_mask_loadu_epi64(_mm512_castsi128_si512(*p), 0xFC, data - 16);
+    *p = *(const __m128i *)(const void *)(data + 15 * 16);
+    CBC_XOR_512(0) CBC_XOR_512(1) CBC_XOR_512(2)
+    STOREU_512(data + 3 * 64, _mm512_xor_si512(v3, prev));
+  }
+
+  if (numBlocks != 0)
+    AesCbc_Decode_Intel(ivAes, data, numBlocks);
+}
+
+ATTRIB_VAES512
+void MY_FAST_CALL AesCtr_Code_VAes512(UInt32 *ivAes, Byte *data, size_t numBlocks)
+{
+  __m128i *p = (__m128i *)(void *)ivAes;
+  const UInt32 numRounds = NUM_ROUNDS2(p) * 2;
+  __m512i keys[15];
+  __m512i ctr;
+  const __m512i four = _mm512_set_epi64(0, 4, 0, 4, 0, 4, 0, 4);
+  UInt32 r;
+
+  for (r = 0; r <= numRounds; r++)
+    keys[r] = _mm512_broadcast_i32x4(p[2 + r]);
+  ctr = _mm512_add_epi64(_mm512_broadcast_i32x4(*p), _mm512_set_epi64(0, 4, 0, 3, 0, 2, 0, 1));
+
+  for (; numBlocks >= 16; numBlocks -= 16, data += 16 * 16)
+  {
+    __m512i v0, v1, v2, v3;
+    {
+      const __m512i k = keys[0];
+      v0 = _mm512_xor_si512(ctr, k); ctr = _mm512_add_epi64(ctr, four);
+      v1 = _mm512_xor_si512(ctr, k); ctr = _mm512_add_epi64(ctr, four);
+      v2 = _mm512_xor_si512(ctr, k); ctr = _mm512_add_epi64(ctr, four);
+      v3 = _mm512_xor_si512(ctr, k); ctr = _mm512_add_epi64(ctr, four);
+    }
+    for (r = 1; r < numRounds; r++)
+    {
+      const __m512i k = keys[r];
+      V_OP_4(_mm512_aesenc_epi128, k)
+    }
+    {
+      const __m512i k = keys[numRounds];
+      V_OP_4(_mm512_aesenclast_epi128, k)
+    }
+    STOREU_512(data,       _mm512_xor_si512(v0, LOADU_512(data)));
+    STOREU_512(data + 64,  _mm512_xor_si512(v1, LOADU_512(data + 64)));
+    STOREU_512(data + 128, _mm512_xor_si512(v2, LOADU_512(data + 128)));
+    STOREU_512(data + 192, _mm512_xor_si512(v3, LOADU_512(data + 192)));
+  }
+
+  *p = _mm_sub_epi64(_mm512_castsi512_si128(ctr), _mm_cvtsi32_si128(1));
+  if (numBlocks != 0)
+    AesCtr_Code_Intel(ivAes, data, numBlocks);
+}
+
+#endif
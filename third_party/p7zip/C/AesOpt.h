@@ -0,0 +1,49 @@
+/* AesOpt.h -- AES with AES-NI and VAES
+2018-10-16 : Public domain */
+
+#ifndef __AES_OPT_H
+#define __AES_OPT_H
+
+#include "7zTypes.h"
+#include "CpuArch.h"
+
+EXTERN_C_BEGIN
+
+#ifdef MY_CPU_X86_OR_AMD64
+  #if defined(_MSC_VER) && _MSC_VER >= 1500 \
+      || defined(__clang__) && (__clang_major__ * 100 + __clang_minor__ >= 308) \
+      || defined(__GNUC__) && !defined(__clang__) && (__GNUC__ * 100 + __GNUC_MINOR__ >= 409)
+    /* AES-NI */
+    #define AES_HW_SUPPORTED
+  #endif
+  #if defined(_MSC_VER) && _MSC_VER >= 1920 \
+      || defined(__clang__) && (__clang_major__ >= 8) \
+      || defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 8)
+    /* VAES with AVX2 and with AVX-512 */
+    #define AES_VAES_SUPPORTED
+  #endif
+#endif
+
+/*
+The functions have the arguments of AES_CODE_FUNC and AES_CODE_MULTI_FUNC.
+The _Intel ones need CPU_Is_Aes_Supported(), the _VAes ones CPU_Is_VAes_Supported()
+and the _VAes512 ones CPU_Is_VAes512_Supported().
+*/
+
+#ifdef AES_HW_SUPPORTED
+void MY_FAST_CALL AesCbc_Encode_Intel(UInt32 *ivAes, Byte *data, size_t numBlocks);
+void MY_FAST_CALL AesCbc_Decode_Intel(UInt32 *ivAes, Byte *data, size_t numBlocks);
+void MY_FAST_CALL AesCtr_Code_Intel(UInt32 *ivAes, Byte *data, size_t numBlocks);
+void MY_FAST_CALL AesCbc_Encode_Multi_Intel(UInt32 * const *ivAes, Byte * const *data, size_t numBlocks, unsigned num);
+#endif
+
+#ifdef AES_VAES_SUPPORTED
+void MY_FAST_CALL AesCbc_Decode_VAes(UInt32 *ivAes, Byte *data, size_t numBlocks);
+void MY_FAST_CALL AesCtr_Code_VAes(UInt32 *ivAes, Byte *data, size_t numBlocks);
+void MY_FAST_CALL AesCbc_Decode_VAes512(UInt32 *ivAes, Byte *data, size_t numBlocks);
+void MY_FAST_CALL AesCtr_Code_VAes512(UInt32 *ivAes, Byte *data, size_t numBlocks);
+#endif
+
+EXTERN_C_END
+
+#endif
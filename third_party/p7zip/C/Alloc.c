@@ -9,15 +9,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#ifdef _7ZIP_LARGE_PAGES
 #ifdef __linux__
 #ifndef _7ZIP_ST
 #include <pthread.h>
 #endif
-#include <errno.h>
-#include <string.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef _7ZIP_LARGE_PAGES
+#include <errno.h>
+#include <string.h>
 #include <mntent.h>
 #endif
 #endif
@@ -94,93 +95,224 @@ void MyFree(void *address)
 
 #ifndef _WIN32
 
-#ifdef _7ZIP_LARGE_PAGES
-
 #ifdef __linux__
-#define _7ZIP_MAX_HUGE_ALLOCS 64
-static void *g_HugePageAddr[_7ZIP_MAX_HUGE_ALLOCS] = { NULL };
-static size_t g_HugePageLen[_7ZIP_MAX_HUGE_ALLOCS];
-static char *g_HugetlbPath;
-#endif
 
+/*
+  Linux: the blocks of MidAlloc() and BigAlloc() that hold at least one huge page
+  are mapped separately, aligned to the huge page size, and marked with MADV_HUGEPAGE,
+  so that the kernel backs them with transparent huge pages also in "madvise" mode.
+  The random accesses of the match finders and of PPMd to these blocks take much
+  fewer TLB misses then. The large pages of SetLargePageSize() are tried before
+  them in BigAlloc(): MAP_HUGETLB pages, or the files of mounted hugetlbfs.
+
+  If the system has several NUMA nodes, the pages of such block are preferred
+  on the node of the thread that allocates the block. So the coders of MtCoder
+  allocate their buffers and their state in their own threads.
+*/
+
+#define LINUX_HUGE_PAGE_SIZE ((size_t)1 << 21)
+
+#define LINUX_MAX_MAPS 256
+static void *g_MapAddr[LINUX_MAX_MAPS];
+static size_t g_MapLen[LINUX_MAX_MAPS];
+#ifndef _7ZIP_ST
+static pthread_mutex_t g_MapMutex = PTHREAD_MUTEX_INITIALIZER;
+#define MAP_LOCK pthread_mutex_lock(&g_MapMutex);
+#define MAP_UNLOCK pthread_mutex_unlock(&g_MapMutex);
+#else
+#define MAP_LOCK
+#define MAP_UNLOCK
 #endif
 
 #ifdef _7ZIP_LARGE_PAGES
-static void *VirtualAlloc(size_t size, int memLargePages)
+static char *g_HugetlbPath;
+#endif
+
+/* it returns 0, if there are no free slots: then the caller unmaps the block itself */
+static int Linux_AddMap(void *address, size_t size)
 {
-  if (memLargePages)
-  {
-    #ifdef __linux__
-    /* huge pages support for Linux; added by Joachim Henke */
-    #ifndef _7ZIP_ST
-    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-    #endif
-    int i;
-
-    void * address = NULL;
-    #ifndef _7ZIP_ST
-    pthread_mutex_lock(&mutex);
-    #endif
-    for (i = 0; i < _7ZIP_MAX_HUGE_ALLOCS; ++i)
+  int i, res = 0;
+  MAP_LOCK
+  for (i = 0; i < LINUX_MAX_MAPS; i++)
+    if (g_MapAddr[i] == NULL)
     {
-      if (g_HugePageAddr[i] == NULL)
-      {
-        int fd, pathlen = strlen(g_HugetlbPath);
-        char tempname[pathlen+12];
-
-        memcpy(tempname, g_HugetlbPath, pathlen);
-        memcpy(tempname + pathlen, "/7z-XXXXXX", 11);
-        fd = mkstemp(tempname);
-        unlink(tempname);
-        if (fd < 0)
-        {
-          fprintf(stderr,"cant't open %s (%s)\n",tempname,strerror(errno));
-          break;
-        }
-        address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-        close(fd);
-        if (address == MAP_FAILED)
-        {
-          address = NULL;
-          break;
-        }
-        g_HugePageLen[i] = size;
-        g_HugePageAddr[i] = address;
-// fprintf(stderr,"HUGE[%d]=%ld %p\n",i,(long)size,address);
-        break;
-      }
+      g_MapAddr[i] = address;
+      g_MapLen[i] = size;
+      res = 1;
+      break;
     }
-    #ifndef _7ZIP_ST
-    pthread_mutex_unlock(&mutex);
-    #endif
-    return address;
-    #endif
-  }
-  return align_alloc(size);
+  MAP_UNLOCK
+  return res;
 }
-#else
-static void *VirtualAlloc(size_t size, int memLargePages )
+
+/* it returns 0, if (address) was not mapped by Linux_AddMap() */
+static int Linux_FreeMap(void *address)
 {
-  return align_alloc(size);
+  int i;
+  size_t size = 0;
+  MAP_LOCK
+  for (i = 0; i < LINUX_MAX_MAPS; i++)
+    if (g_MapAddr[i] == address)
+    {
+      g_MapAddr[i] = NULL;
+      size = g_MapLen[i];
+      break;
+    }
+  MAP_UNLOCK
+  if (size == 0)
+    return 0;
+  munmap(address, size);
+  return 1;
 }
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
 #endif
 
-static int VirtualFree(void *address)
+static int g_NumaMultiNode;
+
+static void Linux_InitNuma(void)
 {
-  #ifdef _7ZIP_LARGE_PAGES
-  #ifdef __linux__
-  int i;
+  g_NumaMultiNode = (access("/sys/devices/system/node/node1", F_OK) == 0);
+}
+
+/* the pages that are not touched yet will be preferred on the NUMA node of current thread */
+static void Linux_SetLocalNode(void *address, size_t size)
+{
+  #if defined(SYS_getcpu) && defined(SYS_mbind)
+  unsigned cpu, node;
+  unsigned long mask;
+  #ifndef _7ZIP_ST
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, Linux_InitNuma);
+  #else
+  static int wasInit = 0;
+  if (!wasInit)
+  {
+    Linux_InitNuma();
+    wasInit = 1;
+  }
+  #endif
+  if (!g_NumaMultiNode)
+    return;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0 || node >= sizeof(mask) * 8)
+    return;
+  mask = (unsigned long)1 << node;
+  /* the kernel reads (maxnode - 1) bits of the mask */
+  syscall(SYS_mbind, address, size, MPOL_PREFERRED, &mask, (unsigned long)(sizeof(mask) * 8 + 1), 0);
+  #else
+  UNUSED_VAR(address);
+  UNUSED_VAR(size);
+  #endif
+}
+
+/* an anonymous mapping of (size) bytes that starts at the huge page boundary */
+static void *Linux_AllocHuge(size_t size)
+{
+  size_t pageSize = (size_t)getpagesize();
+  size_t mapSize = (size + pageSize - 1) & ~(pageSize - 1);
+  size_t head;
+  Byte *base;
+  Byte *address;
+
+  if (mapSize < size || mapSize + LINUX_HUGE_PAGE_SIZE < mapSize)
+    return NULL;
+  base = (Byte *)mmap(NULL, mapSize + LINUX_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == (Byte *)MAP_FAILED)
+    return NULL;
+  head = (LINUX_HUGE_PAGE_SIZE - ((size_t)base & (LINUX_HUGE_PAGE_SIZE - 1))) & (LINUX_HUGE_PAGE_SIZE - 1);
+  address = base + head;
+  if (head != 0)
+    munmap(base, head);
+  munmap(address + mapSize, LINUX_HUGE_PAGE_SIZE - head);
+
+  #ifdef MADV_HUGEPAGE
+  /* the tail after the last whole huge page stays in small pages: it doesn't waste memory */
+  madvise(address, size & ~(LINUX_HUGE_PAGE_SIZE - 1), MADV_HUGEPAGE);
+  #endif
+  Linux_SetLocalNode(address, mapSize);
+
+  if (!Linux_AddMap(address, mapSize))
+  {
+    munmap(address, mapSize);
+    return NULL;
+  }
+  return address;
+}
 
-  for (i = 0; i < _7ZIP_MAX_HUGE_ALLOCS; ++i)
+#ifdef _7ZIP_LARGE_PAGES
+static void *Linux_AllocLarge(size_t size)
+{
+  void *address;
+  #ifdef MAP_HUGETLB
+  address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (address != MAP_FAILED)
   {
-    if (g_HugePageAddr[i] == address)
+    Linux_SetLocalNode(address, size);
+    if (Linux_AddMap(address, size))
+      return address;
+    munmap(address, size);
+    return NULL;
+  }
+  #endif
+
+  if (g_HugetlbPath == NULL)
+    return NULL;
+
+  /* huge pages support for Linux; added by Joachim Henke */
+  {
+    int fd, pathlen = strlen(g_HugetlbPath);
+    char tempname[pathlen+12];
+
+    memcpy(tempname, g_HugetlbPath, pathlen);
+    memcpy(tempname + pathlen, "/7z-XXXXXX", 11);
+    fd = mkstemp(tempname);
+    unlink(tempname);
+    if (fd < 0)
     {
-      munmap(address, g_HugePageLen[i]);
-      g_HugePageAddr[i] = NULL;
-      return 1;
+      fprintf(stderr,"cant't open %s (%s)\n",tempname,strerror(errno));
+      return NULL;
     }
+    address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED)
+      return NULL;
+    // fprintf(stderr,"HUGE=%ld %p\n",(long)size,address);
+    if (Linux_AddMap(address, size))
+      return address;
+    munmap(address, size);
+    return NULL;
+  }
+}
+#endif
+
+#endif
+
+static void *VirtualAlloc(size_t size, int memLargePages)
+{
+  #ifdef __linux__
+  void *address;
+  #ifdef _7ZIP_LARGE_PAGES
+  if (memLargePages)
+    return Linux_AllocLarge(size);
+  #endif
+  if (size >= LINUX_HUGE_PAGE_SIZE)
+  {
+    address = Linux_AllocHuge(size);
+    if (address)
+      return address;
   }
   #endif
+  UNUSED_VAR(memLargePages);
+  return align_alloc(size);
+}
+
+static int VirtualFree(void *address)
+{
+  #ifdef __linux__
+  if (Linux_FreeMap(address))
+    return 1;
   #endif
   align_free(address);
   return 1;
@@ -259,9 +391,34 @@ size_t largePageMinimum()
       // fprintf(stderr," Found hugetlbfs = '%s'\n",g_HugetlbPath);
     }
   }
-  if (g_HugetlbPath == NULL || (size = pathconf(g_HugetlbPath, _PC_REC_MIN_XFER_SIZE)) <= getpagesize())
-    return 0;
-  return size;
+  if (g_HugetlbPath != NULL)
+  {
+    if ((size = pathconf(g_HugetlbPath, _PC_REC_MIN_XFER_SIZE)) <= getpagesize())
+      return 0;
+    return size;
+  }
+
+  #ifdef MAP_HUGETLB
+  // no hugetlbfs => MAP_HUGETLB, if the pool of huge pages is not empty
+  {
+    FILE *fp = fopen("/proc/meminfo", "r");
+    char line[256];
+    unsigned long total = 0, sizeKb = 0;
+    if (!fp)
+      return 0;
+    while (fgets(line, sizeof(line), fp))
+    {
+      sscanf(line, "HugePages_Total: %lu", &total);
+      sscanf(line, "Hugepagesize: %lu kB", &sizeKb);
+    }
+    fclose(fp);
+    if (total == 0 || ((size_t)sizeKb << 10) <= (size_t)getpagesize())
+      return 0;
+    return (size_t)sizeKb << 10;
+  }
+  #else
+  return 0;
+  #endif
 }
 #else
 #define largePageMinimum() 0
@@ -326,3 +483,67 @@ static void *SzBigAlloc(void *p, size_t size) { UNUSED_VAR(p); return BigAlloc(s
 static void SzBigFree(void *p, void *address) { UNUSED_VAR(p); BigFree(address); }
 ISzAlloc g_BigAlloc = { SzBigAlloc, SzBigFree };
 
+static void *SzMidAlloc(void *p, size_t size) { UNUSED_VAR(p); return MidAlloc(size); }
+static void SzMidFree(void *p, void *address) { UNUSED_VAR(p); MidFree(address); }
+ISzAlloc g_MidAlloc = { SzMidAlloc, SzMidFree };
+
+
+#ifdef _WIN32
+  typedef UINT_PTR UIntPtr;
+#else
+  typedef ptrdiff_t UIntPtr;
+#endif
+
+#define MY_ALIGN_PTR_DOWN(p, align) ((void *)((((UIntPtr)(p)) & ~((UIntPtr)(align) - 1))))
+#define MY_ALIGN_PTR_DOWN_1(p) MY_ALIGN_PTR_DOWN(p, sizeof(void *))
+
+/* we align ptr to support cases where CAlignOffsetAlloc::offset is not multiply of sizeof(void *) */
+#define REAL_BLOCK_PTR_VAR(p) ((void **)MY_ALIGN_PTR_DOWN_1(p))[-1]
+
+static void *AlignOffsetAlloc_Alloc(void *pp, size_t size)
+{
+  CAlignOffsetAlloc *p = (CAlignOffsetAlloc *)pp;
+  void *adr;
+  void *pAligned;
+  size_t newSize;
+  size_t extra;
+  size_t alignSize = (size_t)1 << p->numAlignBits;
+
+  if (alignSize < sizeof(void *))
+    alignSize = sizeof(void *);
+  
+  if (p->offset >= alignSize)
+    return NULL;
+
+  extra = p->offset & (sizeof(void *) - 1);
+  newSize = size + alignSize + extra;
+  if (newSize < size)
+    return NULL;
+
+  adr = IAlloc_Alloc(p->baseAlloc, newSize);
+  
+  if (!adr)
+    return NULL;
+
+  pAligned = (char *)MY_ALIGN_PTR_DOWN((char *)adr +
+      alignSize - p->offset + extra, alignSize) + p->offset;
+
+  REAL_BLOCK_PTR_VAR(pAligned) = adr;
+
+  return pAligned;
+}
+
+static void AlignOffsetAlloc_Free(void *pp, void *address)
+{
+  if (address)
+  {
+    CAlignOffsetAlloc *p = (CAlignOffsetAlloc *)pp;
+    IAlloc_Free(p->baseAlloc, REAL_BLOCK_PTR_VAR(address));
+  }
+}
+
+void AlignOffsetAlloc_CreateVTable(CAlignOffsetAlloc *p)
+{
+  p->vt.Alloc = AlignOffsetAlloc_Alloc;
+  p->vt.Free = AlignOffsetAlloc_Free;
+}
@@ -20,6 +20,17 @@ void BigFree(void *address);
 
 extern ISzAlloc g_Alloc;
 extern ISzAlloc g_BigAlloc;
+extern ISzAlloc g_MidAlloc;
+
+typedef struct
+{
+  ISzAlloc vt;
+  ISzAlloc *baseAlloc;
+  unsigned numAlignBits; /* ((1 << numAlignBits) >= sizeof(void *)) */
+  size_t offset;         /* (offset == (k * sizeof(void *)) && offset < (1 << numAlignBits) */
+} CAlignOffsetAlloc;
+
+void AlignOffsetAlloc_CreateVTable(CAlignOffsetAlloc *p);
 
 EXTERN_C_END
 
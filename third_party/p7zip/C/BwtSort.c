@@ -513,3 +513,257 @@ UInt32 BlockSort(UInt32 *Indices, const Byte *data, UInt32 blockSize)
   #endif
   return Groups[0];
 }
+
+/* ---------- SA-IS ---------- */
+
+/*
+BlockSort_SaIs() sorts the rotations with the suffix array of the least rotation.
+If the block is primitive, its least rotation is a Lyndon word, and the order of
+suffixes of a Lyndon word is the order of its rotations. If the block is a power
+(l^m) of some word, the rotations of the Lyndon word (l) are sorted, and each of
+them is repeated (m) times: these rotations are equal.
+The suffix array is built by SA-IS (Nong, Zhang, Chan) in linear time.
+The types of suffixes are in bit arrays. The buckets, the bit arrays and the copy
+of least rotation are in the second part of (Indices) buffer.
+*/
+
+#define SAIS_EMPTY ((UInt32)0xFFFFFFFF)
+
+/* type bit: 1 - S-type, 0 - L-type */
+#define SAIS_IS_S(t, i) (((t)[(i) >> 5] >> ((i) & 31)) & 1)
+#define SAIS_SET_S(t, i) (t)[(i) >> 5] |= ((UInt32)1 << ((i) & 31))
+#define SAIS_IS_LMS(t, i) ((i) != 0 && SAIS_IS_S(t, i) && !SAIS_IS_S(t, (i) - 1))
+
+#define SAIS_CHR(i) (s8 ? (UInt32)s8[i] : s32[i])
+
+static void SaIs_GetBuckets(const Byte *s8, const UInt32 *s32, UInt32 n, UInt32 K, UInt32 *bkt, int end)
+{
+  UInt32 i, sum = 0;
+  for (i = 0; i < K; i++)
+    bkt[i] = 0;
+  for (i = 0; i < n; i++)
+    bkt[SAIS_CHR(i)]++;
+  for (i = 0; i < K; i++)
+  {
+    sum += bkt[i];
+    bkt[i] = end ? sum : sum - bkt[i];
+  }
+}
+
+static void SaIs_Induce(const Byte *s8, const UInt32 *s32, UInt32 *SA, UInt32 n, UInt32 K, UInt32 *bkt, const UInt32 *t)
+{
+  UInt32 i;
+  SaIs_GetBuckets(s8, s32, n, K, bkt, 0);
+  /* the suffix before the virtual sentinel is L-type, and it's first in its bucket */
+  SA[bkt[SAIS_CHR(n - 1)]++] = n - 1;
+  for (i = 0; i < n; i++)
+  {
+    UInt32 j = SA[i];
+    if (j != SAIS_EMPTY && j != 0)
+    {
+      j--;
+      if (!SAIS_IS_S(t, j))
+        SA[bkt[SAIS_CHR(j)]++] = j;
+    }
+  }
+  SaIs_GetBuckets(s8, s32, n, K, bkt, 1);
+  for (i = n; i != 0;)
+  {
+    UInt32 j = SA[--i];
+    if (j != SAIS_EMPTY && j != 0)
+    {
+      j--;
+      if (SAIS_IS_S(t, j))
+        SA[--bkt[SAIS_CHR(j)]] = j;
+    }
+  }
+}
+
+/*
+Builds the suffix array of (s8) or (s32) (n > 0, symbols < K) with the virtual
+sentinel after the end. (work) must contain ((n >> 5) + 1 + K) items, and
+the items for the recursion: ((n >> 4) + 4 + n / 2) items are enough.
+*/
+
+static void SaIs(const Byte *s8, const UInt32 *s32, UInt32 *SA, UInt32 n, UInt32 K, UInt32 *work)
+{
+  UInt32 *t = work;
+  UInt32 *bkt = work + (n >> 5) + 1;
+  UInt32 i, j, n1, numNames;
+
+  for (i = 0; i <= (n >> 5); i++)
+    t[i] = 0;
+  for (i = n - 1; i != 0;)
+  {
+    UInt32 c0, c1;
+    i--;
+    c0 = SAIS_CHR(i);
+    c1 = SAIS_CHR(i + 1);
+    if (c0 < c1 || (c0 == c1 && SAIS_IS_S(t, i + 1)))
+      SAIS_SET_S(t, i);
+  }
+
+  /* stage 1: sort the LMS-substrings */
+  SaIs_GetBuckets(s8, s32, n, K, bkt, 1);
+  for (i = 0; i < n; i++)
+    SA[i] = SAIS_EMPTY;
+  for (i = 1; i < n; i++)
+    if (SAIS_IS_LMS(t, i))
+      SA[--bkt[SAIS_CHR(i)]] = i;
+  SaIs_Induce(s8, s32, SA, n, K, bkt, t);
+
+  n1 = 0;
+  for (i = 0; i < n; i++)
+  {
+    UInt32 pos = SA[i];
+    if (SAIS_IS_LMS(t, pos))
+      SA[n1++] = pos;
+  }
+
+  /* name the LMS-substrings: (n1 <= n / 2), and the positions are 2 items apart at least */
+  for (i = n1; i < n; i++)
+    SA[i] = SAIS_EMPTY;
+  numNames = 0;
+  {
+    UInt32 prev = SAIS_EMPTY;
+    for (i = 0; i < n1; i++)
+    {
+      UInt32 pos = SA[i];
+      int diff = 1;
+      if (prev != SAIS_EMPTY)
+      {
+        UInt32 d;
+        for (d = 0;; d++)
+        {
+          /* the substring with the sentinel is unique */
+          if (pos + d == n || prev + d == n
+              || SAIS_CHR(pos + d) != SAIS_CHR(prev + d)
+              || SAIS_IS_S(t, pos + d) != SAIS_IS_S(t, prev + d))
+            break;
+          if (d != 0 && SAIS_IS_LMS(t, pos + d))
+          {
+            diff = 0;
+            break;
+          }
+        }
+      }
+      if (diff)
+      {
+        numNames++;
+        prev = pos;
+      }
+      SA[n1 + (pos >> 1)] = numNames - 1;
+    }
+  }
+  for (i = n, j = n; i > n1;)
+  {
+    UInt32 name = SA[--i];
+    if (name != SAIS_EMPTY)
+      SA[--j] = name;
+  }
+
+  /* stage 2: sort the LMS-suffixes by the suffix array of the reduced string */
+  {
+    UInt32 *s1 = SA + n - n1;
+    if (numNames < n1)
+      SaIs(NULL, s1, SA, n1, numNames, work + (n >> 5) + 1);
+    else
+      for (i = 0; i < n1; i++)
+        SA[s1[i]] = i;
+
+    for (i = 1, j = 0; i < n; i++)
+      if (SAIS_IS_LMS(t, i))
+        s1[j++] = i;
+    for (i = 0; i < n1; i++)
+      SA[i] = s1[SA[i]];
+    for (i = n1; i < n; i++)
+      SA[i] = SAIS_EMPTY;
+  }
+
+  SaIs_GetBuckets(s8, s32, n, K, bkt, 1);
+  for (i = n1; i != 0;)
+  {
+    UInt32 pos = SA[--i];
+    SA[i] = SAIS_EMPTY;
+    SA[--bkt[SAIS_CHR(pos)]] = pos;
+  }
+  SaIs_Induce(s8, s32, SA, n, K, bkt, t);
+}
+
+/*
+Returns the start of the least rotation of data[0 .. n) by Duval's factorization
+of (data + data): it's the start of last Lyndon factor that starts in first copy.
+(*period) is the length of that factor: (n) is a multiple of it.
+*/
+
+static UInt32 LeastRotation(const Byte *data, UInt32 n, UInt32 *period)
+{
+  const UInt32 n2 = n * 2;
+  UInt32 i = 0, res = 0, per = n;
+  while (i < n)
+  {
+    UInt32 j = i + 1;
+    UInt32 k = i;
+    res = i;
+    for (; j < n2; j++)
+    {
+      Byte a = data[k < n ? k : k - n];
+      Byte b = data[j < n ? j : j - n];
+      if (a > b)
+        break;
+      if (a < b)
+        k = i;
+      else
+        k++;
+    }
+    per = j - k;
+    while (i <= k)
+      i += j - k;
+  }
+  if (n % per != 0)
+    per = n;
+  *period = per;
+  return res;
+}
+
+UInt32 BlockSort_SaIs(UInt32 *Indices, const Byte *data, UInt32 blockSize)
+{
+  UInt32 *work = Indices + blockSize;
+  Byte *text = (Byte *)(work + blockSize + BS_TEMP_SIZE) - blockSize;
+  UInt32 start, period, num, i, origPtr = 0;
+
+  start = LeastRotation(data, blockSize, &period);
+  for (i = 0; i < period; i++)
+  {
+    UInt32 k = start + i;
+    if (k >= blockSize)
+      k -= blockSize;
+    text[i] = data[k];
+  }
+  SaIs(text, NULL, Indices, period, 256, work);
+
+  num = blockSize / period;
+  if (num != 1)
+    for (i = period; i != 0;)
+    {
+      UInt32 pos, k;
+      i--;
+      pos = Indices[i];
+      for (k = num; k != 0;)
+      {
+        k--;
+        Indices[i * num + k] = pos + k * period;
+      }
+    }
+
+  for (i = 0; i < blockSize; i++)
+  {
+    UInt32 pos = Indices[i] + start;
+    if (pos >= blockSize)
+      pos -= blockSize;
+    Indices[i] = pos;
+    if (pos == 0)
+      origPtr = i;
+  }
+  return origPtr;
+}
@@ -21,6 +21,10 @@ EXTERN_C_BEGIN
 
 UInt32 BlockSort(UInt32 *indices, const Byte *data, UInt32 blockSize);
 
+/* BlockSort_SaIs() returns the same result as BlockSort(), but it works in linear time.
+   It's faster for repetitive data. It uses the buffer of the same size. */
+UInt32 BlockSort_SaIs(UInt32 *indices, const Byte *data, UInt32 blockSize);
+
 EXTERN_C_END
 
 #endif
@@ -16,6 +16,10 @@
 #include <intrin.h>
 #endif
 
+#if defined(_MSC_VER) && _MSC_VER >= 1600
+#include <immintrin.h>
+#endif
+
 #if defined(USE_ASM) && !defined(MY_CPU_AMD64)
 static UInt32 CheckFlag(UInt32 flag)
 {
@@ -100,14 +104,14 @@ void MyCPUID(UInt32 function, UInt32 *a, UInt32 *b, UInt32 *c, UInt32 *d)
   #endif
       "=c" (*c) ,
       "=d" (*d)
-    : "0" (function)) ;
+    : "0" (function), "2" (0)) ;
 
   #endif
   
   #else
 
   int CPUInfo[4];
-  __cpuid(CPUInfo, function);
+  __cpuidex(CPUInfo, function, 0);
   *a = CPUInfo[0];
   *b = CPUInfo[1];
   *c = CPUInfo[2];
@@ -198,6 +202,92 @@ Bool CPU_Is_Aes_Supported()
   return (p.c >> 25) & 1;
 }
 
+Bool CPU_Is_Clmul_Supported()
+{
+  Cx86cpuid p;
+  CHECK_SYS_SSE_SUPPORT
+  if (!x86cpuid_CheckAndRead(&p))
+    return False;
+  return (p.c >> 1) & 1;
+}
+
+static UInt32 MyXGETBV()
+{
+  #ifdef _MSC_VER
+  return (UInt32)_xgetbv(0);
+  #else
+  UInt32 a, d;
+  __asm__ __volatile__ ("xgetbv" : "=a" (a), "=d" (d) : "c" (0));
+  return a;
+  #endif
+}
+
+Bool CPU_Is_VClmul_Supported()
+{
+  Cx86cpuid p;
+  UInt32 a, b, c, d;
+  if (!x86cpuid_CheckAndRead(&p) || p.maxFunc < 7)
+    return False;
+  /* OSXSAVE and PCLMULQDQ */
+  if (((p.c >> 27) & 1) == 0 || ((p.c >> 1) & 1) == 0)
+    return False;
+  /* the OS saves the SSE, AVX and AVX-512 registers */
+  if ((MyXGETBV() & 0xE6) != 0xE6)
+    return False;
+  MyCPUID(7, &a, &b, &c, &d);
+  /* AVX512F and VPCLMULQDQ */
+  return ((b >> 16) & 1) && ((c >> 10) & 1);
+}
+
+Bool CPU_Is_Sha_Supported()
+{
+  Cx86cpuid p;
+  UInt32 a, b, c, d;
+  CHECK_SYS_SSE_SUPPORT
+  if (!x86cpuid_CheckAndRead(&p) || p.maxFunc < 7)
+    return False;
+  /* SSSE3 and SSE4.1 */
+  if (((p.c >> 9) & 1) == 0 || ((p.c >> 19) & 1) == 0)
+    return False;
+  MyCPUID(7, &a, &b, &c, &d);
+  return (b >> 29) & 1;
+}
+
+Bool CPU_Is_Avx2_Supported()
+{
+  Cx86cpuid p;
+  UInt32 a, b, c, d;
+  if (!x86cpuid_CheckAndRead(&p) || p.maxFunc < 7)
+    return False;
+  /* OSXSAVE, and the OS saves the SSE and AVX registers */
+  if (((p.c >> 27) & 1) == 0 || (MyXGETBV() & 6) != 6)
+    return False;
+  MyCPUID(7, &a, &b, &c, &d);
+  return (b >> 5) & 1;
+}
+
+Bool CPU_Is_VAes_Supported()
+{
+  UInt32 a, b, c, d;
+  if (!CPU_Is_Aes_Supported() || !CPU_Is_Avx2_Supported())
+    return False;
+  MyCPUID(7, &a, &b, &c, &d);
+  return (c >> 9) & 1;
+}
+
+Bool CPU_Is_VAes512_Supported()
+{
+  UInt32 a, b, c, d;
+  if (!CPU_Is_VAes_Supported())
+    return False;
+  /* the OS saves the AVX-512 registers */
+  if ((MyXGETBV() & 0xE0) != 0xE0)
+    return False;
+  MyCPUID(7, &a, &b, &c, &d);
+  /* AVX512F */
+  return (b >> 16) & 1;
+}
+
 #endif
 
 #else
@@ -207,5 +297,87 @@ Bool CPU_Is_InOrder()
     return True;
 }
 
+#ifdef MY_CPU_X86_OR_AMD64
+
+Bool CPU_Is_Aes_Supported()
+{
+    return False;
+}
+
+Bool CPU_Is_Clmul_Supported()
+{
+    return False;
+}
+
+Bool CPU_Is_VClmul_Supported()
+{
+    return False;
+}
+
+Bool CPU_Is_Sha_Supported()
+{
+    return False;
+}
+
+Bool CPU_Is_Avx2_Supported()
+{
+    return False;
+}
+
+Bool CPU_Is_VAes_Supported()
+{
+    return False;
+}
+
+Bool CPU_Is_VAes512_Supported()
+{
+    return False;
+}
+
+#endif
+
 #endif // ifdef _7ZIP_ASM
 
+
+#ifdef MY_CPU_ARM64
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+Bool CPU_Is_Sha_Supported()
+{
+  return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE) ? True : False;
+}
+
+#elif defined(__APPLE__)
+
+/* every arm64 Apple CPU has the crypto extensions */
+Bool CPU_Is_Sha_Supported()
+{
+  return True;
+}
+
+#elif defined(__linux__)
+
+#include <sys/auxv.h>
+
+#define MY_HWCAP_SHA1 (1 << 5)
+#define MY_HWCAP_SHA2 (1 << 6)
+
+Bool CPU_Is_Sha_Supported()
+{
+  unsigned long hwcap = getauxval(AT_HWCAP);
+  return (hwcap & MY_HWCAP_SHA1) && (hwcap & MY_HWCAP_SHA2);
+}
+
+#else
+
+Bool CPU_Is_Sha_Supported()
+{
+  return False;
+}
+
+#endif
+
+#endif
@@ -39,6 +39,10 @@ MY_CPU_LE_UNALIGN means that CPU is LITTLE ENDIAN and CPU supports unaligned mem
 #define MY_CPU_X86_OR_AMD64
 #endif
 
+#if defined(_M_ARM64) || defined(__aarch64__)
+#define MY_CPU_ARM64
+#endif
+
 #if defined(MY_CPU_X86) \
     || defined(_M_ARM) \
     || defined(__ARMEL__) \
@@ -218,7 +222,18 @@ int x86cpuid_GetFirm(const Cx86cpuid *p);
 
 Bool CPU_Is_InOrder();
 Bool CPU_Is_Aes_Supported();
+Bool CPU_Is_Clmul_Supported();
+Bool CPU_Is_VClmul_Supported();
+Bool CPU_Is_Sha_Supported();
+Bool CPU_Is_Avx2_Supported();
+Bool CPU_Is_VAes_Supported();
+Bool CPU_Is_VAes512_Supported();
+
+#endif
 
+#ifdef MY_CPU_ARM64
+/* SHA-1 and SHA-256 instructions of the ARMv8 crypto extensions */
+Bool CPU_Is_Sha_Supported();
 #endif
 
 EXTERN_C_END
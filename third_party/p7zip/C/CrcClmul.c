@@ -0,0 +1,140 @@
+/* CrcClmul.c -- CRC folding with carry-less multiplication
+2018-10-16 : Public domain */
+
+#include "Precomp.h"
+
+#include "CrcClmul.h"
+
+/*
+The 16 bytes of a block are the polynomial L * x^64 + H of the reflected
+64-bit halves L (the first 8 bytes) and H. Moving it D bits forward is
+  L * (x^(D+64) mod P) + H * (x^D mod P)
+The product of two reflected 64-bit values read as a reflected 128-bit value
+has an extra factor x, so the keys are x^(D+63) and x^(D-1) mod P.
+*/
+
+/* x^e mod P, reflected in the high width bits */
+static UInt64 CrcClmul_XPow(UInt64 poly, unsigned width, unsigned e)
+{
+  UInt64 r = (UInt64)1 << (width - 1);
+  for (; e != 0; e--)
+    r = (r >> 1) ^ (poly & ((UInt64)0 - (r & 1)));
+  return r << (64 - width);
+}
+
+void CrcClmulKeys_Init(CCrcClmulKeys *p, UInt64 poly, unsigned width)
+{
+  static const unsigned kDistances[3] = { 128, 512, 2048 };
+  unsigned i;
+  for (i = 0; i < 3; i++)
+  {
+    p->k[i * 2] = CrcClmul_XPow(poly, width, kDistances[i] + 63);
+    p->k[i * 2 + 1] = CrcClmul_XPow(poly, width, kDistances[i] - 1);
+  }
+}
+
+#ifdef CRC_CLMUL_SUPPORTED
+
+#include <emmintrin.h>
+#include <wmmintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define ATTRIB_CLMUL __attribute__((__target__("sse2,pclmul")))
+#else
+  #define ATTRIB_CLMUL
+#endif
+
+#define LOAD_128(p) _mm_loadu_si128((const __m128i *)(const void *)(p))
+
+#define CLMUL_FOLD(x, k) _mm_xor_si128( \
+    _mm_clmulepi64_si128(x, k, 0x00), \
+    _mm_clmulepi64_si128(x, k, 0x11))
+
+ATTRIB_CLMUL
+size_t MY_FAST_CALL CrcClmul_Fold(UInt64 v, const Byte *data, size_t size, const CCrcClmulKeys *keys, Byte *state)
+{
+  const Byte *p = data;
+  const __m128i k128 = LOAD_128(keys->k);
+  const __m128i k512 = LOAD_128(keys->k + 2);
+  __m128i x0 = _mm_xor_si128(LOAD_128(p), _mm_loadl_epi64((const __m128i *)(const void *)&v));
+  __m128i x1 = LOAD_128(p + 16);
+  __m128i x2 = LOAD_128(p + 32);
+  __m128i x3 = LOAD_128(p + 48);
+
+  for (p += 64, size -= 64; size >= 64; p += 64, size -= 64)
+  {
+    x0 = _mm_xor_si128(CLMUL_FOLD(x0, k512), LOAD_128(p));
+    x1 = _mm_xor_si128(CLMUL_FOLD(x1, k512), LOAD_128(p + 16));
+    x2 = _mm_xor_si128(CLMUL_FOLD(x2, k512), LOAD_128(p + 32));
+    x3 = _mm_xor_si128(CLMUL_FOLD(x3, k512), LOAD_128(p + 48));
+  }
+
+  x0 = _mm_xor_si128(CLMUL_FOLD(x0, k128), x1);
+  x0 = _mm_xor_si128(CLMUL_FOLD(x0, k128), x2);
+  x0 = _mm_xor_si128(CLMUL_FOLD(x0, k128), x3);
+  for (; size >= 16; p += 16, size -= 16)
+    x0 = _mm_xor_si128(CLMUL_FOLD(x0, k128), LOAD_128(p));
+
+  _mm_storeu_si128((__m128i *)(void *)state, x0);
+  return (size_t)(p - data);
+}
+
+#endif
+
+#ifdef CRC_VCLMUL_SUPPORTED
+
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define ATTRIB_VCLMUL __attribute__((__target__("avx512f,vpclmulqdq,pclmul")))
+#else
+  #define ATTRIB_VCLMUL
+#endif
+
+#define LOAD_512(p) _mm512_loadu_si512((const void *)(p))
+
+/* (z folded by k) ^ d */
+#define VCLMUL_FOLD(z, k, d) _mm512_ternarylogic_epi64( \
+    _mm512_clmulepi64_epi128(z, k, 0x00), \
+    _mm512_clmulepi64_epi128(z, k, 0x11), d, 0x96)
+
+ATTRIB_VCLMUL
+size_t MY_FAST_CALL CrcClmul_VFold(UInt64 v, const Byte *data, size_t size, const CCrcClmulKeys *keys, Byte *state)
+{
+  const Byte *p = data;
+  const __m128i k128 = LOAD_128(keys->k);
+  const __m512i k512 = _mm512_broadcast_i32x4(LOAD_128(keys->k + 2));
+  const __m512i k2048 = _mm512_broadcast_i32x4(LOAD_128(keys->k + 4));
+  __m512i z0 = _mm512_xor_si512(LOAD_512(p), _mm512_inserti32x4(_mm512_setzero_si512(),
+      _mm_loadl_epi64((const __m128i *)(const void *)&v), 0));
+  __m512i z1 = LOAD_512(p + 64);
+  __m512i z2 = LOAD_512(p + 128);
+  __m512i z3 = LOAD_512(p + 192);
+  __m128i x;
+
+  for (p += 256, size -= 256; size >= 256; p += 256, size -= 256)
+  {
+    z0 = VCLMUL_FOLD(z0, k2048, LOAD_512(p));
+    z1 = VCLMUL_FOLD(z1, k2048, LOAD_512(p + 64));
+    z2 = VCLMUL_FOLD(z2, k2048, LOAD_512(p + 128));
+    z3 = VCLMUL_FOLD(z3, k2048, LOAD_512(p + 192));
+  }
+
+  z0 = VCLMUL_FOLD(z0, k512, z1);
+  z0 = VCLMUL_FOLD(z0, k512, z2);
+  z0 = VCLMUL_FOLD(z0, k512, z3);
+  for (; size >= 64; p += 64, size -= 64)
+    z0 = VCLMUL_FOLD(z0, k512, LOAD_512(p));
+
+  x = _mm512_castsi512_si128(z0);
+  x = _mm_xor_si128(CLMUL_FOLD(x, k128), _mm512_extracti32x4_epi32(z0, 1));
+  x = _mm_xor_si128(CLMUL_FOLD(x, k128), _mm512_extracti32x4_epi32(z0, 2));
+  x = _mm_xor_si128(CLMUL_FOLD(x, k128), _mm512_extracti32x4_epi32(z0, 3));
+  for (; size >= 16; p += 16, size -= 16)
+    x = _mm_xor_si128(CLMUL_FOLD(x, k128), LOAD_128(p));
+
+  _mm_storeu_si128((__m128i *)(void *)state, x);
+  return (size_t)(p - data);
+}
+
+#endif
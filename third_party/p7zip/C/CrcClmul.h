@@ -0,0 +1,59 @@
+/* CrcClmul.h -- CRC folding with carry-less multiplication
+2018-10-16 : Public domain */
+
+#ifndef __CRC_CLMUL_H
+#define __CRC_CLMUL_H
+
+#include "7zTypes.h"
+#include "CpuArch.h"
+
+EXTERN_C_BEGIN
+
+#ifdef MY_CPU_X86_OR_AMD64
+  #if defined(_MSC_VER) && _MSC_VER >= 1500 \
+      || defined(__clang__) && (__clang_major__ * 100 + __clang_minor__ >= 308) \
+      || defined(__GNUC__) && !defined(__clang__) && (__GNUC__ * 100 + __GNUC_MINOR__ >= 409)
+    #define CRC_CLMUL_SUPPORTED
+  #endif
+  #if defined(_MSC_VER) && _MSC_VER >= 1920 \
+      || defined(__clang__) && (__clang_major__ >= 6) \
+      || defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 8)
+    #define CRC_VCLMUL_SUPPORTED
+  #endif
+#endif
+
+/*
+The fold constants of one reflected CRC polynomial.
+k[0], k[1] move a 128-bit block forward by 128 bits,
+k[2], k[3] by 512 bits and k[4], k[5] by 2048 bits.
+*/
+
+typedef struct
+{
+  UInt64 k[6];
+} CCrcClmulKeys;
+
+/* poly is the reflected polynomial without its top bit, width is 32 or 64 */
+void CrcClmulKeys_Init(CCrcClmulKeys *p, UInt64 poly, unsigned width);
+
+#define CRC_CLMUL_MIN_SIZE 64
+#define CRC_VCLMUL_MIN_SIZE 256
+
+/*
+CrcClmul_Fold() and CrcClmul_VFold() fold the 16-byte blocks of data into 16 bytes
+written to state and return the size folded, a multiple of 16.
+v is the CRC register value before data, size must be at least CRC_CLMUL_MIN_SIZE or
+CRC_VCLMUL_MIN_SIZE. The register value after the folded blocks is the table update
+of the 16 state bytes that starts from zero.
+*/
+
+#ifdef CRC_CLMUL_SUPPORTED
+size_t MY_FAST_CALL CrcClmul_Fold(UInt64 v, const Byte *data, size_t size, const CCrcClmulKeys *keys, Byte *state);
+#endif
+#ifdef CRC_VCLMUL_SUPPORTED
+size_t MY_FAST_CALL CrcClmul_VFold(UInt64 v, const Byte *data, size_t size, const CCrcClmulKeys *keys, Byte *state);
+#endif
+
+EXTERN_C_END
+
+#endif
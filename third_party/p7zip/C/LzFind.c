@@ -5,6 +5,7 @@
 
 #include <string.h>
 
+#include "CpuArch.h"
 #include "LzFind.h"
 #include "LzHash.h"
 
@@ -16,6 +17,105 @@
 
 #define kStartMaxLen 3
 
+/*
+The match extension compares 8 bytes at once (XOR and count of trailing zeros),
+and 32 bytes at once with AVX2 for long matches. It never reads beyond lenLimit.
+*/
+
+#if defined(MY_CPU_LE_UNALIGN) && defined(MY_CPU_64BIT)
+  #if defined(_MSC_VER) && _MSC_VER >= 1400
+    #include <intrin.h>
+    #pragma intrinsic(_BitScanForward64)
+    #define LZ_MATCH_WORDS
+    #define LZ_INLINE __forceinline
+    static LZ_INLINE unsigned Lz_Ctz64(UInt64 v) { unsigned long i; _BitScanForward64(&i, v); return (unsigned)i; }
+    static LZ_INLINE unsigned Lz_Ctz32(UInt32 v) { unsigned long i; _BitScanForward(&i, v); return (unsigned)i; }
+  #elif defined(__GNUC__) || defined(__clang__)
+    #define LZ_MATCH_WORDS
+    #define LZ_INLINE __inline__ __attribute__((__always_inline__))
+    #define Lz_Ctz64(v) ((unsigned)__builtin_ctzll(v))
+    #define Lz_Ctz32(v) ((unsigned)__builtin_ctz(v))
+  #endif
+#endif
+
+#if defined(LZ_MATCH_WORDS) && defined(MY_CPU_AMD64)
+  #if defined(_MSC_VER) && _MSC_VER >= 1900 \
+      || defined(__clang__) && (__clang_major__ * 100 + __clang_minor__ >= 308) \
+      || defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 5)
+    #define LZ_MATCH_AVX2
+  #endif
+#endif
+
+#ifdef LZ_MATCH_AVX2
+
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define ATTRIB_AVX2 __attribute__((__target__("avx2")))
+#else
+  #define ATTRIB_AVX2
+#endif
+
+/* it's set by MatchFinder_Construct() */
+static Bool g_LzFind_UseAvx2;
+
+static UInt32 ATTRIB_AVX2 MY_NO_INLINE LzFind_MatchLen_Avx2(const Byte *pb, const Byte *cur, UInt32 len, UInt32 lenLimit)
+{
+  for (; len + 32 <= lenLimit; len += 32)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(const void *)(pb + len));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(const void *)(cur + len));
+    UInt32 mask = ~(UInt32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+    if (mask != 0)
+      return len + Lz_Ctz32(mask);
+  }
+  for (; len + 8 <= lenLimit; len += 8)
+  {
+    UInt64 x = GetUi64(pb + len) ^ GetUi64(cur + len);
+    if (x != 0)
+      return len + (Lz_Ctz64(x) >> 3);
+  }
+  for (; len != lenLimit; len++)
+    if (pb[len] != cur[len])
+      break;
+  return len;
+}
+
+#endif
+
+#ifndef LZ_INLINE
+  #define LZ_INLINE
+#endif
+
+/* The bytes before (len) must be equal. It returns the length of match that is limited by lenLimit. */
+
+static LZ_INLINE UInt32 LzFind_MatchLen(const Byte *pb, const Byte *cur, UInt32 len, UInt32 lenLimit)
+{
+  #ifdef LZ_MATCH_WORDS
+  if (len + 8 <= lenLimit)
+  {
+    UInt64 x = GetUi64(pb + len) ^ GetUi64(cur + len);
+    if (x != 0)
+      return len + (Lz_Ctz64(x) >> 3);
+    len += 8;
+    #ifdef LZ_MATCH_AVX2
+    if (g_LzFind_UseAvx2 && len + 32 <= lenLimit)
+      return LzFind_MatchLen_Avx2(pb, cur, len, lenLimit);
+    #endif
+    for (; len + 8 <= lenLimit; len += 8)
+    {
+      x = GetUi64(pb + len) ^ GetUi64(cur + len);
+      if (x != 0)
+        return len + (Lz_Ctz64(x) >> 3);
+    }
+  }
+  #endif
+  for (; len != lenLimit; len++)
+    if (pb[len] != cur[len])
+      break;
+  return len;
+}
+
 static void LzInWindow_Free(CMatchFinder *p, ISzAlloc *alloc)
 {
   if (!p->directInput)
@@ -132,6 +232,7 @@ static void MatchFinder_SetDefaultSettings(CMatchFinder *p)
   p->btMode = 1;
   p->numHashBytes = 4;
   p->bigHash = 0;
+  p->cyclicBufferExtra = 0;
 }
 
 #define kCrcPoly 0xEDB88320
@@ -152,6 +253,10 @@ void MatchFinder_Construct(CMatchFinder *p)
       r = (r >> 1) ^ (kCrcPoly & ~((r & 1) - 1));
     p->crc[i] = r;
   }
+
+  #ifdef LZ_MATCH_AVX2
+  g_LzFind_UseAvx2 = CPU_Is_Avx2_Supported();
+  #endif
 }
 
 static void MatchFinder_FreeThisClassMemory(CMatchFinder *p, ISzAlloc *alloc)
@@ -199,7 +304,7 @@ int MatchFinder_Create(CMatchFinder *p, UInt32 historySize,
   
   if (LzInWindow_Create(p, sizeReserv, alloc))
   {
-    UInt32 newCyclicBufferSize = historySize + 1;
+    UInt32 newCyclicBufferSize = historySize + 1 + p->cyclicBufferExtra;
     UInt32 hs;
     p->matchMaxLen = matchMaxLen;
     {
@@ -369,10 +474,7 @@ static UInt32 * Hc_GetMatchesSpec(UInt32 lenLimit, UInt32 curMatch, UInt32 pos,
       curMatch = son[_cyclicBufferPos - delta + ((delta > _cyclicBufferPos) ? _cyclicBufferSize : 0)];
       if (pb[maxLen] == cur[maxLen] && *pb == *cur)
       {
-        UInt32 len = 0;
-        while (++len != lenLimit)
-          if (pb[len] != cur[len])
-            break;
+        UInt32 len = LzFind_MatchLen(pb, cur, 1, lenLimit);
         if (maxLen < len)
         {
           *distances++ = maxLen = len;
@@ -385,8 +487,8 @@ static UInt32 * Hc_GetMatchesSpec(UInt32 lenLimit, UInt32 curMatch, UInt32 pos,
   }
 }
 
-UInt32 * GetMatchesSpec1(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byte *cur, CLzRef *son,
-    UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 cutValue,
+static LZ_INLINE UInt32 * GetMatchesSpec(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byte *cur, CLzRef *son,
+    UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 maxDelta, UInt32 cutValue,
     UInt32 *distances, UInt32 maxLen)
 {
   CLzRef *ptr0 = son + (_cyclicBufferPos << 1) + 1;
@@ -395,7 +497,7 @@ UInt32 * GetMatchesSpec1(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byt
   for (;;)
   {
     UInt32 delta = pos - curMatch;
-    if (cutValue-- == 0 || delta >= _cyclicBufferSize)
+    if (cutValue-- == 0 || delta >= maxDelta)
     {
       *ptr0 = *ptr1 = kEmptyHashValue;
       return distances;
@@ -407,9 +509,7 @@ UInt32 * GetMatchesSpec1(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byt
       if (pb[len] == cur[len])
       {
         if (++len != lenLimit && pb[len] == cur[len])
-          while (++len != lenLimit)
-            if (pb[len] != cur[len])
-              break;
+          len = LzFind_MatchLen(pb, cur, len + 1, lenLimit);
         if (maxLen < len)
         {
           *distances++ = maxLen = len;
@@ -440,6 +540,24 @@ UInt32 * GetMatchesSpec1(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byt
   }
 }
 
+UInt32 * GetMatchesSpec1(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byte *cur, CLzRef *son,
+    UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 cutValue,
+    UInt32 *distances, UInt32 maxLen)
+{
+  return GetMatchesSpec(lenLimit, curMatch, pos, cur, son,
+      _cyclicBufferPos, _cyclicBufferSize, _cyclicBufferSize, cutValue,
+      distances, maxLen);
+}
+
+UInt32 * GetMatchesSpec1_MaxDelta(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byte *cur, CLzRef *son,
+    UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 maxDelta, UInt32 cutValue,
+    UInt32 *distances, UInt32 maxLen)
+{
+  return GetMatchesSpec(lenLimit, curMatch, pos, cur, son,
+      _cyclicBufferPos, _cyclicBufferSize, maxDelta, cutValue,
+      distances, maxLen);
+}
+
 static void SkipMatchesSpec(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byte *cur, CLzRef *son,
     UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 cutValue)
 {
@@ -460,9 +578,7 @@ static void SkipMatchesSpec(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const
       UInt32 len = (len0 < len1 ? len0 : len1);
       if (pb[len] == cur[len])
       {
-        while (++len != lenLimit)
-          if (pb[len] != cur[len])
-            break;
+        len = LzFind_MatchLen(pb, cur, len + 1, lenLimit);
         {
           if (len == lenLimit)
           {
@@ -516,12 +632,7 @@ static void MatchFinder_MovePos(CMatchFinder *p) { MOVE_POS; }
 #define SKIP_FOOTER \
   SkipMatchesSpec(lenLimit, curMatch, MF_PARAMS(p)); MOVE_POS;
 
-#define UPDATE_maxLen { \
-    ptrdiff_t diff = (ptrdiff_t)0 - d2; \
-    const Byte *c = cur + maxLen; \
-    const Byte *lim = cur + lenLimit; \
-    for (; c != lim; c++) if (*(c + diff) != *c) break; \
-    maxLen = (UInt32)(c - cur); }
+#define UPDATE_maxLen { maxLen = LzFind_MatchLen(cur - d2, cur, maxLen, lenLimit); }
 
 static UInt32 Bt2_MatchFinder_GetMatches(CMatchFinder *p, UInt32 *distances)
 {
@@ -19,7 +19,7 @@ typedef struct _CMatchFinder
   UInt32 lenLimit;
 
   UInt32 cyclicBufferPos;
-  UInt32 cyclicBufferSize; /* it must be = (historySize + 1) */
+  UInt32 cyclicBufferSize; /* it must be = (historySize + 1 + cyclicBufferExtra) */
 
   Byte streamEndWasReached;
   Byte btMode;
@@ -47,6 +47,8 @@ typedef struct _CMatchFinder
   SRes result;
   UInt32 crc[256];
   size_t numRefs;
+  UInt32 cyclicBufferExtra; /* the positions that are kept in cyclic buffer after historySize, default = 0.
+                               LzFindMt needs them for several binary tree threads. */
 } CMatchFinder;
 
 #define Inline_MatchFinder_GetPointerToCurrentPos(p) ((p)->buffer)
@@ -80,6 +82,12 @@ UInt32 * GetMatchesSpec1(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byt
     UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 _cutValue,
     UInt32 *distances, UInt32 maxLen);
 
+/* It's GetMatchesSpec1() for cyclic buffer that is larger than the window:
+   the nodes are used only for (delta < maxDelta), where maxDelta <= _cyclicBufferSize. */
+UInt32 * GetMatchesSpec1_MaxDelta(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byte *buffer, CLzRef *son,
+    UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 maxDelta, UInt32 _cutValue,
+    UInt32 *distances, UInt32 maxLen);
+
 /*
 Conditions:
   Mf_GetNumAvailableBytes_Func must be called before each Mf_GetMatchLen_Func.
@@ -137,7 +137,13 @@ void MtSync_Init(CMtSync *p) { p->needStart = True; }
   static void GetHeads ## name(const Byte *p, UInt32 pos, \
       UInt32 *hash, UInt32 hashMask, UInt32 *heads, UInt32 numHeads, const UInt32 *crc) \
     { action; for (; numHeads != 0; numHeads--) { \
-      const UInt32 value = (v); p++; *heads++ = pos - hash[value]; hash[value] = pos++;  } }
+      const UInt32 value = (v); p++; *heads++ = pos - hash[value]; hash[value] = pos++;  } } \
+  static void GetHeadsParts ## name(const Byte *p, UInt32 pos, \
+      UInt32 *hash, UInt32 hashMask, UInt32 *heads, UInt32 numHeads, const UInt32 *crc, \
+      Byte *parts, UInt32 numParts) \
+    { action; for (; numHeads != 0; numHeads--) { \
+      const UInt32 value = (v); p++; *heads++ = pos - hash[value]; hash[value] = pos++; \
+      *parts++ = (Byte)(value % numParts); } }
 
 #define DEF_GetHeads(name, v) DEF_GetHeads2(name, v, ;)
 
@@ -204,7 +210,11 @@ static void HashThreadFunc(CMatchFinderMt *mt)
             num = num - mf->numHashBytes + 1;
             if (num > kMtHashBlockSize - 2)
               num = kMtHashBlockSize - 2;
-            mt->GetHeadsFunc(mf->buffer, mf->pos, mf->hash + mf->fixedHashSize, mf->hashMask, heads + 2, num, mf->crc);
+            if (mt->numBtThreads > 1)
+              mt->GetHeadsPartsFunc(mf->buffer, mf->pos, mf->hash + mf->fixedHashSize, mf->hashMask, heads + 2, num, mf->crc,
+                  mt->hashParts + (heads + 2 - mt->hashBuf), mt->numBtThreads);
+            else
+              mt->GetHeadsFunc(mf->buffer, mf->pos, mf->hash + mf->fixedHashSize, mf->hashMask, heads + 2, num, mf->crc);
             heads[0] += num;
           }
           mf->pos += num;
@@ -234,7 +244,7 @@ static void MatchFinderMt_GetNextBlock_Hash(CMatchFinderMt *p)
 #define NO_INLINE MY_FAST_CALL
 
 static Int32 NO_INLINE GetMatchesSpecN(UInt32 lenLimit, UInt32 pos, const Byte *cur, CLzRef *son,
-    UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 _cutValue,
+    UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 maxDelta, UInt32 _cutValue,
     UInt32 *_distances, UInt32 _maxLen, const UInt32 *hash, Int32 limit, UInt32 size, UInt32 *posRes)
 {
   do
@@ -250,7 +260,7 @@ static Int32 NO_INLINE GetMatchesSpecN(UInt32 lenLimit, UInt32 pos, const Byte *
   for (;;)
   {
     UInt32 delta = pos - curMatch;
-    if (cutValue-- == 0 || delta >= _cyclicBufferSize)
+    if (cutValue-- == 0 || delta >= maxDelta)
     {
       *ptr0 = *ptr1 = kEmptyHashValue;
       break;
@@ -310,16 +320,104 @@ static Int32 NO_INLINE GetMatchesSpecN(UInt32 lenLimit, UInt32 pos, const Byte *
 
 #endif
 
+static void BtWorker_GetMatches(CMatchFinderMt *p, CMtBtWorker *w)
+{
+  UInt32 *distances = w->stage;
+  const Byte *parts = p->btStepParts;
+  const UInt32 *heads = p->btStepHeads;
+  const Byte *cur = p->btStepBuffer;
+  UInt32 pos = p->btStepPos;
+  UInt32 cyclicBufferPos = p->btStepCyclicBufferPos;
+  UInt32 num = p->btStepSize;
+  UInt32 index = w->index;
+  UInt32 i;
+  
+  for (i = 0; i < num; i++)
+    if (parts[i] == index)
+    {
+      UInt32 *startDistances = distances;
+      distances = GetMatchesSpec1_MaxDelta(p->btStepLenLimit, pos + i - heads[i],
+          pos + i, cur + i, p->son, cyclicBufferPos + i, p->cyclicBufferSize, p->historySize + 1, p->cutValue,
+          startDistances + 1, p->numHashBytes - 1);
+      *startDistances = (UInt32)(distances - startDistances) - 1;
+    }
+  
+  w->stagePos = 0;
+}
+
+static void BtWorkerFunc(CMtBtWorker *w)
+{
+  CMatchFinderMt *mt = w->mt;
+  for (;;)
+  {
+    Event_Wait(&w->canStart);
+    if (mt->btWorkersExit)
+      return;
+    BtWorker_GetMatches(mt, w);
+    Semaphore_Release1(&mt->btWorkersDone);
+  }
+}
+
+/* It searches the matches for (num) positions from (p->hashBufPos) with all BT threads. */
+
+static void BtStep(CMatchFinderMt *p, UInt32 lenLimit, UInt32 num)
+{
+  UInt32 i;
+  p->btStepPos = p->pos;
+  p->btStepCyclicBufferPos = p->cyclicBufferPos;
+  p->btStepBuffer = p->buffer;
+  p->btStepHeads = p->hashBuf + p->hashBufPos;
+  p->btStepParts = p->hashParts + p->hashBufPos;
+  p->btStepSize = num;
+  p->btStepLenLimit = lenLimit;
+
+  for (i = 1; i < p->numBtThreads; i++)
+    Event_Set(&p->btWorkers[i].canStart);
+  BtWorker_GetMatches(p, &p->btWorkers[0]);
+  for (i = 1; i < p->numBtThreads; i++)
+    Semaphore_Wait(&p->btWorkersDone);
+
+  p->btPendingNum = num;
+  p->btPendingParts = p->btStepParts;
+  p->hashBufPos += num;
+}
+
+/* It writes the matches of pending positions in position order, while (curPos < limit). */
+
+static UInt32 BtStep_Write(CMatchFinderMt *p, UInt32 *distances, UInt32 curPos, UInt32 limit)
+{
+  const Byte *parts = p->btPendingParts;
+  UInt32 num = p->btPendingNum;
+  for (; num != 0 && curPos < limit; num--)
+  {
+    CMtBtWorker *w = &p->btWorkers[*parts++];
+    const UInt32 *src = w->stage + w->stagePos;
+    UInt32 n = src[0] + 1;
+    w->stagePos += n;
+    do
+      distances[curPos++] = *src++;
+    while (--n != 0);
+  }
+  p->btPendingParts = parts;
+  p->btPendingNum = num;
+  return curPos;
+}
+
 static void BtGetMatches(CMatchFinderMt *p, UInt32 *distances)
 {
-  UInt32 numProcessed = 0;
+  UInt32 numProcessed = p->btPendingNum;
   UInt32 curPos = 2;
   UInt32 limit = kMtBtBlockSize - (p->matchMaxLen * 2);
   
-  distances[1] = p->hashNumAvail;
+  distances[1] = p->hashNumAvail + p->btPendingNum;
   
   while (curPos < limit)
   {
+    if (p->btPendingNum != 0)
+    {
+      curPos = BtStep_Write(p, distances, curPos, limit);
+      continue;
+    }
     if (p->hashBufPos == p->hashBufPosLimit)
     {
       MatchFinderMt_GetNextBlock_Hash(p);
@@ -348,12 +446,22 @@ static void BtGetMatches(CMatchFinderMt *p, UInt32 *distances)
           size = size2;
       }
       
+      if (p->numBtThreads > 1 && size >= kMtBtStepSizeMin)
+      {
+        if (size > p->btStepSizeMax)
+          size = p->btStepSizeMax;
+        BtStep(p, lenLimit, size);
+        cyclicBufferPos += size;
+        pos += size;
+        p->buffer += size;
+      }
+      else
       #ifndef MFMT_GM_INLINE
       while (curPos < limit && size-- != 0)
       {
         UInt32 *startDistances = distances + curPos;
-        UInt32 num = (UInt32)(GetMatchesSpec1(lenLimit, pos - p->hashBuf[p->hashBufPos++],
-            pos, p->buffer, p->son, cyclicBufferPos, p->cyclicBufferSize, p->cutValue,
+        UInt32 num = (UInt32)(GetMatchesSpec1_MaxDelta(lenLimit, pos - p->hashBuf[p->hashBufPos++],
+            pos, p->buffer, p->son, cyclicBufferPos, p->cyclicBufferSize, p->historySize + 1, p->cutValue,
             startDistances + 1, p->numHashBytes - 1) - startDistances);
         *startDistances = num - 1;
         curPos += num;
@@ -364,7 +472,7 @@ static void BtGetMatches(CMatchFinderMt *p, UInt32 *distances)
       #else
       {
         UInt32 posRes;
-        curPos = limit - GetMatchesSpecN(lenLimit, pos, p->buffer, p->son, cyclicBufferPos, p->cyclicBufferSize, p->cutValue,
+        curPos = limit - GetMatchesSpecN(lenLimit, pos, p->buffer, p->son, cyclicBufferPos, p->cyclicBufferSize, p->historySize + 1, p->cutValue,
             distances + curPos, p->numHashBytes - 1, p->hashBuf + p->hashBufPos, (Int32)(limit - curPos), size, &posRes);
         p->hashBufPos += posRes - pos;
         cyclicBufferPos += posRes - pos;
@@ -438,21 +546,62 @@ void BtThreadFunc(CMatchFinderMt *mt)
 
 void MatchFinderMt_Construct(CMatchFinderMt *p)
 {
+  unsigned i;
   p->hashBuf = NULL;
   MtSync_Construct(&p->hashSync);
   MtSync_Construct(&p->btSync);
+
+  p->numBtThreads = 1;
+  p->numBtWorkers = 0;
+  p->btWorkersExit = False;
+  p->btStages = NULL;
+  p->hashParts = NULL;
+  Semaphore_Construct(&p->btWorkersDone);
+  for (i = 0; i < kMtBtNumThreadsMax; i++)
+  {
+    CMtBtWorker *w = &p->btWorkers[i];
+    w->mt = p;
+    w->index = i;
+    w->stage = NULL;
+    Thread_Construct(&w->thread);
+    Event_Construct(&w->canStart);
+  }
+}
+
+static void MatchFinderMt_DestructWorkers(CMatchFinderMt *p)
+{
+  unsigned i;
+  p->btWorkersExit = True;
+  for (i = 1; i < kMtBtNumThreadsMax; i++)
+  {
+    CMtBtWorker *w = &p->btWorkers[i];
+    if (Thread_WasCreated(&w->thread))
+    {
+      Event_Set(&w->canStart);
+      Thread_Wait(&w->thread);
+      Thread_Close(&w->thread);
+    }
+    Event_Close(&w->canStart);
+  }
+  Semaphore_Close(&p->btWorkersDone);
+  p->btWorkersExit = False;
+  p->numBtWorkers = 0;
 }
 
 static void MatchFinderMt_FreeMem(CMatchFinderMt *p, ISzAlloc *alloc)
 {
   alloc->Free(alloc, p->hashBuf);
   p->hashBuf = NULL;
+  alloc->Free(alloc, p->btStages);
+  p->btStages = NULL;
+  p->hashParts = NULL;
 }
 
 void MatchFinderMt_Destruct(CMatchFinderMt *p, ISzAlloc *alloc)
 {
   MtSync_Destruct(&p->hashSync);
   MtSync_Destruct(&p->btSync);
+  MatchFinderMt_DestructWorkers(p);
   MatchFinderMt_FreeMem(p, alloc);
 }
 
@@ -470,6 +619,50 @@ static THREAD_FUNC_RET_TYPE THREAD_FUNC_CALL_TYPE BtThreadFunc2(void *p)
     BtThreadFunc((CMatchFinderMt *)p);
   return 0;
 }
+static THREAD_FUNC_RET_TYPE THREAD_FUNC_CALL_TYPE BtWorkerFunc2(void *p) { BtWorkerFunc((CMtBtWorker *)p);  return 0; }
+
+static SRes MatchFinderMt_CreateWorkers2(CMatchFinderMt *p)
+{
+  UInt32 i;
+  RINOK_THREAD(Semaphore_Create(&p->btWorkersDone, 0, kMtBtNumThreadsMax));
+  for (i = 1; i < p->numBtThreads; i++)
+  {
+    CMtBtWorker *w = &p->btWorkers[i];
+    RINOK_THREAD(AutoResetEvent_CreateNotSignaled(&w->canStart));
+    RINOK_THREAD(Thread_Create(&w->thread, BtWorkerFunc2, w));
+    p->numBtWorkers = i;
+  }
+  return SZ_OK;
+}
+
+static SRes MatchFinderMt_CreateWorkers(CMatchFinderMt *p, ISzAlloc *alloc)
+{
+  UInt32 numThreads = p->numBtThreads;
+  UInt32 i;
+  SRes res;
+
+  if (p->numBtWorkers == numThreads - 1 && (numThreads == 1 || p->btStages))
+    return SZ_OK;
+
+  MatchFinderMt_DestructWorkers(p);
+  alloc->Free(alloc, p->btStages);
+  p->btStages = NULL;
+  p->hashParts = NULL;
+  if (numThreads == 1)
+    return SZ_OK;
+
+  p->btStages = (UInt32 *)alloc->Alloc(alloc, (size_t)kMtBtStageSize * numThreads * sizeof(UInt32) + kHashBufferSize);
+  if (!p->btStages)
+    return SZ_ERROR_MEM;
+  for (i = 0; i < numThreads; i++)
+    p->btWorkers[i].stage = p->btStages + (size_t)kMtBtStageSize * i;
+  p->hashParts = (Byte *)(p->btStages + (size_t)kMtBtStageSize * numThreads);
+
+  res = MatchFinderMt_CreateWorkers2(p);
+  if (res != SZ_OK)
+    MatchFinderMt_DestructWorkers(p);
+  return res;
+}
 
 SRes MatchFinderMt_Create(CMatchFinderMt *p, UInt32 historySize, UInt32 keepAddBufferBefore,
     UInt32 matchMaxLen, UInt32 keepAddBufferAfter, ISzAlloc *alloc)
@@ -478,6 +671,8 @@ SRes MatchFinderMt_Create(CMatchFinderMt *p, UInt32 historySize, UInt32 keepAddB
   p->historySize = historySize;
   if (kMtBtBlockSize <= matchMaxLen * 4)
     return SZ_ERROR_PARAM;
+  if (p->numBtThreads < 1 || p->numBtThreads > kMtBtNumThreadsMax)
+    return SZ_ERROR_PARAM;
   if (!p->hashBuf)
   {
     p->hashBuf = (UInt32 *)alloc->Alloc(alloc, (kHashBufferSize + kBtBufferSize) * sizeof(UInt32));
@@ -487,9 +682,16 @@ SRes MatchFinderMt_Create(CMatchFinderMt *p, UInt32 historySize, UInt32 keepAddB
   }
   keepAddBufferBefore += (kHashBufferSize + kBtBufferSize);
   keepAddBufferAfter += kMtHashBlockSize;
+  mf->cyclicBufferExtra = 0;
+  if (p->numBtThreads > 1)
+  {
+    keepAddBufferBefore += kMtBtStepSize;
+    mf->cyclicBufferExtra = kMtBtStepSize;
+  }
   if (!MatchFinder_Create(mf, historySize, keepAddBufferBefore, matchMaxLen, keepAddBufferAfter, alloc))
     return SZ_ERROR_MEM;
 
+  RINOK(MatchFinderMt_CreateWorkers(p, alloc));
   RINOK(MtSync_Create(&p->hashSync, HashThreadFunc2, p, kMtHashNumBlocks));
   RINOK(MtSync_Create(&p->btSync, BtThreadFunc2, p, kMtBtNumBlocks));
   return SZ_OK;
@@ -521,6 +723,11 @@ void MatchFinderMt_Init(CMatchFinderMt *p)
   p->cyclicBufferPos = mf->cyclicBufferPos;
   p->cyclicBufferSize = mf->cyclicBufferSize;
   p->cutValue = mf->cutValue;
+
+  p->btPendingNum = 0;
+  p->btStepSizeMax = kMtBtStageSize / (p->matchMaxLen * 2 + 1);
+  if (p->btStepSizeMax > kMtBtStepSize)
+    p->btStepSizeMax = kMtBtStepSize;
 }
 
 /* ReleaseStream is required to finish multithreading */
@@ -777,18 +984,21 @@ void MatchFinderMt_CreateVTable(CMatchFinderMt *p, IMatchFinder *vTable)
   {
     case 2:
       p->GetHeadsFunc = GetHeads2;
+      p->GetHeadsPartsFunc = GetHeadsParts2;
       p->MixMatchesFunc = (Mf_Mix_Matches)0;
       vTable->Skip = (Mf_Skip_Func)MatchFinderMt0_Skip;
       vTable->GetMatches = (Mf_GetMatches_Func)MatchFinderMt2_GetMatches;
       break;
     case 3:
       p->GetHeadsFunc = GetHeads3;
+      p->GetHeadsPartsFunc = GetHeadsParts3;
       p->MixMatchesFunc = (Mf_Mix_Matches)MixMatches2;
       vTable->Skip = (Mf_Skip_Func)MatchFinderMt2_Skip;
       break;
     default:
     /* case 4: */
       p->GetHeadsFunc = p->MatchFinder->bigHash ? GetHeads4b : GetHeads4;
+      p->GetHeadsPartsFunc = p->MatchFinder->bigHash ? GetHeadsParts4b : GetHeadsParts4;
       p->MixMatchesFunc = (Mf_Mix_Matches)MixMatches3;
       vTable->Skip = (Mf_Skip_Func)MatchFinderMt3_Skip;
       break;
@@ -17,6 +17,21 @@ EXTERN_C_BEGIN
 #define kMtBtNumBlocks (1 << 6)
 #define kMtBtNumBlocksMask (kMtBtNumBlocks - 1)
 
+/*
+Several BT threads:
+  The binary trees of different hash values don't share nodes. So the positions
+  are processed in steps of up to kMtBtStepSize positions, and each thread
+  searches and updates only the trees of its hash values (hashValue % numBtThreads).
+  The cyclic buffer keeps kMtBtStepSize additional positions, so the threads
+  don't overwrite the nodes that are used by other threads in the same step,
+  and the matches are the same as with one BT thread.
+*/
+
+#define kMtBtNumThreadsMax 16
+#define kMtBtStepSize (1 << 12)
+#define kMtBtStepSizeMin (1 << 6)
+#define kMtBtStageSize (1 << 18)
+
 typedef struct _CMtSync
 {
   Bool wasCreated;
@@ -44,6 +59,24 @@ typedef UInt32 * (*Mf_Mix_Matches)(void *p, UInt32 matchMinPos, UInt32 *distance
 typedef void (*Mf_GetHeads)(const Byte *buffer, UInt32 pos,
   UInt32 *hash, UInt32 hashMask, UInt32 *heads, UInt32 numHeads, const UInt32 *crc);
 
+/* it also writes (hashValue % numParts) for each head to (parts) */
+typedef void (*Mf_GetHeadsParts)(const Byte *buffer, UInt32 pos,
+  UInt32 *hash, UInt32 hashMask, UInt32 *heads, UInt32 numHeads, const UInt32 *crc,
+  Byte *parts, UInt32 numParts);
+
+struct _CMatchFinderMt;
+
+typedef struct _CMtBtWorker
+{
+  struct _CMatchFinderMt *mt;
+  UInt32 index;
+  CThread thread;
+  CAutoResetEvent canStart;
+  UInt32 *stage;    /* the matches for the positions of this thread in current step */
+  UInt32 stagePos;
+  Byte dummy[kMtCacheLineDummy];
+} CMtBtWorker;
+
 typedef struct _CMatchFinderMt
 {
   /* LZ */
@@ -77,15 +110,35 @@ typedef struct _CMatchFinderMt
   UInt32 pos;
   const Byte *buffer;
   UInt32 cyclicBufferPos;
-  UInt32 cyclicBufferSize; /* it must be historySize + 1 */
+  UInt32 cyclicBufferSize; /* it must be historySize + 1 + MatchFinder->cyclicBufferExtra */
   UInt32 cutValue;
 
+  /* BT threads */
+  UInt32 numBtThreads; /* 1 <= numBtThreads <= kMtBtNumThreadsMax, default = 1. Set it before MatchFinderMt_Create() */
+  UInt32 numBtWorkers; /* the number of created worker threads */
+  Bool btWorkersExit;
+  CSemaphore btWorkersDone;
+  UInt32 *btStages;
+  Byte *hashParts;
+  UInt32 btStepSizeMax;
+  UInt32 btStepPos;
+  UInt32 btStepCyclicBufferPos;
+  UInt32 btStepSize;
+  UInt32 btStepLenLimit;
+  const Byte *btStepBuffer;
+  const UInt32 *btStepHeads;
+  const Byte *btStepParts;
+  UInt32 btPendingNum; /* the positions of last step that were not written to btBuf */
+  const Byte *btPendingParts;
+  CMtBtWorker btWorkers[kMtBtNumThreadsMax];
+
   /* BT + Hash */
   CMtSync hashSync;
   /* Byte hashDummy[kMtCacheLineDummy]; */
   
   /* Hash */
   Mf_GetHeads GetHeadsFunc;
+  Mf_GetHeadsParts GetHeadsPartsFunc;
   CMatchFinder *MatchFinder;
 } CMatchFinderMt;
 
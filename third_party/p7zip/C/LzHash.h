@@ -19,6 +19,19 @@
   h2 = temp & (kHash2Size - 1); \
   hv = (temp ^ ((UInt32)cur[2] << 8)) & p->hashMask; }
 
+#ifdef MY_CPU_LE_UNALIGN
+
+/* the same values from one load of 4 bytes */
+#define HASH4_CALC { \
+  UInt32 v = GetUi32(cur); \
+  UInt32 temp = p->crc[v & 0xFF] ^ ((v >> 8) & 0xFF); \
+  h2 = temp & (kHash2Size - 1); \
+  temp ^= ((v >> 8) & 0xFF00); \
+  h3 = temp & (kHash3Size - 1); \
+  hv = (temp ^ (p->crc[v >> 24] << 5)) & p->hashMask; }
+
+#else
+
 #define HASH4_CALC { \
   UInt32 temp = p->crc[cur[0]] ^ cur[1]; \
   h2 = temp & (kHash2Size - 1); \
@@ -26,6 +39,8 @@
   h3 = temp & (kHash3Size - 1); \
   hv = (temp ^ (p->crc[cur[3]] << 5)) & p->hashMask; }
 
+#endif
+
 #define HASH5_CALC { \
   UInt32 temp = p->crc[cur[0]] ^ cur[1]; \
   h2 = temp & (kHash2Size - 1); \
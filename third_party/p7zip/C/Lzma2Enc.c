@@ -184,6 +184,7 @@ void Lzma2EncProps_Init(CLzma2EncProps *p)
 void Lzma2EncProps_Normalize(CLzma2EncProps *p)
 {
   int t1, t1n, t2, t3;
+  Bool t1Auto = (p->lzmaProps.numThreads <= 0);
   {
     CLzmaEncProps lzmaProps = p->lzmaProps;
     LzmaEncProps_Normalize(&lzmaProps);
@@ -252,6 +253,13 @@ void Lzma2EncProps_Normalize(CLzma2EncProps *p)
         t2 = (unsigned)numBlocks;
         if (t2 == 0)
           t2 = 1;
+        /* the match finders of the blocks get the threads that are not used for blocks */
+        if (t1Auto && t1 > 1 && t3 / t2 > t1)
+        {
+          p->lzmaProps.numThreads = t3 / t2;
+          LzmaEncProps_Normalize(&p->lzmaProps);
+          t1 = p->lzmaProps.numThreads;
+        }
         t3 = t1 * t2;
       }
     }
@@ -344,7 +352,7 @@ typedef struct
 } CMtCallbackImp;
 
 static SRes MtCallbackImp_Code(void *pp, unsigned index, Byte *dest, size_t *destSize,
-      const Byte *src, size_t srcSize, int finished)
+      const Byte *src, size_t srcSize, size_t dictSize, int finished)
 {
   CMtCallbackImp *imp = (CMtCallbackImp *)pp;
   CLzma2Enc *mainEncoder = imp->lzma2Enc;
@@ -357,6 +365,14 @@ static SRes MtCallbackImp_Code(void *pp, unsigned index, Byte *dest, size_t *des
 
     if (srcSize != 0)
     {
+      /* the encoder is created and its buffers are allocated in the thread that uses them:
+         they are local to the NUMA node of that thread (see Alloc.c) */
+      if (!p->enc)
+      {
+        p->enc = LzmaEnc_Create(mainEncoder->alloc);
+        if (!p->enc)
+          return SZ_ERROR_MEM;
+      }
       RINOK(Lzma2EncInt_Init(p, &mainEncoder->props));
      
       RINOK(LzmaEnc_MemPrepare(p->enc, src, srcSize, LZMA2_KEEP_WINDOW_SIZE,
@@ -475,18 +491,6 @@ SRes Lzma2Enc_Encode(CLzma2EncHandle pp,
     ISeqOutStream *outStream, ISeqInStream *inStream, ICompressProgress *progress)
 {
   CLzma2Enc *p = (CLzma2Enc *)pp;
-  int i;
-
-  for (i = 0; i < p->props.numBlockThreads; i++)
-  {
-    CLzma2EncInt *t = &p->coders[(unsigned)i];
-    if (!t->enc)
-    {
-      t->enc = LzmaEnc_Create(p->alloc);
-      if (!t->enc)
-        return SZ_ERROR_MEM;
-    }
-  }
 
   #ifndef _7ZIP_ST
   if (p->props.numBlockThreads > 1)
@@ -516,5 +520,11 @@ SRes Lzma2Enc_Encode(CLzma2EncHandle pp,
   }
   #endif
 
+  if (!p->coders[0].enc)
+  {
+    p->coders[0].enc = LzmaEnc_Create(p->alloc);
+    if (!p->coders[0].enc)
+      return SZ_ERROR_MEM;
+  }
   return Lzma2Enc_EncodeMt1(&p->coders[0], p, outStream, inStream, progress);
 }
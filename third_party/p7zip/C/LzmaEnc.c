@@ -14,6 +14,7 @@
 
 #include "LzmaEnc.h"
 
+#include "CpuArch.h"
 #include "LzFind.h"
 #ifndef _7ZIP_ST
 #include "LzFindMt.h"
@@ -54,6 +55,7 @@ void LzmaEncProps_Init(CLzmaEncProps *p)
   p->reduceSize = (UInt64)(Int64)-1;
   p->lc = p->lp = p->pb = p->algo = p->fb = p->btMode = p->numHashBytes = p->numThreads = -1;
   p->writeEndMark = 0;
+  p->ldmSize = 0;
 }
 
 void LzmaEncProps_Normalize(CLzmaEncProps *p)
@@ -72,6 +74,10 @@ void LzmaEncProps_Normalize(CLzmaEncProps *p)
       if ((UInt32)p->reduceSize <= ((UInt32)3 << i)) { p->dictSize = ((UInt32)3 << i); break; }
     }
   }
+  if (p->ldmSize > p->reduceSize)
+    p->ldmSize = (UInt32)p->reduceSize;
+  if (p->ldmSize <= p->dictSize)
+    p->ldmSize = 0;
 
   if (p->lc < 0) p->lc = 3;
   if (p->lp < 0) p->lp = 0;
@@ -96,7 +102,7 @@ UInt32 LzmaEncProps_GetDictSize(const CLzmaEncProps *props2)
 {
   CLzmaEncProps props = *props2;
   LzmaEncProps_Normalize(&props);
-  return props.dictSize;
+  return (props.ldmSize != 0) ? props.ldmSize : props.dictSize;
 }
 
 #if (_MSC_VER >= 1400)
@@ -296,6 +302,36 @@ typedef struct
 } CSaveState;
 
 
+/*
+  Long distance matching: the match finder indexes only the (dictSize) bytes
+  before the current position, but the buffer keeps (ldmSize) bytes.
+  The gear hash of the last kLdmMinLen bytes (each byte shifts it left by 1 bit,
+  so the high bits depend on all 64 bytes) chooses the sampled positions:
+  one of (1 << kLdmSampleBits) on average, when its high bits are zero.
+  The block of kLdmMinLen bytes that ends at the sampled position goes to a
+  table of (1 << kLdmBucketBits) positions in bucket. A block that is found in
+  the table gives a distance, and ReadMatchDistances() adds the match at this
+  distance to the matches of match finder, while the data continues to match.
+*/
+
+#define kLdmMinLen 64
+#define kLdmSampleBits 7
+#define kLdmBucketBits 3
+#define kLdmHashBitsMin 8
+
+/* the shorter matches at long distances are rarely cheaper than literals */
+#define kLdmMatchLenMin 8
+
+/* the sampled blocks can start before the current position */
+#define kLdmKeepBefore (kLdmMinLen + LZMA_MATCH_LEN_MAX * 2)
+
+typedef struct
+{
+  UInt32 pos;
+  UInt32 check;
+} CLdmEntry;
+
+
 typedef struct
 {
   void *matchFinderObj;
@@ -335,6 +371,15 @@ typedef struct
   UInt32 dictSize;
   SRes result;
 
+  UInt32 ldmSize;
+  UInt32 ldmDist;
+  unsigned ldmHashBits;
+  UInt64 ldmPos;
+  UInt64 ldmFeedPos;
+  UInt64 ldmHash;
+  UInt64 *ldmGear;
+  CLdmEntry *ldmTable;
+
   CRangeEnc rc;
 
   #ifndef _7ZIP_ST
@@ -445,10 +490,13 @@ SRes LzmaEnc_SetProps(CLzmaEncHandle pp, const CLzmaEncProps *props2)
       || props.lp > LZMA_LP_MAX
       || props.pb > LZMA_PB_MAX
       || props.dictSize > ((UInt64)1 << kDicLogSizeMaxCompress)
-      || props.dictSize > kMaxHistorySize)
+      || props.dictSize > kMaxHistorySize
+      || props.ldmSize > ((UInt64)1 << kDicLogSizeMaxCompress)
+      || props.ldmSize > kMaxHistorySize)
     return SZ_ERROR_PARAM;
 
   p->dictSize = props.dictSize;
+  p->ldmSize = props.ldmSize;
   {
     unsigned fb = props.fb;
     if (fb < 5)
@@ -487,6 +535,14 @@ SRes LzmaEnc_SetProps(CLzmaEncHandle pp, const CLzmaEncProps *props2)
   }
   */
   p->multiThread = (props.numThreads > 1);
+  {
+    int numBtThreads = props.numThreads - 1;
+    if (numBtThreads < 1)
+      numBtThreads = 1;
+    if (numBtThreads > kMtBtNumThreadsMax)
+      numBtThreads = kMtBtNumThreadsMax;
+    p->matchFinderMt.numBtThreads = (UInt32)numBtThreads;
+  }
   #endif
 
   return SZ_OK;
@@ -850,6 +906,100 @@ static void LenEnc_Encode2(CLenPriceEnc *p, CRangeEnc *rc, UInt32 symbol, UInt32
 
 
 
+/* (block) is the data at (pos), the data before it up to (ldmSize) is in the buffer */
+
+static void Ldm_Insert(CLzmaEnc *p, const Byte *block, UInt64 pos)
+{
+  CLdmEntry *bucket;
+  UInt64 h = 0;
+  UInt32 check, dist = 0;
+  unsigned i;
+
+  for (i = 0; i < kLdmMinLen; i += 8)
+    h = (h ^ GetUi64(block + i)) * UINT64_CONST(0x9E3779B97F4A7C15);
+  bucket = p->ldmTable + ((size_t)(h >> (64 - p->ldmHashBits)) << kLdmBucketBits);
+  check = (UInt32)(h ^ (h >> 32));
+
+  /* the positions are stored modulo (1 << 32), so the found blocks are compared */
+  for (i = 0; i < (1 << kLdmBucketBits); i++)
+  {
+    UInt32 d = (UInt32)pos - bucket[i].pos;
+    if (bucket[i].check == check && d != 0 && d <= p->ldmSize && d <= pos
+        && memcmp(block, block - d, kLdmMinLen) == 0)
+    {
+      dist = d;
+      break;
+    }
+  }
+  memmove(bucket + 1, bucket, ((1 << kLdmBucketBits) - 1) * sizeof(CLdmEntry));
+  bucket[0].pos = (UInt32)pos;
+  bucket[0].check = check;
+
+  /* the previous distance is kept while it matches, then it's the rep0 of the matches */
+  if (dist != 0 && dist != p->ldmDist)
+  {
+    UInt32 prev = p->ldmDist;
+    if (prev == 0 || prev > pos || memcmp(block, block - prev, kLdmMinLen) != 0)
+      p->ldmDist = dist;
+  }
+}
+
+/* (cur) is the data at (ldmPos), (numAvail) bytes of it are available.
+   The hash runs ahead of (ldmPos), so the sampled blocks can cover the current position. */
+
+static void Ldm_Feed(CLzmaEnc *p, const Byte *cur, UInt32 numAvail)
+{
+  UInt64 pos = p->ldmFeedPos;
+  UInt64 lim = p->ldmPos + numAvail;
+  UInt64 hash = p->ldmHash;
+  const UInt64 *gear = p->ldmGear;
+  const Byte *data = cur + (ptrdiff_t)(Int64)(pos - p->ldmPos);
+
+  for (; pos < lim; pos++, data++)
+  {
+    hash = (hash << 1) + gear[*data];
+    if ((hash >> (64 - kLdmSampleBits)) == 0 && pos >= kLdmMinLen - 1)
+      Ldm_Insert(p, data + 1 - kLdmMinLen, pos + 1 - kLdmMinLen);
+  }
+  p->ldmHash = hash;
+  p->ldmFeedPos = pos;
+}
+
+/* adds the match at (ldmDist), if it's longer than (*lenRes), the longest match of match finder */
+
+static UInt32 Ldm_GetMatches(CLzmaEnc *p, UInt32 numPairs, UInt32 *lenRes)
+{
+  const Byte *cur = p->matchFinder.GetPointerToCurrentPos(p->matchFinderObj) - 1;
+  UInt32 numAvail = p->numAvail;
+  UInt32 dist;
+  if (numAvail > LZMA_MATCH_LEN_MAX)
+    numAvail = LZMA_MATCH_LEN_MAX;
+
+  Ldm_Feed(p, cur, numAvail);
+
+  dist = p->ldmDist;
+  if (dist != 0 && dist <= p->ldmPos)
+  {
+    const Byte *src = cur - dist;
+    UInt32 len = 0;
+    for (; len < numAvail && cur[len] == src[len]; len++);
+    if (len > *lenRes && len >= kLdmMatchLenMin)
+    {
+      /* the pairs are sorted by length, and the match finder returns (numFastBytes) at most */
+      UInt32 pairLen = (len < p->numFastBytes) ? len : p->numFastBytes;
+      if (numPairs != 0 && p->matches[numPairs - 2] >= pairLen)
+        numPairs -= 2;
+      p->matches[numPairs] = pairLen;
+      p->matches[numPairs + 1] = dist - 1;
+      numPairs += 2;
+      *lenRes = len;
+    }
+  }
+  p->ldmPos++;
+  return numPairs;
+}
+
+
 static void MovePos(CLzmaEnc *p, UInt32 num)
 {
   #ifdef SHOW_STAT
@@ -860,6 +1010,7 @@ static void MovePos(CLzmaEnc *p, UInt32 num)
   if (num != 0)
   {
     p->additionalOffset += num;
+    p->ldmPos += num;
     p->matchFinder.Skip(p->matchFinderObj, num);
   }
 }
@@ -898,6 +1049,8 @@ static UInt32 ReadMatchDistances(CLzmaEnc *p, UInt32 *numDistancePairsRes)
       }
     }
   }
+  if (p->ldmSize != 0)
+    numPairs = Ldm_GetMatches(p, numPairs, &lenRes);
   p->additionalOffset++;
   *numDistancePairsRes = numPairs;
   return lenRes;
@@ -1760,6 +1913,9 @@ void LzmaEnc_Construct(CLzmaEnc *p)
   LzmaEnc_InitPriceTables(p->ProbPrices);
   p->litProbs = NULL;
   p->saveState.litProbs = NULL;
+  p->ldmGear = NULL;
+  p->ldmTable = NULL;
+  p->ldmHashBits = 0;
 }
 
 CLzmaEncHandle LzmaEnc_Create(ISzAlloc *alloc)
@@ -1779,6 +1935,14 @@ void LzmaEnc_FreeLits(CLzmaEnc *p, ISzAlloc *alloc)
   p->saveState.litProbs = NULL;
 }
 
+static void LzmaEnc_FreeLdm(CLzmaEnc *p, ISzAlloc *allocBig)
+{
+  allocBig->Free(allocBig, p->ldmGear);
+  p->ldmGear = NULL;
+  p->ldmTable = NULL;
+  p->ldmHashBits = 0;
+}
+
 void LzmaEnc_Destruct(CLzmaEnc *p, ISzAlloc *alloc, ISzAlloc *allocBig)
 {
   #ifndef _7ZIP_ST
@@ -1786,6 +1950,7 @@ void LzmaEnc_Destruct(CLzmaEnc *p, ISzAlloc *alloc, ISzAlloc *allocBig)
   #endif
   
   MatchFinder_Free(&p->matchFinderBase, allocBig);
+  LzmaEnc_FreeLdm(p, allocBig);
   LzmaEnc_FreeLits(p, alloc);
   RangeEnc_Free(&p->rc, alloc);
 }
@@ -1796,12 +1961,23 @@ void LzmaEnc_Destroy(CLzmaEncHandle p, ISzAlloc *alloc, ISzAlloc *allocBig)
   alloc->Free(alloc, p);
 }
 
+static void LzmaEnc_InitLdm(CLzmaEnc *p)
+{
+  p->ldmDist = 0;
+  p->ldmPos = 0;
+  p->ldmFeedPos = 0;
+  p->ldmHash = 0;
+  if (p->ldmTable)
+    memset(p->ldmTable, 0, (size_t)sizeof(CLdmEntry) << (p->ldmHashBits + kLdmBucketBits));
+}
+
 static SRes LzmaEnc_CodeOneBlock(CLzmaEnc *p, Bool useLimits, UInt32 maxPackSize, UInt32 maxUnpackSize)
 {
   UInt32 nowPos32, startPos32;
   if (p->needInit)
   {
     p->matchFinder.Init(p->matchFinderObj);
+    LzmaEnc_InitLdm(p);
     p->needInit = 0;
   }
 
@@ -1960,6 +2136,39 @@ static SRes LzmaEnc_CodeOneBlock(CLzmaEnc *p, Bool useLimits, UInt32 maxPackSize
 
 #define kBigHashDicLimit ((UInt32)1 << 24)
 
+/* the table has one position for (1 << kLdmSampleBits) bytes of (windowSize) */
+
+static SRes LzmaEnc_AllocLdm(CLzmaEnc *p, UInt32 windowSize, ISzAlloc *allocBig)
+{
+  unsigned bits = kLdmHashBitsMin;
+  while (bits + kLdmBucketBits + kLdmSampleBits < 31
+      && ((UInt32)1 << (bits + kLdmBucketBits + kLdmSampleBits)) < windowSize)
+    bits++;
+
+  if (!p->ldmGear || p->ldmHashBits != bits)
+  {
+    unsigned i;
+    UInt64 x = 0;
+    LzmaEnc_FreeLdm(p, allocBig);
+    p->ldmGear = (UInt64 *)allocBig->Alloc(allocBig,
+        256 * sizeof(UInt64) + ((size_t)sizeof(CLdmEntry) << (bits + kLdmBucketBits)));
+    if (!p->ldmGear)
+      return SZ_ERROR_MEM;
+    p->ldmTable = (CLdmEntry *)(p->ldmGear + 256);
+    p->ldmHashBits = bits;
+
+    /* splitmix64 */
+    for (i = 0; i < 256; i++)
+    {
+      UInt64 z = (x += UINT64_CONST(0x9E3779B97F4A7C15));
+      z = (z ^ (z >> 30)) * UINT64_CONST(0xBF58476D1CE4E5B9);
+      z = (z ^ (z >> 27)) * UINT64_CONST(0x94D049BB133111EB);
+      p->ldmGear[i] = z ^ (z >> 31);
+    }
+  }
+  return SZ_OK;
+}
+
 static SRes LzmaEnc_Alloc(CLzmaEnc *p, UInt32 keepWindowSize, ISzAlloc *alloc, ISzAlloc *allocBig)
 {
   UInt32 beforeSize = kNumOpts;
@@ -1987,6 +2196,20 @@ static SRes LzmaEnc_Alloc(CLzmaEnc *p, UInt32 keepWindowSize, ISzAlloc *alloc, I
   }
 
   p->matchFinderBase.bigHash = (Byte)(p->dictSize > kBigHashDicLimit ? 1 : 0);
+  p->matchFinderBase.cyclicBufferExtra = 0;
+
+  if (p->ldmSize != 0)
+  {
+    /* the table for the block of LZMA2 is not larger than the block */
+    UInt32 windowSize = p->ldmSize;
+    if (p->matchFinderBase.directInput && p->matchFinderBase.directInputRem < windowSize)
+      windowSize = (UInt32)p->matchFinderBase.directInputRem;
+    RINOK(LzmaEnc_AllocLdm(p, windowSize, allocBig));
+    if (keepWindowSize < p->ldmSize + kLdmKeepBefore)
+      keepWindowSize = p->ldmSize + kLdmKeepBefore;
+  }
+  else
+    LzmaEnc_FreeLdm(p, allocBig);
 
   if (beforeSize + p->dictSize < keepWindowSize)
     beforeSize = keepWindowSize - p->dictSize;
@@ -2087,8 +2310,9 @@ void LzmaEnc_InitPrices(CLzmaEnc *p)
 static SRes LzmaEnc_AllocAndInit(CLzmaEnc *p, UInt32 keepWindowSize, ISzAlloc *alloc, ISzAlloc *allocBig)
 {
   UInt32 i;
+  UInt32 dictSize = (p->ldmSize != 0) ? p->ldmSize : p->dictSize;
   for (i = 0; i < (UInt32)kDicLogSizeMaxCompress; i++)
-    if (p->dictSize <= ((UInt32)1 << i))
+    if (dictSize <= ((UInt32)1 << i))
       break;
   p->distTableSize = i * 2;
 
@@ -2272,7 +2496,7 @@ SRes LzmaEnc_WriteProperties(CLzmaEncHandle pp, Byte *props, SizeT *size)
 {
   CLzmaEnc *p = (CLzmaEnc *)pp;
   unsigned i;
-  UInt32 dictSize = p->dictSize;
+  UInt32 dictSize = (p->ldmSize != 0) ? p->ldmSize : p->dictSize;
   if (*size < LZMA_PROPS_SIZE)
     return SZ_ERROR_PARAM;
   *size = LZMA_PROPS_SIZE;
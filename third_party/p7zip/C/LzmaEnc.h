@@ -27,11 +27,17 @@ typedef struct _CLzmaEncProps
   int numHashBytes; /* 2, 3 or 4, default = 4 */
   UInt32 mc;        /* 1 <= mc <= (1 << 30), default = 32 */
   unsigned writeEndMark;  /* 0 - do not write EOPM, 1 - write EOPM, default = 0 */
-  int numThreads;  /* 1 or 2, default = 2 */
+  int numThreads;  /* 1 or 2, default = 2
+                      3 or more: (numThreads - 1) threads search the binary trees */
+  UInt32 ldmSize;  /* 0 - no long distance matching, default = 0
+                      dictSize < ldmSize <= (1 << 30) + (1 << 29) for 64-bit version:
+                      the matches up to ldmSize back are searched in a sparse table.
+                      It's written as dictionary size, that the decoder allocates. */
 } CLzmaEncProps;
 
 void LzmaEncProps_Init(CLzmaEncProps *p);
 void LzmaEncProps_Normalize(CLzmaEncProps *p);
+/* returns the dictionary size for the decoder: (ldmSize), if it's used */
 UInt32 LzmaEncProps_GetDictSize(const CLzmaEncProps *props2);
 
 
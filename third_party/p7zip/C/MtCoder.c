@@ -3,6 +3,8 @@
 
 #include "Precomp.h"
 
+#include <string.h>
+
 #include "MtCoder.h"
 
 void LoopThread_Construct(CLoopThread *p)
@@ -151,11 +153,19 @@ static void CMtThread_Destruct(CMtThread *p)
     size = newSize; buf = (Byte *)IAlloc_Alloc(p->mtCoder->alloc, size); \
     if (buf == 0) return SZ_ERROR_MEM; }
 
-static SRes CMtThread_Prepare(CMtThread *p)
+/* It's called in the thread of coder, when it reads its first block:
+   so the pages of buffers are preferred on the NUMA node of that thread (see Alloc.c). */
+static SRes CMtThread_AllocBufs(CMtThread *p)
 {
-  MY_BUF_ALLOC(p->inBuf, p->inBufSize, p->mtCoder->blockSize)
+  MY_BUF_ALLOC(p->inBuf, p->inBufSize, p->mtCoder->dictSize + p->mtCoder->blockSize)
   MY_BUF_ALLOC(p->outBuf, p->outBufSize, p->mtCoder->destBlockSize)
+  return SZ_OK;
+}
 
+static SRes CMtThread_Prepare(CMtThread *p)
+{
+  p->inDictSize = 0;
+  p->inDataSize = 0;
   p->stopReading = False;
   p->stopWriting = False;
   RINOK_THREAD(AutoResetEvent_CreateNotSignaled(&p->canRead));
@@ -183,6 +193,7 @@ static SRes FullRead(ISeqInStream *stream, Byte *data, size_t *processedSize)
 }
 
 #define GET_NEXT_THREAD(p) &p->mtCoder->threads[p->index == p->mtCoder->numThreads  - 1 ? 0 : p->index + 1]
+#define GET_PREV_THREAD(p) &p->mtCoder->threads[p->index == 0 ? p->mtCoder->numThreads - 1 : p->index - 1]
 
 static SRes MtThread_Process(CMtThread *p, Bool *stop)
 {
@@ -199,17 +210,35 @@ static SRes MtThread_Process(CMtThread *p, Bool *stop)
     return Event_Set(&next->canRead) == 0 ? SZ_OK : SZ_ERROR_THREAD;
   }
 
+  RINOK(CMtThread_AllocBufs(p));
+
   {
     size_t size = p->mtCoder->blockSize;
     size_t destSize = p->outBufSize;
+    size_t dictSize = p->mtCoder->dictSize;
+    Byte *data;
+
+    if (dictSize != 0)
+    {
+      /* the previous thread doesn't read its next block until we set (next->canRead),
+         so its buffer still contains the previous block */
+      CMtThread *prev = GET_PREV_THREAD(p);
+      if (dictSize > prev->inDataSize)
+        dictSize = prev->inDataSize;
+      if (dictSize != 0)
+        memmove(p->inBuf, prev->inBuf + prev->inDictSize + prev->inDataSize - dictSize, dictSize);
+    }
+    p->inDictSize = dictSize;
+    data = p->inBuf + dictSize;
 
-    RINOK(FullRead(p->mtCoder->inStream, p->inBuf, &size));
+    RINOK(FullRead(p->mtCoder->inStream, data, &size));
+    p->inDataSize = size;
     next->stopReading = *stop = (size != p->mtCoder->blockSize);
     if (Event_Set(&next->canRead) != 0)
       return SZ_ERROR_THREAD;
 
     RINOK(p->mtCoder->mtCallback->Code(p->mtCoder->mtCallback, p->index,
-        p->outBuf, &destSize, p->inBuf, size, *stop));
+        p->outBuf, &destSize, data, size, dictSize, *stop));
 
     MtProgress_Reinit(&p->mtCoder->mtProgress, p->index);
 
@@ -250,6 +279,7 @@ void MtCoder_Construct(CMtCoder* p)
 {
   unsigned i;
   p->alloc = 0;
+  p->dictSize = 0;
   for (i = 0; i < NUM_MT_CODER_THREADS_MAX; i++)
   {
     CMtThread *t = &p->threads[i];
@@ -55,6 +55,8 @@ typedef struct
   size_t outBufSize;
   Byte *inBuf;
   size_t inBufSize;
+  size_t inDictSize;
+  size_t inDataSize;
   unsigned index;
   CLoopThread thread;
 
@@ -64,16 +66,22 @@ typedef struct
   CAutoResetEvent canWrite;
 } CMtThread;
 
+/*
+dictSize bytes before src are the last bytes of the previous block.
+(dictSize == 0) for the first block and if CMtCoder::dictSize is 0.
+*/
+
 typedef struct
 {
   SRes (*Code)(void *p, unsigned index, Byte *dest, size_t *destSize,
-      const Byte *src, size_t srcSize, int finished);
+      const Byte *src, size_t srcSize, size_t dictSize, int finished);
 } IMtCoderCallback;
 
 typedef struct _CMtCoder
 {
   size_t blockSize;
   size_t destBlockSize;
+  size_t dictSize; /* the size of the tail of the previous block that is kept before each block */
   unsigned numThreads;
   
   ISeqInStream *inStream;
@@ -1,5 +1,5 @@
 /* Sha1.c -- SHA-1 Hash
-2016-05-20 : Igor Pavlov : Public domain
+2018-10-16 : Igor Pavlov : Public domain
 This code is based on public domain code of Steve Reid from Wei Dai's Crypto++ library. */
 
 #include "Precomp.h"
@@ -10,6 +10,10 @@ This code is based on public domain code of Steve Reid from Wei Dai's Crypto++ l
 #include "RotateDefs.h"
 #include "Sha1.h"
 
+#ifdef _7ZIP_SHA_OPT
+  #include "ShaOpt.h"
+#endif
+
 // define it for speed optimization
 // #define _SHA1_UNROLL
 
@@ -68,7 +72,32 @@ This code is based on public domain code of Steve Reid from Wei Dai's Crypto++ l
 #endif
 
 
-void Sha1_Init(CSha1 *p)
+void MY_FAST_CALL Sha1_UpdateBlocks(UInt32 state[5], const UInt32 *data, size_t numBlocks);
+
+static SHA1_FUNC_UPDATE_BLOCKS g_FUNC_UPDATE_BLOCKS = Sha1_UpdateBlocks;
+static SHA1_FUNC_UPDATE_BLOCKS g_FUNC_UPDATE_BLOCKS_HW;
+
+Bool Sha1_SetFunction(CSha1 *p, unsigned algo)
+{
+  SHA1_FUNC_UPDATE_BLOCKS func = Sha1_UpdateBlocks;
+  if (algo != SHA1_ALGO_SW)
+  {
+    if (algo == SHA1_ALGO_DEFAULT)
+      func = g_FUNC_UPDATE_BLOCKS;
+    else
+    {
+      if (algo != SHA1_ALGO_HW)
+        return False;
+      func = g_FUNC_UPDATE_BLOCKS_HW;
+      if (!func)
+        return False;
+    }
+  }
+  p->func_UpdateBlocks = func;
+  return True;
+}
+
+void Sha1_InitState(CSha1 *p)
 {
   p->state[0] = 0x67452301;
   p->state[1] = 0xEFCDAB89;
@@ -78,6 +107,12 @@ void Sha1_Init(CSha1 *p)
   p->count = 0;
 }
 
+void Sha1_Init(CSha1 *p)
+{
+  p->func_UpdateBlocks = g_FUNC_UPDATE_BLOCKS;
+  Sha1_InitState(p);
+}
+
 void Sha1_GetBlockDigest(CSha1 *p, const UInt32 *data, UInt32 *destDigest)
 {
   UInt32 a, b, c, d, e;
@@ -104,6 +139,35 @@ void Sha1_GetBlockDigest(CSha1 *p, const UInt32 *data, UInt32 *destDigest)
   destDigest[4] = p->state[4] + e;
 }
 
+void MY_FAST_CALL Sha1_UpdateBlocks(UInt32 state[5], const UInt32 *data, size_t numBlocks)
+{
+  UInt32 a, b, c, d, e;
+  UInt32 W[kNumW];
+
+  for (; numBlocks != 0; numBlocks--, data += SHA1_NUM_BLOCK_WORDS)
+  {
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+
+    RX_15
+
+    RX_1_4(R0, R1, 15);
+
+    RX_20(R2, 20);
+    RX_20(R3, 40);
+    RX_20(R4, 60);
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+  }
+}
+
 void Sha1_UpdateBlock_Rar(CSha1 *p, UInt32 *data, int returnRes)
 {
   UInt32 a, b, c, d, e;
@@ -137,7 +201,7 @@ void Sha1_UpdateBlock_Rar(CSha1 *p, UInt32 *data, int returnRes)
   }
 }
 
-#define Sha1_UpdateBlock(p) Sha1_GetBlockDigest(p, p->buffer, p->state)
+#define Sha1_UpdateBlock(p) (p)->func_UpdateBlocks((p)->state, (p)->buffer, 1)
 
 void Sha1_Update(CSha1 *p, const Byte *data, size_t size)
 {
@@ -287,7 +351,7 @@ void Sha1_Final(CSha1 *p, Byte *digest)
     digest += 4;
   }
 
-  Sha1_Init(p);
+  Sha1_InitState(p);
 }
 
 
@@ -336,5 +400,16 @@ void Sha1_32_Final(CSha1 *p, UInt32 *digest)
 
   Sha1_GetBlockDigest(p, p->buffer, digest);
   
-  Sha1_Init(p);
+  Sha1_InitState(p);
+}
+
+void Sha1Prepare(void)
+{
+  #ifdef SHA_HW_SUPPORTED
+  if (CPU_Is_Sha_Supported())
+  {
+    g_FUNC_UPDATE_BLOCKS_HW = Sha1_UpdateBlocks_HW;
+    g_FUNC_UPDATE_BLOCKS = Sha1_UpdateBlocks_HW;
+  }
+  #endif
 }
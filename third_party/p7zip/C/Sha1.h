@@ -1,5 +1,5 @@
 /* Sha1.h -- SHA-1 Hash
-2016-05-20 : Igor Pavlov : Public domain */
+2018-10-16 : Igor Pavlov : Public domain */
 
 #ifndef __7Z_SHA1_H
 #define __7Z_SHA1_H
@@ -14,13 +14,31 @@ EXTERN_C_BEGIN
 #define SHA1_BLOCK_SIZE   (SHA1_NUM_BLOCK_WORDS * 4)
 #define SHA1_DIGEST_SIZE  (SHA1_NUM_DIGEST_WORDS * 4)
 
+/* data is the big-endian words of the blocks, already in the CPU order */
+typedef void (MY_FAST_CALL *SHA1_FUNC_UPDATE_BLOCKS)(UInt32 state[5], const UInt32 *data, size_t numBlocks);
+
 typedef struct
 {
+  SHA1_FUNC_UPDATE_BLOCKS func_UpdateBlocks;
   UInt32 state[SHA1_NUM_DIGEST_WORDS];
   UInt64 count;
   UInt32 buffer[SHA1_NUM_BLOCK_WORDS];
 } CSha1;
 
+#define SHA1_ALGO_DEFAULT 0
+#define SHA1_ALGO_SW      1
+#define SHA1_ALGO_HW      2
+
+/*
+Sha1_SetFunction()
+return:
+  0 - (algo) value is not supported, and func_UpdateBlocks was not changed
+  1 - func_UpdateBlocks was set according (algo) value.
+*/
+
+Bool Sha1_SetFunction(CSha1 *p, unsigned algo);
+
+void Sha1_InitState(CSha1 *p);
 void Sha1_Init(CSha1 *p);
 
 void Sha1_GetBlockDigest(CSha1 *p, const UInt32 *data, UInt32 *destDigest);
@@ -33,6 +51,9 @@ void Sha1_32_PrepareBlock(const CSha1 *p, UInt32 *block, unsigned size);
 void Sha1_32_Update(CSha1 *p, const UInt32 *data, size_t size);
 void Sha1_32_Final(CSha1 *p, UInt32 *digest);
 
+/* selects the fastest code for the CPU, call it one time before other SHA1 functions */
+void Sha1Prepare(void);
+
 EXTERN_C_END
 
 #endif
@@ -0,0 +1,150 @@
+/* Sha1Opt.c -- SHA-1 with CPU extensions
+2018-10-16 : Public domain */
+
+#include "Precomp.h"
+
+#include "ShaOpt.h"
+
+#if defined(SHA_HW_SUPPORTED) && defined(MY_CPU_X86_OR_AMD64)
+
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define ATTRIB_SHA __attribute__((__target__("sse4.1,sha")))
+#else
+  #define ATTRIB_SHA
+#endif
+
+/* the words are in the CPU order already, sha1 instructions want the first one in the high lane */
+#define LOAD_W(p) _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(const void *)(p)), 0x1B)
+
+/*
+4 rounds of the group g with the words m0.
+m1, m2, m3 are the next vectors, m3 is also the previous one.
+ec is E for these rounds, eo gets E for the next group.
+*/
+
+#define R4(g, ec, eo, m0, m1, m2, m3) \
+    ec = _mm_sha1nexte_epu32(ec, m0); \
+    eo = abcd; \
+    if ((g) >= 3 && (g) <= 18) m1 = _mm_sha1msg2_epu32(m1, m0); \
+    abcd = _mm_sha1rnds4_epu32(abcd, ec, (g) / 5); \
+    if ((g) >= 1 && (g) <= 16) m3 = _mm_sha1msg1_epu32(m3, m0); \
+    if ((g) >= 2 && (g) <= 17) m2 = _mm_xor_si128(m2, m0);
+
+#define R16(g) \
+    R4((g)    , e0, e1, m0, m1, m2, m3) \
+    R4((g) + 1, e1, e0, m1, m2, m3, m0) \
+    R4((g) + 2, e0, e1, m2, m3, m0, m1) \
+    R4((g) + 3, e1, e0, m3, m0, m1, m2)
+
+ATTRIB_SHA
+void MY_FAST_CALL Sha1_UpdateBlocks_HW(UInt32 state[5], const UInt32 *data, size_t numBlocks)
+{
+  __m128i abcd, e0, e1;
+  __m128i m0, m1, m2, m3;
+
+  abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(const void *)state), 0x1B);
+  e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+  for (; numBlocks != 0; numBlocks--, data += 16)
+  {
+    const __m128i abcd_save = abcd;
+    const __m128i e0_save = e0;
+
+    m0 = LOAD_W(data);
+    m1 = LOAD_W(data + 4);
+    m2 = LOAD_W(data + 8);
+    m3 = LOAD_W(data + 12);
+
+    /* the first group adds the words to E, there are no previous rounds */
+    e0 = _mm_add_epi32(e0, m0);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+    R4(1, e1, e0, m1, m2, m3, m0)
+    R4(2, e0, e1, m2, m3, m0, m1)
+    R4(3, e1, e0, m3, m0, m1, m2)
+    R16(4)
+    R16(8)
+    R16(12)
+    R16(16)
+
+    e0 = _mm_sha1nexte_epu32(e0, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  _mm_storeu_si128((__m128i *)(void *)state, _mm_shuffle_epi32(abcd, 0x1B));
+  state[4] = (UInt32)_mm_extract_epi32(e0, 3);
+}
+
+#elif defined(SHA_HW_SUPPORTED) && defined(MY_CPU_ARM64)
+
+#if defined(_MSC_VER) && !defined(__clang__)
+  #include <arm64_neon.h>
+  #define ATTRIB_SHA
+#else
+  #include <arm_neon.h>
+  #if defined(__clang__)
+    #define ATTRIB_SHA __attribute__((__target__("crypto")))
+  #else
+    #define ATTRIB_SHA __attribute__((__target__("+crypto")))
+  #endif
+#endif
+
+/* 4 rounds with the words m0, then m0 gets the words of the group g + 4 */
+#define R4(g, op, k, m0, m1, m2, m3) \
+    wk = vaddq_u32(m0, vdupq_n_u32(k)); \
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0)); \
+    abcd = op(abcd, e0, wk); \
+    e0 = e1; \
+    if ((g) <= 15) m0 = vsha1su1q_u32(vsha1su0q_u32(m0, m1, m2), m3);
+
+ATTRIB_SHA
+void MY_FAST_CALL Sha1_UpdateBlocks_HW(UInt32 state[5], const UInt32 *data, size_t numBlocks)
+{
+  uint32x4_t abcd = vld1q_u32(state);
+  uint32_t e0 = state[4], e1;
+  uint32x4_t wk;
+  uint32x4_t m0, m1, m2, m3;
+
+  for (; numBlocks != 0; numBlocks--, data += 16)
+  {
+    const uint32x4_t abcd_save = abcd;
+    const uint32_t e0_save = e0;
+
+    m0 = vld1q_u32(data);
+    m1 = vld1q_u32(data + 4);
+    m2 = vld1q_u32(data + 8);
+    m3 = vld1q_u32(data + 12);
+
+    R4( 0, vsha1cq_u32, 0x5A827999, m0, m1, m2, m3)
+    R4( 1, vsha1cq_u32, 0x5A827999, m1, m2, m3, m0)
+    R4( 2, vsha1cq_u32, 0x5A827999, m2, m3, m0, m1)
+    R4( 3, vsha1cq_u32, 0x5A827999, m3, m0, m1, m2)
+    R4( 4, vsha1cq_u32, 0x5A827999, m0, m1, m2, m3)
+    R4( 5, vsha1pq_u32, 0x6ED9EBA1, m1, m2, m3, m0)
+    R4( 6, vsha1pq_u32, 0x6ED9EBA1, m2, m3, m0, m1)
+    R4( 7, vsha1pq_u32, 0x6ED9EBA1, m3, m0, m1, m2)
+    R4( 8, vsha1pq_u32, 0x6ED9EBA1, m0, m1, m2, m3)
+    R4( 9, vsha1pq_u32, 0x6ED9EBA1, m1, m2, m3, m0)
+    R4(10, vsha1mq_u32, 0x8F1BBCDC, m2, m3, m0, m1)
+    R4(11, vsha1mq_u32, 0x8F1BBCDC, m3, m0, m1, m2)
+    R4(12, vsha1mq_u32, 0x8F1BBCDC, m0, m1, m2, m3)
+    R4(13, vsha1mq_u32, 0x8F1BBCDC, m1, m2, m3, m0)
+    R4(14, vsha1mq_u32, 0x8F1BBCDC, m2, m3, m0, m1)
+    R4(15, vsha1pq_u32, 0xCA62C1D6, m3, m0, m1, m2)
+    R4(16, vsha1pq_u32, 0xCA62C1D6, m0, m1, m2, m3)
+    R4(17, vsha1pq_u32, 0xCA62C1D6, m1, m2, m3, m0)
+    R4(18, vsha1pq_u32, 0xCA62C1D6, m2, m3, m0, m1)
+    R4(19, vsha1pq_u32, 0xCA62C1D6, m3, m0, m1, m2)
+
+    abcd = vaddq_u32(abcd, abcd_save);
+    e0 += e0_save;
+  }
+
+  vst1q_u32(state, abcd);
+  state[4] = e0;
+}
+
+#endif
@@ -1,5 +1,5 @@
 /* Crypto/Sha256.c -- SHA-256 Hash
-2015-11-14 : Igor Pavlov : Public domain
+2018-10-16 : Igor Pavlov : Public domain
 This code is based on public domain code from Wei Dai's Crypto++ library. */
 
 #include "Precomp.h"
@@ -18,7 +18,40 @@ This code is based on public domain code from Wei Dai's Crypto++ library. */
 
 /* #define _SHA256_UNROLL2 */
 
-void Sha256_Init(CSha256 *p)
+#ifdef _7ZIP_SHA_OPT
+  #include "ShaOpt.h"
+#endif
+
+void MY_FAST_CALL Sha256_UpdateBlocks(UInt32 state[8], const Byte *data, size_t numBlocks);
+
+static SHA256_FUNC_UPDATE_BLOCKS g_FUNC_UPDATE_BLOCKS = Sha256_UpdateBlocks;
+static SHA256_FUNC_UPDATE_BLOCKS g_FUNC_UPDATE_BLOCKS_HW;
+
+#ifdef SHA256_X8_SUPPORTED
+static Bool g_Sha256_UseX8;
+#endif
+
+Bool Sha256_SetFunction(CSha256 *p, unsigned algo)
+{
+  SHA256_FUNC_UPDATE_BLOCKS func = Sha256_UpdateBlocks;
+  if (algo != SHA256_ALGO_SW)
+  {
+    if (algo == SHA256_ALGO_DEFAULT)
+      func = g_FUNC_UPDATE_BLOCKS;
+    else
+    {
+      if (algo != SHA256_ALGO_HW)
+        return False;
+      func = g_FUNC_UPDATE_BLOCKS_HW;
+      if (!func)
+        return False;
+    }
+  }
+  p->func_UpdateBlocks = func;
+  return True;
+}
+
+void Sha256_InitState(CSha256 *p)
 {
   p->state[0] = 0x6a09e667;
   p->state[1] = 0xbb67ae85;
@@ -31,6 +64,12 @@ void Sha256_Init(CSha256 *p)
   p->count = 0;
 }
 
+void Sha256_Init(CSha256 *p)
+{
+  p->func_UpdateBlocks = g_FUNC_UPDATE_BLOCKS;
+  Sha256_InitState(p);
+}
+
 #define S0(x) (rotrFixed(x, 2) ^ rotrFixed(x,13) ^ rotrFixed(x, 22))
 #define S1(x) (rotrFixed(x, 6) ^ rotrFixed(x,11) ^ rotrFixed(x, 25))
 #define s0(x) (rotrFixed(x, 7) ^ rotrFixed(x,18) ^ (x >> 3))
@@ -90,7 +129,9 @@ void Sha256_Init(CSha256 *p)
 
 #endif
 
-static const UInt32 K[64] = {
+#define K SHA256_K_ARRAY
+
+const UInt32 SHA256_K_ARRAY[64] = {
   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
   0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
@@ -109,11 +150,10 @@ static const UInt32 K[64] = {
   0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
 };
 
-static void Sha256_WriteByteBlock(CSha256 *p)
+static void Sha256_UpdateBlock(UInt32 *state, const Byte *data)
 {
   UInt32 W[16];
   unsigned j;
-  UInt32 *state;
 
   #ifdef _SHA256_UNROLL2
   UInt32 a,b,c,d,e,f,g,h;
@@ -123,15 +163,13 @@ static void Sha256_WriteByteBlock(CSha256 *p)
 
   for (j = 0; j < 16; j += 4)
   {
-    const Byte *ccc = p->buffer + j * 4;
+    const Byte *ccc = data + j * 4;
     W[j    ] = GetBe32(ccc);
     W[j + 1] = GetBe32(ccc + 4);
     W[j + 2] = GetBe32(ccc + 8);
     W[j + 3] = GetBe32(ccc + 12);
   }
 
-  state = p->state;
-
   #ifdef _SHA256_UNROLL2
   a = state[0];
   b = state[1];
@@ -170,6 +208,14 @@ static void Sha256_WriteByteBlock(CSha256 *p)
   /* memset(T, 0, sizeof(T)); */
 }
 
+void MY_FAST_CALL Sha256_UpdateBlocks(UInt32 state[8], const Byte *data, size_t numBlocks)
+{
+  for (; numBlocks != 0; numBlocks--, data += 64)
+    Sha256_UpdateBlock(state, data);
+}
+
+#define Sha256_WriteByteBlock(p) (p)->func_UpdateBlocks((p)->state, (p)->buffer, 1)
+
 #undef S0
 #undef S1
 #undef s0
@@ -198,14 +244,15 @@ void Sha256_Update(CSha256 *p, const Byte *data, size_t size)
     data += num;
   }
 
-  for (;;)
+  Sha256_WriteByteBlock(p);
   {
-    Sha256_WriteByteBlock(p);
-    if (size < 64)
-      break;
-    size -= 64;
-    memcpy(p->buffer, data, 64);
-    data += 64;
+    size_t numBlocks = size >> 6;
+    if (numBlocks != 0)
+    {
+      p->func_UpdateBlocks(p->state, data, numBlocks);
+      data += numBlocks << 6;
+      size &= 0x3F;
+    }
   }
 
   if (size != 0)
@@ -244,5 +291,132 @@ void Sha256_Final(CSha256 *p, Byte *digest)
     digest += 8;
   }
   
-  Sha256_Init(p);
+  Sha256_InitState(p);
+}
+
+#define SHA256_NUM_LANES 8
+
+typedef struct
+{
+  const Byte *data;
+  size_t numBlocks;
+  size_t block;
+  size_t index;
+  unsigned numTailBlocks;
+  Byte tail[128];
+} CSha256Lane;
+
+static void Sha256Lane_Start(CSha256Lane *lane, const Byte *data, size_t size, size_t index)
+{
+  unsigned rem = (unsigned)size & 0x3F;
+  unsigned tailSize = (rem < 64 - 8) ? 64 : 128;
+  UInt64 numBits = (UInt64)size << 3;
+  lane->data = data;
+  lane->numBlocks = size >> 6;
+  lane->block = 0;
+  lane->index = index;
+  lane->numTailBlocks = tailSize >> 6;
+  if (rem != 0)
+    memcpy(lane->tail, data + size - rem, rem);
+  lane->tail[rem] = 0x80;
+  memset(lane->tail + rem + 1, 0, tailSize - rem - 1 - 8);
+  SetBe32(lane->tail + tailSize - 8, (UInt32)(numBits >> 32));
+  SetBe32(lane->tail + tailSize - 4, (UInt32)(numBits));
+}
+
+/* the next block of the padded message, NULL after the last one */
+static const Byte *Sha256Lane_Next(CSha256Lane *lane)
+{
+  size_t block = lane->block;
+  if (block == lane->numBlocks + lane->numTailBlocks)
+    return NULL;
+  lane->block = block + 1;
+  if (block < lane->numBlocks)
+    return lane->data + (block << 6);
+  return lane->tail + ((block - lane->numBlocks) << 6);
+}
+
+void Sha256_Multi(const Byte * const *data, const size_t *sizes, size_t num, Byte *digests)
+{
+  #ifdef SHA256_X8_SUPPORTED
+  if (g_Sha256_UseX8 && num > 1)
+  {
+    static const Byte kZeroBlock[64] = { 0 };
+    CSha256Lane lanes[SHA256_NUM_LANES];
+    Bool active[SHA256_NUM_LANES];
+    const Byte *blocks[SHA256_NUM_LANES];
+    UInt32 states[8 * SHA256_NUM_LANES];
+    CSha256 init;
+    size_t next = 0;
+    unsigned numActive = 0;
+    unsigned lane, i;
+
+    Sha256_InitState(&init);
+    for (lane = 0; lane < SHA256_NUM_LANES; lane++)
+    {
+      active[lane] = (next < num);
+      if (!active[lane])
+        continue;
+      Sha256Lane_Start(&lanes[lane], data[next], sizes[next], next);
+      for (i = 0; i < 8; i++)
+        states[i * SHA256_NUM_LANES + lane] = init.state[i];
+      next++;
+      numActive++;
+    }
+
+    while (numActive != 0)
+    {
+      for (lane = 0; lane < SHA256_NUM_LANES; lane++)
+        blocks[lane] = active[lane] ? Sha256Lane_Next(&lanes[lane]) : kZeroBlock;
+      Sha256_UpdateBlocks_X8(states, blocks);
+
+      for (lane = 0; lane < SHA256_NUM_LANES; lane++)
+      {
+        CSha256Lane *p = &lanes[lane];
+        Byte *digest;
+        if (!active[lane] || p->block != p->numBlocks + p->numTailBlocks)
+          continue;
+        digest = digests + p->index * SHA256_DIGEST_SIZE;
+        for (i = 0; i < 8; i++)
+          SetBe32(digest + i * 4, states[i * SHA256_NUM_LANES + lane]);
+        /* the lane takes the next message */
+        if (next == num)
+        {
+          active[lane] = False;
+          numActive--;
+          continue;
+        }
+        Sha256Lane_Start(p, data[next], sizes[next], next);
+        for (i = 0; i < 8; i++)
+          states[i * SHA256_NUM_LANES + lane] = init.state[i];
+        next++;
+      }
+    }
+    return;
+  }
+  #endif
+  {
+    size_t i;
+    for (i = 0; i < num; i++)
+    {
+      CSha256 sha;
+      Sha256_Init(&sha);
+      Sha256_Update(&sha, data[i], sizes[i]);
+      Sha256_Final(&sha, digests + i * SHA256_DIGEST_SIZE);
+    }
+  }
+}
+
+void Sha256Prepare(void)
+{
+  #ifdef SHA_HW_SUPPORTED
+  if (CPU_Is_Sha_Supported())
+  {
+    g_FUNC_UPDATE_BLOCKS_HW = Sha256_UpdateBlocks_HW;
+    g_FUNC_UPDATE_BLOCKS = Sha256_UpdateBlocks_HW;
+  }
+  #endif
+  #ifdef SHA256_X8_SUPPORTED
+  g_Sha256_UseX8 = CPU_Is_Avx2_Supported();
+  #endif
 }
@@ -1,5 +1,5 @@
 /* Sha256.h -- SHA-256 Hash
-2013-01-18 : Igor Pavlov : Public domain */
+2018-10-16 : Igor Pavlov : Public domain */
 
 #ifndef __CRYPTO_SHA256_H
 #define __CRYPTO_SHA256_H
@@ -10,17 +10,55 @@ EXTERN_C_BEGIN
 
 #define SHA256_DIGEST_SIZE 32
 
+typedef void (MY_FAST_CALL *SHA256_FUNC_UPDATE_BLOCKS)(UInt32 state[8], const Byte *data, size_t numBlocks);
+
+/*
+  if (the system supports different SHA256 code implementations)
+  {
+    (CSha256::func_UpdateBlocks) will be used
+    (CSha256::func_UpdateBlocks) can be set by
+       Sha256_Init()        - to default (fastest)
+       Sha256_SetFunction() - to any algo
+  }
+*/
+
 typedef struct
 {
+  SHA256_FUNC_UPDATE_BLOCKS func_UpdateBlocks;
   UInt32 state[8];
   UInt64 count;
   Byte buffer[64];
 } CSha256;
 
+#define SHA256_ALGO_DEFAULT 0
+#define SHA256_ALGO_SW      1
+#define SHA256_ALGO_HW      2
+
+/*
+Sha256_SetFunction()
+return:
+  0 - (algo) value is not supported, and func_UpdateBlocks was not changed
+  1 - func_UpdateBlocks was set according (algo) value.
+*/
+
+Bool Sha256_SetFunction(CSha256 *p, unsigned algo);
+
+void Sha256_InitState(CSha256 *p);
 void Sha256_Init(CSha256 *p);
 void Sha256_Update(CSha256 *p, const Byte *data, size_t size);
 void Sha256_Final(CSha256 *p, Byte *digest);
 
+/*
+Sha256_Multi() hashes (num) independent messages and writes (num) digests of
+SHA256_DIGEST_SIZE bytes. With AVX2 it runs 8 messages at a time, a lane that
+finishes its message takes the next one, so it is for many small messages.
+*/
+
+void Sha256_Multi(const Byte * const *data, const size_t *sizes, size_t num, Byte *digests);
+
+/* selects the fastest code for the CPU, call it one time before other SHA256 functions */
+void Sha256Prepare(void);
+
 EXTERN_C_END
 
 #endif
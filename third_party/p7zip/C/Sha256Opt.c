@@ -0,0 +1,276 @@
+/* Sha256Opt.c -- SHA-256 with CPU extensions
+2018-10-16 : Public domain */
+
+#include "Precomp.h"
+
+#include "ShaOpt.h"
+
+extern const UInt32 SHA256_K_ARRAY[64];
+
+#define K SHA256_K_ARRAY
+
+#if defined(SHA_HW_SUPPORTED) && defined(MY_CPU_X86_OR_AMD64)
+
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define ATTRIB_SHA __attribute__((__target__("sse4.1,sha")))
+#else
+  #define ATTRIB_SHA
+#endif
+
+/*
+The four message vectors m0..m3 hold the words 4j..4j+3 of the schedule in turn.
+R4 runs 4 rounds with the words of m; MSG1 starts the words that replace mp,
+MSG2 finishes the next words mn.
+*/
+
+#define RND4(m, j) \
+    msg = _mm_add_epi32(m, _mm_loadu_si128((const __m128i *)(const void *)&K[(j) * 4])); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+    msg = _mm_shuffle_epi32(msg, 0x0E); \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+#define MSG1(mp, m)  mp = _mm_sha256msg1_epu32(mp, m);
+
+#define MSG2(mn, m, mp) \
+    mn = _mm_sha256msg2_epu32(_mm_add_epi32(mn, _mm_alignr_epi8(m, mp, 4)), m);
+
+#define R4(j, m)                     RND4(m, j)
+#define R4_1(j, m, mp)               RND4(m, j) MSG1(mp, m)
+#define R4_12(j, m, mp, mn)          MSG2(mn, m, mp) RND4(m, j) MSG1(mp, m)
+#define R4_2(j, m, mp, mn)           MSG2(mn, m, mp) RND4(m, j)
+
+ATTRIB_SHA
+void MY_FAST_CALL Sha256_UpdateBlocks_HW(UInt32 state[8], const Byte *data, size_t numBlocks)
+{
+  const __m128i mask = _mm_set_epi32(0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203);
+  __m128i state0, state1, tmp, msg;
+  __m128i m0, m1, m2, m3;
+
+  tmp = _mm_loadu_si128((const __m128i *)(const void *)&state[0]);
+  state1 = _mm_loadu_si128((const __m128i *)(const void *)&state[4]);
+  tmp = _mm_shuffle_epi32(tmp, 0xB1);
+  state1 = _mm_shuffle_epi32(state1, 0x1B);
+  /* ABEF and CDGH, the order of sha256rnds2 */
+  state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+  for (; numBlocks != 0; numBlocks--, data += 64)
+  {
+    const __m128i abef = state0;
+    const __m128i cdgh = state1;
+
+    m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(const void *)(data     )), mask);
+    m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(const void *)(data + 16)), mask);
+    m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(const void *)(data + 32)), mask);
+    m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(const void *)(data + 48)), mask);
+
+    R4   ( 0, m0)
+    R4_1 ( 1, m1, m0)
+    R4_1 ( 2, m2, m1)
+    R4_12( 3, m3, m2, m0)
+    R4_12( 4, m0, m3, m1)
+    R4_12( 5, m1, m0, m2)
+    R4_12( 6, m2, m1, m3)
+    R4_12( 7, m3, m2, m0)
+    R4_12( 8, m0, m3, m1)
+    R4_12( 9, m1, m0, m2)
+    R4_12(10, m2, m1, m3)
+    R4_12(11, m3, m2, m0)
+    R4_12(12, m0, m3, m1)
+    R4_2 (13, m1, m0, m2)
+    R4_2 (14, m2, m1, m3)
+    R4   (15, m3)
+
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1B);
+  state1 = _mm_shuffle_epi32(state1, 0xB1);
+  state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+  state1 = _mm_alignr_epi8(state1, tmp, 8);
+  _mm_storeu_si128((__m128i *)(void *)&state[0], state0);
+  _mm_storeu_si128((__m128i *)(void *)&state[4], state1);
+}
+
+#elif defined(SHA_HW_SUPPORTED) && defined(MY_CPU_ARM64)
+
+#if defined(_MSC_VER) && !defined(__clang__)
+  #include <arm64_neon.h>
+  #define ATTRIB_SHA
+#else
+  #include <arm_neon.h>
+  #if defined(__clang__)
+    #define ATTRIB_SHA __attribute__((__target__("crypto")))
+  #else
+    #define ATTRIB_SHA __attribute__((__target__("+crypto")))
+  #endif
+#endif
+
+/* the words 4j..4j+3 of the schedule in m, the next ones replace them */
+#define R4(j, m) \
+    msg = vaddq_u32(m, vld1q_u32(&K[(j) * 4])); \
+    tmp = state0; \
+    state0 = vsha256hq_u32(state0, state1, msg); \
+    state1 = vsha256h2q_u32(state1, tmp, msg);
+
+#define R4_S(j, m, m1, m2, m3) \
+    R4(j, m) \
+    m = vsha256su1q_u32(vsha256su0q_u32(m, m1), m2, m3);
+
+ATTRIB_SHA
+void MY_FAST_CALL Sha256_UpdateBlocks_HW(UInt32 state[8], const Byte *data, size_t numBlocks)
+{
+  uint32x4_t state0 = vld1q_u32(&state[0]);
+  uint32x4_t state1 = vld1q_u32(&state[4]);
+  uint32x4_t tmp, msg;
+  uint32x4_t m0, m1, m2, m3;
+
+  for (; numBlocks != 0; numBlocks--, data += 64)
+  {
+    const uint32x4_t abcd = state0;
+    const uint32x4_t efgh = state1;
+
+    m0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data     )));
+    m1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+    m2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+    m3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+    R4_S( 0, m0, m1, m2, m3)
+    R4_S( 1, m1, m2, m3, m0)
+    R4_S( 2, m2, m3, m0, m1)
+    R4_S( 3, m3, m0, m1, m2)
+    R4_S( 4, m0, m1, m2, m3)
+    R4_S( 5, m1, m2, m3, m0)
+    R4_S( 6, m2, m3, m0, m1)
+    R4_S( 7, m3, m0, m1, m2)
+    R4_S( 8, m0, m1, m2, m3)
+    R4_S( 9, m1, m2, m3, m0)
+    R4_S(10, m2, m3, m0, m1)
+    R4_S(11, m3, m0, m1, m2)
+    R4  (12, m0)
+    R4  (13, m1)
+    R4  (14, m2)
+    R4  (15, m3)
+
+    state0 = vaddq_u32(state0, abcd);
+    state1 = vaddq_u32(state1, efgh);
+  }
+
+  vst1q_u32(&state[0], state0);
+  vst1q_u32(&state[4], state1);
+}
+
+#endif
+
+#ifdef SHA256_X8_SUPPORTED
+
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define ATTRIB_AVX2 __attribute__((__target__("avx2")))
+#else
+  #define ATTRIB_AVX2
+#endif
+
+#define ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define XOR3(a, b, c) _mm256_xor_si256(_mm256_xor_si256(a, b), c)
+#define ADD(a, b) _mm256_add_epi32(a, b)
+
+#define S0(x) XOR3(ROTR(x, 2), ROTR(x, 13), ROTR(x, 22))
+#define S1(x) XOR3(ROTR(x, 6), ROTR(x, 11), ROTR(x, 25))
+#define s0(x) XOR3(ROTR(x, 7), ROTR(x, 18), _mm256_srli_epi32(x, 3))
+#define s1(x) XOR3(ROTR(x, 17), ROTR(x, 19), _mm256_srli_epi32(x, 10))
+
+#define Ch(x, y, z) _mm256_xor_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(x, z))
+#define Maj(x, y, z) _mm256_or_si256(_mm256_and_si256(x, y), _mm256_and_si256(z, _mm256_or_si256(x, y)))
+
+/* rows r0..r7 become columns */
+#define TRANSPOSE_8X8(r0, r1, r2, r3, r4, r5, r6, r7) \
+  { \
+    __m256i t0 = _mm256_unpacklo_epi32(r0, r1), t1 = _mm256_unpackhi_epi32(r0, r1); \
+    __m256i t2 = _mm256_unpacklo_epi32(r2, r3), t3 = _mm256_unpackhi_epi32(r2, r3); \
+    __m256i t4 = _mm256_unpacklo_epi32(r4, r5), t5 = _mm256_unpackhi_epi32(r4, r5); \
+    __m256i t6 = _mm256_unpacklo_epi32(r6, r7), t7 = _mm256_unpackhi_epi32(r6, r7); \
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2); \
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3); \
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6); \
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7); \
+    r0 = _mm256_permute2x128_si256(u0, u4, 0x20); \
+    r1 = _mm256_permute2x128_si256(u1, u5, 0x20); \
+    r2 = _mm256_permute2x128_si256(u2, u6, 0x20); \
+    r3 = _mm256_permute2x128_si256(u3, u7, 0x20); \
+    r4 = _mm256_permute2x128_si256(u0, u4, 0x31); \
+    r5 = _mm256_permute2x128_si256(u1, u5, 0x31); \
+    r6 = _mm256_permute2x128_si256(u2, u6, 0x31); \
+    r7 = _mm256_permute2x128_si256(u3, u7, 0x31); \
+  }
+
+#define LOAD_ROW(i) _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(const void *)(blocks[i] + offset)), mask)
+
+ATTRIB_AVX2
+void MY_FAST_CALL Sha256_UpdateBlocks_X8(UInt32 *states, const Byte * const *blocks)
+{
+  const __m256i mask = _mm256_set_epi8(
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  __m256i W[16];
+  __m256i a, b, c, d, e, f, g, h;
+  unsigned i, offset;
+
+  for (offset = 0; offset < 64; offset += 32)
+  {
+    __m256i r0 = LOAD_ROW(0), r1 = LOAD_ROW(1), r2 = LOAD_ROW(2), r3 = LOAD_ROW(3);
+    __m256i r4 = LOAD_ROW(4), r5 = LOAD_ROW(5), r6 = LOAD_ROW(6), r7 = LOAD_ROW(7);
+    TRANSPOSE_8X8(r0, r1, r2, r3, r4, r5, r6, r7)
+    W[offset / 4 + 0] = r0;
+    W[offset / 4 + 1] = r1;
+    W[offset / 4 + 2] = r2;
+    W[offset / 4 + 3] = r3;
+    W[offset / 4 + 4] = r4;
+    W[offset / 4 + 5] = r5;
+    W[offset / 4 + 6] = r6;
+    W[offset / 4 + 7] = r7;
+  }
+
+  a = _mm256_loadu_si256((const __m256i *)(const void *)(states     ));
+  b = _mm256_loadu_si256((const __m256i *)(const void *)(states +  8));
+  c = _mm256_loadu_si256((const __m256i *)(const void *)(states + 16));
+  d = _mm256_loadu_si256((const __m256i *)(const void *)(states + 24));
+  e = _mm256_loadu_si256((const __m256i *)(const void *)(states + 32));
+  f = _mm256_loadu_si256((const __m256i *)(const void *)(states + 40));
+  g = _mm256_loadu_si256((const __m256i *)(const void *)(states + 48));
+  h = _mm256_loadu_si256((const __m256i *)(const void *)(states + 56));
+
+  for (i = 0; i < 64; i++)
+  {
+    __m256i t1, t2;
+    if (i >= 16)
+      W[i & 15] = ADD(ADD(W[i & 15], s0(W[(i - 15) & 15])), ADD(W[(i - 7) & 15], s1(W[(i - 2) & 15])));
+    t1 = ADD(ADD(h, S1(e)), ADD(Ch(e, f, g), ADD(_mm256_set1_epi32((int)K[i]), W[i & 15])));
+    t2 = ADD(S0(a), Maj(a, b, c));
+    h = g;
+    g = f;
+    f = e;
+    e = ADD(d, t1);
+    d = c;
+    c = b;
+    b = a;
+    a = ADD(t1, t2);
+  }
+
+  #define STORE_ADD(i, x) _mm256_storeu_si256((__m256i *)(void *)(states + (i) * 8), \
+      ADD(x, _mm256_loadu_si256((const __m256i *)(const void *)(states + (i) * 8))));
+  STORE_ADD(0, a)
+  STORE_ADD(1, b)
+  STORE_ADD(2, c)
+  STORE_ADD(3, d)
+  STORE_ADD(4, e)
+  STORE_ADD(5, f)
+  STORE_ADD(6, g)
+  STORE_ADD(7, h)
+}
+
+#endif
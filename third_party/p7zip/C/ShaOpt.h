@@ -0,0 +1,47 @@
+/* ShaOpt.h -- SHA-1 and SHA-256 with CPU extensions
+2018-10-16 : Public domain */
+
+#ifndef __SHA_OPT_H
+#define __SHA_OPT_H
+
+#include "7zTypes.h"
+#include "CpuArch.h"
+
+EXTERN_C_BEGIN
+
+#if defined(MY_CPU_X86_OR_AMD64)
+  #if defined(_MSC_VER) && _MSC_VER >= 1900 \
+      || defined(__clang__) && (__clang_major__ * 100 + __clang_minor__ >= 308) \
+      || defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 5)
+    /* SHA-NI */
+    #define SHA_HW_SUPPORTED
+    /* AVX2 */
+    #define SHA256_X8_SUPPORTED
+  #endif
+#elif defined(MY_CPU_ARM64)
+  #if defined(_MSC_VER) && _MSC_VER >= 1910 \
+      || defined(__clang__) && (__clang_major__ >= 8) \
+      || defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 8)
+    /* ARMv8 crypto extensions */
+    #define SHA_HW_SUPPORTED
+  #endif
+#endif
+
+#ifdef SHA_HW_SUPPORTED
+/* CPU_Is_Sha_Supported() tells if the CPU has them */
+void MY_FAST_CALL Sha256_UpdateBlocks_HW(UInt32 state[8], const Byte *data, size_t numBlocks);
+/* data is big-endian words that are already in the CPU order, as in CSha1::buffer */
+void MY_FAST_CALL Sha1_UpdateBlocks_HW(UInt32 state[5], const UInt32 *data, size_t numBlocks);
+#endif
+
+#ifdef SHA256_X8_SUPPORTED
+/*
+One block of each of 8 messages, CPU_Is_Avx2_Supported() tells if it can run.
+states is word-major: states[i * 8 + lane] is the word i of the state of lane.
+*/
+void MY_FAST_CALL Sha256_UpdateBlocks_X8(UInt32 *states, const Byte * const *blocks);
+#endif
+
+EXTERN_C_END
+
+#endif
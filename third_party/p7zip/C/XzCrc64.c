@@ -1,11 +1,15 @@
 /* XzCrc64.c -- CRC64 calculation
-2015-03-01 : Igor Pavlov : Public domain */
+2018-10-16 : Igor Pavlov : Public domain */
 
 #include "Precomp.h"
 
 #include "XzCrc64.h"
 #include "CpuArch.h"
 
+#ifdef _7ZIP_CRC_CLMUL
+#include "CrcClmul.h"
+#endif
+
 #define kCrc64Poly UINT64_CONST(0xC96C5795D7870F42)
 
 #ifdef MY_CPU_LE
@@ -31,9 +35,48 @@
 
 typedef UInt64 (MY_FAST_CALL *CRC_FUNC)(UInt64 v, const void *data, size_t size, const UInt64 *table);
 
-static CRC_FUNC g_Crc64Update;
+CRC_FUNC g_Crc64UpdateT4;
+CRC_FUNC g_Crc64UpdateClmul;
+CRC_FUNC g_Crc64UpdateVClmul;
+CRC_FUNC g_Crc64Update;
 UInt64 g_Crc64Table[256 * CRC_NUM_TABLES];
 
+#if defined(_7ZIP_CRC_CLMUL) && defined(CRC_CLMUL_SUPPORTED)
+
+static CCrcClmulKeys g_Crc64ClmulKeys;
+
+static UInt64 MY_FAST_CALL XzCrc64UpdateClmul(UInt64 v, const void *data, size_t size, const UInt64 *table)
+{
+  if (size >= CRC_CLMUL_MIN_SIZE)
+  {
+    Byte state[16];
+    size_t folded = CrcClmul_Fold(v, (const Byte *)data, size, &g_Crc64ClmulKeys, state);
+    v = g_Crc64UpdateT4(0, state, 16, table);
+    data = (const Byte *)data + folded;
+    size -= folded;
+  }
+  return g_Crc64UpdateT4(v, data, size, table);
+}
+
+#ifdef CRC_VCLMUL_SUPPORTED
+
+static UInt64 MY_FAST_CALL XzCrc64UpdateVClmul(UInt64 v, const void *data, size_t size, const UInt64 *table)
+{
+  if (size >= CRC_VCLMUL_MIN_SIZE)
+  {
+    Byte state[16];
+    size_t folded = CrcClmul_VFold(v, (const Byte *)data, size, &g_Crc64ClmulKeys, state);
+    v = g_Crc64UpdateT4(0, state, 16, table);
+    data = (const Byte *)data + folded;
+    size -= folded;
+  }
+  return XzCrc64UpdateClmul(v, data, size, table);
+}
+
+#endif
+
+#endif
+
 UInt64 MY_FAST_CALL Crc64Update(UInt64 v, const void *data, size_t size)
 {
   return g_Crc64Update(v, data, size, g_Crc64Table);
@@ -63,14 +106,31 @@ void MY_FAST_CALL Crc64GenerateTable()
   
   #ifdef MY_CPU_LE
 
+  g_Crc64UpdateT4 = XzCrc64UpdateT4;
   g_Crc64Update = XzCrc64UpdateT4;
 
+  #if defined(_7ZIP_CRC_CLMUL) && defined(CRC_CLMUL_SUPPORTED)
+  if (CPU_Is_Clmul_Supported())
+  {
+    CrcClmulKeys_Init(&g_Crc64ClmulKeys, kCrc64Poly, 64);
+    g_Crc64UpdateClmul = XzCrc64UpdateClmul;
+    g_Crc64Update = XzCrc64UpdateClmul;
+    #ifdef CRC_VCLMUL_SUPPORTED
+    if (CPU_Is_VClmul_Supported())
+    {
+      g_Crc64UpdateVClmul = XzCrc64UpdateVClmul;
+      g_Crc64Update = XzCrc64UpdateVClmul;
+    }
+    #endif
+  }
+  #endif
+
   #else
   {
     #ifndef MY_CPU_BE
     UInt32 k = 1;
     if (*(const Byte *)&k == 1)
-      g_Crc64Update = XzCrc64UpdateT4;
+      g_Crc64UpdateT4 = g_Crc64Update = XzCrc64UpdateT4;
     else
     #endif
     {
@@ -79,7 +139,7 @@ void MY_FAST_CALL Crc64GenerateTable()
         UInt64 x = g_Crc64Table[i - 256];
         g_Crc64Table[i] = CRC_UINT64_SWAP(x);
       }
-      g_Crc64Update = XzCrc64UpdateT1_BeT4;
+      g_Crc64UpdateT4 = g_Crc64Update = XzCrc64UpdateT1_BeT4;
     }
   }
   #endif
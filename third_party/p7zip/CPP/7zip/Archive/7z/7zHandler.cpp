@@ -469,6 +469,12 @@ HRESULT CHandler::SetMethodToProp(CNum folderIndex, PROPVARIANT *prop) const
         }
       }
     }
+    else if (id64 == k_Dedup)
+    {
+      name = "Dedup";
+      if (propsSize == 1)
+        ConvertUInt32ToString(props[0], s);
+    }
     
     if (name)
     {
@@ -128,6 +128,14 @@ HRESULT CHandler::SetMainMethod(
     if (_numSolidBytesDefined)
       continue;
 
+    if (methodFull.Id == k_Dedup)
+    {
+      // Dedup finds the copies only inside of solid block
+      _numSolidBytes = kSolidBytes_Max;
+      _numSolidBytesDefined = true;
+      continue;
+    }
+
     UInt32 dicSize;
     switch (methodFull.Id)
     {
@@ -121,6 +121,9 @@ const UInt32 k_SPARC = 0x3030805;
 
 const UInt32 k_AES   = 0x6F10701;
 
+// the ID of DOC/Methods.txt for random IDs
+const UInt64 k_Dedup = UINT64_CONST(0x3FCF23D63D6F0001);
+
 
 static inline bool IsFilterMethod(UInt64 m)
 {
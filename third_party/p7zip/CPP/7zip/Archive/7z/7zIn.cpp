@@ -1553,23 +1553,40 @@ HRESULT CInArchive::ReadDatabase2(
     db.UnexpectedEnd = true;
     return S_FALSE;
   }
-  RINOK(_stream->Seek(nextHeaderOffset, STREAM_SEEK_CUR, NULL));
+  UInt64 nextHeaderPos;
+  RINOK(_stream->Seek(nextHeaderOffset, STREAM_SEEK_CUR, &nextHeaderPos));
 
   size_t nextHeaderSize_t = (size_t)nextHeaderSize;
   if (nextHeaderSize_t != nextHeaderSize)
     return E_OUTOFMEMORY;
-  CByteBuffer buffer2(nextHeaderSize_t);
 
-  RINOK(ReadStream_FALSE(_stream, buffer2, nextHeaderSize_t));
+  // a mapped input stream gives the header in place, so it's not copied
+  const Byte *nextHeader = NULL;
+  CByteBuffer buffer2;
+  {
+    CMyComPtr<IStreamGetBuffer> getBuffer;
+    _stream.QueryInterface(IID_IStreamGetBuffer, &getBuffer);
+    const Byte *data;
+    UInt64 size;
+    if (getBuffer && getBuffer->GetBuffer(&data, &size) == S_OK
+        && nextHeaderPos <= size && size - nextHeaderPos >= nextHeaderSize)
+      nextHeader = data + (size_t)nextHeaderPos;
+  }
+  if (!nextHeader)
+  {
+    buffer2.Alloc(nextHeaderSize_t);
+    RINOK(ReadStream_FALSE(_stream, buffer2, nextHeaderSize_t));
+    nextHeader = buffer2;
+  }
 
-  if (CrcCalc(buffer2, nextHeaderSize_t) != nextHeaderCRC)
+  if (CrcCalc(nextHeader, nextHeaderSize_t) != nextHeaderCRC)
     ThrowIncorrect();
 
   if (!db.StartHeaderWasRecovered)
     db.PhySizeWasConfirmed = true;
   
   CStreamSwitch streamSwitch;
-  streamSwitch.Set(this, buffer2);
+  streamSwitch.Set(this, nextHeader, nextHeaderSize_t, false);
   
   CObjectVector<CByteBuffer> dataVector;
   
@@ -283,7 +283,7 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
       break;
     }
 
-    if (decoderSpec->Base.BitDecoder.ExtraBitsWereRead())
+    if (decoderSpec->InputEofError())
     {
       _needMoreInput = true;
       packSize = streamSize;
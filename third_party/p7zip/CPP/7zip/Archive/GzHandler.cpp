@@ -12,9 +12,14 @@
 
 #include "../../Windows/PropVariant.h"
 #include "../../Windows/TimeUtils.h"
+#ifndef _7ZIP_ST
+#include "../../Windows/Synchronization.h"
+#include "../../Windows/Thread.h"
+#endif
 
 #include "../Common/ProgressUtils.h"
 #include "../Common/RegisterArc.h"
+#include "../Common/StreamObjects.h"
 #include "../Common/StreamUtils.h"
 
 #include "../Compress/CopyCoder.h"
@@ -446,11 +451,31 @@ HRESULT CItem::WriteFooter(ISequentialOutStream *stream)
   return WriteStream(stream, buf, 8);
 }
 
+/* The index item is the start of stream (the gzip header) or a checkpoint
+   in the Deflate data of stream (the start of block). */
+
+struct CIndexItem
+{
+  UInt64 PackPos;     // the first byte of header or the byte that contains the first bit of block
+  UInt64 UnpackPos;
+  UInt32 WindowSize;  // the size of unpacked window
+  Byte Bits;          // the bit offset of block in the byte at PackPos
+  bool IsStreamStart;
+  CByteBuffer Window; // the window (Deflate stream) for checkpoint
+
+  CIndexItem(): PackPos(0), UnpackPos(0), WindowSize(0), Bits(0), IsStreamStart(true) {}
+};
+
+#ifndef _7ZIP_ST
+class CMtExtract;
+#endif
+
 class CHandler:
   public IInArchive,
   public IArchiveOpenSeq,
   public IOutArchive,
   public ISetProperties,
+  public IArchiveStreamIndex,
   public CMyUnknownImp
 {
   CItem _item;
@@ -475,18 +500,53 @@ class CHandler:
 
   CSingleMethodProps _props;
 
+  UInt64 _streamSize; // the size of stream in Open()
+  UInt64 _indexSpacing;
+  bool _indexIsComplete;
+  CObjectVector<CIndexItem> _index;
+  CMyComPtr<ICompressCoder> _windowEncoder;
+
+  // the state of ReadAt()
+  CMyComPtr<ICompressCoder> _readDecoder;
+  NDecoder::CCOMCoder *_readDecoderSpec;
+  bool _readIsActive;
+  bool _readNeedResume;
+  UInt64 _readPos;
+  UInt64 _readStreamPos;
+
+  HRESULT PackWindow(const CByteBuffer &window, CIndexItem &item);
+  void AddStreamStart(UInt64 packPos, UInt64 unpackPos);
+  HRESULT AddCheckpoint(const NDecoder::CCheckpoint &cp, UInt64 packPos, UInt64 unpackPos);
+  unsigned FindIndexItem(UInt64 offset) const;
+  HRESULT ReadAtStart(const CIndexItem &item);
+
+  #ifndef _7ZIP_ST
+  friend class CMtExtract;
+  #endif
+
 public:
-  MY_UNKNOWN_IMP4(
+  MY_UNKNOWN_IMP5(
       IInArchive,
       IArchiveOpenSeq,
       IOutArchive,
-      ISetProperties)
+      ISetProperties,
+      IArchiveStreamIndex)
   INTERFACE_IInArchive(;)
   INTERFACE_IOutArchive(;)
   STDMETHOD(OpenSeq)(ISequentialInStream *stream);
   STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps);
 
-  CHandler()
+  STDMETHOD(SetIndexSpacing)(UInt64 spacing);
+  STDMETHOD(SaveIndex)(ISequentialOutStream *stream);
+  STDMETHOD(LoadIndex)(ISequentialInStream *stream);
+  STDMETHOD(ReadAt)(UInt64 offset, void *data, UInt32 size, UInt32 *processedSize);
+
+  CHandler():
+      _streamSize(0),
+      _indexSpacing(0),
+      _indexIsComplete(false),
+      _readDecoderSpec(NULL),
+      _readIsActive(false)
   {
     _decoderSpec = new NDecoder::CCOMCoder;
     _decoder = _decoderSpec;
@@ -630,6 +690,7 @@ STDMETHODIMP CHandler::Open(IInStream *stream, const UInt64 *, IArchiveOpenCallb
   UInt64 endPos;
   RINOK(stream->Seek(-8, STREAM_SEEK_END, &endPos));
   _packSize = endPos + 8;
+  _streamSize = _packSize;
   RINOK(_item.ReadFooter2(stream));
   _stream = stream;
   _isArc = true;
@@ -670,12 +731,768 @@ STDMETHODIMP CHandler::Close()
 
   _packSize = 0;
   _headerSize = 0;
+  _streamSize = 0;
+
+  _index.Clear();
+  _indexIsComplete = false;
+  _readIsActive = false;
   
   _stream.Release();
   _decoderSpec->ReleaseInStream();
+  if (_readDecoderSpec)
+    _readDecoderSpec->ReleaseInStream();
+  return S_OK;
+}
+
+static const Byte kIndexSignature[8] = { 'G', 'z', 'I', 'n', 'd', 'e', 'x', 0 };
+static const UInt32 kIndexVersion = 1;
+static const unsigned kIndexHeaderSize = 8 + 4 + 8 * 5 + 4;
+static const unsigned kIndexItemSize = 8 + 8 + 4 + 4 + 1 + 1;
+
+static const UInt64 kNoSize = (UInt64)(Int64)-1;
+
+HRESULT CHandler::PackWindow(const CByteBuffer &window, CIndexItem &item)
+{
+  item.WindowSize = (UInt32)window.Size();
+  item.Window.Free();
+  if (window.Size() == 0)
+    return S_OK;
+  if (!_windowEncoder)
+  {
+    NEncoder::CCOMCoder *encoderSpec = new NEncoder::CCOMCoder;
+    _windowEncoder = encoderSpec;
+    const PROPID propID = NCoderPropID::kLevel;
+    NCOM::CPropVariant prop((UInt32)1);
+    RINOK(encoderSpec->SetCoderProperties(&propID, &prop, 1));
+  }
+  CBufInStream *inStreamSpec = new CBufInStream;
+  CMyComPtr<ISequentialInStream> inStream = inStreamSpec;
+  inStreamSpec->Init(window, window.Size());
+  CDynBufSeqOutStream *outStreamSpec = new CDynBufSeqOutStream;
+  CMyComPtr<ISequentialOutStream> outStream = outStreamSpec;
+  RINOK(_windowEncoder->Code(inStream, outStream, NULL, NULL, NULL));
+  outStreamSpec->CopyToBuffer(item.Window);
+  return S_OK;
+}
+
+static HRESULT UnpackWindow(NDecoder::CCOMCoder *decoderSpec, const CIndexItem &item, CByteBuffer &window)
+{
+  window.Alloc(item.WindowSize);
+  if (item.WindowSize == 0)
+    return S_OK;
+  CBufInStream *inStreamSpec = new CBufInStream;
+  CMyComPtr<ISequentialInStream> inStream = inStreamSpec;
+  inStreamSpec->Init(item.Window, item.Window.Size());
+  CBufPtrSeqOutStream *outStreamSpec = new CBufPtrSeqOutStream;
+  CMyComPtr<ISequentialOutStream> outStream = outStreamSpec;
+  outStreamSpec->Init(window, item.WindowSize);
+  const UInt64 size = item.WindowSize;
+  RINOK(decoderSpec->Code(inStream, outStream, NULL, &size, NULL));
+  return outStreamSpec->GetPos() == item.WindowSize ? S_OK : S_FALSE;
+}
+
+// The items are stored at least _indexSpacing bytes apart.
+
+void CHandler::AddStreamStart(UInt64 packPos, UInt64 unpackPos)
+{
+  if (!_index.IsEmpty() && unpackPos < _index.Back().UnpackPos + _indexSpacing)
+    return;
+  CIndexItem &item = _index.AddNew();
+  item.PackPos = packPos;
+  item.UnpackPos = unpackPos;
+}
+
+HRESULT CHandler::AddCheckpoint(const NDecoder::CCheckpoint &cp, UInt64 packPos, UInt64 unpackPos)
+{
+  unpackPos += cp.OutPos;
+  if (!_index.IsEmpty() && unpackPos < _index.Back().UnpackPos + _indexSpacing)
+    return S_OK;
+  CIndexItem &item = _index.AddNew();
+  const UInt64 bits = (packPos << 3) + cp.InBits;
+  item.PackPos = bits >> 3;
+  item.Bits = (Byte)(bits & 7);
+  item.UnpackPos = unpackPos;
+  item.IsStreamStart = false;
+  return PackWindow(cp.Window, item);
+}
+
+// the point, where the decoding (or the unit of parallel decoding) starts or ends
+
+struct CUnitPoint
+{
+  UInt64 PackPos;
+  Byte Bits;
+  bool IsCheckpoint;           // false : the gzip header at PackPos
+  const CIndexItem *IndexItem; // the checkpoint from index, or the unpacked Window
+  CByteBuffer Window;
+
+  CUnitPoint(): PackPos(0), Bits(0), IsCheckpoint(false), IndexItem(NULL) {}
+  
+  void SetStreamStart(UInt64 packPos)
+  {
+    PackPos = packPos;
+    Bits = 0;
+    IsCheckpoint = false;
+    IndexItem = NULL;
+    Window.Free();
+  }
+  
+  void SetCheckpoint(const NDecoder::CCheckpoint &cp)
+  {
+    PackPos = cp.InBits >> 3;
+    Bits = (Byte)(cp.InBits & 7);
+    IsCheckpoint = true;
+    IndexItem = NULL;
+    Window = cp.Window;
+  }
+};
+
+#ifndef _7ZIP_ST
+
+static bool IsStreamStart(const Byte *p, Byte hostOS)
+{
+  return p[0] == kSignature_0
+      && p[1] == kSignature_1
+      && p[2] == kSignature_2
+      && (p[3] & NFlags::kReserved) == 0
+      && (p[8] == 0 || p[8] == NExtraFlags::kMaximum || p[8] == NExtraFlags::kFastest)
+      && p[9] == hostOS;
+}
+
+// returns the size of BGZF block (the stream with BSIZE in "BC" extra subfield), or 0
+
+static UInt32 GetBgzfBlockSize(const Byte *p, size_t size)
+{
+  if (size < 18
+      || p[0] != kSignature_0
+      || p[1] != kSignature_1
+      || p[2] != kSignature_2
+      || (p[3] & NFlags::kExtra) == 0)
+    return 0;
+  const unsigned xlen = GetUi16(p + 10);
+  if (12 + xlen > size)
+    return 0;
+  p += 12;
+  for (unsigned i = 0; i + 4 <= xlen;)
+  {
+    const unsigned len = GetUi16(p + i + 2);
+    if (p[i] == 'B' && p[i + 1] == 'C' && len == 2 && i + 6 <= xlen)
+      return (UInt32)GetUi16(p + i + 4) + 1;
+    i += 4 + len;
+  }
+  return 0;
+}
+
+/* Parallel Extract() splits the stream to units, that are decoded by threads to memory
+   and then written in order:
+     - with index: the units are the parts between index items, about kIndexUnitSize bytes each.
+     - BGZF: the units are groups of BGZF blocks.
+     - other: the unit starts at gzip header and it ends at the end of stream after next
+       gzip header candidate. If the unit doesn't end at the start of next unit, the next
+       units are dropped, and the decoding continues from the real end. The unit stops
+       at the start of block after kUnitOutLimit bytes, and next unit continues from that
+       checkpoint. */
+
+static const UInt32 kUnitPackSize = (UInt32)1 << 20;
+static const UInt32 kScanSize = (UInt32)1 << 20;
+static const UInt64 kUnitOutLimit = (UInt64)1 << 24;
+static const UInt64 kIndexUnitSize = (UInt64)1 << 22;
+static const unsigned kPeekSize = 64;
+
+#define RINOK_THREAD(x) { WRes __result_ = (x); if (__result_ != 0) return __result_; }
+
+class CSharedInStream
+{
+  NSynchronization::CCriticalSection _cs;
+public:
+  IInStream *Stream;
+
+  HRESULT ReadAt(UInt64 pos, void *data, UInt32 size, UInt32 *processedSize)
+  {
+    NSynchronization::CCriticalSectionLock lock(_cs);
+    RINOK(Stream->Seek(pos, STREAM_SEEK_SET, NULL));
+    return Stream->Read(data, size, processedSize);
+  }
+  HRESULT ReadFull(UInt64 pos, Byte *data, UInt32 size, UInt32 &processed);
+};
+
+HRESULT CSharedInStream::ReadFull(UInt64 pos, Byte *data, UInt32 size, UInt32 &processed)
+{
+  processed = 0;
+  while (processed < size)
+  {
+    UInt32 cur = 0;
+    RINOK(ReadAt(pos + processed, data + processed, size - processed, &cur));
+    if (cur == 0)
+      break;
+    processed += cur;
+  }
   return S_OK;
 }
 
+class CSharedInStreamReader:
+  public ISequentialInStream,
+  public CMyUnknownImp
+{
+public:
+  CSharedInStream *Shared;
+  UInt64 Pos;
+
+  MY_UNKNOWN_IMP1(ISequentialInStream)
+  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
+};
+
+STDMETHODIMP CSharedInStreamReader::Read(void *data, UInt32 size, UInt32 *processedSize)
+{
+  UInt32 processed = 0;
+  HRESULT res = Shared->ReadAt(Pos, data, size, &processed);
+  Pos += processed;
+  if (processedSize)
+    *processedSize = processed;
+  return res;
+}
+
+struct CStreamStart
+{
+  UInt64 PackPos;
+  UInt64 OutPos;
+};
+
+struct CStreamEnd
+{
+  UInt64 OutPos;
+  UInt32 Crc;
+  UInt32 Size32;
+};
+
+struct CUnit
+{
+  CUnitPoint Start;
+  UInt64 PackEnd;    // the unit ends at the end of first stream that ends at or after PackEnd,
+  UInt64 UnpackSize; // or after UnpackSize bytes, if it's not kNoSize.
+  UInt64 OutLimit;   // it stops at the start of block after OutLimit bytes
+  UInt32 Generation;
+
+  CDynBufSeqOutStream *OutSpec;
+  CMyComPtr<ISequentialOutStream> Out;
+  CRecordVector<CStreamStart> StreamStarts;
+  CRecordVector<CStreamEnd> StreamEnds;
+  CObjectVector<NDecoder::CCheckpoint> Checkpoints; // InBits from the start of archive, OutPos in the unit
+  HRESULT Result;
+  bool EndIsSize;    // the unit was finished after UnpackSize bytes
+  CUnitPoint End;    // the start of stream after last stream or the checkpoint, where the unit stopped
+
+  NSynchronization::CAutoResetEvent Done;
+
+  CUnit()
+  {
+    OutSpec = new CDynBufSeqOutStream;
+    Out = OutSpec;
+  }
+};
+
+class CMtExtract;
+
+struct CWorker
+{
+  CMtExtract *Owner;
+  NWindows::CThread Thread;
+  NDecoder::CCOMCoder *DecoderSpec;
+  CMyComPtr<ICompressCoder> Decoder;
+  NDecoder::CCOMCoder *WindowDecoderSpec;
+  CMyComPtr<ICompressCoder> WindowDecoder;
+  CSharedInStreamReader *ReaderSpec;
+  CMyComPtr<ISequentialInStream> Reader;
+  CObjectVector<NDecoder::CCheckpoint> Checkpoints;
+
+  CWorker()
+  {
+    DecoderSpec = new NDecoder::CCOMCoder;
+    Decoder = DecoderSpec;
+    WindowDecoderSpec = new NDecoder::CCOMCoder;
+    WindowDecoder = WindowDecoderSpec;
+    ReaderSpec = new CSharedInStreamReader;
+    Reader = ReaderSpec;
+  }
+
+  void ThreadFunc();
+  HRESULT Decode(CUnit &unit);
+  HRESULT DecodeUnit(CUnit &unit);
+};
+
+struct CExtractState
+{
+  CUnitPoint Start;   // the point, where the decoding continues
+  UInt64 StreamStart; // the unpack position of current stream
+  UInt64 NumStreams;
+  bool CrcError;
+
+  CExtractState(): StreamStart(0), NumStreams(0), CrcError(false) {}
+};
+
+class CMtExtract
+{
+  CHandler *_handler;
+  CSharedInStream _shared;
+  UInt64 _indexSpacing;
+  CObjectVector<CWorker> _workers;
+  CObjectVector<CUnit> _units;
+  unsigned _head;
+  unsigned _numInFlight;
+  unsigned _nextTaken;
+  bool _semIsCreated;
+  bool _exit;
+  NSynchronization::CCriticalSection _cs;
+  NSynchronization::CSemaphore _sem;
+  CByteBuffer _scanBuf;
+
+  void Submit()
+  {
+    _numInFlight++;
+    _sem.Release();
+  }
+  CUnit &WaitUnit();
+  HRESULT FindStream(UInt64 pos, Byte hostOS, UInt64 &found);
+public:
+  UInt64 IndexSpacing() const { return _indexSpacing; }
+  CSharedInStream &Shared() { return _shared; }
+
+  CMtExtract(): _head(0), _numInFlight(0), _nextTaken(0), _semIsCreated(false), _exit(false) {}
+  ~CMtExtract() { Stop(); }
+  
+  HRESULT Create(CHandler *handler, unsigned numThreads, UInt64 indexSpacing);
+  void Stop();
+  CUnit *GetUnit();
+  HRESULT Extract(ISequentialOutStream *outStream, COutStreamWithCRC *outStreamSpec,
+      CLocalProgress *lps, CExtractState &state);
+};
+
+static THREAD_FUNC_DECL WorkerThread(void *p) { ((CWorker *)p)->ThreadFunc(); return 0; }
+
+HRESULT CMtExtract::Create(CHandler *handler, unsigned numThreads, UInt64 indexSpacing)
+{
+  _handler = handler;
+  _shared.Stream = handler->_stream;
+  _indexSpacing = indexSpacing;
+  const unsigned numUnits = numThreads * 2;
+  for (unsigned i = 0; i < numUnits; i++)
+  {
+    RINOK_THREAD(_units.AddNew().Done.CreateIfNotCreated());
+  }
+  RINOK_THREAD(_sem.Create(0, numUnits + numThreads));
+  _semIsCreated = true;
+  for (unsigned i = 0; i < numThreads; i++)
+  {
+    CWorker &worker = _workers.AddNew();
+    worker.Owner = this;
+    worker.ReaderSpec->Shared = &_shared;
+    RINOK_THREAD(worker.Thread.Create(WorkerThread, &worker));
+  }
+  return S_OK;
+}
+
+void CMtExtract::Stop()
+{
+  if (_exit)
+    return;
+  while (_numInFlight != 0)
+    WaitUnit();
+  {
+    NSynchronization::CCriticalSectionLock lock(_cs);
+    _exit = true;
+  }
+  if (_semIsCreated && !_workers.IsEmpty())
+    _sem.Release(_workers.Size());
+  FOR_VECTOR (i, _workers)
+    if (_workers[i].Thread.IsCreated())
+      _workers[i].Thread.Wait();
+}
+
+CUnit *CMtExtract::GetUnit()
+{
+  _sem.Lock();
+  NSynchronization::CCriticalSectionLock lock(_cs);
+  if (_exit)
+    return NULL;
+  CUnit *unit = &_units[_nextTaken];
+  if (++_nextTaken == _units.Size())
+    _nextTaken = 0;
+  return unit;
+}
+
+CUnit &CMtExtract::WaitUnit()
+{
+  CUnit &unit = _units[_head];
+  unit.Done.Lock();
+  if (++_head == _units.Size())
+    _head = 0;
+  _numInFlight--;
+  return unit;
+}
+
+void CWorker::ThreadFunc()
+{
+  for (;;)
+  {
+    CUnit *unit = Owner->GetUnit();
+    if (!unit)
+      return;
+    unit->Result = DecodeUnit(*unit);
+    unit->Done.Set();
+  }
+}
+
+HRESULT CWorker::DecodeUnit(CUnit &unit)
+{
+  try
+  {
+    return Decode(unit);
+  }
+  catch(const CInBufferException &e) { return e.ErrorCode; }
+  catch(...) { return E_OUTOFMEMORY; }
+}
+
+HRESULT CWorker::Decode(CUnit &unit)
+{
+  unit.OutSpec->Init();
+  unit.StreamStarts.Clear();
+  unit.StreamEnds.Clear();
+  unit.Checkpoints.Clear();
+  unit.EndIsSize = false;
+
+  const UInt64 packBase = unit.Start.PackPos;
+  ReaderSpec->Pos = packBase;
+  DecoderSpec->SetInStream(Reader);
+  RINOK(DecoderSpec->InitInStream(true));
+  
+  bool inStream = unit.Start.IsCheckpoint;
+  if (inStream)
+  {
+    CByteBuffer window;
+    if (unit.Start.IndexItem)
+    {
+      RINOK(UnpackWindow(WindowDecoderSpec, *unit.Start.IndexItem, window));
+    }
+    const CByteBuffer &w = unit.Start.IndexItem ? window : unit.Start.Window;
+    RINOK(DecoderSpec->InitFromCheckpoint(unit.Start.Bits, w, (UInt32)w.Size()));
+  }
+
+  for (;;)
+  {
+    const UInt64 outSize = unit.OutSpec->GetSize();
+    if (!inStream)
+    {
+      const UInt64 packPos = packBase + DecoderSpec->GetInputProcessedSize();
+      if (unit.UnpackSize != kNoSize && outSize == unit.UnpackSize)
+      {
+        unit.EndIsSize = true;
+        return S_OK;
+      }
+      if ((unit.UnpackSize == kNoSize && packPos >= unit.PackEnd) || outSize >= unit.OutLimit)
+      {
+        unit.End.SetStreamStart(packPos);
+        return S_OK;
+      }
+      CStreamStart ss;
+      ss.PackPos = packPos;
+      ss.OutPos = outSize;
+      unit.StreamStarts.Add(ss);
+      CItem item;
+      RINOK(item.ReadHeader(DecoderSpec));
+    }
+
+    Checkpoints.Clear();
+    DecoderSpec->SetCheckpoints(&Checkpoints, Owner->IndexSpacing(),
+        unit.OutLimit == kNoSize ? kNoSize : unit.OutLimit - outSize);
+    const UInt64 rem = unit.UnpackSize - outSize;
+    const UInt64 *remPtr = (unit.UnpackSize == kNoSize ? NULL : &rem);
+    HRESULT res = inStream ?
+        DecoderSpec->CodeReal(unit.Out, remPtr, NULL) :
+        DecoderSpec->CodeResume(unit.Out, remPtr, NULL);
+    DecoderSpec->SetCheckpoints(NULL, 0);
+    inStream = false;
+
+    FOR_VECTOR (i, Checkpoints)
+    {
+      NDecoder::CCheckpoint &cp = unit.Checkpoints.AddNew();
+      cp.InBits = (packBase << 3) + Checkpoints[i].InBits;
+      cp.OutPos = outSize + Checkpoints[i].OutPos;
+      cp.Window = Checkpoints[i].Window;
+    }
+    
+    RINOK(res);
+    if (DecoderSpec->InputEofError())
+      return S_FALSE;
+    if (DecoderSpec->IsStopped())
+    {
+      unit.End.SetCheckpoint(unit.Checkpoints.Back());
+      return S_OK;
+    }
+    if (!DecoderSpec->IsFinished())
+    {
+      unit.EndIsSize = true;
+      return S_OK;
+    }
+
+    DecoderSpec->AlignToByte();
+    CItem item;
+    RINOK(item.ReadFooter1(DecoderSpec));
+    CStreamEnd se;
+    se.OutPos = unit.OutSpec->GetSize();
+    se.Crc = item.Crc;
+    se.Size32 = item.Size32;
+    unit.StreamEnds.Add(se);
+  }
+}
+
+HRESULT CMtExtract::FindStream(UInt64 pos, Byte hostOS, UInt64 &found)
+{
+  found = kNoSize;
+  const UInt64 streamSize = _handler->_streamSize;
+  if (pos >= streamSize)
+    return S_OK;
+  const UInt64 end = MyMin(pos + kScanSize, streamSize);
+  const UInt32 kBufSize = (UInt32)1 << 16;
+  _scanBuf.Alloc(kBufSize + 16);
+  while (pos < end)
+  {
+    const UInt32 cur = (UInt32)MyMin(end - pos, (UInt64)kBufSize);
+    UInt32 processed;
+    RINOK(_shared.ReadFull(pos, _scanBuf, cur + 9, processed));
+    const Byte *p = _scanBuf;
+    for (UInt32 i = 0; i < cur && i + 10 <= processed; i++)
+      if (p[i] == kSignature_0 && IsStreamStart(p + i, hostOS))
+      {
+        found = pos + i;
+        return S_OK;
+      }
+    if (processed < cur + 9)
+      break;
+    pos += cur;
+  }
+  return S_OK;
+}
+
+HRESULT CMtExtract::Extract(ISequentialOutStream *outStream, COutStreamWithCRC *outStreamSpec,
+    CLocalProgress *lps, CExtractState &state)
+{
+  CHandler &h = *_handler;
+  enum { kMode_Index, kMode_Bgzf, kMode_Scan } mode;
+  Byte hostOS;
+  {
+    Byte header[kPeekSize];
+    UInt32 processed;
+    RINOK(_shared.ReadFull(0, header, kPeekSize, processed));
+    if (processed < 10)
+      return S_OK;
+    hostOS = header[9];
+    mode = h._indexIsComplete ? kMode_Index :
+        GetBgzfBlockSize(header, processed) != 0 ? kMode_Bgzf : kMode_Scan;
+  }
+
+  CUnitPoint next;       // the start of next unit
+  bool nextIsValid = true;
+  unsigned nextItem = 0;
+  bool finished = false;
+  bool scanEnabled = true;
+  UInt32 generation = 0;
+
+  for (;;)
+  {
+    while (nextIsValid && !finished && _numInFlight < _units.Size())
+    {
+      CUnit &unit = _units[(_head + _numInFlight) % _units.Size()];
+      unit.Generation = generation;
+      unit.PackEnd = 0;
+      unit.UnpackSize = kNoSize;
+      unit.OutLimit = kNoSize;
+      
+      if (mode == kMode_Index)
+      {
+        if (nextItem >= h._index.Size())
+        {
+          finished = true;
+          next.SetStreamStart(h._packSize);
+          break;
+        }
+        const CIndexItem &item = h._index[nextItem];
+        unit.Start.PackPos = item.PackPos;
+        unit.Start.Bits = item.Bits;
+        unit.Start.IsCheckpoint = !item.IsStreamStart;
+        unit.Start.IndexItem = (item.IsStreamStart ? NULL : &item);
+        unit.Start.Window.Free();
+        unsigned last = nextItem + 1;
+        while (last < h._index.Size()
+            && h._index[last].UnpackPos - item.UnpackPos < kIndexUnitSize)
+          last++;
+        if (last < h._index.Size() && !h._index[last].IsStreamStart)
+          unit.UnpackSize = h._index[last].UnpackPos - item.UnpackPos;
+        else
+          unit.PackEnd = (last < h._index.Size() ? h._index[last].PackPos : h._packSize);
+        nextItem = last;
+        if (last < h._index.Size())
+        {
+          next.SetStreamStart(h._index[last].PackPos);
+          next.IsCheckpoint = !h._index[last].IsStreamStart;
+        }
+        else
+          next.SetStreamStart(h._packSize);
+        Submit();
+        continue;
+      }
+
+      if (!next.IsCheckpoint && next.PackPos >= h._streamSize)
+      {
+        finished = true;
+        break;
+      }
+      unit.Start = next;
+
+      if (mode == kMode_Bgzf && !next.IsCheckpoint)
+      {
+        UInt64 pos = next.PackPos;
+        while (pos < h._streamSize && pos - next.PackPos < kUnitPackSize)
+        {
+          Byte header[kPeekSize];
+          UInt32 processed;
+          RINOK(_shared.ReadFull(pos, header, kPeekSize, processed));
+          const UInt32 blockSize = GetBgzfBlockSize(header, processed);
+          if (blockSize == 0)
+            break;
+          pos += blockSize;
+        }
+        if (pos != next.PackPos)
+        {
+          unit.PackEnd = pos;
+          next.SetStreamStart(pos);
+          Submit();
+          continue;
+        }
+        mode = kMode_Scan;
+      }
+
+      unit.OutLimit = kUnitOutLimit;
+      UInt64 found = kNoSize;
+      if (scanEnabled)
+      {
+        RINOK(FindStream(next.PackPos + kUnitPackSize, hostOS, found));
+      }
+      if (found != kNoSize)
+      {
+        unit.PackEnd = found;
+        next.SetStreamStart(found);
+      }
+      else
+      {
+        // the end of unit will be known after decoding
+        unit.PackEnd = h._streamSize;
+        nextIsValid = false;
+        if (next.PackPos + kUnitPackSize + kScanSize < h._streamSize)
+          scanEnabled = false;
+      }
+      Submit();
+    }
+
+    if (_numInFlight == 0)
+    {
+      state.Start = next;
+      return S_OK;
+    }
+
+    CUnit &unit = WaitUnit();
+    if (unit.Generation != generation)
+      continue;
+    if (unit.Result != S_OK)
+    {
+      // the sequential decoding reports the error
+      state.Start = unit.Start;
+      return S_OK;
+    }
+
+    const UInt64 unitOutStart = outStreamSpec->GetSize();
+    
+    if (_indexSpacing != 0)
+    {
+      unsigned si = 0;
+      unsigned ci = 0;
+      for (;;)
+      {
+        const bool isStart = (si < unit.StreamStarts.Size());
+        const bool isCheckpoint = (ci < unit.Checkpoints.Size());
+        if (!isStart && !isCheckpoint)
+          break;
+        if (isCheckpoint && (!isStart || unit.Checkpoints[ci].OutPos <= unit.StreamStarts[si].OutPos))
+        {
+          RINOK(h.AddCheckpoint(unit.Checkpoints[ci], 0, unitOutStart));
+          ci++;
+        }
+        else
+        {
+          h.AddStreamStart(unit.StreamStarts[si].PackPos, unitOutStart + unit.StreamStarts[si].OutPos);
+          si++;
+        }
+      }
+    }
+
+    const Byte *data = unit.OutSpec->GetBuffer();
+    size_t pos = 0;
+    for (unsigned i = 0;; i++)
+    {
+      const size_t end = (i < unit.StreamEnds.Size() ? (size_t)unit.StreamEnds[i].OutPos : unit.OutSpec->GetSize());
+      RINOK(WriteStream(outStream, data + pos, end - pos));
+      pos = end;
+      if (i == unit.StreamEnds.Size())
+        break;
+      const CStreamEnd &se = unit.StreamEnds[i];
+      if (se.Crc != outStreamSpec->GetCRC() ||
+          se.Size32 != (UInt32)(outStreamSpec->GetSize() - state.StreamStart))
+      {
+        state.CrcError = true;
+        return S_OK;
+      }
+      outStreamSpec->InitCRC();
+      state.StreamStart = outStreamSpec->GetSize();
+    }
+    state.NumStreams += unit.StreamStarts.Size();
+
+    lps->InSize = unit.Start.PackPos;
+    lps->OutSize = outStreamSpec->GetSize();
+    RINOK(lps->SetCur());
+
+    bool continues = unit.EndIsSize;
+    if (!continues && !unit.End.IsCheckpoint)
+    {
+      const CUnitPoint *following = NULL;
+      if (_numInFlight != 0)
+      {
+        const CUnit &unit2 = _units[_head];
+        if (unit2.Generation == generation)
+          following = &unit2.Start;
+      }
+      else if (nextIsValid)
+        following = &next;
+      continues = (following && !following->IsCheckpoint && following->PackPos == unit.End.PackPos);
+    }
+    if (!continues)
+    {
+      if (mode == kMode_Index)
+      {
+        // the index doesn't match the data
+        state.Start = unit.End;
+        return S_OK;
+      }
+      generation++;
+      next = unit.End;
+      nextIsValid = true;
+      finished = false;
+      if (!unit.End.IsCheckpoint)
+        scanEnabled = true;
+    }
+  }
+}
+
+#endif
+
 STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testMode, IArchiveExtractCallback *extractCallback)
 {
@@ -709,35 +1526,91 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   CMyComPtr<ICompressProgressInfo> progress = lps;
   lps->Init(extractCallback, true);
 
-  bool needReadFirstItem = _needSeekToStart;
-  
-  if (_needSeekToStart)
-  {
-    if (!_stream)
-      return E_FAIL;
-    RINOK(_stream->Seek(0, STREAM_SEEK_SET, NULL));
-    _decoderSpec->InitInStream(true);
-    // printf("\nSeek");
-  }
-  else
-    _needSeekToStart = true;
+  _readIsActive = false;
+  const bool recordIndex = (_indexSpacing != 0 && !_indexIsComplete);
+  if (recordIndex)
+    _index.Clear();
 
+  bool needReadFirstItem = _needSeekToStart;
   bool firstItem = true;
+  bool inStream = false; // the decoding continues the stream from checkpoint
+  UInt64 packBase = 0;
+  UInt64 numStreams = 0;
+  UInt64 streamStart = 0;
+  bool crcError = false;
 
-  UInt64 packSize = _decoderSpec->GetInputProcessedSize();
-  // printf("\npackSize = %d", (unsigned)packSize);
+  CUnitPoint start;
 
-  UInt64 unpackedSize = 0;
-  UInt64 numStreams = 0;
+  #ifndef _7ZIP_ST
+  const int numThreads = _props.Get_NumThreads();
+  if (_stream && numThreads > 1)
+  {
+    CExtractState state;
+    {
+      CMtExtract mt;
+      RINOK(mt.Create(this, MyMin((unsigned)numThreads, (unsigned)64), recordIndex ? _indexSpacing : 0));
+      RINOK(mt.Extract(outStream, outStreamSpec, lps, state));
+    }
+    numStreams = state.NumStreams;
+    streamStart = state.StreamStart;
+    crcError = state.CrcError;
+    if (numStreams != 0)
+      firstItem = false;
+    start = state.Start;
+    if (start.IndexItem)
+    {
+      RINOK(UnpackWindow(_decoderSpec, *start.IndexItem, start.Window));
+    }
+  }
+  #endif
 
-  bool crcError = false;
+  UInt64 packSize = 0;
+  UInt64 unpackedSize = outStreamSpec->GetSize();
 
   HRESULT result = S_OK;
 
   try {
+
+  if (!crcError)
+  {
+    if (!firstItem)
+    {
+      // it continues after parallel decoding
+      RINOK(_stream->Seek(start.PackPos, STREAM_SEEK_SET, NULL));
+      _decoderSpec->SetInStream(_stream);
+      RINOK(_decoderSpec->InitInStream(true));
+      packBase = start.PackPos;
+      if (start.IsCheckpoint)
+      {
+        RINOK(_decoderSpec->InitFromCheckpoint(start.Bits, start.Window, (UInt32)start.Window.Size()));
+        inStream = true;
+      }
+    }
+    else if (_needSeekToStart)
+    {
+      if (!_stream)
+        return E_FAIL;
+      RINOK(_stream->Seek(0, STREAM_SEEK_SET, NULL));
+      _decoderSpec->SetInStream(_stream);
+      _decoderSpec->InitInStream(true);
+      // printf("\nSeek");
+    }
+    else
+      _needSeekToStart = true;
+    packSize = packBase + _decoderSpec->GetInputProcessedSize();
+  }
+  // printf("\npackSize = %d", (unsigned)packSize);
+
+  CObjectVector<NDecoder::CCheckpoint> checkpoints;
   
   for (;;)
   {
+    if (crcError)
+    {
+      result = S_FALSE;
+      break;
+    }
+
     lps->InSize = packSize;
     lps->OutSize = unpackedSize;
 
@@ -745,44 +1618,70 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 
     CItem item;
     
-    if (!firstItem || needReadFirstItem)
+    if (!inStream)
     {
-      result = item.ReadHeader(_decoderSpec);
-
-      if (result != S_OK && result != S_FALSE)
-        return result;
-    
-      if (_decoderSpec->InputEofError())
-        result = S_FALSE;
-
-      if (result != S_OK && firstItem)
+      const UInt64 headerPos = (firstItem && !needReadFirstItem) ? 0 : packSize;
+      
+      if (!firstItem || needReadFirstItem)
       {
-        _isArc = false;
-        break;
-      }
+        result = item.ReadHeader(_decoderSpec);
 
-      if (packSize == _decoderSpec->GetStreamSize())
-      {
-        result = S_OK;
-        break;
+        if (result != S_OK && result != S_FALSE)
+          return result;
+      
+        if (_decoderSpec->InputEofError())
+          result = S_FALSE;
+
+        if (result != S_OK && firstItem)
+        {
+          _isArc = false;
+          break;
+        }
+
+        if (packSize == packBase + _decoderSpec->GetStreamSize())
+        {
+          result = S_OK;
+          break;
+        }
+
+        if (result != S_OK)
+        {
+          _dataAfterEnd = true;
+          break;
+        }
       }
+      
+      numStreams++;
+      firstItem = false;
 
-      if (result != S_OK)
-      {
-        _dataAfterEnd = true;
-        break;
-      }
+      streamStart = outStreamSpec->GetSize();
+      outStreamSpec->InitCRC();
+      if (recordIndex)
+        AddStreamStart(headerPos, streamStart);
+    }
+
+    const UInt64 decoderStart = outStreamSpec->GetSize();
+    if (recordIndex)
+    {
+      checkpoints.Clear();
+      _decoderSpec->SetCheckpoints(&checkpoints, _indexSpacing);
     }
-    
-    numStreams++;
-    firstItem = false;
 
-    UInt64 startOffset = outStreamSpec->GetSize();
-    outStreamSpec->InitCRC();
+    result = inStream ?
+        _decoderSpec->CodeReal(outStream, NULL, progress) :
+        _decoderSpec->CodeResume(outStream, NULL, progress);
+    inStream = false;
 
-    result = _decoderSpec->CodeResume(outStream, NULL, progress);
+    if (recordIndex)
+    {
+      _decoderSpec->SetCheckpoints(NULL, 0);
+      FOR_VECTOR (i, checkpoints)
+      {
+        RINOK(AddCheckpoint(checkpoints[i], packBase, decoderStart));
+      }
+    }
 
-    packSize = _decoderSpec->GetInputProcessedSize();
+    packSize = packBase + _decoderSpec->GetInputProcessedSize();
     unpackedSize = outStreamSpec->GetSize();
 
     if (result != S_OK && result != S_FALSE)
@@ -790,7 +1689,7 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 
     if (_decoderSpec->InputEofError())
     {
-      packSize = _decoderSpec->GetStreamSize();
+      packSize = packBase + _decoderSpec->GetStreamSize();
       _needMoreInput = true;
       result = S_FALSE;
     }
@@ -802,7 +1701,7 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     
     result = item.ReadFooter1(_decoderSpec);
 
-    packSize = _decoderSpec->GetInputProcessedSize();
+    packSize = packBase + _decoderSpec->GetInputProcessedSize();
 
     if (result != S_OK && result != S_FALSE)
       return result;
@@ -818,7 +1717,7 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     }
 
     if (item.Crc != outStreamSpec->GetCRC() ||
-        item.Size32 != (UInt32)(unpackedSize - startOffset))
+        item.Size32 != (UInt32)(unpackedSize - streamStart))
     {
       crcError = true;
       result = S_FALSE;
@@ -860,12 +1759,293 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   else
     return result;
 
+  if (recordIndex)
+  {
+    _indexIsComplete = !firstItem && (
+        retResult == NExtract::NOperationResult::kOK ||
+        retResult == NExtract::NOperationResult::kDataAfterEnd);
+    if (!_indexIsComplete)
+      _index.Clear();
+  }
+
   return extractCallback->SetOperationResult(retResult);
 
 
   COM_TRY_END
 }
 
+STDMETHODIMP CHandler::SetIndexSpacing(UInt64 spacing)
+{
+  _indexSpacing = spacing;
+  return S_OK;
+}
+
+/*
+Index:
+  Signature[8], Version[4], StreamSize[8], PackSize[8], UnpackSize[8], NumStreams[8], Spacing[8], NumItems[4]
+  Items: PackPos[8], UnpackPos[8], WindowSize[4], PackedWindowSize[4], Bits[1], IsStreamStart[1], PackedWindow[]
+*/
+
+STDMETHODIMP CHandler::SaveIndex(ISequentialOutStream *stream)
+{
+  COM_TRY_BEGIN
+  if (!_indexIsComplete)
+    return S_FALSE;
+  Byte buf[kIndexHeaderSize];
+  memcpy(buf, kIndexSignature, sizeof(kIndexSignature));
+  SetUi32(buf + 8, kIndexVersion);
+  SetUi64(buf + 12, _streamSize);
+  SetUi64(buf + 20, _packSize);
+  SetUi64(buf + 28, _unpackSize);
+  SetUi64(buf + 36, _numStreams);
+  SetUi64(buf + 44, _indexSpacing);
+  SetUi32(buf + 52, _index.Size());
+  RINOK(WriteStream(stream, buf, kIndexHeaderSize));
+  FOR_VECTOR (i, _index)
+  {
+    const CIndexItem &item = _index[i];
+    Byte p[kIndexItemSize];
+    SetUi64(p, item.PackPos);
+    SetUi64(p + 8, item.UnpackPos);
+    SetUi32(p + 16, item.WindowSize);
+    SetUi32(p + 20, (UInt32)item.Window.Size());
+    p[24] = item.Bits;
+    p[25] = (Byte)(item.IsStreamStart ? 1 : 0);
+    RINOK(WriteStream(stream, p, kIndexItemSize));
+    RINOK(WriteStream(stream, item.Window, item.Window.Size()));
+  }
+  return S_OK;
+  COM_TRY_END
+}
+
+STDMETHODIMP CHandler::LoadIndex(ISequentialInStream *stream)
+{
+  COM_TRY_BEGIN
+  _index.Clear();
+  _indexIsComplete = false;
+  _readIsActive = false;
+  if (!_stream)
+    return S_FALSE;
+  
+  Byte buf[kIndexHeaderSize];
+  RINOK(ReadStream_FALSE(stream, buf, kIndexHeaderSize));
+  if (memcmp(buf, kIndexSignature, sizeof(kIndexSignature)) != 0
+      || GetUi32(buf + 8) != kIndexVersion
+      || GetUi64(buf + 12) != _streamSize)
+    return S_FALSE;
+  const UInt64 packSize = GetUi64(buf + 20);
+  const UInt64 unpackSize = GetUi64(buf + 28);
+  const UInt64 numStreams = GetUi64(buf + 36);
+  const UInt32 numItems = GetUi32(buf + 52);
+  if (packSize > _streamSize || numItems == 0 || numItems > packSize)
+    return S_FALSE;
+  
+  for (UInt32 i = 0; i < numItems; i++)
+  {
+    Byte p[kIndexItemSize];
+    HRESULT res = ReadStream_FALSE(stream, p, kIndexItemSize);
+    if (res == S_OK)
+    {
+      CIndexItem &item = _index.AddNew();
+      item.PackPos = GetUi64(p);
+      item.UnpackPos = GetUi64(p + 8);
+      item.WindowSize = GetUi32(p + 16);
+      const UInt32 packedWindowSize = GetUi32(p + 20);
+      item.Bits = p[24];
+      item.IsStreamStart = (p[25] != 0);
+      if (item.PackPos >= packSize
+          || item.UnpackPos > unpackSize
+          || item.Bits > 7
+          || item.WindowSize > kHistorySize32
+          || packedWindowSize > kHistorySize32 * 2
+          || (item.IsStreamStart && (item.Bits != 0 || item.WindowSize != 0 || packedWindowSize != 0))
+          || (i == 0 && (!item.IsStreamStart || item.PackPos != 0 || item.UnpackPos != 0))
+          || (i != 0 && (item.PackPos < _index[i - 1].PackPos || item.UnpackPos < _index[i - 1].UnpackPos)))
+        res = S_FALSE;
+      else
+      {
+        item.Window.Alloc(packedWindowSize);
+        res = ReadStream_FALSE(stream, item.Window, packedWindowSize);
+      }
+    }
+    if (res != S_OK)
+    {
+      _index.Clear();
+      return res;
+    }
+  }
+
+  _packSize = packSize;
+  _unpackSize = unpackSize;
+  _numStreams = numStreams;
+  _packSize_Defined = true;
+  _unpackSize_Defined = true;
+  _numStreams_Defined = true;
+  _indexIsComplete = true;
+  return S_OK;
+  COM_TRY_END
+}
+
+class CReadAtOutStream:
+  public ISequentialOutStream,
+  public CMyUnknownImp
+{
+public:
+  Byte *Data;
+  UInt64 Skip;
+  UInt32 Rem;
+  UInt64 Processed;
+
+  void Init(void *data, UInt64 skip, UInt32 size)
+  {
+    Data = (Byte *)data;
+    Skip = skip;
+    Rem = size;
+    Processed = 0;
+  }
+
+  MY_UNKNOWN_IMP1(ISequentialOutStream)
+  STDMETHOD(Write)(const void *data, UInt32 size, UInt32 *processedSize);
+};
+
+STDMETHODIMP CReadAtOutStream::Write(const void *data, UInt32 size, UInt32 *processedSize)
+{
+  if (processedSize)
+    *processedSize = size;
+  Processed += size;
+  if (Skip >= size)
+  {
+    Skip -= size;
+    return S_OK;
+  }
+  data = (const Byte *)data + (size_t)Skip;
+  size -= (UInt32)Skip;
+  Skip = 0;
+  if (size > Rem)
+    size = Rem;
+  memcpy(Data, data, size);
+  Data += size;
+  Rem -= size;
+  return S_OK;
+}
+
+unsigned CHandler::FindIndexItem(UInt64 offset) const
+{
+  unsigned left = 0, right = _index.Size();
+  while (right - left > 1)
+  {
+    const unsigned mid = (left + right) / 2;
+    if (_index[mid].UnpackPos <= offset)
+      left = mid;
+    else
+      right = mid;
+  }
+  return left;
+}
+
+HRESULT CHandler::ReadAtStart(const CIndexItem &item)
+{
+  _readIsActive = false;
+  if (!_readDecoder)
+  {
+    _readDecoderSpec = new NDecoder::CCOMCoder;
+    _readDecoder = _readDecoderSpec;
+  }
+  CByteBuffer window;
+  if (!item.IsStreamStart)
+  {
+    RINOK(UnpackWindow(_readDecoderSpec, item, window));
+  }
+  RINOK(_stream->Seek(item.PackPos, STREAM_SEEK_SET, NULL));
+  _readDecoderSpec->SetInStream(_stream);
+  RINOK(_readDecoderSpec->InitInStream(true));
+  if (item.IsStreamStart)
+  {
+    CItem header;
+    RINOK(header.ReadHeader(_readDecoderSpec));
+  }
+  else
+  {
+    RINOK(_readDecoderSpec->InitFromCheckpoint(item.Bits, window, item.WindowSize));
+  }
+  _readNeedResume = item.IsStreamStart;
+  _readPos = item.UnpackPos;
+  _readIsActive = true;
+  return S_OK;
+}
+
+STDMETHODIMP CHandler::ReadAt(UInt64 offset, void *data, UInt32 size, UInt32 *processedSize)
+{
+  COM_TRY_BEGIN
+  if (processedSize)
+    *processedSize = 0;
+  if (!_stream || !_indexIsComplete)
+    return E_FAIL;
+
+  CReadAtOutStream *outStreamSpec = new CReadAtOutStream;
+  CMyComPtr<ISequentialOutStream> outStream = outStreamSpec;
+  HRESULT res = S_OK;
+
+  try
+  {
+    while (size != 0 && offset < _unpackSize)
+    {
+      const CIndexItem &item = _index[FindIndexItem(offset)];
+      // the decoder continues, if there is no index item after current position
+      if (!_readIsActive || offset < _readPos || item.UnpackPos > _readPos)
+        res = ReadAtStart(item);
+      else
+        res = _stream->Seek(_readStreamPos, STREAM_SEEK_SET, NULL);
+      if (res != S_OK)
+        break;
+
+      const UInt64 skip = offset - _readPos;
+      const UInt64 cur = skip + size;
+      outStreamSpec->Init(data, skip, size);
+      res = _readNeedResume ?
+          _readDecoderSpec->CodeResume(outStream, &cur, NULL) :
+          _readDecoderSpec->CodeReal(outStream, &cur, NULL);
+      _readNeedResume = false;
+      _readPos += outStreamSpec->Processed;
+      const UInt32 copied = size - outStreamSpec->Rem;
+      data = (Byte *)data + copied;
+      size -= copied;
+      offset += copied;
+      if (processedSize)
+        *processedSize += copied;
+      if (res == S_OK && _readDecoderSpec->InputEofError())
+        res = S_FALSE;
+      if (res != S_OK)
+        break;
+
+      if (_readDecoderSpec->IsFinished())
+      {
+        // the next stream follows
+        _readDecoderSpec->AlignToByte();
+        CItem footer;
+        res = footer.ReadFooter1(_readDecoderSpec);
+        if (res == S_OK && _readPos < _unpackSize)
+        {
+          CItem header;
+          res = header.ReadHeader(_readDecoderSpec);
+          _readNeedResume = true;
+        }
+        if (res != S_OK)
+          break;
+      }
+      res = _stream->Seek(0, STREAM_SEEK_CUR, &_readStreamPos);
+      if (res != S_OK)
+        break;
+    }
+  }
+  catch(const CInBufferException &e) { res = e.ErrorCode; }
+
+  if (res != S_OK)
+    _readIsActive = false;
+  return res;
+  COM_TRY_END
+}
+
 static const Byte kHostOS =
   #ifdef _WIN32
   NHostOS::kFAT;
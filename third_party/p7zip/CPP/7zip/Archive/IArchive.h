@@ -508,6 +508,24 @@ ARCHIVE_INTERFACE(IArchiveAllowTail, 0x05)
   STDMETHOD(AllowTail)(Int32 allowTail) PURE;
 };
 
+/* Index of checkpoints in the stream of single-stream archive (gz):
+     SetIndexSpacing(spacing) : next Extract() of all data stores the start of every stream
+        and a checkpoint at about every (spacing) bytes of unpacked data. 0 disables it.
+     SaveIndex() : writes the index after such Extract(). It returns S_FALSE, if there is no index.
+     LoadIndex() : reads the index of same archive. It returns S_FALSE, if the index is not for that archive.
+     ReadAt() : reads unpacked data from (offset) with the index. It requires IInStream in Open().
+        It returns S_FALSE for data error, and (*processedSize < size) only at the end of data.
+   Extract() with (numThreads > 1) decodes in parallel: the parts between the items of index,
+   or the streams of multi-stream archive. */
+
+ARCHIVE_INTERFACE(IArchiveStreamIndex, 0x09)
+{
+  STDMETHOD(SetIndexSpacing)(UInt64 spacing) PURE;
+  STDMETHOD(SaveIndex)(ISequentialOutStream *stream) PURE;
+  STDMETHOD(LoadIndex)(ISequentialInStream *stream) PURE;
+  STDMETHOD(ReadAt)(UInt64 offset, void *data, UInt32 size, UInt32 *processedSize) PURE;
+};
+
 
 #define IMP_IInArchive_GetProp(k) \
   (UInt32 index, BSTR *name, PROPID *propID, VARTYPE *varType) \
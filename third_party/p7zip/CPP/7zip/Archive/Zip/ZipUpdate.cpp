@@ -664,7 +664,10 @@ static HRESULT Update2(
     if (options2.MethodInfo.FindProp(NCoderPropID::kNumThreads) < 0)
     {
       // fixed for 9.31. bzip2 default is just one thread.
-      if (options2.NumThreadsWasChanged || method == NFileHeader::NCompressionMethod::kBZip2)
+      if (options2.NumThreadsWasChanged
+          || method == NFileHeader::NCompressionMethod::kBZip2
+          || method == NFileHeader::NCompressionMethod::kDeflated
+          || method == NFileHeader::NCompressionMethod::kDeflated64)
         options2.MethodInfo.AddProp_NumThreads(numThreads);
     }
   }
@@ -688,6 +691,25 @@ static HRESULT Update2(
       }
       numThreads /= numBZip2Threads;
     }
+    if (method == NFileHeader::NCompressionMethod::kDeflated
+        || method == NFileHeader::NCompressionMethod::kDeflated64)
+    {
+      bool fixedNumber;
+      UInt32 numDeflateThreads = options2.MethodInfo.Get_Deflate_NumThreads(fixedNumber);
+      if (!fixedNumber && numFilesToCompress < numThreads)
+      {
+        // the threads that are not needed for the files split the files to 1 MiB blocks
+        UInt64 averageNumberOfBlocks = (numBytesToCompress / numFilesToCompress >> 20) + 1;
+        numDeflateThreads = numThreads / (UInt32)numFilesToCompress;
+        if (averageNumberOfBlocks < numDeflateThreads)
+          numDeflateThreads = (UInt32)averageNumberOfBlocks;
+        if (numDeflateThreads > 1)
+          options2.MethodInfo.AddProp_NumThreads(numDeflateThreads);
+        else
+          numDeflateThreads = 1;
+      }
+      numThreads /= numDeflateThreads;
+    }
     if (method == NFileHeader::NCompressionMethod::kLZMA)
     {
       bool fixedNumber;
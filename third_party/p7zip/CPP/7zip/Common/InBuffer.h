@@ -77,6 +77,14 @@ public:
   
   size_t ReadBytes(Byte *buf, size_t size);
   size_t Skip(size_t size);
+
+  /* The direct access to the buffer for fast decoding loops:
+     the bytes from GetBufBase() to GetBufLim() are in the buffer, GetBufPos() is next byte.
+     SetBufPos() can move the position only inside that range. */
+  const Byte *GetBufBase() const { return _bufBase; }
+  const Byte *GetBufPos() const { return _buf; }
+  const Byte *GetBufLim() const { return _bufLim; }
+  void SetBufPos(const Byte *pos) { _buf = _bufBase + (pos - _bufBase); }
 };
 
 class CInBuffer: public CInBufferBase
@@ -251,7 +251,8 @@ static const CNameToPropID g_NameToPropID[] =
   { VT_UI4, "mt" },
   { VT_BOOL, "eos" },
   { VT_UI4, "x" },
-  { VT_UI4, "reduceSize" }
+  { VT_UI4, "reduceSize" },
+  { VT_UI4, "ldm" }
 };
 
 static int FindPropIdExact(const UString &name)
@@ -334,6 +335,7 @@ static bool IsLogSizeProp(PROPID propid)
     case NCoderPropID::kUsedMemorySize:
     case NCoderPropID::kBlockSize:
     case NCoderPropID::kReduceSize:
+    case NCoderPropID::kLdmSize:
       return true;
   }
   return false;
@@ -114,7 +114,7 @@ public:
     if (numThreads >= 0)
     {
       fixedNumber = true;
-      return numThreads < 2 ? 1 : 2;
+      return numThreads < 2 ? 1 : (UInt32)numThreads;
     }
     return Get_Lzma_Algo() == 0 ? 1 : 2;
   }
@@ -133,6 +133,20 @@ public:
     return 1;
   }
 
+  UInt32 Get_Deflate_NumThreads(bool &fixedNumber) const
+  {
+    fixedNumber = false;
+    int numThreads = Get_NumThreads();
+    if (numThreads >= 0)
+    {
+      fixedNumber = true;
+      if (numThreads < 1) return 1;
+      if (numThreads > 32) return 32;
+      return numThreads;
+    }
+    return 1;
+  }
+
   UInt32 Get_BZip2_BlockSize() const
   {
     int i = FindProp(NCoderPropID::kDictionarySize);
@@ -4,6 +4,9 @@
 
 #include "../../../C/Alloc.h"
 
+#include "../Common/StreamObjects.h"
+#include "../Common/StreamUtils.h"
+
 #include "BZip2Decoder.h"
 #include "Mtf8.h"
 
@@ -13,7 +16,7 @@ namespace NBZip2 {
 #undef NO_INLINE
 #define NO_INLINE
   
-static const UInt32 kNumThreadsMax = 4;
+static const UInt32 kNumThreadsMax = 64;
 
 static const UInt32 kBufferSize = (1 << 17);
 
@@ -411,78 +414,686 @@ static UInt32 NO_INLINE DecodeBlock(const CBlockProps &props, UInt32 *tt, COutBu
     return DecodeBlock2    (tt, props.blockSize, props.origPtr, m_OutStream);
 }
 
-CDecoder::CDecoder()
+#ifndef _7ZIP_ST
+
+/*
+  The multi-threaded decoder:
+    The input is read to the buffer by large pieces. The signature of block and
+    the signature of end of stream can start at any bit position, and the threads
+    search them in the parts of each new piece. Each block signature is a candidate
+    for the start of block: the data from it to next signature is copied to the job,
+    and any free thread decodes that job. The jobs are in the ring, so the size of
+    read-ahead data and the size of decoded data are limited.
+    The caller's thread follows the chain of blocks: each block must end exactly at
+    the signature of next block or the end of stream. So the false signatures in the
+    data of blocks are skipped. If the chain is broken (data error, CRC error,
+    unexpected end of input), the stream is decoded from the start of that block by
+    the single-threaded code that reports the error.
+*/
+
+static const UInt32 kMtReadSize = (UInt32)1 << 22;
+static const UInt32 kMtScanSize = (UInt32)1 << 20;
+static const UInt32 kMtBlockPackSizeMax = (UInt32)5 << 19; // 900000 symbols of 20 bits and the tables
+static const unsigned kMtPadSize = 8;
+static const unsigned kSigSize = 6;
+
+#define RINOK_THREAD(x) { WRes __result_ = (x); if (__result_ != 0) return __result_; }
+
+struct CSigPrefix
 {
-  #ifndef _7ZIP_ST
-  m_States = 0;
-  m_NumThreadsPrev = 0;
-  NumThreads = 1;
-  #endif
-  _needInStreamInit = true;
+  UInt64 Sig;
+  UInt32 Pair;    // second and third bytes of data that start with the signature
+  unsigned Shift; // bit position of the signature in first byte
+  unsigned IsEnd;
+};
+
+static CSigPrefix g_SigPrefixes[16];
+static Byte g_SigPairs[(1 << 16) / 8];
+
+static UInt64 GetSig48(const Byte *p)
+{
+  UInt64 v = 0;
+  for (unsigned i = 0; i < kSigSize; i++)
+    v = (v << 8) | p[i];
+  return v;
 }
 
-#ifndef _7ZIP_ST
+static struct CSigPrefixesInit
+{
+  CSigPrefixesInit()
+  {
+    const Byte blockSig[kSigSize] = { kBlockSig0, kBlockSig1, kBlockSig2, kBlockSig3, kBlockSig4, kBlockSig5 };
+    const Byte endSig[kSigSize] = { kFinSig0, kFinSig1, kFinSig2, kFinSig3, kFinSig4, kFinSig5 };
+    unsigned i = 0;
+    for (unsigned shift = 0; shift < 8; shift++)
+      for (unsigned isEnd = 0; isEnd < 2; isEnd++)
+      {
+        CSigPrefix &p = g_SigPrefixes[i++];
+        p.Sig = GetSig48(isEnd ? endSig : blockSig);
+        p.Pair = (UInt32)(p.Sig >> (24 + shift)) & 0xFFFF;
+        p.Shift = shift;
+        p.IsEnd = isEnd;
+        g_SigPairs[p.Pair >> 3] |= (Byte)(1 << (p.Pair & 7));
+      }
+  }
+} g_SigPrefixesInit;
 
-CDecoder::~CDecoder()
+/* Adds the signatures that start in bytes [start, end) of (buf) to (sigs)
+   as ((bit position) << 1) | isEnd. (buf) must contain 8 bytes from (end - 1). */
+
+static void FindSigs(const Byte *buf, size_t start, size_t end, UInt64 bufBits, CRecordVector<UInt64> &sigs)
 {
-  Free();
+  for (size_t i = start; i < end; i++)
+  {
+    const UInt32 pair = ((UInt32)buf[i + 1] << 8) | buf[i + 2];
+    if ((g_SigPairs[pair >> 3] & (1 << (pair & 7))) == 0)
+      continue;
+    UInt64 v = 0;
+    for (unsigned k = 0; k < 8; k++)
+      v = (v << 8) | buf[i + k];
+    for (unsigned k = 0; k < 16; k++)
+    {
+      const CSigPrefix &p = g_SigPrefixes[k];
+      if (p.Pair == pair && ((v >> (16 - p.Shift)) & (((UInt64)1 << 48) - 1)) == p.Sig)
+        sigs.Add(((bufBits + ((UInt64)i << 3) + p.Shift) << 1) | p.IsEnd);
+    }
+  }
 }
 
-#define RINOK_THREAD(x) { WRes __result_ = (x); if (__result_ != 0) return __result_; }
+struct CMtBlock
+{
+  UInt64 Pos;    // the position of block signature in bits
+  UInt64 EndPos; // the position after the block in bits
+  CByteBuffer In;
+  size_t InSize;
+  UInt32 Crc;
+  UInt32 DecodedCrc;
+  CBlockProps Props;
+  HRESULT Result;
+  bool Finished;
+
+  CDynBufSeqOutStream *OutSpec;
+  CMyComPtr<ISequentialOutStream> Out;
+
+  NWindows::NSynchronization::CAutoResetEvent Done;
+
+  CMtBlock()
+  {
+    OutSpec = new CDynBufSeqOutStream;
+    Out = OutSpec;
+  }
+};
 
-HRESULT CDecoder::Create()
+struct CMtScan
 {
-  RINOK_THREAD(CanProcessEvent.CreateIfNotCreated());
-  RINOK_THREAD(CanStartWaitingEvent.CreateIfNotCreated());
-  if (m_States != 0 && m_NumThreadsPrev == NumThreads)
-    return S_OK;
-  Free();
-  MtMode = (NumThreads > 1);
-  m_NumThreadsPrev = NumThreads;
+  size_t Start;
+  size_t End;
+  bool Error;
+  CRecordVector<UInt64> Sigs;
+};
+
+class CMtDecoder;
+
+struct CMtWorker
+{
+  CMtDecoder *Owner;
+  NWindows::CThread Thread;
+  CBase Base;
+  CState State;
+  COutBuffer OutStream;
+  CBufInStream *InSpec;
+  CMyComPtr<ISequentialInStream> In;
+
+  CMtWorker()
+  {
+    InSpec = new CBufInStream;
+    In = InSpec;
+  }
+
+  void ThreadFunc();
+  HRESULT Decode(CMtBlock &block);
+  HRESULT DecodeJob(CMtBlock &block);
+};
+
+// the data that was read by CMtDecoder, and then the rest of input stream
+
+class CMtRestStream:
+  public ISequentialInStream,
+  public CMyUnknownImp
+{
+public:
+  CByteBuffer Buf;
+  size_t Pos;
+  CMyComPtr<ISequentialInStream> Stream;
+
+  MY_UNKNOWN_IMP1(ISequentialInStream)
+  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
+};
+
+STDMETHODIMP CMtRestStream::Read(void *data, UInt32 size, UInt32 *processedSize)
+{
+  if (processedSize)
+    *processedSize = 0;
+  if (Pos == Buf.Size())
+    return Stream->Read(data, size, processedSize);
+  size_t rem = Buf.Size() - Pos;
+  if (size > rem)
+    size = (UInt32)rem;
+  memcpy(data, Buf + Pos, size);
+  Pos += size;
+  if (processedSize)
+    *processedSize = size;
+  return S_OK;
+}
+
+class CMtDecoder
+{
+  CObjectVector<CMtWorker> _workers;
+  CObjectVector<CMtBlock> _blocks;
+  CObjectVector<CMtScan> _scans;
+  CRecordVector<int> _tasks; // the index of block, or (-1 - index) of scan
+  unsigned _head;
+  unsigned _numBlocks;
+  unsigned _numScansRem;
+  bool _semIsCreated;
+  bool _exit;
+  NWindows::NSynchronization::CCriticalSection _cs;
+  NWindows::NSynchronization::CSemaphore _sem;
+  NWindows::NSynchronization::CAutoResetEvent _scanDone;
+
+  CMyComPtr<ISequentialInStream> _stream;
+  CByteBuffer _buf;
+  size_t _bufSize;
+  UInt64 _bufPos;  // the position of _buf[0] in input stream
+  UInt64 _scanPos; // all signatures that start before that position were found
+  bool _eof;
+  CRecordVector<UInt64> _sigs; // ((bit position) << 1) | isEnd
+  unsigned _sigsHead;          // the first signature that is not before ChainPos
+  unsigned _sigsNext;          // the signature for next job
+
+  bool GetTask(int &task);
+  bool GetScanTask(int &task);
+  void RunScan(unsigned index);
+  void WaitBlock(CMtBlock &block);
+  void CreateBlocks();
+  HRESULT Scan();
+  HRESULT ReadMore();
+  HRESULT Fill();
+  void SkipToChain();
+  friend struct CMtWorker;
+public:
+  UInt64 ChainPos; // the position (in bits) of next signature in the chain
+
+  CMtDecoder(): _head(0), _numBlocks(0), _numScansRem(0), _semIsCreated(false), _exit(false) {}
+  ~CMtDecoder() { Stop(); }
+
+  HRESULT Create(UInt32 numThreads);
+  void Stop();
+  UInt32 GetNumThreads() const { return _workers.Size(); }
+
+  void Init(ISequentialInStream *stream);
+  /* Finds the signature at ChainPos. For block signature it waits for the job
+     of that block. found == false, if there is no signature at ChainPos. */
+  HRESULT GetNext(bool &found, bool &isEnd, CMtBlock *&block);
+  void PopBlock()
+  {
+    if (++_head == _blocks.Size())
+      _head = 0;
+    _numBlocks--;
+  }
+  // avail == false, if the stream ends before the end of these bits
+  HRESULT ReadBits(UInt64 bitPos, unsigned numBits, UInt32 &value, bool &avail);
+  void GetRestStream(CMyComPtr<ISequentialInStream> &stream);
+  UInt64 GetStreamSize() const { return _bufPos + _bufSize; }
+};
+
+static THREAD_FUNC_DECL MtWorkerThread(void *p) { ((CMtWorker *)p)->ThreadFunc(); return 0; }
+
+HRESULT CMtDecoder::Create(UInt32 numThreads)
+{
+  const unsigned numBlocks = numThreads * 2;
+  for (unsigned i = 0; i < numBlocks; i++)
+  {
+    RINOK_THREAD(_blocks.AddNew().Done.CreateIfNotCreated());
+  }
+  RINOK_THREAD(_scanDone.CreateIfNotCreated());
+  // the caller's thread also takes the scan tasks, so there can be extra counts
+  RINOK_THREAD(_sem.Create(0, (UInt32)1 << 30));
+  _semIsCreated = true;
+  for (unsigned i = 0; i < numThreads; i++)
+  {
+    CMtWorker &worker = _workers.AddNew();
+    worker.Owner = this;
+    RINOK_THREAD(worker.Thread.Create(MtWorkerThread, &worker));
+  }
+  return S_OK;
+}
+
+void CMtDecoder::Stop()
+{
+  if (_exit)
+    return;
+  while (_numBlocks != 0)
+  {
+    WaitBlock(_blocks[_head]);
+    PopBlock();
+  }
+  {
+    NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+    _exit = true;
+  }
+  if (_semIsCreated && !_workers.IsEmpty())
+    _sem.Release(_workers.Size());
+  FOR_VECTOR (i, _workers)
+    if (_workers[i].Thread.IsCreated())
+      _workers[i].Thread.Wait();
+}
+
+bool CMtDecoder::GetTask(int &task)
+{
+  for (;;)
+  {
+    _sem.Lock();
+    NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+    if (_exit)
+      return false;
+    if (!_tasks.IsEmpty())
+    {
+      task = _tasks[0];
+      _tasks.Delete(0);
+      return true;
+    }
+  }
+}
+
+bool CMtDecoder::GetScanTask(int &task)
+{
+  NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+  if (_tasks.IsEmpty() || _tasks[0] >= 0)
+    return false;
+  task = _tasks[0];
+  _tasks.Delete(0);
+  return true;
+}
+
+void CMtDecoder::RunScan(unsigned index)
+{
+  CMtScan &scan = _scans[index];
   try
   {
-    m_States = new CState[NumThreads];
-    if (!m_States)
-      return E_OUTOFMEMORY;
+    FindSigs(_buf, scan.Start, scan.End, _bufPos << 3, scan.Sigs);
   }
+  catch(...) { scan.Error = true; }
+  bool finished;
+  {
+    NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+    finished = (--_numScansRem == 0);
+  }
+  if (finished)
+    _scanDone.Set();
+}
+
+void CMtWorker::ThreadFunc()
+{
+  for (;;)
+  {
+    int task;
+    if (!Owner->GetTask(task))
+      return;
+    if (task < 0)
+    {
+      Owner->RunScan((unsigned)(-1 - task));
+      continue;
+    }
+    CMtBlock &block = Owner->_blocks[task];
+    block.Result = DecodeJob(block);
+    block.Done.Set();
+  }
+}
+
+HRESULT CMtWorker::DecodeJob(CMtBlock &block)
+{
+  try
+  {
+    return Decode(block);
+  }
+  catch(const CInBufferException &e) { return e.ErrorCode; }
+  catch(const COutBufferException &e) { return e.ErrorCode; }
   catch(...) { return E_OUTOFMEMORY; }
-  for (UInt32 t = 0; t < NumThreads; t++)
+}
+
+HRESULT CMtWorker::Decode(CMtBlock &block)
+{
+  if (!State.Alloc() || !Base.BitDecoder.Create(kBufferSize) || !OutStream.Create(kBufferSize))
+    return E_OUTOFMEMORY;
+  InSpec->Init(block.In, block.InSize);
+  Base.BitDecoder.SetStream(In);
+  Base.BitDecoder.Init();
+  const unsigned shift = (unsigned)block.Pos & 7;
+  if (shift != 0)
+    Base.ReadBits(shift);
+  // the signature
+  Base.ReadBits(24);
+  Base.ReadBits(24);
+  UInt32 crc = 0;
+  for (unsigned i = 0; i < 4; i++)
+    crc = (crc << 8) | Base.ReadBits(8);
+  block.Crc = crc;
+
+  block.Props.randMode = true;
+  RINOK(Base.ReadBlock(State.Counters, kBlockSizeMax, &block.Props));
+  block.EndPos = (block.Pos & ~(UInt64)7) + Base.BitDecoder.GetProcessedBits();
+
+  DecodeBlock1(State.Counters, block.Props.blockSize);
+  block.OutSpec->Init();
+  OutStream.SetStream(block.Out);
+  OutStream.Init();
+  block.DecodedCrc = DecodeBlock(block.Props, State.Counters + 256, OutStream);
+  return OutStream.Flush();
+}
+
+void CMtDecoder::WaitBlock(CMtBlock &block)
+{
+  if (!block.Finished)
+  {
+    block.Done.Lock();
+    block.Finished = true;
+  }
+}
+
+void CMtDecoder::Init(ISequentialInStream *stream)
+{
+  while (_numBlocks != 0)
+  {
+    WaitBlock(_blocks[_head]);
+    PopBlock();
+  }
+  _stream = stream;
+  _bufSize = 0;
+  _bufPos = 0;
+  _scanPos = 0;
+  _eof = false;
+  _sigs.Clear();
+  _sigsHead = 0;
+  _sigsNext = 0;
+  ChainPos = 0;
+}
+
+HRESULT CMtDecoder::Scan()
+{
+  UInt64 end = GetStreamSize();
+  if (!_eof)
+  {
+    // the signature that starts in last bytes can continue in next data
+    if (end < kSigSize)
+      return S_OK;
+    end -= kSigSize;
+  }
+  if (end <= _scanPos)
+    return S_OK;
+
+  const size_t start = (size_t)(_scanPos - _bufPos);
+  const size_t size = (size_t)(end - _scanPos);
+  const unsigned numScans = (unsigned)((size + kMtScanSize - 1) / kMtScanSize);
+  while (_scans.Size() < numScans)
+    _scans.AddNew();
+  for (unsigned i = 0; i < numScans; i++)
+  {
+    CMtScan &scan = _scans[i];
+    scan.Start = start + (size_t)i * kMtScanSize;
+    scan.End = (i == numScans - 1) ? start + size : scan.Start + kMtScanSize;
+    scan.Error = false;
+    scan.Sigs.Clear();
+  }
+  _numScansRem = numScans;
   {
-    CState &ti = m_States[t];
-    ti.Decoder = this;
-    if (MtMode)
+    NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+    // the scan tasks are before the jobs of blocks
+    for (unsigned i = 1; i < numScans; i++)
+      _tasks.Insert(i - 1, -1 - (int)i);
+  }
+  if (numScans > 1)
+    _sem.Release(numScans - 1);
+  
+  RunScan(0);
+  int task;
+  while (GetScanTask(task))
+    RunScan((unsigned)(-1 - task));
+  _scanDone.Lock();
+
+  for (unsigned i = 0; i < numScans; i++)
+  {
+    if (_scans[i].Error)
+      return E_OUTOFMEMORY;
+    _sigs += _scans[i].Sigs;
+  }
+  _scanPos = end;
+  return S_OK;
+}
+
+HRESULT CMtDecoder::ReadMore()
+{
+  if (_buf.Size() - _bufSize < kMtReadSize + kMtPadSize)
+  {
+    // the data before ChainPos is not required
+    const size_t keep = (size_t)((ChainPos >> 3) - _bufPos);
+    if (keep != 0)
     {
-      HRESULT res = ti.Create();
-      if (res != S_OK)
+      memmove(_buf, _buf + keep, _bufSize - keep);
+      _bufSize -= keep;
+      _bufPos += keep;
+    }
+    const size_t need = _bufSize + kMtReadSize + kMtPadSize;
+    if (_buf.Size() < need)
+      _buf.ChangeSize_KeepData(need + (need >> 1), _bufSize);
+  }
+  size_t size = kMtReadSize;
+  RINOK(ReadStream(_stream, _buf + _bufSize, &size));
+  _bufSize += size;
+  memset(_buf + _bufSize, 0, kMtPadSize);
+  if (size != kMtReadSize)
+    _eof = true;
+  return Scan();
+}
+
+void CMtDecoder::CreateBlocks()
+{
+  while (_numBlocks != _blocks.Size() && _sigsNext < _sigs.Size())
+  {
+    const UInt64 sig = _sigs[_sigsNext];
+    if (sig & 1)
+    {
+      _sigsNext++;
+      continue;
+    }
+    const UInt64 pos = sig >> 1;
+    const UInt64 start = pos >> 3;
+    UInt64 end = GetStreamSize();
+    if (_sigsNext + 1 < _sigs.Size())
+    {
+      // the block must end at next signature
+      const UInt64 next = (_sigs[_sigsNext + 1] >> 4) + 1;
+      if (end > next)
+        end = next;
+    }
+    else if (!_eof && end - start < kMtBlockPackSizeMax)
+      break;
+    if (end - start > kMtBlockPackSizeMax)
+      end = start + kMtBlockPackSizeMax;
+
+    unsigned index = _head + _numBlocks;
+    if (index >= _blocks.Size())
+      index -= _blocks.Size();
+    CMtBlock &block = _blocks[index];
+    block.Pos = pos;
+    block.InSize = (size_t)(end - start);
+    block.In.AllocAtLeast(block.InSize);
+    memcpy(block.In, _buf + (size_t)(start - _bufPos), block.InSize);
+    block.Finished = false;
+    _numBlocks++;
+    _sigsNext++;
+    {
+      NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+      _tasks.Add((int)index);
+    }
+    _sem.Release();
+  }
+}
+
+HRESULT CMtDecoder::Fill()
+{
+  for (;;)
+  {
+    CreateBlocks();
+    if (_eof
+        || _numBlocks == _blocks.Size()
+        || GetStreamSize() - (ChainPos >> 3) >= (UInt64)_blocks.Size() * kMtBlockPackSizeMax)
+      return S_OK;
+    RINOK(ReadMore());
+  }
+}
+
+void CMtDecoder::SkipToChain()
+{
+  while (_sigsHead < _sigs.Size() && (_sigs[_sigsHead] >> 1) < ChainPos)
+    _sigsHead++;
+  if (_sigsNext < _sigsHead)
+    _sigsNext = _sigsHead;
+  if (_sigsHead >= (1 << 10))
+  {
+    _sigs.DeleteFrontal(_sigsHead);
+    _sigsNext -= _sigsHead;
+    _sigsHead = 0;
+  }
+  while (_numBlocks != 0 && _blocks[_head].Pos < ChainPos)
+  {
+    WaitBlock(_blocks[_head]);
+    PopBlock();
+  }
+}
+
+HRESULT CMtDecoder::GetNext(bool &found, bool &isEnd, CMtBlock *&block)
+{
+  found = false;
+  isEnd = false;
+  block = NULL;
+  for (;;)
+  {
+    RINOK(Fill());
+    SkipToChain();
+    if (_sigsHead < _sigs.Size())
+    {
+      const UInt64 sig = _sigs[_sigsHead];
+      if ((sig >> 1) != ChainPos)
+        return S_OK;
+      if (sig & 1)
       {
-        NumThreads = t;
-        Free();
-        return res;
+        found = isEnd = true;
+        return S_OK;
+      }
+      if (_numBlocks != 0)
+      {
+        CMtBlock &b = _blocks[_head];
+        if (b.Pos != ChainPos)
+          return S_OK;
+        WaitBlock(b);
+        found = true;
+        block = &b;
+        return S_OK;
       }
     }
+    else if ((ChainPos >> 3) < _scanPos)
+      return S_OK;
+    if (_eof)
+      return S_OK;
+    RINOK(ReadMore());
+  }
+}
+
+HRESULT CMtDecoder::ReadBits(UInt64 bitPos, unsigned numBits, UInt32 &value, bool &avail)
+{
+  value = 0;
+  avail = false;
+  while (GetStreamSize() < ((bitPos + numBits + 7) >> 3))
+  {
+    if (_eof)
+      return S_OK;
+    RINOK(ReadMore());
   }
+  for (unsigned i = 0; i < numBits; i++, bitPos++)
+  {
+    const unsigned b = _buf[(size_t)((bitPos >> 3) - _bufPos)];
+    value = (value << 1) | ((b >> (7 - ((unsigned)bitPos & 7))) & 1);
+  }
+  avail = true;
   return S_OK;
 }
 
-void CDecoder::Free()
+void CMtDecoder::GetRestStream(CMyComPtr<ISequentialInStream> &stream)
 {
-  if (!m_States)
-    return;
-  CloseThreads = true;
-  CanProcessEvent.Set();
-  for (UInt32 t = 0; t < NumThreads; t++)
+  while (_numBlocks != 0)
   {
-    CState &s = m_States[t];
-    if (MtMode)
-      s.Thread.Wait();
-    s.Free();
+    WaitBlock(_blocks[_head]);
+    PopBlock();
   }
-  delete []m_States;
-  m_States = 0;
+  CMtRestStream *spec = new CMtRestStream;
+  stream = spec;
+  const size_t pos = (size_t)((ChainPos >> 3) - _bufPos);
+  spec->Buf.CopyFrom(_buf + pos, _bufSize - pos);
+  spec->Pos = 0;
+  spec->Stream = _stream;
 }
 
 #endif
 
+CDecoder::CDecoder()
+{
+  #ifndef _7ZIP_ST
+  NumThreads = 1;
+  _mt = NULL;
+  _mtMode = false;
+  _mtOutSize = 0;
+  #endif
+  _inBase = 0;
+  _needInStreamInit = true;
+}
+
+#ifndef _7ZIP_ST
+
+CDecoder::~CDecoder()
+{
+  delete _mt;
+}
+
+#endif
+
+UInt64 CDecoder::GetStreamSize() const
+{
+  #ifndef _7ZIP_ST
+  if (_mtMode)
+    return _mt->GetStreamSize();
+  #endif
+  return _inBase + Base.BitDecoder.GetStreamSize();
+}
+
+UInt64 CDecoder::GetInputProcessedSize() const
+{
+  #ifndef _7ZIP_ST
+  if (_mtMode)
+    return _mt->ChainPos >> 3;
+  #endif
+  return _inBase + Base.BitDecoder.GetProcessedSize();
+}
+
+bool CDecoder::InputEofError() const
+{
+  #ifndef _7ZIP_ST
+  if (_mtMode)
+    return false;
+  #endif
+  return Base.BitDecoder.ExtraBitsWereRead();
+}
+
 bool IsEndSig(const Byte *p) throw()
 {
   return
@@ -547,28 +1158,122 @@ HRESULT CDecoder::ReadSignature(UInt32 &crc)
   return S_OK;
 }
 
-HRESULT CDecoder::DecodeFile(ICompressProgressInfo *progress)
+HRESULT CDecoder::DecodeBlocks(UInt32 dicSize)
 {
-  Progress = progress;
-  #ifndef _7ZIP_ST
-  RINOK(Create());
-  for (UInt32 t = 0; t < NumThreads; t++)
+  for (;;)
   {
-    CState &s = m_States[t];
-    if (!s.Alloc())
-      return E_OUTOFMEMORY;
-    if (MtMode)
+    RINOK(SetRatioProgress(GetInputProcessedSize()));
+    UInt32 crc;
+    RINOK(ReadSignature(crc));
+    if (BzWasFinished)
+      return S_OK;
+
+    CBlockProps props;
+    props.randMode = true;
+    RINOK(Base.ReadBlock(m_State.Counters, dicSize, &props));
+    DecodeBlock1(m_State.Counters, props.blockSize);
+    if (DecodeBlock(props, m_State.Counters + 256, m_OutStream) != crc)
     {
-      RINOK(s.StreamWasFinishedEvent.Reset());
-      RINOK(s.WaitingWasStartedEvent.Reset());
-      RINOK(s.CanWriteEvent.Reset());
+      CrcError = true;
+      return S_FALSE;
     }
   }
-  #else
-  if (!m_States[0].Alloc())
+}
+
+#ifndef _7ZIP_ST
+
+HRESULT CDecoder::SwitchToSerial(UInt64 bitPos)
+{
+  _mt->ChainPos = bitPos;
+  _mt->GetRestStream(_restStream);
+  _mtMode = false;
+  Base.BitDecoder.SetStream(_restStream);
+  Base.BitDecoder.Init();
+  _inBase = bitPos >> 3;
+  const unsigned shift = (unsigned)bitPos & 7;
+  if (shift != 0)
+    Base.ReadBits(shift);
+  if (!m_State.Alloc())
     return E_OUTOFMEMORY;
+  return S_OK;
+}
+
+HRESULT CDecoder::DecodeStreamMt(ISequentialOutStream *outStream)
+{
+  CMtDecoder &mt = *_mt;
+  UInt64 pos = mt.ChainPos;
+  bool avail;
+  UInt32 sig;
+  RINOK(mt.ReadBits(pos, 32, sig, avail));
+  const unsigned level = (unsigned)(sig & 0xFF);
+  if (!avail
+      || (sig >> 8) != (((UInt32)kArSig0 << 16) | ((UInt32)kArSig1 << 8) | kArSig2)
+      || level <= kArSig3
+      || level > kArSig3 + kBlockSizeMultMax)
+  {
+    // the single-threaded code reports the error
+    RINOK(SwitchToSerial(pos));
+    return DecodeFile(outStream, Progress);
+  }
+  const UInt32 dicSize = (UInt32)(level - kArSig3) * kBlockSizeStep;
+  pos += 32;
+  mt.ChainPos = pos;
+  CombinedCrc.Init();
+
+  for (;;)
+  {
+    RINOK(SetRatioProgress(pos >> 3));
+    bool found, isEnd;
+    CMtBlock *block;
+    RINOK(mt.GetNext(found, isEnd, block));
+    if (!found)
+      break;
+    if (isEnd)
+    {
+      UInt32 crc;
+      RINOK(mt.ReadBits(pos + kSigSize * 8, 32, crc, avail));
+      if (!avail || crc != CombinedCrc.GetDigest())
+        break;
+      IsBz = true;
+      BzWasFinished = true;
+      pos = (pos + (kSigSize + 4) * 8 + 7) & ~(UInt64)7;
+      mt.ChainPos = pos;
+      return SetRatioProgress(pos >> 3);
+    }
+    if (block->Result != S_OK
+        || block->Props.blockSize > dicSize
+        || block->DecodedCrc != block->Crc)
+      break;
+    IsBz = true;
+    CombinedCrc.Update(block->Crc);
+    Base.NumBlocks++;
+    const size_t size = block->OutSpec->GetSize();
+    RINOK(WriteStream(outStream, block->OutSpec->GetBuffer(), size));
+    _mtOutSize += size;
+    pos = block->EndPos;
+    mt.ChainPos = pos;
+    mt.PopBlock();
+  }
+
+  RINOK(SwitchToSerial(pos));
+  return DecodeBlocks(dicSize);
+}
+
+#endif
+
+HRESULT CDecoder::DecodeFile(ISequentialOutStream *outStream, ICompressProgressInfo *progress)
+{
+  Progress = progress;
+  #ifndef _7ZIP_ST
+  if (_mtMode)
+    return DecodeStreamMt(outStream);
+  #else
+  UNUSED_VAR(outStream)
   #endif
 
+  if (!m_State.Alloc())
+    return E_OUTOFMEMORY;
+
   IsBz = false;
 
   /*
@@ -593,52 +1298,7 @@ HRESULT CDecoder::DecodeFile(ICompressProgressInfo *progress)
   UInt32 dicSize = (UInt32)(s[3] - kArSig3) * kBlockSizeStep;
 
   CombinedCrc.Init();
-  #ifndef _7ZIP_ST
-  if (MtMode)
-  {
-    NextBlockIndex = 0;
-    StreamWasFinished1 = StreamWasFinished2 = false;
-    CloseThreads = false;
-    CanStartWaitingEvent.Reset();
-    m_States[0].CanWriteEvent.Set();
-    BlockSizeMax = dicSize;
-    Result1 = Result2 = S_OK;
-    CanProcessEvent.Set();
-    UInt32 t;
-    for (t = 0; t < NumThreads; t++)
-      m_States[t].StreamWasFinishedEvent.Lock();
-    CanProcessEvent.Reset();
-    CanStartWaitingEvent.Set();
-    for (t = 0; t < NumThreads; t++)
-      m_States[t].WaitingWasStartedEvent.Lock();
-    CanStartWaitingEvent.Reset();
-    RINOK(Result2);
-    RINOK(Result1);
-  }
-  else
-  #endif
-  {
-    CState &state = m_States[0];
-    for (;;)
-    {
-      RINOK(SetRatioProgress(Base.BitDecoder.GetProcessedSize()));
-      UInt32 crc;
-      RINOK(ReadSignature(crc));
-      if (BzWasFinished)
-        return S_OK;
-
-      CBlockProps props;
-      props.randMode = true;
-      RINOK(Base.ReadBlock(state.Counters, dicSize, &props));
-      DecodeBlock1(state.Counters, props.blockSize);
-      if (DecodeBlock(props, state.Counters + 256, m_OutStream) != crc)
-      {
-        CrcError = true;
-        return S_FALSE;
-      }
-    }
-  }
-  return SetRatioProgress(Base.BitDecoder.GetProcessedSize());
+  return DecodeBlocks(dicSize);
 }
 
 HRESULT CDecoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *outStream,
@@ -663,17 +1323,50 @@ HRESULT CDecoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *
 
   if (_needInStreamInit)
   {
-    Base.BitDecoder.Init();
+    _inBase = 0;
+    #ifndef _7ZIP_ST
+    _mtMode = false;
+    _restStream.Release();
+    if (NumThreads > 1)
+    {
+      if (_mt && _mt->GetNumThreads() != NumThreads)
+      {
+        delete _mt;
+        _mt = NULL;
+      }
+      if (!_mt)
+      {
+        CMtDecoder *mt = new CMtDecoder;
+        HRESULT res = mt->Create(NumThreads);
+        if (res != S_OK)
+        {
+          delete mt;
+          return res;
+        }
+        _mt = mt;
+      }
+      _mt->Init(inStream ? inStream : (ISequentialInStream *)Base.InStreamRef);
+      _mtMode = true;
+    }
+    else
+    #endif
+      Base.BitDecoder.Init();
     _needInStreamInit = false;
   }
-  _inStart = Base.BitDecoder.GetProcessedSize();
+  _inStart = GetInputProcessedSize();
 
-  Base.BitDecoder.AlignToByte();
+  #ifndef _7ZIP_ST
+  if (!_mtMode)
+  #endif
+    Base.BitDecoder.AlignToByte();
 
   m_OutStream.SetStream(outStream);
   m_OutStream.Init();
+  #ifndef _7ZIP_ST
+  _mtOutSize = 0;
+  #endif
 
-  RINOK(DecodeFile(progress));
+  RINOK(DecodeFile(outStream, progress));
   flusher.NeedFlush = false;
   return Flush();
 
@@ -710,122 +1403,6 @@ STDMETHODIMP CDecoder::ReleaseInStream()
 
 #ifndef _7ZIP_ST
 
-static THREAD_FUNC_DECL MFThread(void *p) { ((CState *)p)->ThreadFunc(); return 0; }
-
-HRESULT CState::Create()
-{
-  RINOK_THREAD(StreamWasFinishedEvent.CreateIfNotCreated());
-  RINOK_THREAD(WaitingWasStartedEvent.CreateIfNotCreated());
-  RINOK_THREAD(CanWriteEvent.CreateIfNotCreated());
-  RINOK_THREAD(Thread.Create(MFThread, this));
-  return S_OK;
-}
-
-void CState::FinishStream()
-{
-  Decoder->StreamWasFinished1 = true;
-  StreamWasFinishedEvent.Set();
-  Decoder->CS.Leave();
-  Decoder->CanStartWaitingEvent.Lock();
-  WaitingWasStartedEvent.Set();
-}
-
-void CState::ThreadFunc()
-{
-  for (;;)
-  {
-    Decoder->CanProcessEvent.Lock();
-    Decoder->CS.Enter();
-    if (Decoder->CloseThreads)
-    {
-      Decoder->CS.Leave();
-      return;
-    }
-    if (Decoder->StreamWasFinished1)
-    {
-      FinishStream();
-      continue;
-    }
-    HRESULT res = S_OK;
-
-    UInt32 blockIndex = Decoder->NextBlockIndex;
-    UInt32 nextBlockIndex = blockIndex + 1;
-    if (nextBlockIndex == Decoder->NumThreads)
-      nextBlockIndex = 0;
-    Decoder->NextBlockIndex = nextBlockIndex;
-    UInt32 crc;
-    UInt64 packSize = 0;
-    CBlockProps props;
-
-    try
-    {
-      res = Decoder->ReadSignature(crc);
-      if (res != S_OK)
-      {
-        Decoder->Result1 = res;
-        FinishStream();
-        continue;
-      }
-      if (Decoder->BzWasFinished)
-      {
-        Decoder->Result1 = res;
-        FinishStream();
-        continue;
-      }
-
-      props.randMode = true;
-      res = Decoder->Base.ReadBlock(Counters, Decoder->BlockSizeMax, &props);
-      if (res != S_OK)
-      {
-        Decoder->Result1 = res;
-        FinishStream();
-        continue;
-      }
-      packSize = Decoder->Base.BitDecoder.GetProcessedSize();
-    }
-    catch(const CInBufferException &e) { res = e.ErrorCode; if (res == S_OK) res = E_FAIL; }
-    catch(...) { res = E_FAIL; }
-    if (res != S_OK)
-    {
-      Decoder->Result1 = res;
-      FinishStream();
-      continue;
-    }
-
-    Decoder->CS.Leave();
-
-    DecodeBlock1(Counters, props.blockSize);
-
-    bool needFinish = true;
-    try
-    {
-      Decoder->m_States[blockIndex].CanWriteEvent.Lock();
-      needFinish = Decoder->StreamWasFinished2;
-      if (!needFinish)
-      {
-        if (DecodeBlock(props, Counters + 256, Decoder->m_OutStream) == crc)
-          res = Decoder->SetRatioProgress(packSize);
-        else
-          res = S_FALSE;
-      }
-    }
-    catch(const COutBufferException &e) { res = e.ErrorCode; if (res == S_OK) res = E_FAIL; }
-    catch(...) { res = E_FAIL; }
-    if (res != S_OK)
-    {
-      Decoder->Result2 = res;
-      Decoder->StreamWasFinished2 = true;
-    }
-    Decoder->m_States[nextBlockIndex].CanWriteEvent.Set();
-    if (res != S_OK || needFinish)
-    {
-      StreamWasFinishedEvent.Set();
-      Decoder->CanStartWaitingEvent.Lock();
-      WaitingWasStartedEvent.Set();
-    }
-  }
-}
-
 STDMETHODIMP CDecoder::SetNumberOfThreads(UInt32 numThreads)
 {
   NumThreads = numThreads;
@@ -844,6 +1421,9 @@ HRESULT CDecoder::SetRatioProgress(UInt64 packSize)
     return S_OK;
   packSize -= _inStart;
   UInt64 unpackSize = m_OutStream.GetProcessedSize();
+  #ifndef _7ZIP_ST
+  unpackSize += _mtOutSize;
+  #endif
   return Progress->SetRatioInfo(&packSize, &unpackSize);
 }
 
@@ -30,30 +30,14 @@ typedef NCompress::NHuffman::CDecoder<kMaxHuffmanLen, kMaxAlphaSize> CHuffmanDec
 
 class CDecoder;
 
+#ifndef _7ZIP_ST
+class CMtDecoder;
+#endif
+
 struct CState
 {
   UInt32 *Counters;
 
-  #ifndef _7ZIP_ST
-
-  CDecoder *Decoder;
-  NWindows::CThread Thread;
-  bool m_OptimizeNumTables;
-
-  NWindows::NSynchronization::CAutoResetEvent StreamWasFinishedEvent;
-  NWindows::NSynchronization::CAutoResetEvent WaitingWasStartedEvent;
-
-  // it's not member of this thread. We just need one event per thread
-  NWindows::NSynchronization::CAutoResetEvent CanWriteEvent;
-
-  Byte MtPad[1 << 8]; // It's pad for Multi-Threading. Must be >= Cache_Line_Size.
-
-  HRESULT Create();
-  void FinishStream();
-  void ThreadFunc();
-
-  #endif
-
   CState(): Counters(0) {}
   ~CState() { Free(); }
   bool Alloc();
@@ -112,10 +96,26 @@ public:
 private:
 
   bool _needInStreamInit;
+  UInt64 _inBase; // the position of Base.BitDecoder stream in input stream
+
+  CState m_State;
+
+  #ifndef _7ZIP_ST
+  UInt32 NumThreads;
+  CMtDecoder *_mt;
+  bool _mtMode;
+  UInt64 _mtOutSize;
+  CMyComPtr<ISequentialInStream> _restStream;
+
+  HRESULT DecodeStreamMt(ISequentialOutStream *outStream);
+  HRESULT SwitchToSerial(UInt64 bitPos);
+  friend class CMtDecoder;
+  #endif
 
   Byte ReadByte();
 
-  HRESULT DecodeFile(ICompressProgressInfo *progress);
+  HRESULT DecodeBlocks(UInt32 dicSize);
+  HRESULT DecodeFile(ISequentialOutStream *outStream, ICompressProgressInfo *progress);
   HRESULT CodeReal(ISequentialInStream *inStream, ISequentialOutStream *outStream, ICompressProgressInfo *progress);
   
   class CDecoderFlusher
@@ -136,30 +136,7 @@ public:
   ICompressProgressInfo *Progress;
 
   #ifndef _7ZIP_ST
-  CState *m_States;
-  UInt32 m_NumThreadsPrev;
-
-  NWindows::NSynchronization::CManualResetEvent CanProcessEvent;
-  NWindows::NSynchronization::CCriticalSection CS;
-  UInt32 NumThreads;
-  bool MtMode;
-  UInt32 NextBlockIndex;
-  bool CloseThreads;
-  bool StreamWasFinished1;
-  bool StreamWasFinished2;
-  NWindows::NSynchronization::CManualResetEvent CanStartWaitingEvent;
-
-  HRESULT Result1;
-  HRESULT Result2;
-
-  UInt32 BlockSizeMax;
-
   ~CDecoder();
-  HRESULT Create();
-  void Free();
-
-  #else
-  CState m_States[1];
   #endif
 
   bool IsBz;
@@ -190,8 +167,9 @@ public:
 
   HRESULT CodeResume(ISequentialOutStream *outStream, ICompressProgressInfo *progress);
 
-  UInt64 GetStreamSize() const { return Base.BitDecoder.GetStreamSize(); }
-  UInt64 GetInputProcessedSize() const { return Base.BitDecoder.GetProcessedSize(); }
+  UInt64 GetStreamSize() const;
+  UInt64 GetInputProcessedSize() const;
+  bool InputEofError() const;
 
   void InitNumBlocks() { Base.InitNumBlocks(); }
   UInt64 GetNumBlocks() const { return Base.NumBlocks; }
@@ -18,6 +18,9 @@ const unsigned kMaxHuffmanLenForEncoding = 16; // it must be < kMaxHuffmanLen =
 static const UInt32 kBufferSize = (1 << 17);
 static const unsigned kNumHuffPasses = 4;
 
+static const UInt32 kSaIsBlockSizeMin = (UInt32)1 << 16;
+static const UInt32 kSaIsGroupSizeMin = 256;
+
 bool CThreadInfo::Alloc()
 {
   if (m_BlockSorterIndex == 0)
@@ -265,13 +268,40 @@ void CEncoder::WriteCrc(UInt32 v)
 }
 
 
+/*
+  BlockSort() sorts the rotations by their first 2 bytes with radix sort, and then
+  it sorts the groups of same 2 bytes. It's fast for high-entropy data, but it's slow,
+  if the groups are large and the rotations in them have long common prefixes.
+  BlockSort_SaIs() works in linear time. So it's used for large blocks, if the
+  expected size of group for random position is large:
+    (sum of squares of group sizes) / blockSize.
+  (counters) is temp buffer for (1 << 16) items.
+*/
+
+static bool UseSaIs(const Byte *block, UInt32 blockSize, UInt32 *counters)
+{
+  if (blockSize < kSaIsBlockSizeMin)
+    return false;
+  UInt32 i;
+  for (i = 0; i < (1 << 16); i++)
+    counters[i] = 0;
+  for (i = 0; i < blockSize - 1; i++)
+    counters[((UInt32)block[i] << 8) | block[i + 1]]++;
+  UInt64 sum = 0;
+  for (i = 0; i < (1 << 16); i++)
+    sum += (UInt64)counters[i] * counters[i];
+  return sum >= (UInt64)blockSize * kSaIsGroupSizeMin;
+}
+
 // blockSize > 0
 void CThreadInfo::EncodeBlock(const Byte *block, UInt32 blockSize)
 {
   WriteBit2(0); // Randomised = false
   
   {
-    UInt32 origPtr = BlockSort(m_BlockSorterIndex, block, blockSize);
+    UInt32 origPtr = UseSaIs(block, blockSize, m_BlockSorterIndex) ?
+        BlockSort_SaIs(m_BlockSorterIndex, block, blockSize) :
+        BlockSort(m_BlockSorterIndex, block, blockSize);
     // if (m_BlockSorterIndex[origPtr] != 0) throw 1;
     m_BlockSorterIndex[origPtr] = blockSize;
     WriteBits2(origPtr, kNumOrigBits);
@@ -40,6 +40,7 @@ public:
 
   UInt64 GetStreamSize() const { return _stream.GetStreamSize(); }
   UInt64 GetProcessedSize() const { return _stream.GetProcessedSize() - ((kNumBigValueBits - _bitPos) >> 3); }
+  UInt64 GetProcessedBits() const { return (_stream.GetProcessedSize() << 3) - (kNumBigValueBits - _bitPos); }
 
   bool ThereAreDataInBitsBuffer() const { return this->_bitPos != kNumBigValueBits; }
 
@@ -123,6 +124,47 @@ public:
 
   Byte ReadDirectByte() { return this->_stream.ReadByte(); }
 
+  /* The direct access to the input for fast decoding loops (TInByte is CInBuffer).
+     BeginDirect() moves the stream back to the byte after the byte that contains the first
+     unread bit, and returns the unread bits of that byte in (bits) and (numBits < 8).
+     It returns false without changes, if these bytes are not in buffer now,
+     or if there are less than (minAvail) bytes after (cur).
+     EndDirect() continues the stream from (cur), where (numBits) last bits before (cur) are unread. */
+  bool BeginDirect(const Byte *&cur, const Byte *&lim, UInt64 &bits, unsigned &numBits, size_t minAvail)
+  {
+    if (this->_stream.NumExtraBytes != 0)
+      return false;
+    const unsigned num = kNumBigValueBits - this->_bitPos;
+    const Byte *pos = this->_stream.GetBufPos();
+    if ((size_t)(pos - this->_stream.GetBufBase()) < ((num + 7) >> 3))
+      return false;
+    pos -= num >> 3;
+    lim = this->_stream.GetBufLim();
+    if ((size_t)(lim - pos) < minAvail)
+      return false;
+    this->_stream.SetBufPos(pos);
+    cur = pos;
+    numBits = num & 7;
+    bits = _normalValue & (((UInt32)1 << numBits) - 1);
+    return true;
+  }
+
+  void EndDirect(const Byte *cur, unsigned numBits)
+  {
+    cur -= numBits >> 3;
+    numBits &= 7;
+    this->_stream.SetBufPos(cur);
+    this->_bitPos = kNumBigValueBits - numBits;
+    _normalValue = 0;
+    this->_value = 0;
+    if (numBits != 0)
+    {
+      const Byte b = cur[-1];
+      _normalValue = (UInt32)b >> (8 - numBits);
+      this->_value = kInvertTable[b];
+    }
+  }
+
   Byte ReadAlignedByte()
   {
     if (this->_bitPos == kNumBigValueBits)
@@ -36,6 +36,7 @@ public:
   
   UInt64 GetStreamSize() const { return _stream.GetStreamSize(); }
   UInt64 GetProcessedSize() const { return _stream.GetProcessedSize() - ((kNumBigValueBits - _bitPos) >> 3); }
+  UInt64 GetProcessedBits() const { return (_stream.GetProcessedSize() << 3) - (kNumBigValueBits - _bitPos); }
 
   bool ExtraBitsWereRead() const
   {
@@ -0,0 +1,29 @@
+// Compress/DedupConst.h
+
+#ifndef __COMPRESS_DEDUP_CONST_H
+#define __COMPRESS_DEDUP_CONST_H
+
+/*
+  Dedup stream is a sequence of records. Each record starts with a header,
+  that is a number in 7-bit groups (low group first, 0x80 flag for next group):
+    (len << 1)     : (len) bytes of literal data follow.
+    (len << 1) | 1 : (dist - 1) follows as number: copy (len) bytes from
+                     (dist) bytes back in the output.
+    0              : end of stream.
+  The property is one byte: log2 of the window. (dist) can't exceed the window.
+*/
+
+namespace NCompress {
+namespace NDedup {
+
+const unsigned kNumWindowBitsMin = 22;
+const unsigned kNumWindowBitsMax = 31;
+const unsigned kNumWindowBitsDefault = 30;
+
+const unsigned kPropsSize = 1;
+
+const unsigned kNumNumberBytesMax = 10;
+
+}}
+
+#endif
@@ -0,0 +1,156 @@
+// DedupDecoder.cpp
+
+#include "StdAfx.h"
+
+#include "DedupConst.h"
+#include "DedupDecoder.h"
+
+namespace NCompress {
+namespace NDedup {
+
+static const UInt32 kInBufSize = (UInt32)1 << 20;
+static const UInt64 kProgressStep = (UInt64)1 << 22;
+
+// the copies of CLzOutWindow::CopyBlock() are split to these pieces
+static const UInt32 kCopyStep = (UInt32)1 << 30;
+
+bool CDecoder::ReadNumber(UInt64 &v)
+{
+  v = 0;
+  for (unsigned i = 0; i < kNumNumberBytesMax; i++)
+  {
+    Byte b;
+    if (!_inStream.ReadByte(b))
+      return false;
+    v |= (UInt64)(b & 0x7F) << (7 * i);
+    if ((b & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+STDMETHODIMP CDecoder::SetDecoderProperties2(const Byte *props, UInt32 size)
+{
+  if (size < kPropsSize)
+    return E_NOTIMPL;
+  if (props[0] < kNumWindowBitsMin || props[0] > kNumWindowBitsMax)
+    return E_NOTIMPL;
+  _numWindowBits = props[0];
+  return S_OK;
+}
+
+STDMETHODIMP CDecoder::SetFinishMode(UInt32 finishMode)
+{
+  _finishMode = (finishMode != 0);
+  return S_OK;
+}
+
+HRESULT CDecoder::CodeReal(const UInt64 *outSize, ICompressProgressInfo *progress)
+{
+  UInt64 processed = 0;
+  UInt64 nextProgress = kProgressStep;
+
+  for (;;)
+  {
+    // a partial decoding (7z extracts the first items of a solid block) stops at (outSize)
+    if (outSize && !_finishMode && processed == *outSize)
+      break;
+
+    UInt64 header;
+    if (!ReadNumber(header))
+      return S_FALSE;
+    if (header == 0)
+      break;
+
+    UInt64 len = header >> 1;
+    if (outSize && len > *outSize - processed)
+    {
+      if (_finishMode)
+        return S_FALSE;
+      len = *outSize - processed;
+    }
+
+    if ((header & 1) != 0)
+    {
+      UInt64 distance;
+      if (!ReadNumber(distance))
+        return S_FALSE;
+      if (distance >= processed || distance >= ((UInt64)1 << _numWindowBits))
+        return S_FALSE;
+      for (UInt64 rem = len; rem != 0;)
+      {
+        UInt32 cur = (rem > kCopyStep) ? kCopyStep : (UInt32)rem;
+        if (!_outWindow.CopyBlock((UInt32)distance, cur))
+          return S_FALSE;
+        rem -= cur;
+      }
+    }
+    else
+    {
+      // the literals are read straight to the window
+      for (UInt64 rem = len; rem != 0;)
+      {
+        UInt32 pos = _outWindow.GetPos();
+        UInt32 cur = _outWindow.GetLimitPos() - pos;
+        if (cur > rem)
+          cur = (UInt32)rem;
+        UInt32 read = (UInt32)_inStream.ReadBytes(_outWindow.GetBuf() + pos, cur);
+        _outWindow.SetPos(pos + read);
+        if (pos + read == _outWindow.GetLimitPos())
+          _outWindow.FlushWithCheck();
+        if (read != cur)
+          return S_FALSE;
+        rem -= cur;
+      }
+    }
+
+    processed += len;
+    if (progress && processed >= nextProgress)
+    {
+      nextProgress = processed + kProgressStep;
+      UInt64 packSize = _inStream.GetProcessedSize();
+      RINOK(progress->SetRatioInfo(&packSize, &processed));
+    }
+  }
+
+  if (outSize && processed != *outSize)
+    return S_FALSE;
+  return S_OK;
+}
+
+STDMETHODIMP CDecoder::Code(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+    const UInt64 * /* inSize */, const UInt64 *outSize, ICompressProgressInfo *progress)
+{
+  if (_numWindowBits == 0)
+    return E_INVALIDARG;
+  try
+  {
+    // the window is not larger than the data: small streams don't allocate the whole window
+    UInt32 windowSize = (UInt32)1 << _numWindowBits;
+    if (outSize && *outSize < windowSize)
+      windowSize = (UInt32)*outSize;
+
+    if (!_outWindow.Create(windowSize))
+      return E_OUTOFMEMORY;
+    if (!_inStream.Create(kInBufSize))
+      return E_OUTOFMEMORY;
+
+    _outWindow.SetStream(outStream);
+    _outWindow.Init(false);
+    _inStream.SetStream(inStream);
+    _inStream.Init();
+
+    HRESULT res = CodeReal(outSize, progress);
+    HRESULT res2 = _outWindow.Flush();
+    _outWindow.SetStream(NULL);
+    _inStream.SetStream(NULL);
+    if (res != S_OK)
+      return res;
+    return res2;
+  }
+  catch(const CInBufferException &e) { return e.ErrorCode; }
+  catch(const CLzOutWindowException &e) { return e.ErrorCode; }
+  catch(...) { return S_FALSE; }
+}
+
+}}
@@ -0,0 +1,44 @@
+// DedupDecoder.h
+
+#ifndef __COMPRESS_DEDUP_DECODER_H
+#define __COMPRESS_DEDUP_DECODER_H
+
+#include "../../Common/MyCom.h"
+
+#include "../ICoder.h"
+
+#include "../Common/InBuffer.h"
+
+#include "LzOutWindow.h"
+
+namespace NCompress {
+namespace NDedup {
+
+class CDecoder:
+  public ICompressCoder,
+  public ICompressSetDecoderProperties2,
+  public ICompressSetFinishMode,
+  public CMyUnknownImp
+{
+  CLzOutWindow _outWindow;
+  CInBuffer _inStream;
+  unsigned _numWindowBits;
+  bool _finishMode;
+
+  bool ReadNumber(UInt64 &v);
+  HRESULT CodeReal(const UInt64 *outSize, ICompressProgressInfo *progress);
+
+public:
+  MY_UNKNOWN_IMP2(ICompressSetDecoderProperties2, ICompressSetFinishMode)
+
+  STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+      const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD(SetDecoderProperties2)(const Byte *data, UInt32 size);
+  STDMETHOD(SetFinishMode)(UInt32 finishMode);
+
+  CDecoder(): _numWindowBits(0), _finishMode(false) {}
+};
+
+}}
+
+#endif
@@ -0,0 +1,466 @@
+// DedupEncoder.cpp
+
+#include "StdAfx.h"
+
+#include <string.h>
+
+#include "../../../C/Alloc.h"
+#include "../../../C/CpuArch.h"
+
+#include "../Common/StreamUtils.h"
+
+#include "DedupConst.h"
+#include "DedupEncoder.h"
+
+namespace NCompress {
+namespace NDedup {
+
+static const unsigned kNumChunkBitsMin = 10;
+static const unsigned kNumChunkBitsMax = 16;
+static const unsigned kNumChunkBitsDefault = 13;
+
+static const size_t kInBufSizeMin = (size_t)1 << 20;
+static const size_t kLitsMin = (size_t)1 << 18;
+static const UInt64 kProgressStep = (UInt64)1 << 22;
+
+static const UInt64 kHashMul = UINT64_CONST(0x9E3779B97F4A7C15);
+
+static UInt64 g_Gear[256];
+
+static struct CGearTableInit
+{
+  CGearTableInit()
+  {
+    // splitmix64: the boundaries must not depend on the build
+    UInt64 x = 0;
+    for (unsigned i = 0; i < 256; i++)
+    {
+      UInt64 z = (x += kHashMul);
+      z = (z ^ (z >> 30)) * UINT64_CONST(0xBF58476D1CE4E5B9);
+      z = (z ^ (z >> 27)) * UINT64_CONST(0x94D049BB133111EB);
+      g_Gear[i] = z ^ (z >> 31);
+    }
+  }
+} g_GearTableInit;
+
+// the gear hash shifts to the left, so its high bits depend on the most bytes
+static inline UInt64 GetHighMask(unsigned numBits)
+{
+  return (((UInt64)1 << numBits) - 1) << (64 - numBits);
+}
+
+static UInt64 GetChunkHash(const Byte *p, size_t size)
+{
+  UInt64 h = (UInt64)size * kHashMul;
+  for (; size >= 8; size -= 8, p += 8)
+  {
+    h = (h ^ GetUi64(p)) * kHashMul;
+    h ^= h >> 32;
+  }
+  for (; size != 0; size--)
+    h = (h ^ *p++) * kHashMul;
+  return h ^ (h >> 29);
+}
+
+static size_t GetSameLen(const Byte *a, const Byte *b, size_t size)
+{
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+    if (GetUi64(a + i) != GetUi64(b + i))
+      break;
+  for (; i < size; i++)
+    if (a[i] != b[i])
+      break;
+  return i;
+}
+
+CEncoder::CEncoder():
+    _numWindowBits(kNumWindowBitsDefault),
+    _numChunkBits(kNumChunkBitsDefault),
+    _reduceSize((UInt64)(Int64)-1),
+    _win(NULL),
+    _winSize(0),
+    _inBuf(NULL),
+    _inBufSize(0),
+    _outBuf(NULL),
+    _outBufSize(0),
+    _table(NULL),
+    _tableSize(0),
+    _inStream(NULL)
+{
+}
+
+CEncoder::~CEncoder()
+{
+  Free();
+}
+
+void CEncoder::Free()
+{
+  ::BigFree(_win);
+  _win = NULL;
+  ::MidFree(_table);
+  _table = NULL;
+  ::MyFree(_inBuf);
+  _inBuf = NULL;
+  ::MyFree(_outBuf);
+  _outBuf = NULL;
+  _winSize = 0;
+  _tableSize = 0;
+  _inBufSize = 0;
+  _outBufSize = 0;
+}
+
+unsigned CEncoder::GetNumWindowBits() const
+{
+  unsigned numBits = _numWindowBits;
+  while (numBits > kNumWindowBitsMin && ((UInt64)1 << (numBits - 1)) >= _reduceSize)
+    numBits--;
+  return numBits;
+}
+
+bool CEncoder::Alloc()
+{
+  unsigned numWindowBits = GetNumWindowBits();
+  size_t winSize = (size_t)1 << numWindowBits;
+  size_t tableSize = (size_t)1 << (numWindowBits - _numChunkBits + 1);
+  size_t avgChunk = (size_t)1 << _numChunkBits;
+
+  _minChunk = avgChunk >> 2;
+  _maxChunk = avgChunk << 3;
+  _maskS = GetHighMask(_numChunkBits + 1);
+  _maskL = GetHighMask(_numChunkBits - 1);
+  _maxLits = (kLitsMin > _maxChunk * 2) ? kLitsMin : _maxChunk * 2;
+
+  size_t inBufSize = (kInBufSizeMin > _maxChunk * 4) ? kInBufSizeMin : _maxChunk * 4;
+  // one step writes up to (_maxLits) literals and two records, and the buffer is written out from (_maxLits)
+  size_t outBufSize = _maxLits * 2 + kNumNumberBytesMax * 4;
+
+  if (_winSize != winSize || _tableSize != tableSize || _inBufSize != inBufSize || _outBufSize != outBufSize)
+  {
+    Free();
+    _win = (Byte *)::BigAlloc(winSize);
+    _table = (CChunkRef *)::MidAlloc(tableSize * sizeof(CChunkRef));
+    _inBuf = (Byte *)::MyAlloc(inBufSize);
+    _outBuf = (Byte *)::MyAlloc(outBufSize);
+    if (!_win || !_table || !_inBuf || !_outBuf)
+    {
+      Free();
+      return false;
+    }
+    _winSize = winSize;
+    _tableSize = tableSize;
+    _inBufSize = inBufSize;
+    _outBufSize = outBufSize;
+  }
+  memset(_table, 0, _tableSize * sizeof(CChunkRef));
+  return true;
+}
+
+HRESULT CEncoder::ReadIn()
+{
+  size_t rem = _inLim - _inPos;
+  if (_inPos != 0)
+  {
+    memmove(_inBuf, _inBuf + _inPos, rem);
+    _inPos = 0;
+    _inLim = rem;
+  }
+  size_t size = _inBufSize - _inLim;
+  size_t req = size;
+  RINOK(ReadStream(_inStream, _inBuf + _inLim, &size));
+  _inLim += size;
+  if (size != req)
+    _inFinished = true;
+  return S_OK;
+}
+
+/* FastCDC normalized chunking: no boundary before (_minChunk), the stricter mask
+   before the average size and the looser one after it, the cut at (_maxChunk). */
+
+size_t CEncoder::FindChunk(const Byte *p, size_t size) const
+{
+  if (size <= _minChunk)
+    return size;
+  size_t limit = (size < _maxChunk) ? size : _maxChunk;
+  size_t normal = (size_t)1 << _numChunkBits;
+  if (normal > limit)
+    normal = limit;
+  UInt64 fp = 0;
+  size_t i = _minChunk;
+  for (; i < normal; i++)
+  {
+    fp = (fp << 1) + g_Gear[p[i]];
+    if ((fp & _maskS) == 0)
+      return i + 1;
+  }
+  for (; i < limit; i++)
+  {
+    fp = (fp << 1) + g_Gear[p[i]];
+    if ((fp & _maskL) == 0)
+      return i + 1;
+  }
+  return limit;
+}
+
+// the number of the first bytes of (p) that are equal to the window from (pos)
+size_t CEncoder::GetMatchLen(const Byte *p, UInt64 pos, size_t size) const
+{
+  size_t len = 0;
+  while (len < size)
+  {
+    size_t offset = (size_t)(pos + len) & (_winSize - 1);
+    size_t cur = _winSize - offset;
+    if (cur > size - len)
+      cur = size - len;
+    size_t same = GetSameLen(p + len, _win + offset, cur);
+    len += same;
+    if (same != cur)
+      break;
+  }
+  return len;
+}
+
+void CEncoder::CopyToWindow(const Byte *p, size_t size)
+{
+  while (size != 0)
+  {
+    size_t offset = (size_t)_pos & (_winSize - 1);
+    size_t cur = _winSize - offset;
+    if (cur > size)
+      cur = size;
+    memcpy(_win + offset, p, cur);
+    p += cur;
+    size -= cur;
+    _pos += cur;
+  }
+}
+
+void CEncoder::WriteNumber(UInt64 v)
+{
+  while (v >= 0x80)
+  {
+    _outBuf[_outPos++] = (Byte)(v | 0x80);
+    v >>= 7;
+  }
+  _outBuf[_outPos++] = (Byte)v;
+}
+
+// the pending literals are still in the window: (_maxLits) is much smaller than the window
+void CEncoder::FlushLits()
+{
+  if (_litLen == 0)
+    return;
+  WriteNumber((UInt64)_litLen << 1);
+  size_t rem = _litLen;
+  UInt64 pos = _litStart;
+  while (rem != 0)
+  {
+    size_t offset = (size_t)pos & (_winSize - 1);
+    size_t cur = _winSize - offset;
+    if (cur > rem)
+      cur = rem;
+    memcpy(_outBuf + _outPos, _win + offset, cur);
+    _outPos += cur;
+    pos += cur;
+    rem -= cur;
+  }
+  _litLen = 0;
+}
+
+void CEncoder::FlushMatch()
+{
+  if (_matchLen == 0)
+    return;
+  WriteNumber((_matchLen << 1) | 1);
+  WriteNumber(_matchDist - 1);
+  _matchLen = 0;
+}
+
+/* There is a pending copy only if there are no pending literals,
+   so the records are written in the order of the data. */
+
+HRESULT CEncoder::CodeStep(bool &finished)
+{
+  if (!_inFinished && _inLim - _inPos < _maxChunk)
+  {
+    RINOK(ReadIn());
+  }
+  const Byte *p = _inBuf + _inPos;
+  size_t avail = _inLim - _inPos;
+  if (avail == 0)
+  {
+    FlushMatch();
+    FlushLits();
+    WriteNumber(0);
+    finished = true;
+    return S_OK;
+  }
+
+  // the copy goes on while the data matches, over the chunk boundaries
+  if (_matchLen != 0)
+  {
+    size_t len = avail;
+    if (len > _matchDist)
+      len = (size_t)_matchDist;
+    len = GetMatchLen(p, _pos - _matchDist, len);
+    if (len != 0)
+    {
+      CopyToWindow(p, len);
+      _inPos += len;
+      _matchLen += len;
+      return S_OK;
+    }
+  }
+
+  size_t size = FindChunk(p, avail);
+  UInt64 hash = GetChunkHash(p, size);
+  UInt32 check = (UInt32)(hash >> 32);
+  CChunkRef &ref = _table[(size_t)hash & (_tableSize - 1)];
+
+  if (ref.Size == size && ref.Check == check && _pos - ref.Pos <= _winSize)
+  {
+    UInt64 dist = _pos - ref.Pos;
+    size_t len = avail;
+    if (len > dist)
+      len = (size_t)dist;
+    len = GetMatchLen(p, ref.Pos, len);
+    if (len >= size)
+    {
+      size_t back = 0;
+      const size_t mask = _winSize - 1;
+      while (back < _litLen && back < ref.Pos && dist + back < _winSize
+          && _win[(size_t)(ref.Pos - back - 1) & mask] == _win[(size_t)(_pos - back - 1) & mask])
+        back++;
+      _litLen -= back;
+      FlushMatch();
+      FlushLits();
+      _matchDist = dist;
+      _matchLen = len + back;
+      ref.Pos = _pos;
+      CopyToWindow(p, len);
+      _inPos += len;
+      return S_OK;
+    }
+  }
+
+  FlushMatch();
+  if (_litLen + size > _maxLits)
+    FlushLits();
+  if (_litLen == 0)
+    _litStart = _pos;
+  _litLen += size;
+  ref.Pos = _pos;
+  ref.Check = check;
+  ref.Size = (UInt32)size;
+  CopyToWindow(p, size);
+  _inPos += size;
+  return S_OK;
+}
+
+STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+    const UInt64 * /* inSize */, const UInt64 * /* outSize */, ICompressProgressInfo *progress)
+{
+  if (!Alloc())
+    return E_OUTOFMEMORY;
+
+  _inStream = inStream;
+  _inPos = 0;
+  _inLim = 0;
+  _inFinished = false;
+  _outPos = 0;
+  _pos = 0;
+  _litLen = 0;
+  _matchDist = 0;
+  _matchLen = 0;
+
+  UInt64 outProcessed = 0;
+  UInt64 nextProgress = kProgressStep;
+  HRESULT res = S_OK;
+
+  for (;;)
+  {
+    bool finished = false;
+    res = CodeStep(finished);
+    if (res != S_OK)
+      break;
+    if (finished || _outPos >= _maxLits)
+    {
+      res = WriteStream(outStream, _outBuf, _outPos);
+      if (res != S_OK)
+        break;
+      outProcessed += _outPos;
+      _outPos = 0;
+    }
+    if (finished)
+      break;
+    if (progress && _pos >= nextProgress)
+    {
+      nextProgress = _pos + kProgressStep;
+      res = progress->SetRatioInfo(&_pos, &outProcessed);
+      if (res != S_OK)
+        break;
+    }
+  }
+
+  _inStream = NULL;
+  return res;
+}
+
+STDMETHODIMP CEncoder::SetCoderProperties(const PROPID *propIDs, const PROPVARIANT *coderProps, UInt32 numProps)
+{
+  unsigned numWindowBits = kNumWindowBitsDefault;
+  unsigned numChunkBits = kNumChunkBitsDefault;
+  UInt64 reduceSize = (UInt64)(Int64)-1;
+
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    const PROPVARIANT &prop = coderProps[i];
+    PROPID propID = propIDs[i];
+    if (propID > NCoderPropID::kReduceSize)
+      continue;
+    if (propID == NCoderPropID::kReduceSize)
+    {
+      if (prop.vt == VT_UI8)
+        reduceSize = prop.uhVal.QuadPart;
+      else if (prop.vt == VT_UI4)
+        reduceSize = prop.ulVal;
+      continue;
+    }
+    if (prop.vt != VT_UI4)
+      return E_INVALIDARG;
+    UInt32 v = (UInt32)prop.ulVal;
+    switch (propID)
+    {
+      case NCoderPropID::kDictionarySize:
+        for (numWindowBits = kNumWindowBitsMin; numWindowBits < kNumWindowBitsMax; numWindowBits++)
+          if (((UInt32)1 << numWindowBits) >= v)
+            break;
+        break;
+      case NCoderPropID::kBlockSize:
+        for (numChunkBits = kNumChunkBitsMin; numChunkBits < kNumChunkBitsMax; numChunkBits++)
+          if (((UInt32)1 << numChunkBits) >= v)
+            break;
+        break;
+      case NCoderPropID::kNumThreads: break;
+      case NCoderPropID::kLevel: break;
+      default: return E_INVALIDARG;
+    }
+  }
+
+  if (sizeof(size_t) < 8 && numWindowBits > 30)
+    numWindowBits = 30;
+  _numWindowBits = numWindowBits;
+  _numChunkBits = numChunkBits;
+  _reduceSize = reduceSize;
+  return S_OK;
+}
+
+STDMETHODIMP CEncoder::WriteCoderProperties(ISequentialOutStream *outStream)
+{
+  Byte props[kPropsSize];
+  props[0] = (Byte)GetNumWindowBits();
+  return WriteStream(outStream, props, kPropsSize);
+}
+
+}}
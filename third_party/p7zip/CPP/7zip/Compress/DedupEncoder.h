@@ -0,0 +1,92 @@
+// DedupEncoder.h
+
+#ifndef __COMPRESS_DEDUP_ENCODER_H
+#define __COMPRESS_DEDUP_ENCODER_H
+
+#include "../../Common/MyCom.h"
+
+#include "../ICoder.h"
+
+namespace NCompress {
+namespace NDedup {
+
+/*
+  The encoder cuts the data to chunks at content-defined boundaries (FastCDC:
+  a gear hash with normalized chunking), so that inserted or removed bytes move
+  only the nearest boundaries. A chunk that is found by its fingerprint in the
+  table of earlier chunks, is compared with the window and is written as a copy.
+  The copy is extended backward over the pending literals, and forward for as
+  long as the data continues to match.
+*/
+
+struct CChunkRef
+{
+  UInt64 Pos;
+  UInt32 Check;
+  UInt32 Size;
+};
+
+class CEncoder:
+  public ICompressCoder,
+  public ICompressSetCoderProperties,
+  public ICompressWriteCoderProperties,
+  public CMyUnknownImp
+{
+  unsigned _numWindowBits;
+  unsigned _numChunkBits;
+  UInt64 _reduceSize;
+
+  Byte *_win;
+  size_t _winSize;
+  Byte *_inBuf;
+  size_t _inBufSize;
+  Byte *_outBuf;
+  size_t _outBufSize;
+  CChunkRef *_table;
+  size_t _tableSize;
+
+  size_t _minChunk;
+  size_t _maxChunk;
+  size_t _maxLits;
+  UInt64 _maskS;
+  UInt64 _maskL;
+
+  ISequentialInStream *_inStream;
+  size_t _inPos;
+  size_t _inLim;
+  bool _inFinished;
+  size_t _outPos;
+
+  UInt64 _pos;
+  UInt64 _litStart;
+  size_t _litLen;
+  UInt64 _matchDist;
+  UInt64 _matchLen;
+
+  unsigned GetNumWindowBits() const;
+  bool Alloc();
+  void Free();
+  HRESULT ReadIn();
+  size_t FindChunk(const Byte *p, size_t size) const;
+  size_t GetMatchLen(const Byte *p, UInt64 pos, size_t size) const;
+  void CopyToWindow(const Byte *p, size_t size);
+  void WriteNumber(UInt64 v);
+  void FlushLits();
+  void FlushMatch();
+  HRESULT CodeStep(bool &finished);
+
+public:
+  MY_UNKNOWN_IMP2(ICompressSetCoderProperties, ICompressWriteCoderProperties)
+
+  STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+      const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD(SetCoderProperties)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
+  STDMETHOD(WriteCoderProperties)(ISequentialOutStream *outStream);
+
+  CEncoder();
+  ~CEncoder();
+};
+
+}}
+
+#endif
@@ -0,0 +1,23 @@
+// DedupRegister.cpp
+
+#include "StdAfx.h"
+
+#include "../Common/RegisterCodec.h"
+
+#include "DedupDecoder.h"
+
+#ifndef EXTRACT_ONLY
+#include "DedupEncoder.h"
+#endif
+
+namespace NCompress {
+namespace NDedup {
+
+// a random developer ID of DOC/Methods.txt
+REGISTER_CODEC_E(Dedup,
+    CDecoder(),
+    CEncoder(),
+    UINT64_CONST(0x3FCF23D63D6F0001),
+    "Dedup")
+
+}}
@@ -2,20 +2,63 @@
 
 #include "StdAfx.h"
 
+#include "../../../C/CpuArch.h"
+
 #include "DeflateDecoder.h"
 
 namespace NCompress {
 namespace NDeflate {
 namespace NDecoder {
 
+/* The window is larger than the history of Deflate stream:
+   DecodeFast() can write some bytes after the end of match,
+   and these bytes never overwrite the history that can be referenced. */
+static const UInt32 kWindowSize = (UInt32)1 << 18;
+
+/* The entries of fast tables (see NHuffman::CLsbTable):
+     literal: kFastLiteral | (sym << 16), or with second literal:
+              kFastLiteral | kFastPair | (sym << 16) | (sym2 << 24), where len is for both codes.
+     end of block: kFastEnd
+     length or distance: kFastMatch | (numDirectBits << kFastDirectBitsShift) | (base << 16)
+   Other entries (0) are decoded by CodeSpec(). */
+
+static const UInt32 kFastLiteral = 1 << 6;
+static const UInt32 kFastPair = 1 << 7;
+static const unsigned kFastDirectBitsShift = 8;
+static const UInt32 kFastEnd = 1 << 13;
+static const UInt32 kFastMatch = 1 << 14;
+
 CCoder::CCoder(bool deflate64Mode, bool deflateNSIS):
     _deflate64Mode(deflate64Mode),
     _deflateNSIS(deflateNSIS),
     _keepHistory(false),
     _needFinishInput(false),
     _needInitInStream(true),
+    _fastTablesAreFixed(false),
+    _stopped(false),
+    _checkpoints(NULL),
+    _checkpointSpacing(0),
+    _nextCheckpoint(0),
+    _stopPos((UInt64)(Int64)-1),
     ZlibMode(false) {}
 
+void CCoder::SetNextCheckpoint(UInt64 outPos)
+{
+  _nextCheckpoint = _checkpointSpacing != 0 ? outPos + _checkpointSpacing : (UInt64)(Int64)-1;
+  if (_nextCheckpoint > _stopPos)
+    _nextCheckpoint = _stopPos;
+}
+
+void CCoder::AddCheckpoint(UInt64 outPos)
+{
+  CCheckpoint &cp = _checkpoints->AddNew();
+  cp.InBits = m_InBitStream.GetProcessedBits();
+  cp.OutPos = outPos;
+  Byte window[kHistorySize64];
+  cp.Window.CopyFrom(window, m_OutWindowStream.GetHistory(window, _deflate64Mode ? kHistorySize64 : kHistorySize32));
+  SetNextCheckpoint(outPos);
+}
+
 UInt32 CCoder::ReadBits(unsigned numBits)
 {
   return m_InBitStream.ReadBits(numBits);
@@ -142,7 +185,259 @@ bool CCoder::ReadTables(void)
     memcpy(levels.distLevels, tmpLevels + numLitLenLevels, _numDistLevels);
   }
   RIF(m_MainDecoder.Build(levels.litLenLevels));
-  return m_DistDecoder.Build(levels.distLevels);
+  RIF(m_DistDecoder.Build(levels.distLevels));
+  
+  const bool isFixed = (blockType == NBlockType::kFixedHuffman);
+  if (isFixed && _fastTablesAreFixed)
+    return true;
+  _fastTablesAreFixed = false;
+  RIF(BuildFastTables(levels.litLenLevels, levels.distLevels));
+  _fastTablesAreFixed = isFixed;
+  return true;
+}
+
+bool CCoder::BuildFastTables(const Byte *litLenLevels, const Byte *distLevels)
+{
+  UInt32 values[kFixedMainTableSize];
+  unsigned i;
+  
+  for (i = 0; i < 0x100; i++)
+    values[i] = kFastLiteral | ((UInt32)i << 16);
+  values[kSymbolEndOfBlock] = kFastEnd;
+  for (i = 0; i < kFixedLenTableSize; i++)
+  {
+    UInt32 v = 0;
+    if (kSymbolMatch + i < kMainTableSize)
+    {
+      if (_deflate64Mode)
+        v = kFastMatch | ((UInt32)kLenDirectBits64[i] << kFastDirectBitsShift) | ((kLenStart64[i] + kMatchMinLen) << 16);
+      else
+        v = kFastMatch | ((UInt32)kLenDirectBits32[i] << kFastDirectBitsShift) | ((kLenStart32[i] + kMatchMinLen) << 16);
+    }
+    values[kSymbolMatch + i] = v;
+  }
+  RIF(_fastMainTable.Build(litLenLevels, values, 0));
+
+  /* The entries of two literals: the second literal is decoded from the bits after
+     the first code, if both codes are in (kFastMainTableBits) bits.
+     The entry (i >> len) is not changed yet, since the table is changed from end. */
+  {
+    UInt32 *table = _fastMainTable.Table;
+    for (i = (1 << kFastMainTableBits); i != 0;)
+    {
+      i--;
+      const UInt32 e = table[i];
+      if ((e & (kFastLiteral | NHuffman::kLsbSubTable)) != kFastLiteral)
+        continue;
+      const unsigned len = (unsigned)(e & NHuffman::kLsbLenMask);
+      const UInt32 e2 = table[i >> len];
+      if ((e2 & (kFastLiteral | NHuffman::kLsbSubTable)) != kFastLiteral)
+        continue;
+      const unsigned len2 = (unsigned)(e2 & NHuffman::kLsbLenMask);
+      if (len + len2 > kFastMainTableBits)
+        continue;
+      table[i] = kFastLiteral | kFastPair | (e & 0xFF0000) | ((e2 & 0xFF0000) << 8) | (len + len2);
+    }
+  }
+
+  for (i = 0; i < kFixedDistTableSize; i++)
+    values[i] = (i < _numDistLevels) ?
+        kFastMatch | ((UInt32)kDistDirectBits[i] << kFastDirectBitsShift) | (kDistStart[i] << 16) : 0;
+  return _fastDistTable.Build(distLevels, values, 0);
+}
+
+#define FAST_REFILL \
+    bitBuf |= GetUi64(in) << numBits; \
+    in += (63 - numBits) >> 3; \
+    numBits |= 56;
+
+#define FAST_SKIP(n) { const unsigned n_ = (unsigned)(n); bitBuf >>= n_; numBits -= n_; }
+
+#define FAST_DIRECT_BITS(e) ((UInt32)bitBuf & (((UInt32)1 << (((e) >> kFastDirectBitsShift) & 0x1F)) - 1))
+
+/* DecodeFast() decodes the symbols of Huffman block directly from the buffer of input stream
+   to the window, while there is enough space in both buffers.
+   The bits are in 64-bit buffer that is refilled with one 8-byte read,
+   and the matches are copied with 16-byte or 8-byte unaligned stores.
+   It stops at the symbols that are not in fast tables, at the errors and at the matches
+   that cross the end of window: CodeSpec() decodes them.
+   It returns true, if the end of block was decoded. */
+
+bool CCoder::DecodeFast(UInt32 &curSize)
+{
+  const unsigned kInMargin = 16; // two refills
+  const UInt32 kCopyMargin = 16;
+  
+  const UInt32 pos = m_OutWindowStream.GetPos();
+  const UInt32 limitPos = m_OutWindowStream.GetLimitPos();
+  if (curSize <= kMatchMaxLen32 || limitPos - pos <= kMatchMaxLen32 + kCopyMargin)
+    return false;
+  UInt32 outAvail = limitPos - pos - kCopyMargin;
+  if (outAvail > curSize)
+    outAvail = curSize;
+
+  const Byte *in;
+  const Byte *inLim;
+  UInt64 bitBuf;
+  unsigned numBits;
+  if (!m_InBitStream.BeginDirect(in, inLim, bitBuf, numBits, kInMargin + 1))
+    return false;
+  inLim -= kInMargin;
+
+  Byte *const win = m_OutWindowStream.GetBuf();
+  Byte *out = win + pos;
+  Byte *const outEnd = out + outAvail;
+  Byte *const outLim = outEnd - kMatchMaxLen32;
+  const UInt32 winSize = m_OutWindowStream.GetBufSize();
+  const bool overDict = m_OutWindowStream.IsOverDict();
+  const UInt32 *const mainTable = _fastMainTable.Table;
+  const UInt32 *const distTable = _fastDistTable.Table;
+  const UInt32 kMainMask = ((UInt32)1 << kFastMainTableBits) - 1;
+  const UInt32 kDistMask = ((UInt32)1 << kFastDistTableBits) - 1;
+  const UInt32 kMainSubMask = ((UInt32)1 << (kNumHuffmanBits - kFastMainTableBits)) - 1;
+  const UInt32 kDistSubMask = ((UInt32)1 << (kNumHuffmanBits - kFastDistTableBits)) - 1;
+  bool blockFinished = false;
+
+  while (in < inLim && out < outLim)
+  {
+    FAST_REFILL
+    UInt32 e = mainTable[(UInt32)bitBuf & kMainMask];
+    
+    if (e & kFastLiteral)
+    {
+      // the codes of up to 4 literals in (2 * kFastMainTableBits) bits without refill
+      FAST_SKIP(e & NHuffman::kLsbLenMask)
+      SetUi16(out, (UInt16)(e >> 16));
+      out += 1 + ((e >> 7) & 1);
+      e = mainTable[(UInt32)bitBuf & kMainMask];
+      if (e & kFastLiteral)
+      {
+        FAST_SKIP(e & NHuffman::kLsbLenMask)
+        SetUi16(out, (UInt16)(e >> 16));
+        out += 1 + ((e >> 7) & 1);
+        continue;
+      }
+    }
+
+    // there are at least (64 - 8 - kFastMainTableBits) bits in buffer here
+    
+    if (e & NHuffman::kLsbSubTable)
+      e = mainTable[(e >> 16) + ((UInt32)(bitBuf >> kFastMainTableBits) & kMainSubMask)];
+    
+    if (e & kFastLiteral)
+    {
+      FAST_SKIP(e & NHuffman::kLsbLenMask)
+      *out++ = (Byte)(e >> 16);
+      continue;
+    }
+    
+    if (e & kFastMatch)
+    {
+      const Byte *inSaved = in;
+      const UInt64 bitBufSaved = bitBuf;
+      const unsigned numBitsSaved = numBits;
+      
+      FAST_SKIP(e & NHuffman::kLsbLenMask)
+      const UInt32 len = (e >> 16) + FAST_DIRECT_BITS(e);
+      FAST_SKIP((e >> kFastDirectBitsShift) & 0x1F)
+      
+      if (numBits < kNumHuffmanBits + 14)
+      {
+        FAST_REFILL
+      }
+      UInt32 d = distTable[(UInt32)bitBuf & kDistMask];
+      if (d & NHuffman::kLsbSubTable)
+        d = distTable[(d >> 16) + ((UInt32)(bitBuf >> kFastDistTableBits) & kDistSubMask)];
+      
+      if (!(d & kFastMatch) || len > (UInt32)(outEnd - out))
+      {
+        in = inSaved;
+        bitBuf = bitBufSaved;
+        numBits = numBitsSaved;
+        break;
+      }
+      
+      FAST_SKIP(d & NHuffman::kLsbLenMask)
+      const UInt32 distance = (d >> 16) + FAST_DIRECT_BITS(d);
+      FAST_SKIP((d >> kFastDirectBitsShift) & 0x1F)
+      
+      Byte *dest = out;
+      const UInt32 outPos = (UInt32)(out - win);
+      out += len;
+      
+      if (distance >= outPos)
+      {
+        if (!overDict)
+        {
+          out = dest;
+          in = inSaved;
+          bitBuf = bitBufSaved;
+          numBits = numBitsSaved;
+          break;
+        }
+        UInt32 srcPos = outPos + winSize - distance - 1;
+        do
+        {
+          *dest++ = win[srcPos];
+          if (++srcPos == winSize)
+            srcPos = 0;
+        }
+        while (dest != out);
+        continue;
+      }
+      
+      const Byte *src = dest - distance - 1;
+      if (distance >= 15)
+      {
+        do
+        {
+          memcpy(dest, src, 16);
+          dest += 16;
+          src += 16;
+        }
+        while (dest < out);
+      }
+      else if (distance >= 7)
+      {
+        do
+        {
+          memcpy(dest, src, 8);
+          dest += 8;
+          src += 8;
+        }
+        while (dest < out);
+      }
+      else if (distance == 0)
+      {
+        const UInt64 v = (UInt64)*src * 0x0101010101010101;
+        do
+        {
+          memcpy(dest, &v, 8);
+          dest += 8;
+        }
+        while (dest < out);
+      }
+      else
+      {
+        do
+          *dest++ = *src++;
+        while (dest != out);
+      }
+      continue;
+    }
+    
+    if (e & kFastEnd)
+    {
+      FAST_SKIP(e & NHuffman::kLsbLenMask)
+      blockFinished = true;
+    }
+    break;
+  }
+  
+  m_InBitStream.EndDirect(in, numBits);
+  m_OutWindowStream.SetPos((UInt32)(out - win));
+  curSize -= (UInt32)(out - (win + pos));
+  return blockFinished;
 }
 
 HRESULT CCoder::CodeSpec(UInt32 curSize, bool finishInputStream)
@@ -152,14 +447,18 @@ HRESULT CCoder::CodeSpec(UInt32 curSize, bool finishInputStream)
   if (_remainLen == kLenIdNeedInit)
   {
     if (!_keepHistory)
-      if (!m_OutWindowStream.Create(_deflate64Mode ? kHistorySize64: kHistorySize32))
+      if (!m_OutWindowStream.Create(kWindowSize))
         return E_OUTOFMEMORY;
     RINOK(InitInStream(_needInitInStream));
     m_OutWindowStream.Init(_keepHistory);
     m_FinalBlock = false;
     _remainLen = 0;
     _needReadTable = true;
+    _stopped = false;
+    SetNextCheckpoint(0);
   }
+  if (_stopped)
+    return S_OK;
 
   while (_remainLen > 0 && curSize > 0)
   {
@@ -181,6 +480,19 @@ HRESULT CCoder::CodeSpec(UInt32 curSize, bool finishInputStream)
         _remainLen = kLenIdFinished;
         break;
       }
+      if (_checkpoints)
+      {
+        const UInt64 outPos = m_OutWindowStream.GetProcessedSize();
+        if (outPos >= _nextCheckpoint)
+        {
+          AddCheckpoint(outPos);
+          if (outPos >= _stopPos)
+          {
+            _stopped = true;
+            break;
+          }
+        }
+      }
       if (!ReadTables())
         return S_FALSE;
       if (m_InBitStream.ExtraBitsWereRead())
@@ -204,6 +516,14 @@ HRESULT CCoder::CodeSpec(UInt32 curSize, bool finishInputStream)
     
     while (curSize > 0)
     {
+      if (DecodeFast(curSize))
+      {
+        _needReadTable = true;
+        break;
+      }
+      if (curSize == 0)
+        break;
+      
       if (m_InBitStream.ExtraBitsWereRead_Fast())
         return S_FALSE;
 
@@ -319,7 +639,7 @@ HRESULT CCoder::CodeReal(ISequentialOutStream *outStream,
     if (!finishInputStream && curSize == 0)
       break;
     RINOK(CodeSpec(curSize, finishInputStream));
-    if (_remainLen == kLenIdFinished)
+    if (_remainLen == kLenIdFinished || _stopped)
       break;
     if (progress)
     {
@@ -407,6 +727,22 @@ STDMETHODIMP CCoder::Read(void *data, UInt32 size, UInt32 *processedSize)
 
 #endif
 
+HRESULT CCoder::InitFromCheckpoint(unsigned numBits, const Byte *window, UInt32 windowSize)
+{
+  if (!m_OutWindowStream.Create(kWindowSize))
+    return E_OUTOFMEMORY;
+  RINOK(InitInStream(true));
+  m_InBitStream.ReadBits(numBits);
+  m_OutWindowStream.Init(false);
+  m_OutWindowStream.SetHistory(window, windowSize);
+  m_FinalBlock = false;
+  _remainLen = 0;
+  _needReadTable = true;
+  _stopped = false;
+  SetNextCheckpoint(0);
+  return S_OK;
+}
+
 STDMETHODIMP CCoder::CodeResume(ISequentialOutStream *outStream, const UInt64 *outSize, ICompressProgressInfo *progress)
 {
   _remainLen = kLenIdNeedInit;
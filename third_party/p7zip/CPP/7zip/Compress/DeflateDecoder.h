@@ -3,7 +3,9 @@
 #ifndef __DEFLATE_DECODER_H
 #define __DEFLATE_DECODER_H
 
+#include "../../Common/MyBuffer.h"
 #include "../../Common/MyCom.h"
+#include "../../Common/MyVector.h"
 
 #include "../ICoder.h"
 
@@ -21,6 +23,19 @@ namespace NDecoder {
 const int kLenIdFinished = -1;
 const int kLenIdNeedInit = -2;
 
+const unsigned kFastMainTableBits = 11;
+const unsigned kFastDistTableBits = 8;
+
+/* A point at the start of a block, where decoding can be resumed
+   with InitFromCheckpoint() without the data before it. */
+
+struct CCheckpoint
+{
+  UInt64 InBits;      // input position (in bits) from InitInStream()
+  UInt64 OutPos;      // output position from the start of stream (or from InitFromCheckpoint())
+  CByteBuffer Window; // up to 32 KB (64 KB for Deflate64) of output before OutPos
+};
+
 class CCoder:
   public ICompressCoder,
   public ICompressGetInStreamProcessedSize,
@@ -38,6 +53,11 @@ class CCoder:
   NCompress::NHuffman::CDecoder<kNumHuffmanBits, kFixedDistTableSize> m_DistDecoder;
   NCompress::NHuffman::CDecoder7b<kLevelTableSize> m_LevelDecoder;
 
+  // the tables for DecodeFast()
+  NCompress::NHuffman::CLsbTable<kNumHuffmanBits, kFixedMainTableSize, kFastMainTableBits> _fastMainTable;
+  NCompress::NHuffman::CLsbTable<kNumHuffmanBits, kFixedDistTableSize, kFastDistTableBits> _fastDistTable;
+  bool _fastTablesAreFixed;
+
   UInt32 m_StoredBlockSize;
 
   UInt32 _numDistLevels;
@@ -54,10 +74,21 @@ class CCoder:
   Int32 _remainLen;
   UInt32 _rep0;
 
+  bool _stopped;
+  CObjectVector<CCheckpoint> *_checkpoints;
+  UInt64 _checkpointSpacing;
+  UInt64 _nextCheckpoint;
+  UInt64 _stopPos;
+
+  void SetNextCheckpoint(UInt64 outPos);
+  void AddCheckpoint(UInt64 outPos);
+
   UInt32 ReadBits(unsigned numBits);
 
   bool DecodeLevels(Byte *levels, unsigned numSymbols);
   bool ReadTables();
+  bool BuildFastTables(const Byte *litLenLevels, const Byte *distLevels);
+  bool DecodeFast(UInt32 &curSize);
   
   HRESULT Flush() { return m_OutWindowStream.Flush(); }
   class CCoderReleaser
@@ -88,6 +119,26 @@ public:
   bool IsFinished() const { return _remainLen == kLenIdFinished;; }
   bool IsFinalBlock() const { return m_FinalBlock; }
 
+  /* The decoder adds a checkpoint to (checkpoints) at the first block start,
+     where the output of the stream is at least (spacing) bytes after previous checkpoint.
+     spacing == 0 : no such checkpoints.
+     If the output reaches (stopPos), the decoder adds a checkpoint at next block start
+     and stops there: IsStopped() returns true.
+     It must be called before the decoding of stream (or after InitFromCheckpoint()). */
+  void SetCheckpoints(CObjectVector<CCheckpoint> *checkpoints, UInt64 spacing, UInt64 stopPos = (UInt64)(Int64)-1)
+  {
+    _checkpoints = checkpoints;
+    _checkpointSpacing = spacing;
+    _stopPos = stopPos;
+    SetNextCheckpoint(0);
+  }
+  bool IsStopped() const { return _stopped; }
+
+  /* Prepares the decoding from checkpoint: the input stream must be at the byte
+     that contains the first bit of block, (numBits) is the bit offset in that byte.
+     Then CodeReal() continues the stream. */
+  HRESULT InitFromCheckpoint(unsigned numBits, const Byte *window, UInt32 windowSize);
+
   HRESULT CodeReal(ISequentialOutStream *outStream,
       const UInt64 *outSize, ICompressProgressInfo *progress);
 
@@ -141,6 +192,7 @@ public:
 
   UInt64 GetStreamSize() const { return m_InBitStream.GetStreamSize(); }
   UInt64 GetInputProcessedSize() const { return m_InBitStream.GetProcessedSize(); }
+  UInt64 GetInputProcessedBits() const { return m_InBitStream.GetProcessedBits(); }
 
   // IGetInStreamProcessedSize
   STDMETHOD(GetInStreamProcessedSize)(UInt64 *value);
@@ -7,6 +7,11 @@
 
 #include "../../Common/ComTry.h"
 
+#ifndef _7ZIP_ST
+#include "../Common/CWrappers.h"
+#include "../Common/StreamObjects.h"
+#endif
+
 #include "DeflateEncoder.h"
 
 #undef NO_INLINE
@@ -93,6 +98,7 @@ void CEncProps::Normalize()
 
 void CCoder::SetProps(const CEncProps *props2)
 {
+  _props = *props2;
   CEncProps props = *props2;
   props.Normalize();
 
@@ -128,7 +134,8 @@ CCoder::CCoder(bool deflate64Mode):
   m_DistanceMemory(0),
   m_Created(false),
   m_Values(0),
-  m_Tables(0)
+  m_Tables(0),
+  m_NumThreads(1)
 {
   m_MatchMaxLen = deflate64Mode ? kMatchMaxLen64 : kMatchMaxLen32;
   m_NumLenCombinations = deflate64Mode ? kNumLenSymbols64 : kNumLenSymbols32;
@@ -139,6 +146,11 @@ CCoder::CCoder(bool deflate64Mode):
     SetProps(&props);
   }
   MatchFinder_Construct(&_lzInWindow);
+  #ifndef _7ZIP_ST
+  MtCoder_Construct(&_mtCoder);
+  for (unsigned i = 0; i < NUM_MT_CODER_THREADS_MAX; i++)
+    _mtCoders[i] = NULL;
+  #endif
 }
 
 HRESULT CCoder::Create()
@@ -199,6 +211,7 @@ HRESULT CCoder::Create()
 HRESULT CCoder::BaseSetEncoderProperties2(const PROPID *propIDs, const PROPVARIANT *coderProps, UInt32 numProps)
 {
   CEncProps props;
+  UInt32 numThreads = 1;
   for (UInt32 i = 0; i < numProps; i++)
   {
     const PROPVARIANT &prop = coderProps[i];
@@ -215,11 +228,12 @@ HRESULT CCoder::BaseSetEncoderProperties2(const PROPID *propIDs, const PROPVARIA
       case NCoderPropID::kMatchFinderCycles: props.mc = v; break;
       case NCoderPropID::kAlgorithm: props.algo = v; break;
       case NCoderPropID::kLevel: props.Level = v; break;
-      case NCoderPropID::kNumThreads: break;
+      case NCoderPropID::kNumThreads: numThreads = v; break;
       default: return E_INVALIDARG;
     }
   }
   SetProps(&props);
+  m_NumThreads = numThreads;
   return S_OK;
 }
   
@@ -235,6 +249,11 @@ CCoder::~CCoder()
 {
   Free();
   MatchFinder_Free(&_lzInWindow, &g_Alloc);
+  #ifndef _7ZIP_ST
+  MtCoder_Destruct(&_mtCoder);
+  for (unsigned i = 0; i < NUM_MT_CODER_THREADS_MAX; i++)
+    delete _mtCoders[i];
+  #endif
 }
 
 NO_INLINE void CCoder::GetMatches()
@@ -932,8 +951,8 @@ SRes Read(void *object, void *data, size_t *size)
   return (SRes)res;
 }
 
-HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *outStream,
-    const UInt64 * /* inSize */ , const UInt64 * /* outSize */ , ICompressProgressInfo *progress)
+HRESULT CCoder::CodeStream(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+    ICompressProgressInfo *progress, UInt32 dictSize, bool finalStream)
 {
   m_CheckStatic = (m_NumPasses != 1 || m_NumDivPasses != 1);
   m_IsMultiPass = (m_CheckStatic || (m_NumPasses != 1 || m_NumDivPasses != 1));
@@ -949,6 +968,14 @@ HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *ou
   _lzInWindow.stream = &_seqInStream.SeqInStream;
 
   MatchFinder_Init(&_lzInWindow);
+  if (dictSize != 0)
+  {
+    // the first (dictSize) bytes of the stream are history only
+    if (_btMode)
+      Bt3Zip_MatchFinder_Skip(&_lzInWindow, dictSize);
+    else
+      Hc3Zip_MatchFinder_Skip(&_lzInWindow, dictSize);
+  }
   m_OutStream.SetStream(outStream);
   m_OutStream.Init();
 
@@ -957,6 +984,16 @@ HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *ou
   CTables &t = m_Tables[1];
   t.m_Pos = 0;
   t.InitStructures();
+  if (dictSize != 0 && !_fastMode)
+  {
+    // the default prices make the matches to the history cheaper than the literals
+    // and the next blocks keep that tables, so we price the literals by the history
+    const Byte *dict = Inline_MatchFinder_GetPointerToCurrentPos(&_lzInWindow) - dictSize;
+    memset(mainFreqs, 0, 256 * sizeof(mainFreqs[0]));
+    for (UInt32 i = 0; i < dictSize; i++)
+      mainFreqs[dict[i]]++;
+    Huffman_Generate(mainFreqs, mainCodes, t.litLenLevels, 256, 12);
+  }
 
   m_AdditionalOffset = 0;
   do
@@ -964,7 +1001,7 @@ HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *ou
     t.BlockSizeRes = kBlockUncompressedSizeThreshold;
     m_SecondPass = false;
     GetBlockPrice(1, m_NumDivPasses);
-    CodeBlock(1, Inline_MatchFinder_GetNumAvailableBytes(&_lzInWindow) == 0);
+    CodeBlock(1, finalStream && Inline_MatchFinder_GetNumAvailableBytes(&_lzInWindow) == 0);
     nowPos += m_Tables[1].BlockSizeRes;
     if (progress != NULL)
     {
@@ -975,9 +1012,117 @@ HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *ou
   while (Inline_MatchFinder_GetNumAvailableBytes(&_lzInWindow) != 0);
   if (_lzInWindow.result != SZ_OK)
     return _lzInWindow.result;
+  if (!finalStream)
+  {
+    // empty stored block: it aligns the end to a byte boundary,
+    // so the next stream can be appended as is (like Z_SYNC_FLUSH in zlib)
+    WriteBits(NFinalBlockField::kNotFinalBlock, kFinalBlockFieldSize);
+    WriteBits(NBlockType::kStored, kBlockTypeFieldSize);
+    m_OutStream.FlushByte();
+    WriteBits(0, kStoredBlockLengthFieldSize);
+    WriteBits((UInt16)~0, kStoredBlockLengthFieldSize);
+  }
   return m_OutStream.Flush();
 }
 
+HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+    const UInt64 * /* inSize */ , const UInt64 * /* outSize */ , ICompressProgressInfo *progress)
+{
+  #ifndef _7ZIP_ST
+  if (m_NumThreads > 1)
+    return CodeMt(inStream, outStream, progress);
+  #endif
+  return CodeStream(inStream, outStream, progress, 0, true);
+}
+
+#ifndef _7ZIP_ST
+
+/*
+Multithreaded mode (like pigz): the input is split into blocks of kMtBlockSize
+bytes that are encoded in parallel. The encoder of each block sees the last
+bytes of the previous block as history, so the matches can cross the borders.
+Each block except the last one ends with an empty stored block, so the encoded
+blocks are concatenated to one Deflate stream.
+*/
+
+static const size_t kMtBlockSize = (size_t)1 << 20;
+
+struct CMtCallbackImp
+{
+  IMtCoderCallback funcTable;
+  CCoder *Coder;
+};
+
+static SRes MtCallbackImp_Code(void *pp, unsigned index, Byte *dest, size_t *destSize,
+    const Byte *src, size_t srcSize, size_t dictSize, int finished)
+{
+  CMtCallbackImp *imp = (CMtCallbackImp *)pp;
+  CCoder *coder = imp->Coder->_mtCoders[index];
+  size_t destLim = *destSize;
+  HRESULT res;
+  *destSize = 0;
+  try
+  {
+    CBufInStream *inStreamSpec = new CBufInStream;
+    CMyComPtr<ISequentialInStream> inStream = inStreamSpec;
+    inStreamSpec->Init(src - dictSize, dictSize + srcSize);
+    CBufPtrSeqOutStream *outStreamSpec = new CBufPtrSeqOutStream;
+    CMyComPtr<ISequentialOutStream> outStream = outStreamSpec;
+    outStreamSpec->Init(dest, destLim);
+    res = coder->CodeStream(inStream, outStream, NULL, (UInt32)dictSize, finished != 0);
+    *destSize = outStreamSpec->GetPos();
+  }
+  catch(const COutBufferException &e) { res = e.ErrorCode; }
+  catch(...) { res = E_OUTOFMEMORY; }
+  if (res != S_OK)
+    return res == E_OUTOFMEMORY ? SZ_ERROR_MEM : SZ_ERROR_FAIL;
+  return MtProgress_Set(&imp->Coder->_mtCoder.mtProgress, index, srcSize, *destSize);
+}
+
+HRESULT CCoder::CodeMt(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+    ICompressProgressInfo *progress)
+{
+  unsigned numThreads = m_NumThreads;
+  if (numThreads > NUM_MT_CODER_THREADS_MAX)
+    numThreads = NUM_MT_CODER_THREADS_MAX;
+  for (unsigned i = 0; i < numThreads; i++)
+  {
+    if (!_mtCoders[i])
+      _mtCoders[i] = new CCoder(m_Deflate64Mode);
+    _mtCoders[i]->SetProps(&_props);
+  }
+
+  CSeqInStreamWrap inWrap(inStream);
+  CSeqOutStreamWrap outWrap(outStream);
+  CCompressProgressWrap progressWrap(progress);
+
+  CMtCallbackImp mtCallback;
+  mtCallback.funcTable.Code = MtCallbackImp_Code;
+  mtCallback.Coder = this;
+
+  _mtCoder.progress = progress ? &progressWrap.p : NULL;
+  _mtCoder.inStream = &inWrap.p;
+  _mtCoder.outStream = &outWrap.p;
+  _mtCoder.alloc = &g_BigAlloc;
+  _mtCoder.mtCallback = &mtCallback.funcTable;
+  _mtCoder.blockSize = kMtBlockSize;
+  // stored blocks are the worst case: 5 bytes per 64 KiB
+  _mtCoder.destBlockSize = kMtBlockSize + (kMtBlockSize >> 10) + (1 << 10);
+  _mtCoder.dictSize = m_Deflate64Mode ? kHistorySize64 : kHistorySize32;
+  _mtCoder.numThreads = numThreads;
+
+  SRes res = MtCoder_Code(&_mtCoder);
+  if (res == SZ_ERROR_READ && inWrap.Res != S_OK)
+    return inWrap.Res;
+  if (res == SZ_ERROR_WRITE && outWrap.Res != S_OK)
+    return outWrap.Res;
+  if (res == SZ_ERROR_PROGRESS && progressWrap.Res != S_OK)
+    return progressWrap.Res;
+  return SResToHRESULT(res);
+}
+
+#endif
+
 HRESULT CCoder::BaseCode(ISequentialInStream *inStream, ISequentialOutStream *outStream,
     const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress)
 {
@@ -4,6 +4,9 @@
 #define __DEFLATE_ENCODER_H
 
 #include "../../../C/LzFind.h"
+#ifndef _7ZIP_ST
+#include "../../../C/MtCoder.h"
+#endif
 
 #include "../../Common/MyCom.h"
 
@@ -136,6 +139,16 @@ public:
 
   UInt32 m_MatchFinderCycles;
 
+  CEncProps _props;
+  UInt32 m_NumThreads;
+
+  #ifndef _7ZIP_ST
+  CMtCoder _mtCoder;
+  CCoder *_mtCoders[NUM_MT_CODER_THREADS_MAX];
+  HRESULT CodeMt(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+      ICompressProgressInfo *progress);
+  #endif
+
   void GetMatches();
   void MovePos(UInt32 num);
   UInt32 Backward(UInt32 &backRes, UInt32 cur);
@@ -169,6 +182,9 @@ public:
   void CodeBlock(unsigned tableIndex, bool finalBlock);
 
   void SetProps(const CEncProps *props2);
+
+  HRESULT CodeStream(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+      ICompressProgressInfo *progress, UInt32 dictSize, bool finalStream);
 public:
   CCoder(bool deflate64Mode = false);
   ~CCoder();
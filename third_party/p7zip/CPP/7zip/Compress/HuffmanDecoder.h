@@ -3,6 +3,8 @@
 #ifndef __COMPRESS_HUFFMAN_DECODER_H
 #define __COMPRESS_HUFFMAN_DECODER_H
 
+#include <string.h>
+
 #include "../../Common/MyTypes.h"
 
 namespace NCompress {
@@ -175,6 +177,115 @@ public:
 
 
 
+const UInt32 kLsbLenMask = 0x1F;
+const UInt32 kLsbSubTable = 0x20;
+
+/* CLsbTable is the table for fast decoders that take the codes from low bits of
+   the bit buffer (the order of bits in Deflate stream).
+   The entry for (bits) is Table[bits & ((1 << kNumTableBits) - 1)]:
+     (values[sym] | len) for the codes with (len <= kNumTableBits).
+     (kLsbSubTable | (offset << 16)) for longer codes: the entry is in subtable
+       Table[offset + ((bits >> kNumTableBits) & ((1 << kNumSubBits) - 1))],
+       and it contains (values[sym] | len), where (len) is full length of code.
+     (emptyEntry) for the codes that are not used.
+   values[sym] must not use the bits of kLsbLenMask and kLsbSubTable. */
+
+template <unsigned kNumBitsMax, UInt32 m_NumSymbols, unsigned kNumTableBits>
+class CLsbTable
+{
+public:
+  enum
+  {
+    kNumSubBits = kNumBitsMax - kNumTableBits,
+    kTableSize = ((UInt32)1 << kNumTableBits) + ((UInt32)m_NumSymbols << (kNumBitsMax - kNumTableBits))
+  };
+
+  UInt32 Table[kTableSize];
+
+  bool Build(const Byte *lens, const UInt32 *values, UInt32 emptyEntry) throw()
+  {
+    UInt32 lenCounts[kNumBitsMax + 1];
+    UInt32 offsets[kNumBitsMax + 1];
+    UInt16 sorted[m_NumSymbols];
+    
+    unsigned i;
+    for (i = 0; i <= kNumBitsMax; i++)
+      lenCounts[i] = 0;
+    
+    UInt32 sym;
+    
+    for (sym = 0; sym < m_NumSymbols; sym++)
+      lenCounts[lens[sym]]++;
+    
+    lenCounts[0] = 0;
+    offsets[0] = 0;
+    UInt32 startPos = 0;
+    const UInt32 kMaxValue = (UInt32)1 << kNumBitsMax;
+    
+    for (i = 1; i <= kNumBitsMax; i++)
+    {
+      startPos += lenCounts[i] << (kNumBitsMax - i);
+      if (startPos > kMaxValue)
+        return false;
+      offsets[i] = offsets[i - 1] + lenCounts[i - 1];
+    }
+    
+    for (sym = 0; sym < m_NumSymbols; sym++)
+      if (lens[sym] != 0)
+        sorted[offsets[lens[sym]]++] = (UInt16)sym;
+
+    /* The codes of the same length are in order of symbols, and the table for
+       (len) bits is two copies of the table for (len - 1) bits plus the codes of (len) bits.
+       So the table is doubled with memcpy() instead of the filling of each entry. */
+
+    const UInt16 *cur = sorted;
+    UInt32 code = 0;
+    UInt32 subPos = (UInt32)1 << kNumTableBits;
+    Table[0] = emptyEntry;
+    
+    for (i = 1; i <= kNumBitsMax; i++, code <<= 1)
+    {
+      if (i <= kNumTableBits)
+      {
+        const UInt32 size = (UInt32)1 << (i - 1);
+        memcpy(Table + size, Table, size * sizeof(Table[0]));
+      }
+      
+      for (UInt32 num = lenCounts[i]; num != 0; num--, code++)
+      {
+        sym = *cur++;
+        UInt32 rev = 0;
+        for (unsigned k = 0; k < i; k++)
+          rev |= ((code >> k) & 1) << (i - 1 - k);
+        const UInt32 entry = values[sym] | i;
+        
+        if (i <= kNumTableBits)
+        {
+          Table[rev] = entry;
+          continue;
+        }
+
+        UInt32 *dest = Table + (rev & (((UInt32)1 << kNumTableBits) - 1));
+        if (!(*dest & kLsbSubTable))
+        {
+          UInt32 *sub = Table + subPos;
+          for (UInt32 k = 0; k < ((UInt32)1 << kNumSubBits); k++)
+            sub[k] = emptyEntry;
+          *dest = kLsbSubTable | (subPos << 16);
+          subPos += (UInt32)1 << kNumSubBits;
+        }
+        dest = Table + (*dest >> 16);
+        for (UInt32 k = rev >> kNumTableBits; k < ((UInt32)1 << kNumSubBits); k += (UInt32)1 << (i - kNumTableBits))
+          dest[k] = entry;
+      }
+    }
+    
+    return true;
+  }
+};
+
+
+
 template <UInt32 m_NumSymbols>
 class CDecoder7b
 {
@@ -12,3 +12,38 @@ void CLzOutWindow::Init(bool solid) throw()
   ErrorCode = S_OK;
   #endif
 }
+
+void CLzOutWindow::SetHistory(const Byte *data, UInt32 size) throw()
+{
+  if (size > _bufSize)
+  {
+    data += size - _bufSize;
+    size = _bufSize;
+  }
+  memcpy(_buf, data, size);
+  _pos = size;
+  if (_pos == _bufSize)
+  {
+    _overDict = true;
+    _pos = 0;
+  }
+  _streamPos = _pos;
+  _limitPos = _bufSize;
+}
+
+UInt32 CLzOutWindow::GetHistory(Byte *dest, UInt32 size) const throw()
+{
+  UInt32 avail = _overDict ? _bufSize : _pos;
+  if (size > avail)
+    size = avail;
+  UInt32 rem = size;
+  if (rem > _pos)
+  {
+    UInt32 num = rem - _pos;
+    memcpy(dest, _buf + _bufSize - num, num);
+    dest += num;
+    rem = _pos;
+  }
+  memcpy(dest, _buf + _pos - rem, rem);
+  return size;
+}
@@ -13,6 +13,11 @@ class CLzOutWindow: public COutBuffer
 {
 public:
   void Init(bool solid = false) throw();
+
+  // Fills the dictionary with data that was written before: it can be referenced, but it is not flushed.
+  void SetHistory(const Byte *data, UInt32 size) throw();
+  // Copies up to (size) last bytes of the dictionary to (dest) and returns their number.
+  UInt32 GetHistory(Byte *dest, UInt32 size) const throw();
   
   // distance >= 0, len > 0,
   bool CopyBlock(UInt32 distance, UInt32 len)
@@ -57,6 +62,16 @@ public:
       FlushWithCheck();
   }
   
+  /* The direct access to the window for fast decoding loops: the bytes can be written
+     from (GetBuf() + GetPos()) up to (GetBuf() + GetLimitPos()), and then SetPos() must be called
+     with new position that is smaller than GetLimitPos(). */
+  Byte *GetBuf() const { return _buf; }
+  UInt32 GetPos() const { return _pos; }
+  UInt32 GetLimitPos() const { return _limitPos; }
+  UInt32 GetBufSize() const { return _bufSize; }
+  bool IsOverDict() const { return _overDict; }
+  void SetPos(UInt32 pos) { _pos = pos; }
+
   Byte GetByte(UInt32 distance) const
   {
     UInt32 pos = _pos - distance - 1;
@@ -4,23 +4,11 @@
 
 #include "../../../C/Alloc.h"
 
+#include "../Common/CWrappers.h"
 #include "../Common/StreamUtils.h"
 
 #include "Lzma2Decoder.h"
 
-static HRESULT SResToHRESULT(SRes res)
-{
-  switch (res)
-  {
-    case SZ_OK: return S_OK;
-    case SZ_ERROR_MEM: return E_OUTOFMEMORY;
-    case SZ_ERROR_PARAM: return E_INVALIDARG;
-    // case SZ_ERROR_PROGRESS: return E_ABORT;
-    case SZ_ERROR_DATA: return S_FALSE;
-  }
-  return E_FAIL;
-}
-
 namespace NCompress {
 namespace NLzma2 {
 
@@ -31,6 +19,12 @@ CDecoder::CDecoder():
     _outStepSize(1 << 22),
     _outSizeDefined(false),
     _finishMode(false)
+    #ifndef _7ZIP_ST
+    , _prop(0xFF)
+    , _numThreads(1)
+    , _memUsage((UInt64)(sizeof(size_t)) << 28)
+    , _dec(NULL)
+    #endif
 {
   Lzma2Dec_Construct(&_state);
 }
@@ -40,6 +34,10 @@ STDMETHODIMP CDecoder::SetOutBufSize(UInt32 , UInt32 size) { _outStepSize = size
 
 CDecoder::~CDecoder()
 {
+  #ifndef _7ZIP_ST
+  if (_dec)
+    Lzma2DecMt_Destroy(_dec);
+  #endif
   Lzma2Dec_Free(&_state, &g_Alloc);
   MidFree(_inBuf);
 }
@@ -50,6 +48,9 @@ STDMETHODIMP CDecoder::SetDecoderProperties2(const Byte *prop, UInt32 size)
     return E_NOTIMPL;
   
   RINOK(SResToHRESULT(Lzma2Dec_Allocate(&_state, prop[0], &g_Alloc)));
+  #ifndef _7ZIP_ST
+  _prop = prop[0];
+  #endif
   if (!_inBuf || _inBufSize != _inBufSizeNew)
   {
     MidFree(_inBuf);
@@ -87,12 +88,128 @@ STDMETHODIMP CDecoder::SetFinishMode(UInt32 finishMode)
   return S_OK;
 }
 
+#ifndef _7ZIP_ST
+
+STDMETHODIMP CDecoder::SetNumberOfThreads(UInt32 numThreads)
+{
+  _numThreads = numThreads;
+  return S_OK;
+}
+
+static UInt64 Get_ExpectedBlockSize_From_Dict(UInt32 dictSize)
+{
+  const UInt32 kMinSize = (UInt32)1 << 20;
+  const UInt32 kMaxSize = (UInt32)1 << 28;
+  UInt64 blockSize = (UInt64)dictSize << 2;
+  if (blockSize < kMinSize) blockSize = kMinSize;
+  if (blockSize > kMaxSize) blockSize = kMaxSize;
+  if (blockSize < dictSize) blockSize = dictSize;
+  blockSize += (kMinSize - 1);
+  blockSize &= ~(UInt64)(kMinSize - 1);
+  return blockSize;
+}
+
+#define LZMA2_DIC_SIZE_FROM_PROP_FULL(p) ((p) == 40 ? 0xFFFFFFFF : (((UInt32)2 | ((p) & 1)) << ((p) / 2 + 11)))
+
+/*
+The parser of Lzma2DecMt splits the stream at the chunks that reset the
+dictionary (control byte 1 or 0xE0-0xFF) and decodes the parts in the threads.
+The chunks that reset only the state or the properties still use the bytes
+before them, so they stay in the part they are in. A stream without such
+resets (or with parts larger than outBlockMax) is decoded in one thread:
+Lzma2DecMt_Decode() goes on in the calling thread with the data it has read.
+That's decided for every stream, since 7z reuses the decoder for the next folders.
+*/
+
+HRESULT CDecoder::CodeMt(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+    const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress)
+{
+  _inSizeProcessed = 0;
+  _outSizeProcessed = 0;
+
+  if (!_dec)
+  {
+    _dec = Lzma2DecMt_Create(&g_Alloc, &g_MidAlloc);
+    if (!_dec)
+      return E_OUTOFMEMORY;
+  }
+
+  CLzma2DecMtProps props;
+  Lzma2DecMtProps_Init(&props);
+  props.inBufSize_ST = _inBufSizeNew;
+  props.outStep_ST = _outStepSize;
+
+  {
+    UInt32 numThreads = _numThreads;
+    UInt32 dictSize = LZMA2_DIC_SIZE_FROM_PROP_FULL(_prop);
+    UInt64 expectedBlockSize64 = Get_ExpectedBlockSize_From_Dict(dictSize);
+    size_t expectedBlockSize = (size_t)expectedBlockSize64;
+    size_t inBlockMax = expectedBlockSize + expectedBlockSize / 16;
+    if (expectedBlockSize != expectedBlockSize64 || inBlockMax < expectedBlockSize)
+      numThreads = 1;
+    else
+    {
+      props.outBlockMax = expectedBlockSize;
+      props.inBlockMax = inBlockMax;
+      const size_t kOverheadSize = props.inBufSize_MT + (1 << 16);
+      UInt64 okThreads = _memUsage / (props.outBlockMax + props.inBlockMax + kOverheadSize);
+      if (numThreads > okThreads)
+        numThreads = (UInt32)okThreads;
+      if (numThreads == 0)
+        numThreads = 1;
+    }
+    props.numThreads = numThreads;
+  }
+
+  CSeqInStreamWrap inWrap(inStream);
+  CSeqOutStreamWrap outWrap(outStream);
+  CCompressProgressWrap progressWrap(progress);
+
+  UInt64 inProcessed = 0;
+  int isMT = True;
+
+  SRes res = Lzma2DecMt_Decode(_dec, _prop, &props,
+      &outWrap.p, outSize, _finishMode,
+      &inWrap.p,
+      &inProcessed,
+      &isMT,
+      progress ? &progressWrap.p : NULL);
+
+  _inSizeProcessed = inProcessed;
+  _outSizeProcessed = outWrap.Processed;
+
+  if (progressWrap.Res != S_OK)
+    return progressWrap.Res;
+  if (outWrap.Res != S_OK)
+    return outWrap.Res;
+  if (inWrap.Res != S_OK && res == SZ_ERROR_READ)
+    return inWrap.Res;
+
+  if (res == SZ_OK && _finishMode)
+  {
+    if (inSize && *inSize != inProcessed)
+      res = SZ_ERROR_DATA;
+    if (outSize && *outSize != outWrap.Processed)
+      res = SZ_ERROR_DATA;
+  }
+
+  return SResToHRESULT(res);
+}
+
+#endif
+
 STDMETHODIMP CDecoder::Code(ISequentialInStream *inStream,
     ISequentialOutStream *outStream, const UInt64 *inSize,
     const UInt64 *outSize, ICompressProgressInfo *progress)
 {
   if (!_inBuf)
     return S_FALSE;
+
+  #ifndef _7ZIP_ST
+  if (_numThreads > 1)
+    return CodeMt(inStream, outStream, inSize, outSize, progress);
+  #endif
+
   SetOutStreamSize(outSize);
 
   UInt32 step = _outStepSize;
@@ -4,6 +4,7 @@
 #define __LZMA2_DECODER_H
 
 #include "../../../C/Lzma2Dec.h"
+#include "../../../C/Lzma2DecMt.h"
 
 #include "../../Common/MyCom.h"
 
@@ -18,6 +19,9 @@ class CDecoder:
   public ICompressSetFinishMode,
   public ICompressGetInStreamProcessedSize,
   public ICompressSetBufSize,
+  #ifndef _7ZIP_ST
+  public ICompressSetCoderMt,
+  #endif
   #ifndef NO_READ_FROM_CODER
   public ICompressSetInStream,
   public ICompressSetOutStreamSize,
@@ -42,6 +46,16 @@ class CDecoder:
   UInt32 _outStepSize;
 
   CLzma2Dec _state;
+
+  #ifndef _7ZIP_ST
+  Byte _prop;
+  UInt32 _numThreads;
+  UInt64 _memUsage;
+  CLzma2DecMtHandle _dec;
+
+  HRESULT CodeMt(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+      const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  #endif
 public:
 
   MY_QUERYINTERFACE_BEGIN2(ICompressCoder)
@@ -49,6 +63,9 @@ public:
   MY_QUERYINTERFACE_ENTRY(ICompressSetFinishMode)
   MY_QUERYINTERFACE_ENTRY(ICompressGetInStreamProcessedSize)
   MY_QUERYINTERFACE_ENTRY(ICompressSetBufSize)
+  #ifndef _7ZIP_ST
+  MY_QUERYINTERFACE_ENTRY(ICompressSetCoderMt)
+  #endif
   #ifndef NO_READ_FROM_CODER
   MY_QUERYINTERFACE_ENTRY(ICompressSetInStream)
   MY_QUERYINTERFACE_ENTRY(ICompressSetOutStreamSize)
@@ -69,6 +86,10 @@ public:
   STDMETHOD(SetInBufSize)(UInt32 streamIndex, UInt32 size);
   STDMETHOD(SetOutBufSize)(UInt32 streamIndex, UInt32 size);
 
+  #ifndef _7ZIP_ST
+  STDMETHOD(SetNumberOfThreads)(UInt32 numThreads);
+  #endif
+
   STDMETHOD(SetInStream)(ISequentialInStream *inStream);
   STDMETHOD(ReleaseInStream)();
   
@@ -74,6 +74,13 @@ HRESULT SetLzmaProp(PROPID propID, const PROPVARIANT &prop, CLzmaEncProps &ep)
       return E_INVALIDARG;
     return ParseMatchFinder(prop.bstrVal, &ep.btMode, &ep.numHashBytes) ? S_OK : E_INVALIDARG;
   }
+  if (propID == NCoderPropID::kLdmSize)
+  {
+    if (prop.vt != VT_UI4)
+      return E_INVALIDARG;
+    ep.ldmSize = prop.ulVal;
+    return S_OK;
+  }
   if (propID > NCoderPropID::kReduceSize)
     return S_OK;
   if (propID == NCoderPropID::kReduceSize)
@@ -60,38 +60,12 @@ STDMETHODIMP CAesCbcCoder::SetInitVector(const Byte *data, UInt32 size)
   return S_OK;
 }
 
-EXTERN_C_BEGIN
-
-void MY_FAST_CALL AesCbc_Encode(UInt32 *ivAes, Byte *data, size_t numBlocks);
-void MY_FAST_CALL AesCbc_Decode(UInt32 *ivAes, Byte *data, size_t numBlocks);
-void MY_FAST_CALL AesCtr_Code(UInt32 *ivAes, Byte *data, size_t numBlocks);
-
-void MY_FAST_CALL AesCbc_Encode_Intel(UInt32 *ivAes, Byte *data, size_t numBlocks);
-void MY_FAST_CALL AesCbc_Decode_Intel(UInt32 *ivAes, Byte *data, size_t numBlocks);
-void MY_FAST_CALL AesCtr_Code_Intel(UInt32 *ivAes, Byte *data, size_t numBlocks);
-
-EXTERN_C_END
-
 bool CAesCbcCoder::SetFunctions(UInt32 algo)
 {
-  _codeFunc = _encodeMode ?
-      g_AesCbc_Encode :
-      g_AesCbc_Decode;
-  if (algo == 1)
-  {
-    _codeFunc = _encodeMode ?
-        AesCbc_Encode:
-        AesCbc_Decode;
-  }
-  if (algo == 2)
-  {
-    #ifdef MY_CPU_X86_OR_AMD64
-    #ifdef _7ZIP_ASM
-    if (g_AesCbc_Encode != AesCbc_Encode_Intel)
-    #endif
-    #endif
-      return false;
-  }
+  AES_CODE_FUNC encodeFunc, decodeFunc, ctrFunc;
+  if (!Aes_GetFunctions(algo, &encodeFunc, &decodeFunc, &ctrFunc))
+    return false;
+  _codeFunc = _encodeMode ? encodeFunc : decodeFunc;
   return true;
 }
 
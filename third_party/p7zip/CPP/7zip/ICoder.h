@@ -119,7 +119,8 @@ namespace NCoderPropID
     kNumThreads,
     kEndMarker,
     kLevel,
-    kReduceSize // estimated size of data that will be compressed. Encoder can use this value to reduce dictionary size.
+    kReduceSize, // estimated size of data that will be compressed. Encoder can use this value to reduce dictionary size.
+    kLdmSize // window of long distance matching of LZMA encoder, that is larger than dictionary.
   };
 }
 
@@ -124,4 +124,11 @@ STREAM_INTERFACE(IStreamGetProps2, 0x09)
   STDMETHOD(GetProps2)(CStreamFileProps *props) PURE;
 };
 
+/* juice: the whole input as one read-only block, that lives as long as the stream.
+   A handler can parse it in place instead of copying it out with Read(). */
+STREAM_INTERFACE(IStreamGetBuffer, 0x80)
+{
+  STDMETHOD(GetBuffer)(const Byte **data, UInt64 *size) PURE;
+};
+
 #endif
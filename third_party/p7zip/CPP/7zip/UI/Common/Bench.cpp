@@ -1697,7 +1697,9 @@ static const CBenchMethod g_Bench[] =
   {  2,  0,    4,    0,    4, "BCJ" },
 
   { 10,  0,   24,    0,   24, "AES256CBC:1" },
-  {  2,  0,    8,    0,    2, "AES256CBC:2" }
+  {  2,  0,    8,    0,    2, "AES256CBC:2" },
+  {  2,  0,    8,    0,    1, "AES256CBC:3" },
+  {  2,  0,    8,    0,    1, "AES256CBC:4" }
 };
 
 struct CBenchHash
@@ -1713,9 +1715,19 @@ static const CBenchHash g_Hash[] =
   {  1,  1820, 0x8F8FEDAB, "CRC32:1" },
   { 10,   558, 0x8F8FEDAB, "CRC32:4" },
   { 10,   339, 0x8F8FEDAB, "CRC32:8" },
+  { 10,    40, 0x8F8FEDAB, "CRC32:128" },
+  { 10,    25, 0x8F8FEDAB, "CRC32:512" },
   { 10,   512, 0xDF1C17CC, "CRC64" },
+  { 10,   512, 0xDF1C17CC, "CRC64:4" },
+  { 10,    40, 0xDF1C17CC, "CRC64:128" },
+  { 10,    25, 0xDF1C17CC, "CRC64:512" },
   { 10,  5100, 0x2D79FF2E, "SHA256" },
+  { 10,  5100, 0x2D79FF2E, "SHA256:1" },
+  { 10,   770, 0x2D79FF2E, "SHA256:2" },
+  { 10,  1130, 0x9E17F3C1, "SHA256-4K" },
   { 10,  2340, 0x4C25132B, "SHA1" },
+  { 10,  2340, 0x4C25132B, "SHA1:1" },
+  { 10,   680, 0x4C25132B, "SHA1:2" },
   {  2,  5500, 0xE084E913, "BLAKE2sp" }
 };
 
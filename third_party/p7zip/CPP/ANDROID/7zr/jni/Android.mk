@@ -173,10 +173,12 @@ LOCAL_SRC_FILES := \
   ../../../../C/LzFind.c \
   ../../../../C/LzFindMt.c \
   ../../../../C/Lzma2Dec.c \
+  ../../../../C/Lzma2DecMt.c \
   ../../../../C/Lzma2Enc.c \
   ../../../../C/LzmaDec.c \
   ../../../../C/LzmaEnc.c \
   ../../../../C/MtCoder.c \
+  ../../../../C/MtDec.c \
   ../../../../C/Sha256.c \
   ../../../../C/Threads.c \
   ../../../../C/Xz.c \
@@ -18,6 +18,8 @@ UInt32 MY_FAST_CALL CrcUpdateT1(UInt32 v, const void *data, size_t size, const U
 extern CRC_FUNC g_CrcUpdate;
 extern CRC_FUNC g_CrcUpdateT8;
 extern CRC_FUNC g_CrcUpdateT4;
+extern CRC_FUNC g_CrcUpdateClmul;
+extern CRC_FUNC g_CrcUpdateVClmul;
 
 EXTERN_C_END
 
@@ -59,6 +61,21 @@ bool CCrcHasher::SetFunctions(UInt32 tSize)
     else
       return false;
   }
+  // 128 and 512 are the widths of the PCLMULQDQ and VPCLMULQDQ folds
+  else if (tSize == 128)
+  {
+    if (g_CrcUpdateClmul)
+      _updateFunc = g_CrcUpdateClmul;
+    else
+      return false;
+  }
+  else if (tSize == 512)
+  {
+    if (g_CrcUpdateVClmul)
+      _updateFunc = g_CrcUpdateVClmul;
+    else
+      return false;
+  }
   
   return true;
 }
@@ -8,8 +8,11 @@
 
 #include "../7zip/Common/RegisterCodec.h"
 
+struct CSha1Prepare { CSha1Prepare() { Sha1Prepare(); } } g_Sha1Prepare;
+
 class CSha1Hasher:
   public IHasher,
+  public ICompressSetCoderProperties,
   public CMyUnknownImp
 {
   CSha1 _sha;
@@ -18,13 +21,30 @@ class CSha1Hasher:
 public:
   CSha1Hasher() { Sha1_Init(&_sha); }
 
-  MY_UNKNOWN_IMP1(IHasher)
+  MY_UNKNOWN_IMP2(IHasher, ICompressSetCoderProperties)
   INTERFACE_IHasher(;)
+  STDMETHOD(SetCoderProperties)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
 };
 
+STDMETHODIMP CSha1Hasher::SetCoderProperties(const PROPID *propIDs, const PROPVARIANT *coderProps, UInt32 numProps)
+{
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    const PROPVARIANT &prop = coderProps[i];
+    if (propIDs[i] == NCoderPropID::kDefaultProp)
+    {
+      if (prop.vt != VT_UI4)
+        return E_INVALIDARG;
+      if (!Sha1_SetFunction(&_sha, prop.ulVal))
+        return E_NOTIMPL;
+    }
+  }
+  return S_OK;
+}
+
 STDMETHODIMP_(void) CSha1Hasher::Init() throw()
 {
-  Sha1_Init(&_sha);
+  Sha1_InitState(&_sha);
 }
 
 STDMETHODIMP_(void) CSha1Hasher::Update(const void *data, UInt32 size) throw()
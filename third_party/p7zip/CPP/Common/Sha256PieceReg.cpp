@@ -0,0 +1,98 @@
+// Sha256PieceReg.cpp
+
+#include "StdAfx.h"
+
+#include "../../C/Sha256.h"
+
+#include "../Common/MyCom.h"
+
+#include "../7zip/Common/RegisterCodec.h"
+
+/* SHA256-4K hashes the stream as 4 KiB pieces with Sha256_Multi() and gives
+   SHA-256 of their digests. It's not SHA-256 of the stream, so it has its own name.
+   It's for the benchmark of Sha256_Multi(). */
+
+static const unsigned kPieceSize = 1 << 12;
+static const unsigned kNumPiecesMax = 64;
+
+class CSha256PieceHasher:
+  public IHasher,
+  public CMyUnknownImp
+{
+  CSha256 _sha;
+  unsigned _piecePos;
+  Byte mtDummy[1 << 7];
+  Byte _piece[kPieceSize];
+  Byte _digests[kNumPiecesMax * SHA256_DIGEST_SIZE];
+
+  void UpdatePieces(const Byte *data, unsigned numPieces);
+public:
+  CSha256PieceHasher(): _piecePos(0) { Sha256_Init(&_sha); }
+
+  MY_UNKNOWN_IMP1(IHasher)
+  INTERFACE_IHasher(;)
+};
+
+void CSha256PieceHasher::UpdatePieces(const Byte *data, unsigned numPieces)
+{
+  const Byte *ptrs[kNumPiecesMax];
+  size_t sizes[kNumPiecesMax];
+  for (unsigned i = 0; i < numPieces; i++)
+  {
+    ptrs[i] = data + (size_t)i * kPieceSize;
+    sizes[i] = kPieceSize;
+  }
+  Sha256_Multi(ptrs, sizes, numPieces, _digests);
+  Sha256_Update(&_sha, _digests, numPieces * SHA256_DIGEST_SIZE);
+}
+
+STDMETHODIMP_(void) CSha256PieceHasher::Init() throw()
+{
+  _piecePos = 0;
+  Sha256_InitState(&_sha);
+}
+
+STDMETHODIMP_(void) CSha256PieceHasher::Update(const void *data, UInt32 size) throw()
+{
+  const Byte *p = (const Byte *)data;
+  while (size != 0)
+  {
+    if (_piecePos != 0 || size < kPieceSize)
+    {
+      UInt32 cur = kPieceSize - _piecePos;
+      if (cur > size)
+        cur = size;
+      memcpy(_piece + _piecePos, p, cur);
+      _piecePos += cur;
+      p += cur;
+      size -= cur;
+      if (_piecePos == kPieceSize)
+      {
+        UpdatePieces(_piece, 1);
+        _piecePos = 0;
+      }
+      continue;
+    }
+    UInt32 num = size / kPieceSize;
+    if (num > kNumPiecesMax)
+      num = kNumPiecesMax;
+    UpdatePieces(p, num);
+    p += num * kPieceSize;
+    size -= num * kPieceSize;
+  }
+}
+
+STDMETHODIMP_(void) CSha256PieceHasher::Final(Byte *digest) throw()
+{
+  if (_piecePos != 0)
+  {
+    const Byte *ptr = _piece;
+    size_t pieceSize = _piecePos;
+    Sha256_Multi(&ptr, &pieceSize, 1, _digests);
+    Sha256_Update(&_sha, _digests, SHA256_DIGEST_SIZE);
+    _piecePos = 0;
+  }
+  Sha256_Final(&_sha, digest);
+}
+
+REGISTER_HASHER(CSha256PieceHasher, 0x20A, "SHA256-4K", SHA256_DIGEST_SIZE)
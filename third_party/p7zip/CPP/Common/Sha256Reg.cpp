@@ -8,8 +8,11 @@
 
 #include "../7zip/Common/RegisterCodec.h"
 
+struct CSha256Prepare { CSha256Prepare() { Sha256Prepare(); } } g_Sha256Prepare;
+
 class CSha256Hasher:
   public IHasher,
+  public ICompressSetCoderProperties,
   public CMyUnknownImp
 {
   CSha256 _sha;
@@ -18,13 +21,30 @@ class CSha256Hasher:
 public:
   CSha256Hasher() { Sha256_Init(&_sha); }
 
-  MY_UNKNOWN_IMP1(IHasher)
+  MY_UNKNOWN_IMP2(IHasher, ICompressSetCoderProperties)
   INTERFACE_IHasher(;)
+  STDMETHOD(SetCoderProperties)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
 };
 
+STDMETHODIMP CSha256Hasher::SetCoderProperties(const PROPID *propIDs, const PROPVARIANT *coderProps, UInt32 numProps)
+{
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    const PROPVARIANT &prop = coderProps[i];
+    if (propIDs[i] == NCoderPropID::kDefaultProp)
+    {
+      if (prop.vt != VT_UI4)
+        return E_INVALIDARG;
+      if (!Sha256_SetFunction(&_sha, prop.ulVal))
+        return E_NOTIMPL;
+    }
+  }
+  return S_OK;
+}
+
 STDMETHODIMP_(void) CSha256Hasher::Init() throw()
 {
-  Sha256_Init(&_sha);
+  Sha256_InitState(&_sha);
 }
 
 STDMETHODIMP_(void) CSha256Hasher::Update(const void *data, UInt32 size) throw()
@@ -38,3 +58,4 @@ STDMETHODIMP_(void) CSha256Hasher::Final(Byte *digest) throw()
 }
 
 REGISTER_HASHER(CSha256Hasher, 0xA, "SHA256", SHA256_DIGEST_SIZE)
+
@@ -9,20 +9,76 @@
 
 #include "../7zip/Common/RegisterCodec.h"
 
+EXTERN_C_BEGIN
+
+typedef UInt64 (MY_FAST_CALL *CRC64_FUNC)(UInt64 v, const void *data, size_t size, const UInt64 *table);
+
+extern CRC64_FUNC g_Crc64Update;
+extern CRC64_FUNC g_Crc64UpdateT4;
+extern CRC64_FUNC g_Crc64UpdateClmul;
+extern CRC64_FUNC g_Crc64UpdateVClmul;
+
+EXTERN_C_END
+
 class CXzCrc64Hasher:
   public IHasher,
+  public ICompressSetCoderProperties,
   public CMyUnknownImp
 {
   UInt64 _crc;
+  CRC64_FUNC _updateFunc;
   Byte mtDummy[1 << 7];
 
+  bool SetFunctions(UInt32 tSize);
 public:
-  CXzCrc64Hasher(): _crc(CRC64_INIT_VAL) {}
+  CXzCrc64Hasher(): _crc(CRC64_INIT_VAL) { SetFunctions(0); }
 
-  MY_UNKNOWN_IMP1(IHasher)
+  MY_UNKNOWN_IMP2(IHasher, ICompressSetCoderProperties)
   INTERFACE_IHasher(;)
+  STDMETHOD(SetCoderProperties)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
 };
 
+bool CXzCrc64Hasher::SetFunctions(UInt32 tSize)
+{
+  _updateFunc = g_Crc64Update;
+
+  if (tSize == 4)
+    _updateFunc = g_Crc64UpdateT4;
+  // 128 and 512 are the widths of the PCLMULQDQ and VPCLMULQDQ folds
+  else if (tSize == 128)
+  {
+    if (g_Crc64UpdateClmul)
+      _updateFunc = g_Crc64UpdateClmul;
+    else
+      return false;
+  }
+  else if (tSize == 512)
+  {
+    if (g_Crc64UpdateVClmul)
+      _updateFunc = g_Crc64UpdateVClmul;
+    else
+      return false;
+  }
+
+  return true;
+}
+
+STDMETHODIMP CXzCrc64Hasher::SetCoderProperties(const PROPID *propIDs, const PROPVARIANT *coderProps, UInt32 numProps)
+{
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    const PROPVARIANT &prop = coderProps[i];
+    if (propIDs[i] == NCoderPropID::kDefaultProp)
+    {
+      if (prop.vt != VT_UI4)
+        return E_INVALIDARG;
+      if (!SetFunctions(prop.ulVal))
+        return E_NOTIMPL;
+    }
+  }
+  return S_OK;
+}
+
 STDMETHODIMP_(void) CXzCrc64Hasher::Init() throw()
 {
   _crc = CRC64_INIT_VAL;
@@ -30,7 +86,7 @@ STDMETHODIMP_(void) CXzCrc64Hasher::Init() throw()
 
 STDMETHODIMP_(void) CXzCrc64Hasher::Update(const void *data, UInt32 size) throw()
 {
-  _crc = Crc64Update(_crc, data, size);
+  _crc = _updateFunc(_crc, data, size, g_Crc64Table);
 }
 
 STDMETHODIMP_(void) CXzCrc64Hasher::Final(Byte *digest) throw()
@@ -60,11 +60,12 @@ typedef short CSHORT;
 
 static LONG TIME_GetBias() {
   time_t utc = time(NULL);
-  struct tm *ptm = localtime(&utc);
-  int localdaylight = ptm->tm_isdst; /* daylight for local timezone */
-  ptm = gmtime(&utc);
-  ptm->tm_isdst = localdaylight; /* use local daylight, not that of Greenwich */
-  LONG bias = (int)(mktime(ptm)-utc);
+  struct tm tm_local, tm_gmt; /* reentrant: the handlers run on several threads */
+  localtime_r(&utc, &tm_local);
+  int localdaylight = tm_local.tm_isdst; /* daylight for local timezone */
+  gmtime_r(&utc, &tm_gmt);
+  tm_gmt.tm_isdst = localdaylight; /* use local daylight, not that of Greenwich */
+  LONG bias = (int)(mktime(&tm_gmt)-utc);
   TRACEN((printf("TIME_GetBias %ld\n",(long)bias)))
   return bias;
 }
@@ -95,7 +96,7 @@ BOOL WINAPI DosDateTimeToFileTime( WORD fatdate, WORD fattime, FILETIME * ft)
 {
     struct tm newtm;
 #ifndef ENV_HAVE_TIMEGM
-    struct tm *gtm;
+    struct tm *gtm, gmt;
     time_t time1, time2;
 #endif
 
@@ -113,7 +114,7 @@ BOOL WINAPI DosDateTimeToFileTime( WORD fatdate, WORD fattime, FILETIME * ft)
 #else
     newtm.tm_isdst = 0;
     time1 = mktime(&newtm);
-    gtm = gmtime(&time1);
+    gtm = gmtime_r(&time1, &gmt);
     time2 = mktime(gtm);
     RtlSecondsSince1970ToFileTime( 2*time1-time2, ft );
 #endif
@@ -176,7 +177,8 @@ BOOL WINAPI FileTimeToDosDateTime( const FILETIME *ft, WORD *fatdate, WORD *fatt
   RtlTimeToSecondsSince1970( &li, &t );
   unixtime = t; /* unixtime = t; * FIXME unixtime = t - TIME_GetBias(); */
 
-  tm = gmtime( &unixtime );
+  struct tm tm_buffer;
+  tm = gmtime_r( &unixtime, &tm_buffer );
 
   fat_t = (tm->tm_hour << 11) + (tm->tm_min << 5) + (tm->tm_sec / 2);
   fat_d = ((tm->tm_year - 80) << 9) + ((tm->tm_mon + 1) << 5) + tm->tm_mday;
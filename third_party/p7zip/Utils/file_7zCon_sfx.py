@@ -11,7 +11,9 @@ files_c=[
  'C/CpuArch.c',
  'C/Delta.c',
  'C/Lzma2Dec.c',
+ 'C/Lzma2DecMt.c',
  'C/LzmaDec.c',
+ 'C/MtDec.c',
  'C/Ppmd7.c',
  'C/Ppmd7Dec.c',
  'C/Sha256.c',
@@ -19,10 +19,12 @@ files_c=[
  'C/LzFind.c',
  'C/LzFindMt.c',
  'C/Lzma2Dec.c',
+ 'C/Lzma2DecMt.c',
  'C/Lzma2Enc.c',
  'C/LzmaDec.c',
  'C/LzmaEnc.c',
  'C/MtCoder.c',
+ 'C/MtDec.c',
  'C/Ppmd7.c',
  'C/Ppmd7Dec.c',
  'C/Ppmd7Enc.c',